@@ -1391,6 +1391,7 @@ int cg_pid_get_machine_name(pid_t pid, char **ret_machine) {
 
         return cg_path_get_machine_name(cgroup, ret_machine);
 }
+#endif // 0
 
 int cg_path_get_cgroupid(const char *path, uint64_t *ret) {
         cg_file_handle fh = CG_FILE_HANDLE_INIT;
@@ -1421,7 +1422,6 @@ int cg_fd_get_cgroupid(int fd, uint64_t *ret) {
         *ret = CG_FILE_HANDLE_CGROUPID(fh);
         return 0;
 }
-#endif // 0
 
 int cg_path_get_session(const char *path, char **ret_session) {
 #if 0 /// UNNEEDED by elogind
@@ -282,10 +282,8 @@ int cg_is_empty_recursive(const char *controller, const char *path);
 
 int cg_get_root_path(char **path);
 
-#if 0 /// elogind does not open cgroup IDs anywhere
 int cg_path_get_cgroupid(const char *path, uint64_t *ret);
 int cg_fd_get_cgroupid(int fd, uint64_t *ret);
-#endif // 0
 int cg_path_get_session(const char *path, char **ret_session);
 int cg_path_get_owner_uid(const char *path, uid_t *ret_uid);
 int cg_path_get_unit(const char *path, char **ret_unit);
@@ -371,6 +369,7 @@ typedef enum ManagedOOMPreference {
 
 const char* managed_oom_preference_to_string(ManagedOOMPreference a) _const_;
 ManagedOOMPreference managed_oom_preference_from_string(const char *s) _pure_;
+#endif // 0
 
 /* The structure to pass to name_to_handle_at() on cgroupfs2 */
 typedef union {
@@ -385,4 +384,3 @@ typedef union {
         }
 
 #define CG_FILE_HANDLE_CGROUPID(fh) (*(uint64_t*) (fh).file_handle.f_handle)
-#endif // 0
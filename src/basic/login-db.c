@@ -0,0 +1,454 @@
+/* SPDX-License-Identifier: LGPL-2.1-or-later */
+
+#include <errno.h>
+#include <fcntl.h>
+#include <pthread.h>
+#include <stdlib.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+
+#include "alloc-util.h"
+#include "fd-util.h"
+#include "login-db.h"
+#include "stat-util.h"
+#include "string-util.h"
+#include "strv.h"
+#include "user-util.h"
+
+/* How often to retry if elogind keeps updating the database while we look at it, before falling back to
+ * the state files. */
+#define LOGIN_DB_READ_ATTEMPTS 64U
+
+typedef struct LoginDbMap {
+        const uint8_t *data;
+        size_t size;
+} LoginDbMap;
+
+/* The mapping currently in use. Mappings of files that have been replaced are never unmapped, as other
+ * threads might still be reading from them. elogind only replaces the file when it needs to grow it, or
+ * when it is restarted, hence this leaks very little. */
+static LoginDbMap *login_db_map = NULL;
+static pthread_mutex_t login_db_mutex = PTHREAD_MUTEX_INITIALIZER;
+
+const char* login_db_path(void) {
+        return secure_getenv("SYSTEMD_LOGIN_DB_PATH") ?: LOGIN_DB_PATH;
+}
+
+static const volatile LoginDbHeader* login_db_header(const LoginDbMap *m) {
+        return (const volatile LoginDbHeader*) m->data;
+}
+
+static bool login_db_is_obsolete(const LoginDbMap *m) {
+        return __atomic_load_n(&login_db_header(m)->flags, __ATOMIC_ACQUIRE) & LOGIN_DB_OBSOLETE;
+}
+
+static int login_db_map_file(LoginDbMap **ret) {
+        _cleanup_close_ int fd = -EBADF;
+        LoginDbHeader h;
+        struct stat st;
+        LoginDbMap *m;
+        void *p;
+        int r;
+
+        assert(ret);
+
+        fd = open(login_db_path(), O_RDONLY|O_CLOEXEC|O_NOCTTY|O_NOFOLLOW);
+        if (fd < 0)
+                return -errno;
+
+        if (fstat(fd, &st) < 0)
+                return -errno;
+
+        r = stat_verify_regular(&st);
+        if (r < 0)
+                return r;
+
+        if (st.st_size < (off_t) sizeof(LoginDbHeader) || (uint64_t) st.st_size > SIZE_MAX)
+                return -EBADMSG;
+
+        p = mmap(NULL, st.st_size, PROT_READ, MAP_SHARED, fd, 0);
+        if (p == MAP_FAILED)
+                return -errno;
+
+        memcpy(&h, p, sizeof(h));
+        if (memcmp(h.signature, LOGIN_DB_SIGNATURE, sizeof(h.signature)) != 0 ||
+            h.version != LOGIN_DB_VERSION) {
+                (void) munmap(p, st.st_size);
+                return -EPROTONOSUPPORT;
+        }
+
+        m = new(LoginDbMap, 1);
+        if (!m) {
+                (void) munmap(p, st.st_size);
+                return -ENOMEM;
+        }
+
+        *m = (LoginDbMap) {
+                .data = p,
+                .size = st.st_size,
+        };
+
+        *ret = m;
+        return 0;
+}
+
+static int login_db_acquire(const LoginDbMap **ret) {
+        LoginDbMap *m;
+        int r = 0;
+
+        assert(ret);
+
+        m = __atomic_load_n(&login_db_map, __ATOMIC_ACQUIRE);
+        if (m && !login_db_is_obsolete(m)) {
+                *ret = m;
+                return 0;
+        }
+
+        assert_se(pthread_mutex_lock(&login_db_mutex) == 0);
+
+        m = login_db_map;
+        if (!m || login_db_is_obsolete(m)) {
+                r = login_db_map_file(&m);
+                if (r >= 0)
+                        __atomic_store_n(&login_db_map, m, __ATOMIC_RELEASE);
+        }
+
+        assert_se(pthread_mutex_unlock(&login_db_mutex) == 0);
+
+        if (r < 0)
+                return -ENOMEDIUM;
+
+        *ret = m;
+        return 0;
+}
+
+static int login_db_begin(const LoginDbMap **ret, uint64_t *ret_generation) {
+        int r;
+
+        assert(ret);
+        assert(ret_generation);
+
+        for (unsigned i = 0; i < LOGIN_DB_READ_ATTEMPTS; i++) {
+                const LoginDbMap *m;
+                uint64_t g;
+
+                r = login_db_acquire(&m);
+                if (r < 0)
+                        return r;
+
+                g = __atomic_load_n(&login_db_header(m)->generation, __ATOMIC_ACQUIRE);
+                if (g & 1) /* elogind is writing right now */
+                        continue;
+
+                if (login_db_is_obsolete(m))
+                        continue;
+
+                *ret = m;
+                *ret_generation = g;
+                return 0;
+        }
+
+        return -ENOMEDIUM;
+}
+
+static bool login_db_end(const LoginDbMap *m, uint64_t generation) {
+        assert(m);
+
+        /* Returns true if nothing changed since login_db_begin(), i.e. everything read in between is
+         * consistent. */
+        __atomic_thread_fence(__ATOMIC_ACQUIRE);
+        return __atomic_load_n(&login_db_header(m)->generation, __ATOMIC_RELAXED) == generation;
+}
+
+/* Everything below may look at data that is being modified concurrently. Hence all offsets and counts are
+ * validated against the size of the mapping before use, and records are copied out of the mapping before
+ * looking at them. Whether the copied data is consistent is then decided by login_db_end(). */
+
+static int login_db_table(
+                const LoginDbMap *m,
+                uint64_t offset,
+                uint64_t n,
+                size_t item_size,
+                const volatile void **ret) {
+
+        assert(m);
+        assert(item_size > 0);
+        assert(ret);
+
+        if (offset % 8 != 0 || offset < sizeof(LoginDbHeader) || offset > m->size)
+                return -EBADMSG;
+        if (n > (m->size - offset) / item_size)
+                return -EBADMSG;
+
+        *ret = (const volatile void*) (m->data + offset);
+        return 0;
+}
+
+static int login_db_string(const LoginDbMap *m, uint64_t offset, const char **ret, size_t *ret_len) {
+        const char *s, *e;
+
+        assert(m);
+        assert(ret);
+        assert(ret_len);
+
+        if (offset == 0) {
+                *ret = NULL;
+                *ret_len = 0;
+                return 0;
+        }
+
+        if (offset < sizeof(LoginDbHeader) || offset >= m->size)
+                return -EBADMSG;
+
+        s = (const char*) m->data + offset;
+        e = memchr(s, 0, m->size - offset);
+        if (!e)
+                return -EBADMSG;
+
+        *ret = s;
+        *ret_len = e - s;
+        return 0;
+}
+
+static int login_db_strdup(const LoginDbMap *m, uint64_t offset, char **ret) {
+        const char *s;
+        size_t l;
+        int r;
+
+        assert(ret);
+
+        r = login_db_string(m, offset, &s, &l);
+        if (r < 0)
+                return r;
+        if (!s) {
+                *ret = NULL;
+                return 0;
+        }
+
+        *ret = strndup(s, l);
+        if (!*ret)
+                return -ENOMEM;
+
+        return 0;
+}
+
+static int login_db_find_user(const LoginDbMap *m, uid_t uid, LoginDbUser *ret) {
+        LoginDbHeader h = *login_db_header(m);
+        const volatile LoginDbUser *users;
+        uint64_t lo = 0, hi;
+        int r;
+
+        assert(ret);
+
+        r = login_db_table(m, h.users_offset, h.n_users, sizeof(LoginDbUser), (const volatile void**) &users);
+        if (r < 0)
+                return r;
+
+        hi = h.n_users;
+        while (lo < hi) {
+                uint64_t mid = lo + (hi - lo) / 2;
+                LoginDbUser u = users[mid];
+
+                if (u.uid == uid) {
+                        *ret = u;
+                        return 0;
+                }
+
+                if (u.uid < uid)
+                        lo = mid + 1;
+                else
+                        hi = mid;
+        }
+
+        return -ENXIO;
+}
+
+static int login_db_collect_uid_array(const LoginDbMap *m, uid_t uid, int require_active, bool seats, char ***ret) {
+        LoginDbHeader h = *login_db_header(m);
+        _cleanup_strv_free_ char **l = NULL;
+        const volatile LoginDbSession *sessions;
+        LoginDbUser u;
+        int r;
+
+        assert(ret);
+
+        r = login_db_find_user(m, uid, &u);
+        if (r < 0)
+                return r;
+
+        r = login_db_table(m, h.sessions_offset, h.n_sessions, sizeof(LoginDbSession), (const volatile void**) &sessions);
+        if (r < 0)
+                return r;
+
+        if (u.first_session > h.n_sessions || u.n_sessions > h.n_sessions - u.first_session)
+                return -EBADMSG;
+
+        for (uint64_t i = u.first_session; i < u.first_session + u.n_sessions; i++) {
+                LoginDbSession s = sessions[i];
+                char *v;
+
+                if (require_active > 0 && !FLAGS_SET(s.flags, LOGIN_DB_SESSION_ACTIVE))
+                        continue;
+                if (require_active == 0 && !FLAGS_SET(s.flags, LOGIN_DB_SESSION_ONLINE))
+                        continue;
+
+                r = login_db_strdup(m, seats ? s.seat : s.id, &v);
+                if (r < 0)
+                        return r;
+                if (!v)
+                        continue;
+
+                r = strv_consume(&l, v);
+                if (r < 0)
+                        return r;
+        }
+
+        *ret = TAKE_PTR(l);
+        return 0;
+}
+
+static int login_db_collect_seat_active(const LoginDbMap *m, const char *seat, char **ret_session, uid_t *ret_uid) {
+        LoginDbHeader h = *login_db_header(m);
+        const volatile LoginDbSeat *seats;
+        int r;
+
+        assert(seat);
+        assert(ret_session);
+        assert(ret_uid);
+
+        r = login_db_table(m, h.seats_offset, h.n_seats, sizeof(LoginDbSeat), (const volatile void**) &seats);
+        if (r < 0)
+                return r;
+
+        for (uint64_t i = 0; i < h.n_seats; i++) {
+                LoginDbSeat s = seats[i];
+                const char *id;
+                size_t l;
+
+                r = login_db_string(m, s.id, &id, &l);
+                if (r < 0)
+                        return r;
+                if (!id || !streq(id, seat))
+                        continue;
+
+                r = login_db_strdup(m, s.active_session, ret_session);
+                if (r < 0)
+                        return r;
+
+                *ret_uid = s.active_uid;
+                return 0;
+        }
+
+        return -ENXIO;
+}
+
+int login_db_uid_get_state(uid_t uid, char **ret_state) {
+        int r;
+
+        assert(ret_state);
+
+        for (unsigned i = 0; i < LOGIN_DB_READ_ATTEMPTS; i++) {
+                _cleanup_free_ char *state = NULL;
+                const LoginDbMap *m;
+                LoginDbUser u;
+                uint64_t g;
+
+                r = login_db_begin(&m, &g);
+                if (r < 0)
+                        return r;
+
+                r = login_db_find_user(m, uid, &u);
+                if (r >= 0)
+                        r = login_db_strdup(m, u.state, &state);
+
+                if (!login_db_end(m, g))
+                        continue;
+
+                if (r == -EBADMSG)
+                        return -ENOMEDIUM;
+                if (r < 0)
+                        return r;
+                if (isempty(state))
+                        return -EIO;
+
+                *ret_state = TAKE_PTR(state);
+                return 0;
+        }
+
+        return -ENOMEDIUM;
+}
+
+int login_db_uid_get_array(uid_t uid, int require_active, bool seats, char ***ret) {
+        int r;
+
+        for (unsigned i = 0; i < LOGIN_DB_READ_ATTEMPTS; i++) {
+                _cleanup_strv_free_ char **l = NULL;
+                const LoginDbMap *m;
+                uint64_t g;
+
+                r = login_db_begin(&m, &g);
+                if (r < 0)
+                        return r;
+
+                r = login_db_collect_uid_array(m, uid, require_active, seats, &l);
+
+                if (!login_db_end(m, g))
+                        continue;
+
+                if (r == -EBADMSG)
+                        return -ENOMEDIUM;
+                if (r < 0)
+                        return r;
+
+                strv_uniq(l);
+                r = (int) strv_length(l);
+
+                if (ret)
+                        *ret = TAKE_PTR(l);
+
+                return r;
+        }
+
+        return -ENOMEDIUM;
+}
+
+int login_db_seat_get_active(const char *seat, char **ret_session, uid_t *ret_uid) {
+        int r;
+
+        assert(seat);
+
+        for (unsigned i = 0; i < LOGIN_DB_READ_ATTEMPTS; i++) {
+                _cleanup_free_ char *session = NULL;
+                const LoginDbMap *m;
+                uid_t uid = UID_INVALID;
+                uint64_t g;
+
+                r = login_db_begin(&m, &g);
+                if (r < 0)
+                        return r;
+
+                r = login_db_collect_seat_active(m, seat, &session, &uid);
+
+                if (!login_db_end(m, g))
+                        continue;
+
+                if (r == -EBADMSG)
+                        return -ENOMEDIUM;
+                if (r < 0)
+                        return r;
+
+                if (ret_session && !session)
+                        return -ENODATA;
+                if (ret_uid && !uid_is_valid(uid))
+                        return -ENODATA;
+
+                if (ret_session)
+                        *ret_session = TAKE_PTR(session);
+                if (ret_uid)
+                        *ret_uid = uid;
+
+                return 0;
+        }
+
+        return -ENOMEDIUM;
+}
@@ -0,0 +1,92 @@
+/* SPDX-License-Identifier: LGPL-2.1-or-later */
+#pragma once
+
+#include <inttypes.h>
+#include <stdbool.h>
+#include <sys/types.h>
+
+#include "macro.h"
+
+/* A binary, memory mapped copy of the most frequently queried parts of the login state, published by
+ * elogind next to the env-style files in /run/systemd/{sessions,users,seats}/. Clients map the file
+ * read-only once and answer sd_uid_get_sessions(), sd_uid_get_seats() and sd_seat_get_active() from the
+ * mapping, without any further system calls.
+ *
+ * elogind updates the file in place. The generation counter in the header is used as a sequence lock: it
+ * is odd while an update is in progress, and readers retry if it changed while they looked at the
+ * data. If the file needs to grow, elogind writes a new file, renames it over the old one and then marks
+ * the old one as obsolete, which tells readers to map the file again.
+ *
+ * All offsets are relative to the beginning of the file. String offsets of 0 mean "not set". The file is
+ * only ever accessed from the local machine, hence all fields are in native byte order. All structures
+ * are laid out so that they do not contain any padding, so that 32-bit and 64-bit clients agree. */
+
+#define LOGIN_DB_PATH "/run/systemd/login.db"
+#define LOGIN_DB_SIGNATURE ((const char[8]) { 'E', 'L', 'G', 'N', 'D', 'B', '\0', '\0' })
+#define LOGIN_DB_VERSION UINT32_C(1)
+
+typedef enum LoginDbFlags {
+        LOGIN_DB_OBSOLETE = 1 << 0, /* The file has been replaced, map LOGIN_DB_PATH again */
+} LoginDbFlags;
+
+typedef enum LoginDbSessionFlags {
+        LOGIN_DB_SESSION_ACTIVE = 1 << 0,
+        LOGIN_DB_SESSION_ONLINE = 1 << 1, /* not closing */
+} LoginDbSessionFlags;
+
+typedef enum LoginDbSeatFlags {
+        LOGIN_DB_SEAT_CAN_TTY       = 1 << 0,
+        LOGIN_DB_SEAT_CAN_GRAPHICAL = 1 << 1,
+} LoginDbSeatFlags;
+
+typedef struct LoginDbHeader {
+        uint8_t signature[8];
+        uint32_t version;
+        uint32_t flags;
+        uint64_t generation;
+        uint64_t size;            /* bytes in use, the file may be larger */
+
+        uint64_t sessions_offset;
+        uint64_t n_sessions;
+        uint64_t users_offset;    /* sorted by uid */
+        uint64_t n_users;
+        uint64_t seats_offset;
+        uint64_t n_seats;
+} LoginDbHeader;
+
+typedef struct LoginDbSession {
+        uint64_t id;              /* string offset */
+        uint64_t seat;            /* string offset */
+        uint32_t uid;
+        uint32_t flags;
+} LoginDbSession;
+
+typedef struct LoginDbUser {
+        uint32_t uid;
+        uint32_t reserved;
+        uint64_t state;           /* string offset */
+        uint64_t first_session;   /* sessions of one user are stored consecutively, in the same order */
+        uint64_t n_sessions;      /* as in the SESSIONS= field of the user's state file */
+} LoginDbUser;
+
+typedef struct LoginDbSeat {
+        uint64_t id;              /* string offset */
+        uint64_t active_session;  /* string offset */
+        uint32_t active_uid;
+        uint32_t flags;
+} LoginDbSeat;
+
+assert_cc(sizeof(LoginDbHeader) == 80);
+assert_cc(sizeof(LoginDbSession) == 24);
+assert_cc(sizeof(LoginDbUser) == 32);
+assert_cc(sizeof(LoginDbSeat) == 24);
+
+/* Returns the path of the database, which may be overridden with $SYSTEMD_LOGIN_DB_PATH for testing. */
+const char* login_db_path(void);
+
+/* The lookup functions below return -ENOMEDIUM if the database is not available or could not be read
+ * consistently, in which case the caller should fall back to the state files. -ENXIO is returned if the
+ * requested object is not known. */
+int login_db_uid_get_state(uid_t uid, char **ret_state);
+int login_db_uid_get_array(uid_t uid, int require_active, bool seats, char ***ret);
+int login_db_seat_get_active(const char *seat, char **ret_session, uid_t *ret_uid);
@@ -74,7 +74,6 @@ int memfd_add_seals(int fd, unsigned int seals) {
         return RET_NERRNO(fcntl(fd, F_ADD_SEALS, seals));
 }
 
-#if 0 /// UNNEEDED by elogind
 int memfd_get_seals(int fd, unsigned int *ret_seals) {
         int r;
 
@@ -89,6 +88,7 @@ int memfd_get_seals(int fd, unsigned int *ret_seals) {
         return 0;
 }
 
+#if 0 /// UNNEEDED by elogind
 int memfd_map(int fd, uint64_t offset, size_t size, void **p) {
         unsigned int seals;
         void *q;
@@ -118,7 +118,6 @@ int memfd_set_sealed(int fd) {
         return memfd_add_seals(fd, F_SEAL_SEAL | F_SEAL_SHRINK | F_SEAL_GROW | F_SEAL_WRITE);
 }
 
-#if 0 /// UNNEEDED by elogind
 int memfd_get_sealed(int fd) {
         unsigned int seals;
         int r;
@@ -130,7 +129,6 @@ int memfd_get_sealed(int fd) {
         /* We ignore F_SEAL_EXEC here to support older kernels. */
         return FLAGS_SET(seals, F_SEAL_SHRINK | F_SEAL_GROW | F_SEAL_WRITE);
 }
-#endif // 0
 
 int memfd_get_size(int fd, uint64_t *sz) {
         struct stat stat;
@@ -173,3 +173,21 @@ void mempool_trim(struct mempool *mp) {
 
         log_debug("Trimmed %s from memory pool %p. (%s left)", FORMAT_BYTES(trimmed), mp, FORMAT_BYTES(left));
 }
+
+#if 1 /// elogind: pools that are not static need to be released, see bus_message_pool_free()
+void mempool_done(struct mempool *mp) {
+        assert(mp);
+
+        /* Releases all memory of the pool at once. The caller must make sure that no tiles are in use
+         * anymore. The pool may be used again afterwards. */
+
+        while (mp->first_pool) {
+                struct pool *d = mp->first_pool;
+
+                mp->first_pool = d->next;
+                free(d);
+        }
+
+        mp->freelist = NULL;
+}
+#endif // 1
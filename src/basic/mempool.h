@@ -26,3 +26,6 @@ static struct mempool pool_name = { \
 __attribute__((weak)) bool mempool_enabled(void);
 
 void mempool_trim(struct mempool *mp);
+#if 1 /// elogind: pools that are not static need to be released, see bus_message_pool_free()
+void mempool_done(struct mempool *mp);
+#endif // 1
@@ -18,16 +18,29 @@
 #include "prioq.h"
 
 struct prioq_item {
+#if 1 /// elogind: inline keys, see prioq_new_with_key()
+        uint64_t key;
+#endif // 1
         void *data;
         unsigned *idx;
 };
 
 struct Prioq {
         compare_func_t compare_func;
+#if 1 /// elogind: inline keys, see prioq_new_with_key()
+        prioq_key_func_t key_func;
+#endif // 1
         unsigned n_items;
         struct prioq_item *items;
 };
 
+#if 1 /// elogind: 4-ary heap
+/* The heap is 4-ary rather than binary, which halves its depth, and keeps all children of an item next to
+ * each other in memory. Optionally, each item additionally carries a key, see prioq_new_with_key(), so that
+ * most comparisons are done within the item array, without touching the objects themselves. */
+#define PRIOQ_ARITY 4U
+#endif // 1
+
 Prioq *prioq_new(compare_func_t compare_func) {
         Prioq *q;
 
@@ -63,6 +76,67 @@ int prioq_ensure_allocated(Prioq **q, compare_func_t compare_func) {
         return 0;
 }
 
+#if 1 /// elogind: inline keys
+Prioq *prioq_new_with_key(compare_func_t compare_func, prioq_key_func_t key_func) {
+        Prioq *q;
+
+        assert(key_func);
+
+        q = prioq_new(compare_func);
+        if (!q)
+                return NULL;
+
+        q->key_func = key_func;
+        return q;
+}
+
+int prioq_ensure_allocated_with_key(Prioq **q, compare_func_t compare_func, prioq_key_func_t key_func) {
+        assert(q);
+
+        if (*q)
+                return 0;
+
+        *q = prioq_new_with_key(compare_func, key_func);
+        if (!*q)
+                return -ENOMEM;
+
+        return 0;
+}
+
+static uint64_t item_key(Prioq *q, void *data) {
+        assert(q);
+
+        return q->key_func ? q->key_func(data) : 0;
+}
+
+static int compare_items(Prioq *q, const struct prioq_item *a, const struct prioq_item *b) {
+        int r;
+
+        assert(q);
+        assert(a);
+        assert(b);
+
+        /* The key orders consistently with the compare function, but may be coarser. Only ties need to
+         * look at the objects themselves. Without a key function all keys are 0. */
+        r = CMP(a->key, b->key);
+        if (r != 0)
+                return r;
+
+        return q->compare_func(a->data, b->data);
+}
+
+static void place_item(Prioq *q, unsigned k, const struct prioq_item *i) {
+        assert(q);
+        assert(k < q->n_items);
+        assert(i);
+
+        q->items[k] = *i;
+        if (i->idx)
+                *i->idx = k;
+}
+#endif // 1
+
+#if 0 /// elogind: 4-ary heap with inline keys, items are moved into a hole instead of swapped
 static void swap(Prioq *q, unsigned j, unsigned k) {
         assert(q);
         assert(j < q->n_items);
@@ -139,6 +213,68 @@ static unsigned shuffle_down(Prioq *q, unsigned idx) {
 
         return idx;
 }
+#else // 0
+static unsigned shuffle_up(Prioq *q, unsigned idx) {
+        struct prioq_item i;
+
+        assert(q);
+        assert(idx < q->n_items);
+
+        i = q->items[idx];
+
+        while (idx > 0) {
+                unsigned k;
+
+                k = (idx-1) / PRIOQ_ARITY;
+
+                if (compare_items(q, q->items + k, &i) <= 0)
+                        break;
+
+                /* Move the parent down into the hole, and continue one level up */
+                place_item(q, idx, q->items + k);
+                idx = k;
+        }
+
+        place_item(q, idx, &i);
+        return idx;
+}
+
+static unsigned shuffle_down(Prioq *q, unsigned idx) {
+        struct prioq_item i;
+
+        assert(q);
+        assert(idx < q->n_items);
+
+        i = q->items[idx];
+
+        for (;;) {
+                unsigned j, end, s;
+
+                j = idx * PRIOQ_ARITY + 1; /* first child */
+                if (j >= q->n_items)
+                        break;
+
+                end = MIN(j + PRIOQ_ARITY, q->n_items);
+
+                /* Find the smallest of the children, which are adjacent in memory */
+                s = j;
+                for (j++; j < end; j++)
+                        if (compare_items(q, q->items + j, q->items + s) < 0)
+                                s = j;
+
+                if (compare_items(q, q->items + s, &i) >= 0)
+                        /* No move necessary, we're done */
+                        break;
+
+                /* Move the smallest child up into the hole, and continue one level down */
+                place_item(q, idx, q->items + s);
+                idx = s;
+        }
+
+        place_item(q, idx, &i);
+        return idx;
+}
+#endif // 0
 
 int prioq_put(Prioq *q, void *data, unsigned *idx) {
         unsigned k;
@@ -150,6 +286,9 @@ int prioq_put(Prioq *q, void *data, unsigned *idx) {
 
         k = q->n_items++;
         q->items[k] = (struct prioq_item) {
+#if 1 /// elogind: inline keys, see prioq_new_with_key()
+                .key = item_key(q, data),
+#endif // 1
                 .data = data,
                 .idx = idx,
         };
@@ -193,10 +332,14 @@ static void remove_item(Prioq *q, struct prioq_item *i) {
 
                 k = i - q->items;
 
+#if 0 /// elogind: inline keys, see prioq_new_with_key()
                 i->data = l->data;
                 i->idx = l->idx;
                 if (i->idx)
                         *i->idx = k;
+#else // 0
+                place_item(q, k, l);
+#endif // 0
                 q->n_items--;
 
                 k = shuffle_down(q, k);
@@ -254,6 +397,10 @@ void prioq_reshuffle(Prioq *q, void *data, unsigned *idx) {
         if (!i)
                 return;
 
+#if 1 /// elogind: the key may have changed, too
+        i->key = item_key(q, data);
+#endif // 1
+
         k = i - q->items;
         k = shuffle_down(q, k);
         shuffle_up(q, k);
@@ -15,6 +15,17 @@ Prioq *prioq_free(Prioq *q);
 DEFINE_TRIVIAL_CLEANUP_FUNC(Prioq*, prioq_free);
 int prioq_ensure_allocated(Prioq **q, compare_func_t compare_func);
 
+#if 1 /// elogind: inline keys
+/* Returns a key for an object, which has to order consistently with the compare function: whenever the key
+ * of a is lower than the key of b, a must compare lower than b, too. Objects with equal keys are ordered by
+ * the compare function. The key is cached in the queue, and only recalculated on prioq_put() and
+ * prioq_reshuffle(). */
+typedef uint64_t (*prioq_key_func_t)(const void *data);
+
+Prioq *prioq_new_with_key(compare_func_t compare_func, prioq_key_func_t key_func);
+int prioq_ensure_allocated_with_key(Prioq **q, compare_func_t compare_func, prioq_key_func_t key_func);
+#endif // 1
+
 int prioq_put(Prioq *q, void *data, unsigned *idx);
 #if 0 /// UNNEEDED by elogind
 int prioq_ensure_put(Prioq **q, compare_func_t compare_func, void *data, unsigned *idx);
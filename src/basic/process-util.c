@@ -40,6 +40,7 @@
 #include "log.h"
 #include "macro.h"
 #include "memory-util.h"
+#include "missing_pidfd.h"
 #include "missing_sched.h"
 #include "missing_syscall.h"
 #include "missing_threads.h"
@@ -1957,6 +1958,37 @@ int pidfd_verify_pid(int pidfd, pid_t pid) {
         return current_pid != pid ? -ESRCH : 0;
 }
 
+#if 1 /// elogind: logind looks up sessions by cgroup ID
+int pidfd_get_cgroupid(int pidfd, uint64_t *ret) {
+        struct pidfd_info info = {
+                .mask = PIDFD_INFO_CGROUPID,
+        };
+
+        assert(pidfd >= 0);
+        assert(ret);
+
+        /* Returns the ID of the cgroup v2 the process is in, without going through /proc/. Well known
+         * errors:
+         *
+         *    -EOPNOTSUPP → kernel does not support PIDFD_GET_INFO (< v6.13), or no cgroup v2
+         *    -ESRCH      → process is already reaped
+         */
+
+        if (ioctl(pidfd, PIDFD_GET_INFO, &info) < 0) {
+                if (ERRNO_IS_NOT_SUPPORTED(errno))
+                        return -EOPNOTSUPP;
+
+                return -errno;
+        }
+
+        if (!FLAGS_SET(info.mask, PIDFD_INFO_CGROUPID))
+                return -EOPNOTSUPP;
+
+        *ret = info.cgroupid;
+        return 0;
+}
+#endif // 1
+
 #if 0 /// UNNEEDED by elogind
 static int rlimit_to_nice(rlim_t limit) {
         if (limit <= 1)
@@ -279,6 +279,9 @@ assert_cc(TASKS_MAX <= (unsigned long) PID_T_MAX);
 
 int pidfd_get_pid(int fd, pid_t *ret);
 int pidfd_verify_pid(int pidfd, pid_t pid);
+#if 1 /// elogind: logind looks up sessions by cgroup ID
+int pidfd_get_cgroupid(int pidfd, uint64_t *ret);
+#endif // 1
 
 #if 0 /// UNNEEDED by elogind
 int setpriority_closest(int priority);
@@ -56,7 +56,6 @@ usec_t now(clockid_t clock_id) {
         return timespec_load(&ts);
 }
 
-#if 0 /// UNNEEDED by elogind
 nsec_t now_nsec(clockid_t clock_id) {
         struct timespec ts;
 
@@ -64,7 +63,6 @@ nsec_t now_nsec(clockid_t clock_id) {
 
         return timespec_load_nsec(&ts);
 }
-#endif // 0
 
 dual_timestamp* dual_timestamp_now(dual_timestamp *ts) {
         assert(ts);
@@ -243,7 +241,6 @@ usec_t timespec_load(const struct timespec *ts) {
                 (usec_t) ts->tv_nsec / NSEC_PER_USEC;
 }
 
-#if 0 /// UNNEEDED by elogind
 nsec_t timespec_load_nsec(const struct timespec *ts) {
         assert(ts);
 
@@ -255,7 +252,6 @@ nsec_t timespec_load_nsec(const struct timespec *ts) {
 
         return (nsec_t) ts->tv_sec * NSEC_PER_SEC + (nsec_t) ts->tv_nsec;
 }
-#endif // 0
 
 struct timespec *timespec_store(struct timespec *ts, usec_t u) {
         assert(ts);
@@ -78,9 +78,7 @@ typedef enum TimestampStyle {
 #define TIMESPEC_OMIT ((const struct timespec) { .tv_nsec = UTIME_OMIT })
 
 usec_t now(clockid_t clock);
-#if 0 /// UNNEEDED by elogind
 nsec_t now_nsec(clockid_t clock);
-#endif // 0
 
 usec_t map_clock_usec_raw(usec_t from, usec_t from_base, usec_t to_base);
 usec_t map_clock_usec(usec_t from, clockid_t from_clock, clockid_t to_clock);
@@ -122,9 +120,7 @@ static inline bool triple_timestamp_is_set(const triple_timestamp *ts) {
 usec_t triple_timestamp_by_clock(triple_timestamp *ts, clockid_t clock);
 
 usec_t timespec_load(const struct timespec *ts) _pure_;
-#if 0 /// UNNEEDED by elogind
 nsec_t timespec_load_nsec(const struct timespec *ts) _pure_;
-#endif // 0
 struct timespec* timespec_store(struct timespec *ts, usec_t u);
 #if 0 /// UNNEEDED by elogind
 struct timespec* timespec_store_nsec(struct timespec *ts, nsec_t n);
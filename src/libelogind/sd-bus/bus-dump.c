@@ -614,7 +614,11 @@ int bus_message_pcap_frame(sd_bus_message *m, size_t snaplen, FILE *f) {
         assert((size_t) (uint32_t) snaplen == snaplen);
 
         ts = m->realtime ?: now(CLOCK_REALTIME);
+#if 0 /// elogind: bodies passed as memfd are dumped inline, too
         msglen = BUS_MESSAGE_SIZE(m);
+#else // 0
+        msglen = BUS_MESSAGE_BODY_BEGIN(m) + m->body_size;
+#endif // 0
         caplen = MIN(msglen, snaplen);
         pad = ALIGN4(caplen) - caplen;
 
@@ -15,6 +15,9 @@
 #include "runtime-scope.h"
 #include "socket-util.h"
 #include "time-util.h"
+/// Additional includes needed by elogind
+#include "bus-signature-cache.h"
+#include "bus-stats.h"
 
 /* Note that we use the new /run prefix here (instead of /var/run) since we require them to be aliases and
  * that way we become independent of /var being mounted */
@@ -222,6 +225,13 @@ struct sd_bus {
         bool attach_timestamp;
         bool connected_signal;
         bool close_on_exit;
+#if 1 /// elogind: write coalescing, see dispatch_wqueue()
+        bool coalesce_writes;
+#endif // 1
+#if 1 /// elogind: large bodies passed as sealed memfd, see message_body_to_memfd()
+        bool accept_memfd;
+        bool can_memfd;
+#endif // 1
 
         RuntimeScope runtime_scope;
 
@@ -251,6 +261,19 @@ struct sd_bus {
         Hashmap *nodes;
         Hashmap *vtable_methods;
         Hashmap *vtable_properties;
+#if 1 /// elogind: properties may be served from a cache, see bus-property-cache.c
+        Hashmap *property_cache;
+        size_t n_property_cache_entries;
+#endif // 1
+#if 1 /// elogind: signatures passed to sd_bus_message_append()/read() are compiled once, see bus-signature-cache.c
+        pthread_mutex_t signature_cache_mutex;
+        BusSignature *signature_cache[BUS_SIGNATURE_CACHE_SIZE];
+#endif // 1
+#if 1 /// elogind: property reads may be deferred, see bus-property-defer.c
+        Hashmap *deferred_reads;
+        bool property_defer_allowed;
+        bool property_deferred;
+#endif // 1
 
         union sockaddr_union sockaddr;
         socklen_t sockaddr_size;
@@ -270,7 +293,11 @@ struct sd_bus {
 
         enum bus_auth auth;
         unsigned auth_index;
+#if 0 /// elogind may also send NEGOTIATE_ELOGIND_MEMFD
         struct iovec auth_iovec[3];
+#else // 0
+        struct iovec auth_iovec[4];
+#endif // 0
         size_t auth_rbegin;
         char *auth_buffer;
         usec_t auth_timeout;
@@ -301,6 +328,15 @@ struct sd_bus {
         struct memfd_cache memfd_cache[MEMFD_CACHE_MAX];
         unsigned n_memfd_cache;
 
+#if 1 /// elogind: messages are recycled per connection, see bus-message-pool.c
+        struct BusMessagePool *message_pool;
+#endif // 1
+
+#if 1 /// elogind: per-connection statistics, see bus-stats.c
+        bool collect_stats;
+        BusStats stats;
+#endif // 1
+
         uint64_t origin_id;
         pid_t busexec_pid;
 
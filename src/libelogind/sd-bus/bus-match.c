@@ -52,11 +52,133 @@ static bool BUS_MATCH_IS_COMPARE(enum bus_match_node_type t) {
         return t >= BUS_MATCH_SENDER && t <= BUS_MATCH_ARG_HAS_LAST;
 }
 
+#if 0 /// elogind also hashes namespace and path prefix matches, see bus_match_run_prefixes()
 static bool BUS_MATCH_CAN_HASH(enum bus_match_node_type t) {
         return (t >= BUS_MATCH_MESSAGE_TYPE && t <= BUS_MATCH_PATH) ||
                 (t >= BUS_MATCH_ARG && t <= BUS_MATCH_ARG_LAST) ||
                 (t >= BUS_MATCH_ARG_HAS && t <= BUS_MATCH_ARG_HAS_LAST);
 }
+#else // 0
+static bool BUS_MATCH_CAN_HASH(enum bus_match_node_type t) {
+        /* Everything but the sender, which also matches well-known names the message doesn't carry */
+        return t >= BUS_MATCH_MESSAGE_TYPE && t <= BUS_MATCH_ARG_HAS_LAST;
+}
+
+static bool BUS_MATCH_IS_PREFIX(enum bus_match_node_type t) {
+        return t == BUS_MATCH_PATH_NAMESPACE ||
+                (t >= BUS_MATCH_ARG_PATH && t <= BUS_MATCH_ARG_PATH_LAST) ||
+                (t >= BUS_MATCH_ARG_NAMESPACE && t <= BUS_MATCH_ARG_NAMESPACE_LAST);
+}
+
+static bool BUS_MATCH_IS_ARG_PATH(enum bus_match_node_type t) {
+        return t >= BUS_MATCH_ARG_PATH && t <= BUS_MATCH_ARG_PATH_LAST;
+}
+
+/* An argNpath match also applies to values that are a prefix of it ending in '/', e.g. arg0path='/aa/bb/cc'
+ * matches a message carrying '/aa/bb/' in its first argument. To find these without looking at every value
+ * node, each value node of an argNpath compare node is also indexed by all of its proper prefixes that end
+ * in '/'. Prefixes are looked up by pointer and length, so that no copies of the tested value are needed. */
+
+typedef struct BusMatchPrefix {
+        const char *str;
+        size_t len;
+} BusMatchPrefix;
+
+typedef struct BusMatchExtension {
+        BusMatchPrefix key;     /* Points to str[] */
+        Set *nodes;
+        char str[];
+} BusMatchExtension;
+
+static void bus_match_prefix_hash_func(const BusMatchPrefix *p, struct siphash *state) {
+        siphash24_compress(p->str, p->len, state);
+        siphash24_compress_typesafe(p->len, state);
+}
+
+static int bus_match_prefix_compare_func(const BusMatchPrefix *x, const BusMatchPrefix *y) {
+        return memcmp_nn(x->str, x->len, y->str, y->len);
+}
+
+static BusMatchExtension* bus_match_extension_free(BusMatchExtension *x) {
+        if (!x)
+                return NULL;
+
+        set_free(x->nodes);
+        return mfree(x);
+}
+
+DEFINE_PRIVATE_HASH_OPS_WITH_VALUE_DESTRUCTOR(
+                bus_match_extension_hash_ops,
+                BusMatchPrefix, bus_match_prefix_hash_func, bus_match_prefix_compare_func,
+                BusMatchExtension, bus_match_extension_free);
+
+/* Iterates over the proper prefixes of v that end in '/' */
+#define FOREACH_PATH_PREFIX(e, v) \
+        for (const char *e = strchr((v), '/'); e && e[1]; e = strchr(e + 1, '/'))
+
+static void bus_match_unindex_extensions(struct bus_match_node *compare, struct bus_match_node *value) {
+        BusMatchExtension *x;
+
+        assert(compare);
+        assert(value);
+
+        FOREACH_PATH_PREFIX(e, value->value.str) {
+                BusMatchPrefix k = { value->value.str, e + 1 - value->value.str };
+
+                x = hashmap_get(compare->compare.extensions, &k);
+                if (!x)
+                        continue;
+
+                set_remove(x->nodes, value);
+                if (set_isempty(x->nodes)) {
+                        assert_se(hashmap_remove(compare->compare.extensions, &x->key) == x);
+                        bus_match_extension_free(x);
+                }
+        }
+}
+
+static int bus_match_index_extensions(struct bus_match_node *compare, struct bus_match_node *value) {
+        BusMatchExtension *x;
+        int r;
+
+        assert(compare);
+        assert(value);
+
+        FOREACH_PATH_PREFIX(e, value->value.str) {
+                BusMatchPrefix k = { value->value.str, e + 1 - value->value.str };
+
+                x = hashmap_get(compare->compare.extensions, &k);
+                if (!x) {
+                        x = malloc(offsetof(BusMatchExtension, str) + k.len);
+                        if (!x) {
+                                r = -ENOMEM;
+                                goto fail;
+                        }
+
+                        *x = (BusMatchExtension) {
+                                .key = { x->str, k.len },
+                        };
+                        memcpy(x->str, k.str, k.len);
+
+                        r = hashmap_ensure_put(&compare->compare.extensions, &bus_match_extension_hash_ops, &x->key, x);
+                        if (r < 0) {
+                                free(x);
+                                goto fail;
+                        }
+                }
+
+                r = set_ensure_put(&x->nodes, NULL, value);
+                if (r < 0)
+                        goto fail;
+        }
+
+        return 0;
+
+fail:
+        bus_match_unindex_extensions(compare, value);
+        return r;
+}
+#endif // 0
 
 static void bus_match_node_free(struct bus_match_node *node) {
         assert(node);
@@ -84,6 +206,11 @@ static void bus_match_node_free(struct bus_match_node *node) {
                 /* We might be in the parent's hash table, so clean
                  * this up */
 
+#if 1 /// elogind: see bus_match_index_extensions()
+                if (BUS_MATCH_IS_ARG_PATH(node->parent->type) && node->value.str)
+                        bus_match_unindex_extensions(node->parent, node);
+#endif // 1
+
                 if (node->parent->type == BUS_MATCH_MESSAGE_TYPE)
                         hashmap_remove(node->parent->compare.children, UINT_TO_PTR(node->value.u8));
                 else if (BUS_MATCH_CAN_HASH(node->parent->type) && node->value.str)
@@ -95,6 +222,10 @@ static void bus_match_node_free(struct bus_match_node *node) {
         if (BUS_MATCH_IS_COMPARE(node->type)) {
                 assert(hashmap_isempty(node->compare.children));
                 hashmap_free(node->compare.children);
+#if 1 /// elogind: see bus_match_index_extensions()
+                assert(hashmap_isempty(node->compare.extensions));
+                hashmap_free(node->compare.extensions);
+#endif // 1
         }
 
         free(node);
@@ -235,6 +366,83 @@ static bool value_node_same(
         }
 }
 
+#if 1 /// elogind: namespace and path prefix matches are hashed, too
+static int bus_match_run_prefixes(
+                sd_bus *bus,
+                struct bus_match_node *node,
+                const char *test_str,
+                sd_bus_message *m) {
+
+        _cleanup_free_ char *p = NULL;
+        struct bus_match_node *found;
+        BusMatchExtension *x;
+        bool complex;
+        size_t n;
+        char c;
+        int r;
+
+        assert(node);
+        assert(BUS_MATCH_IS_PREFIX(node->type));
+        assert(m);
+
+        if (!test_str)
+                return 0;
+
+        /* Instead of testing every value node against the tested value, look up all prefixes of the tested
+         * value that can match, see path_simple_pattern() and path_complex_pattern(): the value itself, and
+         * any prefix followed by a separator. For path_namespace= and argNnamespace= also any prefix that
+         * ends in a separator. */
+
+        complex = BUS_MATCH_IS_ARG_PATH(node->type);
+        c = node->type >= BUS_MATCH_ARG_NAMESPACE && node->type <= BUS_MATCH_ARG_NAMESPACE_LAST ? '.' : '/';
+
+        p = strdup(test_str);
+        if (!p)
+                return -ENOMEM;
+        n = strlen(p);
+
+        for (size_t k = 0; k <= n; k++) {
+                if (k < n &&
+                    !(k > 0 && test_str[k-1] == c) &&
+                    !(!complex && test_str[k] == c))
+                        continue;
+
+                p[k] = 0;
+                found = hashmap_get(node->compare.children, p);
+                p[k] = test_str[k];
+
+                if (!found)
+                        continue;
+
+                r = bus_match_run(bus, found, m);
+                if (r != 0)
+                        return r;
+
+                if (bus && bus->match_callbacks_modified)
+                        return 0;
+        }
+
+        if (!complex || n == 0 || test_str[n-1] != c)
+                return 0;
+
+        /* An argNpath value ending in '/' also matches all longer values it is a prefix of */
+        x = hashmap_get(node->compare.extensions, &(const BusMatchPrefix) { test_str, n });
+        if (!x)
+                return 0;
+
+        SET_FOREACH(found, x->nodes) {
+                r = bus_match_run(bus, found, m);
+                if (r != 0)
+                        return r;
+
+                if (bus && bus->match_callbacks_modified)
+                        return 0;
+        }
+
+        return 0;
+}
+#endif // 1
+
 int bus_match_run(
                 sd_bus *bus,
                 struct bus_match_node *node,
@@ -375,6 +583,13 @@ int bus_match_run(
                 assert_not_reached();
         }
 
+#if 1 /// elogind: namespace and path prefix matches are hashed, too
+        if (BUS_MATCH_IS_PREFIX(node->type)) {
+                r = bus_match_run_prefixes(bus, node, test_str, m);
+                if (r != 0)
+                        return r;
+        } else
+#endif // 1
         if (BUS_MATCH_CAN_HASH(node->type)) {
                 struct bus_match_node *found;
 
@@ -514,6 +729,16 @@ static int bus_match_add_compare_value(
 
                 if (r < 0)
                         goto fail;
+
+#if 1 /// elogind: see bus_match_index_extensions()
+                if (BUS_MATCH_IS_ARG_PATH(t)) {
+                        r = bus_match_index_extensions(c, n);
+                        if (r < 0) {
+                                hashmap_remove(c->compare.children, n->value.str);
+                                goto fail;
+                        }
+                }
+#endif // 1
         } else {
                 n->next = c->child;
                 if (n->next)
@@ -47,6 +47,9 @@ struct bus_match_node {
                 struct {
                         /* If this is set, then the child is NULL */
                         Hashmap *children;
+#if 1 /// elogind: argNpath values are also indexed by their proper prefixes ending in '/'
+                        Hashmap *extensions;
+#endif // 1
                 } compare;
         };
 };
@@ -0,0 +1,314 @@
+/* SPDX-License-Identifier: LGPL-2.1-or-later */
+
+#include <pthread.h>
+#include <stdlib.h>
+
+#include "alloc-util.h"
+#include "bus-message.h"
+#include "bus-message-pool.h"
+#include "log.h"
+#include "mempool.h"
+
+/* A per-connection cache of message objects and their body parts. Messages are freed into the pool and
+ * handed out again by the next sd_bus_message_new() or incoming message, instead of round-tripping through
+ * malloc() for every message, part and body buffer. Every pooled message pins the pool, hence it may
+ * safely outlive the connection it was allocated for. Like the memfd cache, the pool is protected by a
+ * mutex, since messages may be released in a different thread than the one they were created in.
+ *
+ * The pool is only used where mempool_enabled() says so, like the hashmap pools, so that memory checkers see
+ * every message in programs that don't opt in. And since a burst of messages would otherwise keep its
+ * memory until the connection goes away, everything is released once the last message of a burst is
+ * returned. */
+
+typedef struct BusMessagePoolBuffer {
+        void *data;
+        size_t allocated;
+} BusMessagePoolBuffer;
+
+struct BusMessagePool {
+        unsigned n_ref;
+        pthread_mutex_t mutex;
+
+        struct mempool messages;
+        struct mempool parts;
+
+        BusMessagePoolBuffer buffers[BUS_MESSAGE_POOL_BUFFERS_MAX];
+        size_t n_buffers;
+
+        size_t n_messages_live_peak;    /* Most messages in use at once since the last trim */
+
+        BusMessagePoolStats stats;
+};
+
+int bus_message_pool_new(BusMessagePool **ret) {
+        BusMessagePool *p;
+
+        assert(ret);
+
+        p = new(BusMessagePool, 1);
+        if (!p)
+                return -ENOMEM;
+
+        *p = (BusMessagePool) {
+                .n_ref = 1,
+                .messages = {
+                        .tile_size = ALIGN(sizeof(sd_bus_message)) + BUS_MESSAGE_POOL_HEADER_SIZE,
+                        .at_least = 16,
+                },
+                .parts = {
+                        .tile_size = sizeof(struct bus_body_part),
+                        .at_least = 32,
+                },
+        };
+
+        assert_se(pthread_mutex_init(&p->mutex, NULL) == 0);
+
+        *ret = p;
+        return 0;
+}
+
+static BusMessagePool* bus_message_pool_free(BusMessagePool *p) {
+        assert(p);
+        assert(p->stats.n_messages_live == 0);
+
+        bus_message_pool_log_stats(p);
+
+        FOREACH_ARRAY(b, p->buffers, p->n_buffers)
+                free(b->data);
+
+        mempool_done(&p->messages);
+        mempool_done(&p->parts);
+
+        assert_se(pthread_mutex_destroy(&p->mutex) == 0);
+
+        return mfree(p);
+}
+
+BusMessagePool* bus_message_pool_ref(BusMessagePool *p) {
+        if (!p)
+                return NULL;
+
+        assert_se(pthread_mutex_lock(&p->mutex) == 0);
+        assert(p->n_ref > 0);
+        p->n_ref++;
+        assert_se(pthread_mutex_unlock(&p->mutex) == 0);
+
+        return p;
+}
+
+/* Drops a reference with the mutex held, and returns true if it was the last one */
+static bool pool_unref_locked(BusMessagePool *p) {
+        assert(p);
+        assert(p->n_ref > 0);
+
+        return --p->n_ref == 0;
+}
+
+BusMessagePool* bus_message_pool_unref(BusMessagePool *p) {
+        bool last;
+
+        if (!p)
+                return NULL;
+
+        assert_se(pthread_mutex_lock(&p->mutex) == 0);
+        last = pool_unref_locked(p);
+        assert_se(pthread_mutex_unlock(&p->mutex) == 0);
+
+        return last ? bus_message_pool_free(p) : NULL;
+}
+
+sd_bus_message* bus_message_pool_alloc_message(BusMessagePool *p) {
+        sd_bus_message *m;
+
+        assert(p);
+
+        assert_se(pthread_mutex_lock(&p->mutex) == 0);
+
+        if (p->messages.freelist)
+                p->stats.n_messages_reused++;
+        else
+                p->stats.n_messages_allocated++;
+
+        m = mempool_alloc_tile(&p->messages);
+        if (m) {
+                p->n_ref++;
+                p->stats.n_messages_live++;
+                p->stats.n_messages_live_max = MAX(p->stats.n_messages_live_max, p->stats.n_messages_live);
+                p->n_messages_live_peak = MAX(p->n_messages_live_peak, p->stats.n_messages_live);
+        }
+
+        assert_se(pthread_mutex_unlock(&p->mutex) == 0);
+
+        if (!m)
+                return NULL;
+
+        memzero(m, p->messages.tile_size);
+        m->pool = p;
+        return m;
+}
+
+static void pool_trim_locked(BusMessagePool *p) {
+        assert(p);
+        assert(p->stats.n_messages_live == 0);
+
+        /* Parts only belong to pooled messages, hence with none of them in use all tiles are free, and
+         * all memory is released */
+        mempool_trim(&p->messages);
+        mempool_trim(&p->parts);
+
+        FOREACH_ARRAY(b, p->buffers, p->n_buffers)
+                free(b->data);
+        p->n_buffers = 0;
+
+        p->n_messages_live_peak = 0;
+        p->stats.n_trims++;
+}
+
+void bus_message_pool_free_message(sd_bus_message *m) {
+        BusMessagePool *p;
+        bool last;
+
+        if (!m)
+                return;
+
+        p = m->pool;
+        if (!p) {
+                free(m);
+                return;
+        }
+
+        assert_se(pthread_mutex_lock(&p->mutex) == 0);
+
+        assert(p->stats.n_messages_live > 0);
+        p->stats.n_messages_live--;
+
+        mempool_free_tile(&p->messages, m);
+
+        if (p->stats.n_messages_live == 0 && p->n_messages_live_peak > BUS_MESSAGE_POOL_TRIM_THRESHOLD)
+                pool_trim_locked(p);
+
+        last = pool_unref_locked(p);
+
+        assert_se(pthread_mutex_unlock(&p->mutex) == 0);
+
+        if (last)
+                bus_message_pool_free(p);
+}
+
+struct bus_body_part* bus_message_pool_alloc_part(BusMessagePool *p) {
+        struct bus_body_part *part;
+
+        assert(p);
+
+        assert_se(pthread_mutex_lock(&p->mutex) == 0);
+
+        if (p->parts.freelist)
+                p->stats.n_parts_reused++;
+        else
+                p->stats.n_parts_allocated++;
+
+        part = mempool_alloc_tile(&p->parts);
+
+        assert_se(pthread_mutex_unlock(&p->mutex) == 0);
+
+        if (!part)
+                return NULL;
+
+        zero(*part);
+        return part;
+}
+
+void bus_message_pool_free_part(BusMessagePool *p, struct bus_body_part *part) {
+        assert(p);
+
+        assert_se(pthread_mutex_lock(&p->mutex) == 0);
+        mempool_free_tile(&p->parts, part);
+        assert_se(pthread_mutex_unlock(&p->mutex) == 0);
+}
+
+void* bus_message_pool_take_buffer(BusMessagePool *p, size_t size, size_t *ret_allocated) {
+        BusMessagePoolBuffer *best = NULL;
+        void *data;
+
+        assert(p);
+        assert(ret_allocated);
+
+        assert_se(pthread_mutex_lock(&p->mutex) == 0);
+
+        /* Hand out the smallest cached buffer that fits */
+        FOREACH_ARRAY(b, p->buffers, p->n_buffers)
+                if (b->allocated >= size && (!best || b->allocated < best->allocated))
+                        best = b;
+
+        if (best) {
+                data = best->data;
+                *ret_allocated = best->allocated;
+
+                *best = p->buffers[--p->n_buffers];
+                p->stats.n_buffers_reused++;
+        } else {
+                data = NULL;
+                p->stats.n_buffers_missed++;
+        }
+
+        assert_se(pthread_mutex_unlock(&p->mutex) == 0);
+
+        return data;
+}
+
+void bus_message_pool_put_buffer(BusMessagePool *p, void *data, size_t allocated) {
+        assert(p);
+
+        if (!data)
+                return;
+
+        assert_se(pthread_mutex_lock(&p->mutex) == 0);
+
+        if (allocated <= BUS_MESSAGE_POOL_BUFFER_SIZE_MAX && p->n_buffers < BUS_MESSAGE_POOL_BUFFERS_MAX) {
+                p->buffers[p->n_buffers++] = (BusMessagePoolBuffer) {
+                        .data = TAKE_PTR(data),
+                        .allocated = allocated,
+                };
+        } else
+                p->stats.n_buffers_dropped++;
+
+        assert_se(pthread_mutex_unlock(&p->mutex) == 0);
+
+        free(data);
+}
+
+void bus_message_pool_get_stats(BusMessagePool *p, BusMessagePoolStats *ret) {
+        assert(p);
+        assert(ret);
+
+        assert_se(pthread_mutex_lock(&p->mutex) == 0);
+        *ret = p->stats;
+        assert_se(pthread_mutex_unlock(&p->mutex) == 0);
+}
+
+void bus_message_pool_reset_stats(BusMessagePool *p) {
+        assert(p);
+
+        /* The messages that are still in use are not forgotten, they are returned to the pool later on */
+
+        assert_se(pthread_mutex_lock(&p->mutex) == 0);
+        p->stats = (BusMessagePoolStats) {
+                .n_messages_live = p->stats.n_messages_live,
+                .n_messages_live_max = p->stats.n_messages_live,
+        };
+        assert_se(pthread_mutex_unlock(&p->mutex) == 0);
+}
+
+void bus_message_pool_log_stats(BusMessagePool *p) {
+        assert(p);
+
+        log_debug("Bus message pool %p: messages allocated=%" PRIu64 " reused=%" PRIu64 " live=%zu live-max=%zu, "
+                  "parts allocated=%" PRIu64 " reused=%" PRIu64 ", "
+                  "buffers reused=%" PRIu64 " missed=%" PRIu64 " dropped=%" PRIu64 ", trims=%" PRIu64,
+                  p,
+                  p->stats.n_messages_allocated, p->stats.n_messages_reused,
+                  p->stats.n_messages_live, p->stats.n_messages_live_max,
+                  p->stats.n_parts_allocated, p->stats.n_parts_reused,
+                  p->stats.n_buffers_reused, p->stats.n_buffers_missed, p->stats.n_buffers_dropped,
+                  p->stats.n_trims);
+}
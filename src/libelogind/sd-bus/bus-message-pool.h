@@ -0,0 +1,56 @@
+/* SPDX-License-Identifier: LGPL-2.1-or-later */
+#pragma once
+
+#include <inttypes.h>
+#include <stddef.h>
+
+#include "sd-bus.h"
+
+#include "macro.h"
+
+/* Room for the header fields reserved right behind pooled messages. Method calls and replies usually fit,
+ * so that their header needs no allocation of its own. See message_extend_fields(). */
+#define BUS_MESSAGE_POOL_HEADER_SIZE 256U
+
+/* Body buffers are kept for reuse up to this size and count */
+#define BUS_MESSAGE_POOL_BUFFER_SIZE_MAX (64U*1024U)
+#define BUS_MESSAGE_POOL_BUFFERS_MAX 8U
+
+/* Once all messages are returned after more than this many were in use at once, the memory is released */
+#define BUS_MESSAGE_POOL_TRIM_THRESHOLD 64U
+
+struct bus_body_part;
+
+typedef struct BusMessagePool BusMessagePool;
+
+typedef struct BusMessagePoolStats {
+        uint64_t n_messages_allocated;  /* Message tiles taken from fresh pool memory */
+        uint64_t n_messages_reused;     /* Message tiles taken from the freelist */
+        uint64_t n_parts_allocated;
+        uint64_t n_parts_reused;
+        uint64_t n_buffers_reused;      /* Body buffers handed out from the cache */
+        uint64_t n_buffers_missed;      /* Body buffer requests the cache could not serve */
+        uint64_t n_buffers_dropped;     /* Body buffers freed because they were too large or the cache was full */
+        uint64_t n_trims;               /* Times the pool was released after a burst */
+        size_t n_messages_live;         /* Pooled messages currently in use */
+        size_t n_messages_live_max;
+} BusMessagePoolStats;
+
+int bus_message_pool_new(BusMessagePool **ret);
+BusMessagePool* bus_message_pool_ref(BusMessagePool *p);
+BusMessagePool* bus_message_pool_unref(BusMessagePool *p);
+DEFINE_TRIVIAL_CLEANUP_FUNC(BusMessagePool*, bus_message_pool_unref);
+
+sd_bus_message* bus_message_pool_alloc_message(BusMessagePool *p);
+void bus_message_pool_free_message(sd_bus_message *m);
+DEFINE_TRIVIAL_CLEANUP_FUNC_FULL(sd_bus_message*, bus_message_pool_free_message, NULL);
+
+struct bus_body_part* bus_message_pool_alloc_part(BusMessagePool *p);
+void bus_message_pool_free_part(BusMessagePool *p, struct bus_body_part *part);
+
+void* bus_message_pool_take_buffer(BusMessagePool *p, size_t size, size_t *ret_allocated);
+void bus_message_pool_put_buffer(BusMessagePool *p, void *data, size_t allocated);
+
+void bus_message_pool_get_stats(BusMessagePool *p, BusMessagePoolStats *ret);
+void bus_message_pool_reset_stats(BusMessagePool *p);
+void bus_message_pool_log_stats(BusMessagePool *p);
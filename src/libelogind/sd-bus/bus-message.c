@@ -19,6 +19,9 @@
 #include "strv.h"
 #include "time-util.h"
 #include "utf8.h"
+/// Additional includes needed by elogind
+#include "bus-message-pool.h"
+#include "io-util.h"
 
 static int message_append_basic(sd_bus_message *m, char type, const void *p, const void **stored);
 static int message_parse_fields(sd_bus_message *m);
@@ -59,12 +62,30 @@ static void message_free_part(sd_bus_message *m, struct bus_body_part *part) {
                 if (m->sensitive)
                         explicit_bzero_safe(part->data, part->size);
 
+#if 0 /// elogind keeps body buffers of pooled messages for reuse
                 if (part->free_this)
                         free(part->data);
+#else // 0
+                if (part->free_this) {
+                        if (m->pool)
+                                bus_message_pool_put_buffer(m->pool, part->data, part->allocated);
+                        else
+                                free(part->data);
+                }
+#endif // 0
         }
 
+#if 0 /// elogind allocates the parts of pooled messages from the pool
         if (part != &m->body)
                 free(part);
+#else // 0
+        if (part != &m->body) {
+                if (m->pool)
+                        bus_message_pool_free_part(m->pool, part);
+                else
+                        free(part);
+        }
+#endif // 0
 }
 
 static void message_reset_parts(sd_bus_message *m) {
@@ -143,8 +164,23 @@ static sd_bus_message* message_free(sd_bus_message *m) {
         message_free_last_container(m);
 
         bus_creds_done(&m->creds);
+#if 0 /// elogind returns pooled messages to their pool
         return mfree(m);
+#else // 0
+        bus_message_pool_free_message(m);
+        return NULL;
+#endif // 0
+}
+
+#if 1 /// elogind: pooled messages have room for the header fields right behind them
+static bool message_header_is_inline(sd_bus_message *m) {
+        assert(m);
+
+        return m->pool &&
+                !m->free_header &&
+                m->header == (struct bus_header*) ((uint8_t*) m + ALIGN(sizeof(sd_bus_message)));
 }
+#endif // 1
 
 static void *message_extend_fields(sd_bus_message *m, size_t sz, bool add_offset) {
         void *op, *np;
@@ -169,6 +205,10 @@ static void *message_extend_fields(sd_bus_message *m, size_t sz, bool add_offset
                 np = realloc(m->header, ALIGN8(new_size));
                 if (!np)
                         goto poison;
+#if 1 /// elogind: the fields of pooled messages are kept inline as long as they fit
+        } else if (message_header_is_inline(m) && ALIGN8(new_size) <= BUS_MESSAGE_POOL_HEADER_SIZE) {
+                np = m->header;
+#endif // 1
         } else {
                 /* Initially, the header is allocated as part of
                  * the sd_bus_message itself, let's replace it by
@@ -178,7 +218,11 @@ static void *message_extend_fields(sd_bus_message *m, size_t sz, bool add_offset
                 if (!np)
                         goto poison;
 
+#if 0 /// elogind: pooled messages may already carry fields in their inline header
                 memcpy(np, m->header, sizeof(struct bus_header));
+#else // 0
+                memcpy(np, m->header, old_size);
+#endif // 0
         }
 
         /* Zero out padding */
@@ -197,7 +241,12 @@ static void *message_extend_fields(sd_bus_message *m, size_t sz, bool add_offset
         m->sender = adjust_pointer(m->sender, op, old_size, m->header);
         m->error.name = adjust_pointer(m->error.name, op, old_size, m->header);
 
+#if 0 /// elogind: the inline header of pooled messages is not freed separately
         m->free_header = true;
+#else // 0
+        if (np != op)
+                m->free_header = true;
+#endif // 0
 
         if (add_offset) {
                 if (m->n_header_offsets >= ELEMENTSOF(m->header_offsets))
@@ -338,7 +387,11 @@ static int message_from_header(
                 const char *label,
                 sd_bus_message **ret) {
 
+#if 0 /// elogind takes messages from the pool of the connection, see below
         _cleanup_free_ sd_bus_message *m = NULL;
+#else // 0
+        _cleanup_(bus_message_pool_free_messagep) sd_bus_message *m = NULL;
+#endif // 0
         struct bus_header *h;
         size_t a, label_sz = 0; /* avoid false maybe-uninitialized warning */
 
@@ -369,7 +422,14 @@ static int message_from_header(
                 a += label_sz + 1;
         }
 
+#if 0 /// elogind takes messages without a label from the pool of the connection
         m = malloc0(a);
+#else // 0
+        if (!label && bus->message_pool)
+                m = bus_message_pool_alloc_message(bus->message_pool);
+        else
+                m = malloc0(a);
+#endif // 0
         if (!m)
                 return -ENOMEM;
 
@@ -384,9 +444,15 @@ static int message_from_header(
         m->body_size = BUS_MESSAGE_BSWAP32(m, h->body_size);
 
         assert(message_size >= sizeof(struct bus_header));
+#if 0 /// elogind: a body passed as memfd is not part of the message read from the socket
         if (ALIGN8(m->fields_size) > message_size - sizeof(struct bus_header) ||
             m->body_size != message_size - sizeof(struct bus_header) - ALIGN8(m->fields_size))
                 return -EBADMSG;
+#else // 0
+        if (ALIGN8(m->fields_size) > message_size - sizeof(struct bus_header) ||
+            (h->flags & BUS_MESSAGE_BODY_MEMFD ? 0 : m->body_size) != message_size - sizeof(struct bus_header) - ALIGN8(m->fields_size))
+                return -EBADMSG;
+#endif // 0
 
         m->fds = fds;
         m->n_fds = n_fds;
@@ -406,6 +472,66 @@ static int message_from_header(
         return 0;
 }
 
+#if 1 /// elogind: map a body that was passed as sealed memfd, see message_body_to_memfd()
+static int message_map_body_memfd(sd_bus *bus, sd_bus_message *m) {
+        uint64_t size;
+        size_t psz;
+        void *p;
+        int fd, r;
+
+        assert(bus);
+        assert(m);
+
+        /* The memfd is the last of the fds passed along with the message. It is only accepted if we agreed to
+         * this during authentication, and if it is sealed, so that the peer cannot change the body under our
+         * feet anymore. */
+
+        if (!bus->can_memfd || m->n_fds == 0 || m->body_size == 0)
+                return -EBADMSG;
+
+        /* Whatever is wrong with the fd, it's the peer's fault, hence drop the message rather than failing
+         * the connection */
+
+        fd = m->fds[m->n_fds - 1];
+
+        r = memfd_get_sealed(fd);
+        if (r < 0) {
+                log_debug_errno(r, "Failed to get seals of body memfd: %m");
+                return -EBADMSG;
+        }
+        if (r == 0)
+                return -EBADMSG;
+
+        r = memfd_get_size(fd, &size);
+        if (r < 0) {
+                log_debug_errno(r, "Failed to get size of body memfd: %m");
+                return -EBADMSG;
+        }
+        if (size < m->body_size)
+                return -EBADMSG;
+
+        psz = PAGE_ALIGN(m->body_size);
+        p = mmap(NULL, psz, PROT_READ, MAP_PRIVATE, fd, 0);
+        if (p == MAP_FAILED) {
+                log_debug_errno(errno, "Failed to map body memfd: %m");
+                return -EBADMSG;
+        }
+
+        m->n_body_parts = 1;
+        m->body = (struct bus_body_part) {
+                .data = p,
+                .size = m->body_size,
+                .mapped = psz,
+                .mmap_begin = p,
+                .munmap_this = true,
+                .sealed = true,
+                .memfd = -EBADF,
+        };
+
+        return 0;
+}
+#endif // 1
+
 int bus_message_from_malloc(
                 sd_bus *bus,
                 void *buffer,
@@ -429,6 +555,13 @@ int bus_message_from_malloc(
                 return r;
 
         sz = length - sizeof(struct bus_header) - ALIGN8(m->fields_size);
+#if 1 /// elogind: the body may have been passed as sealed memfd instead
+        if (BUS_MESSAGE_BODY_IN_MEMFD(m)) {
+                r = message_map_body_memfd(bus, m);
+                if (r < 0)
+                        return r;
+        } else
+#endif // 1
         if (sz > 0) {
                 m->n_body_parts = 1;
                 m->body.data = (uint8_t*) buffer + sizeof(struct bus_header) + ALIGN8(m->fields_size);
@@ -465,7 +598,13 @@ _public_ int sd_bus_message_new(
         /* Creation of messages with _SD_BUS_MESSAGE_TYPE_INVALID is allowed. */
         assert_return(type < _SD_BUS_MESSAGE_TYPE_MAX, -EINVAL);
 
+#if 0 /// elogind takes messages from the pool of the connection
         sd_bus_message *t = malloc0(ALIGN(sizeof(sd_bus_message)) + sizeof(struct bus_header));
+#else // 0
+        sd_bus_message *t = bus->message_pool ?
+                bus_message_pool_alloc_message(bus->message_pool) :
+                malloc0(ALIGN(sizeof(sd_bus_message)) + sizeof(struct bus_header));
+#endif // 0
         if (!t)
                 return -ENOMEM;
 
@@ -631,6 +770,10 @@ static int message_new_reply(
 
         t->dont_send = FLAGS_SET(call->header->flags, BUS_MESSAGE_NO_REPLY_EXPECTED);
         t->enforced_reply_signature = call->enforced_reply_signature;
+#if 1 /// elogind: the reply completes the latency measurement of the call
+        t->stats_entry = call->stats_entry;
+        t->stats_begin = call->stats_begin;
+#endif // 1
 
         /* let's copy the sensitive flag over. Let's do that as a safety precaution to keep a transaction
          * wholly sensitive if already the incoming message was sensitive. This is particularly useful when a
@@ -1101,7 +1244,11 @@ static struct bus_body_part *message_append_part(sd_bus_message *m) {
         } else {
                 assert(m->body_end);
 
+#if 0 /// elogind allocates the parts of pooled messages from the pool
                 part = new0(struct bus_body_part, 1);
+#else // 0
+                part = m->pool ? bus_message_pool_alloc_part(m->pool) : new0(struct bus_body_part, 1);
+#endif // 0
                 if (!part) {
                         m->poisoned = true;
                         return NULL;
@@ -1150,7 +1297,14 @@ static int part_make_space(
                 size_t new_allocated;
 
                 new_allocated = sz > 0 ? 2 * sz : 64;
+#if 0 /// elogind: fresh parts of pooled messages start out with a recycled buffer, if one fits
                 n = realloc(part->data, new_allocated);
+#else // 0
+                n = !part->data && m->pool ?
+                        bus_message_pool_take_buffer(m->pool, new_allocated, &new_allocated) : NULL;
+                if (!n)
+                        n = realloc(part->data, new_allocated);
+#endif // 0
                 if (!n) {
                         m->poisoned = true;
                         return -ENOMEM;
@@ -1530,7 +1684,12 @@ static int bus_message_open_array(
                 struct bus_container *c,
                 const char *contents,
                 uint32_t **array_size,
+#if 0 /// elogind skips validating contents taken from a compiled signature, see bus-signature-cache.c
                 size_t *begin) {
+#else // 0
+                size_t *begin,
+                bool trusted) {
+#endif // 0
 
         unsigned nindex;
         int alignment;
@@ -1544,7 +1703,11 @@ static int bus_message_open_array(
         assert(array_size);
         assert(begin);
 
+#if 0 /// elogind skips validating contents taken from a compiled signature, see bus-signature-cache.c
         if (!signature_is_single(contents, true))
+#else // 0
+        if (!trusted && !signature_is_single(contents, true))
+#endif // 0
                 return -EINVAL;
 
         if (c->signature && c->signature[c->index]) {
@@ -1658,7 +1821,12 @@ static int bus_message_open_struct(
                 sd_bus_message *m,
                 struct bus_container *c,
                 const char *contents,
+#if 0 /// elogind skips validating contents taken from a compiled signature, see bus-signature-cache.c
                 size_t *begin) {
+#else // 0
+                size_t *begin,
+                bool trusted) {
+#endif // 0
 
         size_t nindex;
 
@@ -1667,7 +1835,11 @@ static int bus_message_open_struct(
         assert(contents);
         assert(begin);
 
+#if 0 /// elogind skips validating contents taken from a compiled signature, see bus-signature-cache.c
         if (!signature_is_valid(contents, false))
+#else // 0
+        if (!trusted && !signature_is_valid(contents, false))
+#endif // 0
                 return -EINVAL;
 
         if (c->signature && c->signature[c->index]) {
@@ -1710,14 +1882,23 @@ static int bus_message_open_dict_entry(
                 sd_bus_message *m,
                 struct bus_container *c,
                 const char *contents,
+#if 0 /// elogind skips validating contents taken from a compiled signature, see bus-signature-cache.c
                 size_t *begin) {
+#else // 0
+                size_t *begin,
+                bool trusted) {
+#endif // 0
 
         assert(m);
         assert(c);
         assert(contents);
         assert(begin);
 
+#if 0 /// elogind skips validating contents taken from a compiled signature, see bus-signature-cache.c
         if (!signature_is_pair(contents))
+#else // 0
+        if (!trusted && !signature_is_pair(contents))
+#endif // 0
                 return -EINVAL;
 
         if (c->enclosing != SD_BUS_TYPE_ARRAY)
@@ -1742,10 +1923,18 @@ static int bus_message_open_dict_entry(
         return 0;
 }
 
+#if 0 /// elogind: sd_bus_message_appendv() opens containers of compiled signatures without validating them again
 _public_ int sd_bus_message_open_container(
                 sd_bus_message *m,
                 char type,
                 const char *contents) {
+#else // 0
+static int message_open_container(
+                sd_bus_message *m,
+                char type,
+                const char *contents,
+                bool trusted) {
+#endif // 0
 
         struct bus_container *c;
         uint32_t *array_size = NULL;
@@ -1777,6 +1966,7 @@ _public_ int sd_bus_message_open_container(
         c->saved_index = c->index;
         before = m->body_size;
 
+#if 0 /// elogind: see message_open_container()
         if (type == SD_BUS_TYPE_ARRAY)
                 r = bus_message_open_array(m, c, contents, &array_size, &begin);
         else if (type == SD_BUS_TYPE_VARIANT)
@@ -1785,6 +1975,16 @@ _public_ int sd_bus_message_open_container(
                 r = bus_message_open_struct(m, c, contents, &begin);
         else if (type == SD_BUS_TYPE_DICT_ENTRY)
                 r = bus_message_open_dict_entry(m, c, contents, &begin);
+#else // 0
+        if (type == SD_BUS_TYPE_ARRAY)
+                r = bus_message_open_array(m, c, contents, &array_size, &begin, trusted);
+        else if (type == SD_BUS_TYPE_VARIANT)
+                r = bus_message_open_variant(m, c, contents);
+        else if (type == SD_BUS_TYPE_STRUCT)
+                r = bus_message_open_struct(m, c, contents, &begin, trusted);
+        else if (type == SD_BUS_TYPE_DICT_ENTRY)
+                r = bus_message_open_dict_entry(m, c, contents, &begin, trusted);
+#endif // 0
         else
                 r = -EINVAL;
         if (r < 0)
@@ -1802,6 +2002,80 @@ _public_ int sd_bus_message_open_container(
         return 0;
 }
 
+#if 1 /// elogind: see message_open_container()
+_public_ int sd_bus_message_open_container(
+                sd_bus_message *m,
+                char type,
+                const char *contents) {
+
+        return message_open_container(m, type, contents, false);
+}
+#endif // 1
+
+#if 1 /// elogind: cached properties are appended as a whole, see bus-property-cache.c
+int bus_message_peek_body(sd_bus_message *m, size_t begin, const void **ret, size_t *ret_size) {
+        struct bus_body_part *part;
+        size_t part_begin;
+
+        assert(m);
+        assert(ret);
+        assert(ret_size);
+
+        /* Returns the body of a message under construction from the given offset to its current end, if
+         * that range is in one piece of regular memory. */
+
+        if (m->poisoned || m->sealed || m->n_body_parts <= 0)
+                return -EINVAL;
+
+        part = m->body_end;
+        if (part->memfd >= 0 || part->is_zero || !part->data)
+                return -EOPNOTSUPP;
+
+        part_begin = m->body_size - part->size;
+        if (begin < part_begin || begin > m->body_size)
+                return -EOPNOTSUPP;
+
+        *ret = (const uint8_t*) part->data + (begin - part_begin);
+        *ret_size = m->body_size - begin;
+        return 0;
+}
+
+int bus_message_append_dict_entry_raw(sd_bus_message *m, const char *contents, const void *data, size_t size) {
+        struct bus_container *c;
+        size_t l;
+        void *p;
+
+        assert(m);
+        assert(contents);
+        assert(data || size == 0);
+
+        /* Appends a complete, serialized dict entry to the array currently being written. Dict entries are
+         * always 8-byte aligned, hence a dict entry serialized once can be copied to any position. */
+
+        if (m->poisoned)
+                return -ESTALE;
+        if (m->sealed)
+                return -EPERM;
+
+        c = message_get_last_container(m);
+        if (c->enclosing != SD_BUS_TYPE_ARRAY || !c->signature)
+                return -ENXIO;
+
+        l = strlen(contents);
+        if (c->signature[c->index] != SD_BUS_TYPE_DICT_ENTRY_BEGIN ||
+            !startswith(c->signature + c->index + 1, contents) ||
+            c->signature[c->index + 1 + l] != SD_BUS_TYPE_DICT_ENTRY_END)
+                return -ENXIO;
+
+        p = message_extend_body(m, 8, size);
+        if (!p)
+                return -ENOMEM;
+
+        memcpy_safe(p, data, size);
+        return 0;
+}
+#endif // 1
+
 _public_ int sd_bus_message_close_container(sd_bus_message *m) {
         struct bus_container *c;
 
@@ -1870,6 +2144,10 @@ _public_ int sd_bus_message_appendv(
         unsigned n_array, n_struct;
         TypeStack stack[BUS_CONTAINER_DEPTH];
         unsigned stack_ptr = 0;
+#if 1 /// elogind: see bus-signature-cache.c
+        _cleanup_(bus_signature_unrefp) BusSignature *sig = NULL;
+        const BusSignatureOp *op;
+#endif // 1
         int r;
 
         assert_return(m, -EINVAL);
@@ -1877,6 +2155,14 @@ _public_ int sd_bus_message_appendv(
         assert_return(!m->sealed, -EPERM);
         assert_return(!m->poisoned, -ESTALE);
 
+#if 1 /// elogind: see bus-signature-cache.c
+        if (m->bus) {
+                sig = bus_signature_cache_get(m->bus, types);
+                if (sig)
+                        types = sig->signature;
+        }
+#endif // 1
+
         n_array = UINT_MAX;
         n_struct = strlen(types);
 
@@ -1968,6 +2254,7 @@ _public_ int sd_bus_message_appendv(
                 case SD_BUS_TYPE_ARRAY: {
                         size_t k;
 
+#if 0 /// elogind: containers of compiled signatures are opened directly, see bus-signature-cache.c
                         r = signature_element_length(t + 1, &k);
                         if (r < 0)
                                 return r;
@@ -1981,6 +2268,28 @@ _public_ int sd_bus_message_appendv(
                                 if (r < 0)
                                         return r;
                         }
+#else // 0
+                        op = bus_signature_op(sig, t);
+                        if (op) {
+                                k = op->length - 1;
+
+                                r = message_open_container(m, SD_BUS_TYPE_ARRAY, op->contents, true);
+                                if (r < 0)
+                                        return r;
+                        } else {
+                                r = signature_element_length(t + 1, &k);
+                                if (r < 0)
+                                        return r;
+
+                                char s[k + 1];
+                                memcpy(s, t + 1, k);
+                                s[k] = 0;
+
+                                r = message_open_container(m, SD_BUS_TYPE_ARRAY, s, false);
+                                if (r < 0)
+                                        return r;
+                        }
+#endif // 0
 
                         if (n_array == UINT_MAX) {
                                 types += k;
@@ -2024,6 +2333,7 @@ _public_ int sd_bus_message_appendv(
                 case SD_BUS_TYPE_DICT_ENTRY_BEGIN: {
                         size_t k;
 
+#if 0 /// elogind: containers of compiled signatures are opened directly, see bus-signature-cache.c
                         r = signature_element_length(t, &k);
                         if (r < 0)
                                 return r;
@@ -2040,6 +2350,31 @@ _public_ int sd_bus_message_appendv(
                                 if (r < 0)
                                         return r;
                         }
+#else // 0
+                        op = bus_signature_op(sig, t);
+                        if (op) {
+                                k = op->length;
+
+                                r = message_open_container(m, *t == SD_BUS_TYPE_STRUCT_BEGIN ? SD_BUS_TYPE_STRUCT : SD_BUS_TYPE_DICT_ENTRY, op->contents, true);
+                                if (r < 0)
+                                        return r;
+                        } else {
+                                r = signature_element_length(t, &k);
+                                if (r < 0)
+                                        return r;
+                                if (k < 2)
+                                        return -ERANGE;
+
+                                char s[k - 1];
+
+                                memcpy(s, t + 1, k - 2);
+                                s[k - 2] = 0;
+
+                                r = message_open_container(m, *t == SD_BUS_TYPE_STRUCT_BEGIN ? SD_BUS_TYPE_STRUCT : SD_BUS_TYPE_DICT_ENTRY, s, false);
+                                if (r < 0)
+                                        return r;
+                        }
+#endif // 0
 
                         if (n_array == UINT_MAX) {
                                 types += k - 1;
@@ -2377,6 +2712,79 @@ static int bus_message_close_header(sd_bus_message *m) {
         return 0;
 }
 
+#if 1 /// elogind: pass large bodies as sealed memfd to peers that agreed to it
+static int message_body_to_memfd(sd_bus_message *m) {
+        _cleanup_close_ int fd = -EBADF;
+        struct bus_body_part *part;
+        unsigned i;
+        size_t psz;
+        void *p;
+        int *f, r;
+
+        assert(m);
+
+        /* Copies the body into a sealed memfd, which is passed as last fd of the message, so that the peer
+         * maps the body instead of reading it through the socket. Only done for bodies large enough to make
+         * this pay off. Sensitive bodies are always sent inline, as a sealed memfd cannot be erased. */
+
+        if (!m->bus || !m->bus->can_memfd)
+                return 0;
+
+        if (m->body_size < MEMFD_MIN_SIZE || m->sensitive || m->n_fds >= BUS_FDS_MAX)
+                return 0;
+
+        fd = memfd_new("sd-bus-body");
+        if (fd < 0)
+                return fd;
+
+        MESSAGE_FOREACH_PART(part, i, m) {
+                r = bus_body_part_map(part);
+                if (r < 0)
+                        return r;
+
+                r = loop_write(fd, part->data, part->size);
+                if (r < 0)
+                        return r;
+        }
+
+        r = memfd_set_sealed(fd);
+        if (r < 0)
+                return r;
+
+        psz = PAGE_ALIGN(m->body_size);
+        p = mmap(NULL, psz, PROT_READ, MAP_PRIVATE, fd, 0);
+        if (p == MAP_FAILED)
+                return -errno;
+
+        f = reallocarray(m->fds, m->n_fds + 1, sizeof(int));
+        if (!f) {
+                (void) munmap(p, psz);
+                return -ENOMEM;
+        }
+
+        m->fds = f;
+        m->fds[m->n_fds++] = TAKE_FD(fd);
+        m->free_fds = true;
+
+        /* From now on the body is served from the memfd, on our side too */
+        message_reset_parts(m);
+        m->n_body_parts = 1;
+        m->body = (struct bus_body_part) {
+                .data = p,
+                .size = m->body_size,
+                .mapped = psz,
+                .mmap_begin = p,
+                .munmap_this = true,
+                .sealed = true,
+                .memfd = -EBADF,
+        };
+        m->body_end = &m->body;
+
+        m->header->flags |= BUS_MESSAGE_BODY_MEMFD;
+        return 1;
+}
+#endif // 1
+
 _public_ int sd_bus_message_seal(sd_bus_message *m, uint64_t cookie, uint64_t timeout_usec) {
         struct bus_body_part *part;
         size_t a;
@@ -2411,6 +2819,12 @@ _public_ int sd_bus_message_seal(sd_bus_message *m, uint64_t cookie, uint64_t ti
                         return r;
         }
 
+#if 1 /// elogind: this adds an fd, hence must happen before the fds are counted
+        r = message_body_to_memfd(m);
+        if (r < 0)
+                return r;
+#endif // 1
+
         if (m->n_fds > 0) {
                 r = message_append_field_uint32(m, BUS_MESSAGE_HEADER_UNIX_FDS, m->n_fds);
                 if (r < 0)
@@ -2858,7 +3272,12 @@ static int bus_message_enter_array(
                 sd_bus_message *m,
                 struct bus_container *c,
                 const char *contents,
+#if 0 /// elogind skips validating contents taken from a compiled signature, see bus-signature-cache.c
                 uint32_t **array_size) {
+#else // 0
+                uint32_t **array_size,
+                bool trusted) {
+#endif // 0
 
         size_t rindex;
         void *q;
@@ -2869,7 +3288,11 @@ static int bus_message_enter_array(
         assert(contents);
         assert(array_size);
 
+#if 0 /// elogind skips validating contents taken from a compiled signature, see bus-signature-cache.c
         if (!signature_is_single(contents, true))
+#else // 0
+        if (!trusted && !signature_is_single(contents, true))
+#endif // 0
                 return -EINVAL;
 
         if (!c->signature || c->signature[c->index] == 0)
@@ -2966,7 +3389,12 @@ static int bus_message_enter_variant(
 static int bus_message_enter_struct(
                 sd_bus_message *m,
                 struct bus_container *c,
+#if 0 /// elogind skips validating contents taken from a compiled signature, see bus-signature-cache.c
                 const char *contents) {
+#else // 0
+                const char *contents,
+                bool trusted) {
+#endif // 0
 
         size_t l;
         int r;
@@ -2975,7 +3403,11 @@ static int bus_message_enter_struct(
         assert(c);
         assert(contents);
 
+#if 0 /// elogind skips validating contents taken from a compiled signature, see bus-signature-cache.c
         if (!signature_is_valid(contents, false))
+#else // 0
+        if (!trusted && !signature_is_valid(contents, false))
+#endif // 0
                 return -EINVAL;
 
         if (!c->signature || c->signature[c->index] == 0)
@@ -3001,7 +3433,12 @@ static int bus_message_enter_struct(
 static int bus_message_enter_dict_entry(
                 sd_bus_message *m,
                 struct bus_container *c,
+#if 0 /// elogind skips validating contents taken from a compiled signature, see bus-signature-cache.c
                 const char *contents) {
+#else // 0
+                const char *contents,
+                bool trusted) {
+#endif // 0
 
         size_t l;
         int r;
@@ -3010,7 +3447,11 @@ static int bus_message_enter_dict_entry(
         assert(c);
         assert(contents);
 
+#if 0 /// elogind skips validating contents taken from a compiled signature, see bus-signature-cache.c
         if (!signature_is_pair(contents))
+#else // 0
+        if (!trusted && !signature_is_pair(contents))
+#endif // 0
                 return -EINVAL;
 
         if (c->enclosing != SD_BUS_TYPE_ARRAY)
@@ -3036,9 +3477,16 @@ static int bus_message_enter_dict_entry(
         return 1;
 }
 
+#if 0 /// elogind: sd_bus_message_readv() enters containers of compiled signatures without validating them again
 _public_ int sd_bus_message_enter_container(sd_bus_message *m,
                                             char type,
                                             const char *contents) {
+#else // 0
+static int message_enter_container(sd_bus_message *m,
+                                   char type,
+                                   const char *contents,
+                                   bool trusted) {
+#endif // 0
         struct bus_container *c;
         uint32_t *array_size = NULL;
         _cleanup_free_ char *signature = NULL;
@@ -3105,6 +3553,7 @@ _public_ int sd_bus_message_enter_container(sd_bus_message *m,
         c->saved_index = c->index;
         before = m->rindex;
 
+#if 0 /// elogind: see message_enter_container()
         if (type == SD_BUS_TYPE_ARRAY)
                 r = bus_message_enter_array(m, c, contents, &array_size);
         else if (type == SD_BUS_TYPE_VARIANT)
@@ -3113,6 +3562,16 @@ _public_ int sd_bus_message_enter_container(sd_bus_message *m,
                 r = bus_message_enter_struct(m, c, contents);
         else if (type == SD_BUS_TYPE_DICT_ENTRY)
                 r = bus_message_enter_dict_entry(m, c, contents);
+#else // 0
+        if (type == SD_BUS_TYPE_ARRAY)
+                r = bus_message_enter_array(m, c, contents, &array_size, trusted);
+        else if (type == SD_BUS_TYPE_VARIANT)
+                r = bus_message_enter_variant(m, c, contents);
+        else if (type == SD_BUS_TYPE_STRUCT)
+                r = bus_message_enter_struct(m, c, contents, trusted);
+        else if (type == SD_BUS_TYPE_DICT_ENTRY)
+                r = bus_message_enter_dict_entry(m, c, contents, trusted);
+#endif // 0
         else
                 r = -EINVAL;
         if (r <= 0)
@@ -3133,6 +3592,15 @@ _public_ int sd_bus_message_enter_container(sd_bus_message *m,
         return 1;
 }
 
+#if 1 /// elogind: see message_enter_container()
+_public_ int sd_bus_message_enter_container(sd_bus_message *m,
+                                            char type,
+                                            const char *contents) {
+
+        return message_enter_container(m, type, contents, false);
+}
+#endif // 1
+
 _public_ int sd_bus_message_exit_container(sd_bus_message *m) {
         struct bus_container *c;
 
@@ -3323,6 +3791,10 @@ _public_ int sd_bus_message_readv(
         TypeStack stack[BUS_CONTAINER_DEPTH];
         unsigned stack_ptr = 0;
         unsigned n_loop = 0;
+#if 1 /// elogind: see bus-signature-cache.c
+        _cleanup_(bus_signature_unrefp) BusSignature *sig = NULL;
+        const BusSignatureOp *op;
+#endif // 1
         int r;
 
         assert_return(m, -EINVAL);
@@ -3332,6 +3804,14 @@ _public_ int sd_bus_message_readv(
         if (isempty(types))
                 return 0;
 
+#if 1 /// elogind: see bus-signature-cache.c
+        if (m->bus) {
+                sig = bus_signature_cache_get(m->bus, types);
+                if (sig)
+                        types = sig->signature;
+        }
+#endif // 1
+
         /* Ideally, we'd just call ourselves recursively on every
          * complex type. However, the state of a va_list that is
          * passed to a function is undefined after that function
@@ -3403,6 +3883,7 @@ _public_ int sd_bus_message_readv(
                 case SD_BUS_TYPE_ARRAY: {
                         size_t k;
 
+#if 0 /// elogind: containers of compiled signatures are entered directly, see bus-signature-cache.c
                         r = signature_element_length(t + 1, &k);
                         if (r < 0)
                                 return r;
@@ -3422,6 +3903,32 @@ _public_ int sd_bus_message_readv(
                                         return -ENXIO;
                                 }
                         }
+#else // 0
+                        op = bus_signature_op(sig, t);
+                        if (op) {
+                                k = op->length - 1;
+
+                                r = message_enter_container(m, SD_BUS_TYPE_ARRAY, op->contents, true);
+                        } else {
+                                r = signature_element_length(t + 1, &k);
+                                if (r < 0)
+                                        return r;
+
+                                char s[k + 1];
+                                memcpy(s, t + 1, k);
+                                s[k] = 0;
+
+                                r = message_enter_container(m, SD_BUS_TYPE_ARRAY, s, false);
+                        }
+                        if (r < 0)
+                                return r;
+                        if (r == 0) {
+                                if (n_loop <= 1)
+                                        return 0;
+
+                                return -ENXIO;
+                        }
+#endif // 0
 
                         if (n_array == UINT_MAX) {
                                 types += k;
@@ -3471,6 +3978,7 @@ _public_ int sd_bus_message_readv(
                 case SD_BUS_TYPE_DICT_ENTRY_BEGIN: {
                         size_t k;
 
+#if 0 /// elogind: containers of compiled signatures are entered directly, see bus-signature-cache.c
                         r = signature_element_length(t, &k);
                         if (r < 0)
                                 return r;
@@ -3491,6 +3999,33 @@ _public_ int sd_bus_message_readv(
                                         return -ENXIO;
                                 }
                         }
+#else // 0
+                        op = bus_signature_op(sig, t);
+                        if (op) {
+                                k = op->length;
+
+                                r = message_enter_container(m, *t == SD_BUS_TYPE_STRUCT_BEGIN ? SD_BUS_TYPE_STRUCT : SD_BUS_TYPE_DICT_ENTRY, op->contents, true);
+                        } else {
+                                r = signature_element_length(t, &k);
+                                if (r < 0)
+                                        return r;
+                                if (k < 2)
+                                        return -ERANGE;
+
+                                char s[k - 1];
+                                memcpy(s, t + 1, k - 2);
+                                s[k - 2] = 0;
+
+                                r = message_enter_container(m, *t == SD_BUS_TYPE_STRUCT_BEGIN ? SD_BUS_TYPE_STRUCT : SD_BUS_TYPE_DICT_ENTRY, s, false);
+                        }
+                        if (r < 0)
+                                return r;
+                        if (r == 0) {
+                                if (n_loop <= 1)
+                                        return 0;
+                                return -ENXIO;
+                        }
+#endif // 0
 
                         if (n_array == UINT_MAX) {
                                 types += k - 1;
@@ -4265,7 +4800,6 @@ _public_ int sd_bus_message_set_sender(sd_bus_message *m, const char *sender) {
         return message_append_field_string(m, BUS_MESSAGE_HEADER_SENDER, SD_BUS_TYPE_STRING, sender, &m->sender);
 }
 
-#if 0 /// UNNEEDED by elogind
 int bus_message_get_blob(sd_bus_message *m, void **buffer, size_t *sz) {
         size_t total;
         void *p, *e;
@@ -4293,7 +4827,6 @@ int bus_message_get_blob(sd_bus_message *m, void **buffer, size_t *sz) {
 
         return 0;
 }
-#endif // 0
 
 _public_ int sd_bus_message_read_strv_extend(sd_bus_message *m, char ***l) {
         char type;
@@ -55,6 +55,9 @@ struct sd_bus_message {
         unsigned n_queued;  /* Counter of references that do not pin the connection */
 
         sd_bus *bus;
+#if 1 /// elogind: messages are recycled per connection, see bus-message-pool.c
+        struct BusMessagePool *pool; /* The pool this message and its body parts came from, if any */
+#endif // 1
 
         uint64_t reply_cookie;
 
@@ -113,6 +116,11 @@ struct sd_bus_message {
          * from the vtable data */
         const char *enforced_reply_signature;
 
+#if 1 /// elogind: method call latency statistics, see bus_stats_record_sent()
+        struct BusStatsEntry *stats_entry;
+        usec_t stats_begin;
+#endif // 1
+
         usec_t timeout;
 
         size_t header_offsets[_BUS_MESSAGE_HEADER_MAX];
@@ -141,11 +149,21 @@ static inline uint64_t BUS_MESSAGE_COOKIE(sd_bus_message *m) {
         return BUS_MESSAGE_BSWAP32(m, m->header->serial);
 }
 
+#if 1 /// elogind: the body may be passed as sealed memfd instead of inline, see message_body_to_memfd()
+static inline bool BUS_MESSAGE_BODY_IN_MEMFD(sd_bus_message *m) {
+        return m->header->flags & BUS_MESSAGE_BODY_MEMFD;
+}
+#endif // 1
+
 static inline size_t BUS_MESSAGE_SIZE(sd_bus_message *m) {
         return
                 sizeof(struct bus_header) +
                 ALIGN8(m->fields_size) +
+#if 0 /// elogind: a body passed as memfd is not part of the byte stream
                 m->body_size;
+#else // 0
+                (BUS_MESSAGE_BODY_IN_MEMFD(m) ? 0 : m->body_size);
+#endif // 0
 }
 
 static inline size_t BUS_MESSAGE_BODY_BEGIN(sd_bus_message *m) {
@@ -159,9 +177,7 @@ static inline void* BUS_MESSAGE_FIELDS(sd_bus_message *m) {
 }
 
 
-#if 0 /// UNNEEDED by elogind
 int bus_message_get_blob(sd_bus_message *m, void **buffer, size_t *sz);
-#endif // 0
 
 int bus_message_from_malloc(
                 sd_bus *bus,
@@ -192,3 +208,8 @@ sd_bus_message* bus_message_ref_queued(sd_bus_message *m, sd_bus *bus);
 sd_bus_message* bus_message_unref_queued(sd_bus_message *m, sd_bus *bus);
 
 char** bus_message_make_log_fields(sd_bus_message *m);
+
+#if 1 /// elogind: cached properties are appended as a whole, see bus-property-cache.c
+int bus_message_peek_body(sd_bus_message *m, size_t begin, const void **ret, size_t *ret_size);
+int bus_message_append_dict_entry_raw(sd_bus_message *m, const char *contents, const void *data, size_t size);
+#endif // 1
@@ -11,6 +11,9 @@
 #include "missing_capability.h"
 #include "string-util.h"
 #include "strv.h"
+/// Additional includes needed by elogind
+#include "bus-property-cache.h"
+#include "bus-property-defer.h"
 
 static int node_vtable_get_userdata(
                 sd_bus *bus,
@@ -395,6 +398,15 @@ static int method_callbacks_run(
          * reply. */
         m->enforced_reply_signature = strempty(c->vtable->x.method.result);
 
+#if 1 /// elogind: per-connection statistics, sending the reply completes the measurement
+        /* Calls dispatched again after an asynchronous polkit check keep their original start time */
+        if (!m->stats_entry) {
+                m->stats_entry = bus_stats_get_entry(bus, BUS_STATS_METHOD, c->interface, c->member);
+                if (m->stats_entry)
+                        m->stats_begin = now(CLOCK_MONOTONIC);
+        }
+#endif // 1
+
         if (c->vtable->x.method.handler) {
                 sd_bus_slot *slot;
 
@@ -442,6 +454,15 @@ static int invoke_property_get(
         assert(reply);
 
         if (v->x.property.get) {
+#if 1 /// elogind: per-connection statistics, see bus-stats.c
+                BusStatsEntry *e = bus_stats_get_entry(bus, BUS_STATS_PROPERTY, interface, property);
+                usec_t begin = e ? now(CLOCK_MONOTONIC) : 0;
+#endif // 1
+
+#if 1 /// elogind: property reads may be deferred, see bus-property-defer.c
+                bus->property_defer_allowed = FLAGS_SET(v->flags, SD_BUS_VTABLE_PROPERTY_ASYNC) &&
+                        bus_property_defer_possible(bus, reply);
+#endif // 1
 
                 bus->current_slot = sd_bus_slot_ref(slot);
                 bus->current_userdata = userdata;
@@ -449,6 +470,16 @@ static int invoke_property_get(
                 bus->current_userdata = NULL;
                 bus->current_slot = sd_bus_slot_unref(slot);
 
+#if 1 /// elogind: property reads may be deferred, see bus-property-defer.c
+                bus->property_defer_allowed = false;
+#endif // 1
+
+#if 1 /// elogind: per-connection statistics, see bus-stats.c
+                if (e)
+                        bus_stats_entry_record(e, usec_sub_unsigned(now(CLOCK_MONOTONIC), begin),
+                                               r < 0 || sd_bus_error_is_set(error));
+#endif // 1
+
                 if (r < 0)
                         return r;
                 if (sd_bus_error_is_set(error))
@@ -627,6 +658,11 @@ static int property_get_set_callbacks_run(
                 if (r < 0)
                         return bus_maybe_reply_error(m, r, &error);
 
+#if 1 /// elogind: the reply is generated again once the read is resumed, see bus-property-defer.c
+                if (bus->property_deferred)
+                        return 1;
+#endif // 1
+
                 if (bus->nodes_modified)
                         return 0;
 
@@ -670,6 +706,10 @@ static int property_get_set_callbacks_run(
                 if (r < 0)
                         return bus_maybe_reply_error(m, r, &error);
 
+#if 1 /// elogind: properties may be served from a cache, see bus-property-cache.c
+                bus_property_cache_invalidate(bus, m->path, c->interface, STRV_MAKE(c->member));
+#endif // 1
+
                 r = invoke_property_set(bus, slot, c->vtable, m->path, c->interface, c->member, m, u, &error);
                 if (r < 0)
                         return bus_maybe_reply_error(m, r, &error);
@@ -689,6 +729,42 @@ static int property_get_set_callbacks_run(
         return 1;
 }
 
+#if 1 /// elogind: properties may be served from a cache, see bus-property-cache.c
+static bool vtable_property_is_cached(const struct node_vtable *c, const sd_bus_vtable *v) {
+        assert(c);
+        assert(v);
+
+        return FLAGS_SET(v->flags, SD_BUS_VTABLE_PROPERTY_CACHED) &&
+                (v->flags & (SD_BUS_VTABLE_PROPERTY_CONST|SD_BUS_VTABLE_PROPERTY_EMITS_CHANGE)) &&
+                !FLAGS_SET(c->vtable->flags, SD_BUS_VTABLE_SENSITIVE);
+}
+
+static bool node_vtable_resolves_without_caller(sd_bus *bus, const char *path, struct node_vtable *c, void *userdata) {
+        sd_bus_message *m;
+        void *u = NULL;
+        int r;
+
+        assert(bus);
+        assert(path);
+        assert(c);
+
+        /* The cache is keyed by path. A find callback may resolve a path differently depending on the
+         * caller though, think of logind's /org/freedesktop/login1/session/self. Hence only use the cache
+         * for paths that resolve to the same object without a caller, like they do when PropertiesChanged
+         * is emitted for them. */
+
+        if (!c->find)
+                return true;
+
+        m = bus->current_message;
+        bus->current_message = NULL;
+        r = node_vtable_get_userdata(bus, path, c, &u, NULL);
+        bus->current_message = m;
+
+        return r > 0 && u == userdata;
+}
+#endif // 1
+
 static int vtable_append_one_property(
                 sd_bus *bus,
                 sd_bus_message *reply,
@@ -700,6 +776,10 @@ static int vtable_append_one_property(
 
         sd_bus_slot *slot;
         int r;
+#if 1 /// elogind: properties may be served from a cache, see bus-property-cache.c
+        bool cached;
+        size_t begin;
+#endif // 1
 
         assert(bus);
         assert(reply);
@@ -713,10 +793,26 @@ static int vtable_append_one_property(
                         return r;
         }
 
+#if 1 /// elogind: properties may be served from a cache, see bus-property-cache.c
+        cached = vtable_property_is_cached(c, v) && node_vtable_resolves_without_caller(bus, path, c, userdata);
+        if (cached) {
+                r = bus_property_cache_append(bus, reply, path, c->interface, v->x.property.member);
+                if (r < 0)
+                        return r;
+                if (r > 0)
+                        return 0;
+        }
+#endif // 1
+
         r = sd_bus_message_open_container(reply, 'e', "sv");
         if (r < 0)
                 return r;
 
+#if 1 /// elogind: properties may be served from a cache, see bus-property-cache.c
+        /* The dict entry starts 8-byte aligned right here */
+        begin = reply->body_size;
+#endif // 1
+
         r = sd_bus_message_append(reply, "s", v->x.property.member);
         if (r < 0)
                 return r;
@@ -730,7 +826,11 @@ static int vtable_append_one_property(
         r = invoke_property_get(bus, slot, v, path, c->interface, v->x.property.member, reply, vtable_property_convert_userdata(v, userdata), error);
         if (r < 0)
                 return r;
+#if 0 /// elogind: property reads may be deferred, see bus-property-defer.c
         if (bus->nodes_modified)
+#else // 0
+        if (bus->nodes_modified || bus->property_deferred)
+#endif // 0
                 return 0;
 
         r = sd_bus_message_close_container(reply);
@@ -741,6 +841,11 @@ static int vtable_append_one_property(
         if (r < 0)
                 return r;
 
+#if 1 /// elogind: properties may be served from a cache, see bus-property-cache.c
+        if (cached)
+                bus_property_cache_put(bus, reply, begin, path, c->interface, v->x.property.member);
+#endif // 1
+
         return 0;
 }
 
@@ -786,7 +891,11 @@ static int vtable_append_all_properties(
                 r = vtable_append_one_property(bus, reply, path, c, v, userdata, error);
                 if (r < 0)
                         return r;
+#if 0 /// elogind: property reads may be deferred, see bus-property-defer.c
                 if (bus->nodes_modified)
+#else // 0
+                if (bus->nodes_modified || bus->property_deferred)
+#endif // 0
                         return 0;
         }
 
@@ -846,6 +955,10 @@ static int property_get_all_callbacks_run(
                 r = vtable_append_all_properties(bus, reply, m->path, c, u, &error);
                 if (r < 0)
                         return bus_maybe_reply_error(m, r, &error);
+#if 1 /// elogind: the reply is generated again once the read is resumed, see bus-property-defer.c
+                if (bus->property_deferred)
+                        return 1;
+#endif // 1
                 if (bus->nodes_modified)
                         return 0;
         }
@@ -1433,6 +1546,10 @@ int bus_process_object(sd_bus *bus, sd_bus_message *m) {
         if (!prefix)
                 return -ENOMEM;
 
+#if 1 /// elogind: property reads may be deferred, see bus-property-defer.c
+        bus->property_deferred = false;
+#endif // 1
+
         do {
                 bus->nodes_modified = false;
 
@@ -1875,7 +1992,11 @@ static int add_object_vtable_internal(
                             !names_are_valid(strempty(v->x.method.signature), &names, &nf) ||
                             !names_are_valid(strempty(v->x.method.result), &names, &nf) ||
                             !(v->x.method.handler || (isempty(v->x.method.signature) && isempty(v->x.method.result))) ||
+#if 0 /// elogind: SD_BUS_VTABLE_PROPERTY_CACHED and SD_BUS_VTABLE_PROPERTY_ASYNC are property flags, too
                             v->flags & (SD_BUS_VTABLE_PROPERTY_CONST|SD_BUS_VTABLE_PROPERTY_EMITS_CHANGE|SD_BUS_VTABLE_PROPERTY_EMITS_INVALIDATION)) {
+#else // 0
+                            v->flags & (SD_BUS_VTABLE_PROPERTY_CONST|SD_BUS_VTABLE_PROPERTY_EMITS_CHANGE|SD_BUS_VTABLE_PROPERTY_EMITS_INVALIDATION|SD_BUS_VTABLE_PROPERTY_CACHED|SD_BUS_VTABLE_PROPERTY_ASYNC)) {
+#endif // 0
                                 r = -EINVAL;
                                 goto fail;
                         }
@@ -1923,6 +2044,12 @@ static int add_object_vtable_internal(
                             (v->flags & SD_BUS_VTABLE_METHOD_NO_REPLY) ||
                             (!!(v->flags & SD_BUS_VTABLE_PROPERTY_CONST) + !!(v->flags & SD_BUS_VTABLE_PROPERTY_EMITS_CHANGE) + !!(v->flags & SD_BUS_VTABLE_PROPERTY_EMITS_INVALIDATION)) > 1 ||
                             ((v->flags & SD_BUS_VTABLE_PROPERTY_EMITS_CHANGE) && (v->flags & SD_BUS_VTABLE_PROPERTY_EXPLICIT)) ||
+#if 1 /// elogind: only properties that announce their changes may be cached
+                            ((v->flags & SD_BUS_VTABLE_PROPERTY_CACHED) && !(v->flags & (SD_BUS_VTABLE_PROPERTY_CONST|SD_BUS_VTABLE_PROPERTY_EMITS_CHANGE))) ||
+#endif // 1
+#if 1 /// elogind: only getters may defer reads, and a deferred value cannot be cached
+                            ((v->flags & SD_BUS_VTABLE_PROPERTY_ASYNC) && (!v->x.property.get || (v->flags & SD_BUS_VTABLE_PROPERTY_CACHED))) ||
+#endif // 1
                             (v->flags & SD_BUS_VTABLE_UNPRIVILEGED && v->type == _SD_BUS_VTABLE_PROPERTY)) {
                                 r = -EINVAL;
                                 goto fail;
@@ -1958,7 +2085,11 @@ static int add_object_vtable_internal(
                         if (!member_name_is_valid(v->x.signal.member) ||
                             !signature_is_valid(strempty(v->x.signal.signature), false) ||
                             !names_are_valid(strempty(v->x.signal.signature), &names, &nf) ||
+#if 0 /// elogind: SD_BUS_VTABLE_PROPERTY_CACHED and SD_BUS_VTABLE_PROPERTY_ASYNC are property flags
                             v->flags & SD_BUS_VTABLE_UNPRIVILEGED) {
+#else // 0
+                            v->flags & (SD_BUS_VTABLE_UNPRIVILEGED|SD_BUS_VTABLE_PROPERTY_CACHED|SD_BUS_VTABLE_PROPERTY_ASYNC)) {
+#endif // 0
                                 r = -EINVAL;
                                 goto fail;
                         }
@@ -2292,6 +2423,10 @@ _public_ int sd_bus_emit_properties_changed_strv(
         if (names && names[0] == NULL)
                 return 0;
 
+#if 1 /// elogind: the values emitted now replace what was cached, see bus-property-cache.c
+        bus_property_cache_invalidate(bus, path, interface, names);
+#endif // 1
+
         BUS_DONT_DESTROY(bus);
 
         pl = strlen(path);
@@ -2528,6 +2663,10 @@ _public_ int sd_bus_emit_object_added(sd_bus *bus, const char *path) {
         if (!BUS_IS_OPEN(bus->state))
                 return -ENOTCONN;
 
+#if 1 /// elogind: properties may be served from a cache, see bus-property-cache.c
+        bus_property_cache_invalidate(bus, path, NULL, NULL);
+#endif // 1
+
         bool path_has_object_manager = false;
         r = bus_find_parent_object_manager(bus, &object_manager, path, &path_has_object_manager);
         if (r < 0)
@@ -2708,6 +2847,10 @@ _public_ int sd_bus_emit_object_removed(sd_bus *bus, const char *path) {
         if (!BUS_IS_OPEN(bus->state))
                 return -ENOTCONN;
 
+#if 1 /// elogind: properties may be served from a cache, see bus-property-cache.c
+        bus_property_cache_invalidate(bus, path, NULL, NULL);
+#endif // 1
+
         bool path_has_object_manager = false;
         r = bus_find_parent_object_manager(bus, &object_manager, path, &path_has_object_manager);
         if (r < 0)
@@ -2867,6 +3010,11 @@ _public_ int sd_bus_emit_interfaces_added_strv(sd_bus *bus, const char *path, ch
         if (!BUS_IS_OPEN(bus->state))
                 return -ENOTCONN;
 
+#if 1 /// elogind: properties may be served from a cache, see bus-property-cache.c
+        STRV_FOREACH(i, interfaces)
+                bus_property_cache_invalidate(bus, path, *i, NULL);
+#endif // 1
+
         if (strv_isempty(interfaces))
                 return 0;
 
@@ -2955,6 +3103,11 @@ _public_ int sd_bus_emit_interfaces_removed_strv(sd_bus *bus, const char *path,
         if (!BUS_IS_OPEN(bus->state))
                 return -ENOTCONN;
 
+#if 1 /// elogind: properties may be served from a cache, see bus-property-cache.c
+        STRV_FOREACH(i, interfaces)
+                bus_property_cache_invalidate(bus, path, *i, NULL);
+#endif // 1
+
         if (strv_isempty(interfaces))
                 return 0;
 
@@ -3031,3 +3184,16 @@ fail:
 
         return r;
 }
+
+#if 1 /// elogind: properties may be served from a cache, see bus-property-cache.c
+_public_ int sd_bus_invalidate_property_cache(sd_bus *bus, const char *path, const char *interface) {
+        assert_return(bus, -EINVAL);
+        assert_return(bus = bus_resolve(bus), -ENOPKG);
+        assert_return(object_path_is_valid(path), -EINVAL);
+        assert_return(!interface || interface_name_is_valid(interface), -EINVAL);
+        assert_return(!bus_origin_changed(bus), -ECHILD);
+
+        bus_property_cache_invalidate(bus, path, interface, NULL);
+        return 0;
+}
+#endif // 1
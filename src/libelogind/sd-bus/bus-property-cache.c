@@ -0,0 +1,246 @@
+/* SPDX-License-Identifier: LGPL-2.1-or-later */
+
+#include "alloc-util.h"
+#include "bus-internal.h"
+#include "bus-message.h"
+#include "bus-property-cache.h"
+#include "hashmap.h"
+#include "string-util.h"
+#include "strv.h"
+
+/* Properties flagged with SD_BUS_VTABLE_PROPERTY_CACHED are kept here in serialized form, as the complete
+ * "{sv}" dict entry that was generated the last time the property was read or emitted. As dict entries
+ * are always 8-byte aligned, such an entry can be copied verbatim into any later GetAll() reply,
+ * GetManagedObjects() reply or InterfacesAdded signal, without invoking the getter again. Entries are
+ * dropped whenever PropertiesChanged is emitted for them, the property is set, or the object is announced
+ * as added or removed. The cache is keyed by object path first, so that dropping an object is cheap. Paths
+ * that resolve to a different object depending on the caller are never cached, see bus-objects.c. */
+
+typedef struct PropertyCacheKey {
+        const char *interface;
+        const char *member;
+} PropertyCacheKey;
+
+typedef struct PropertyCacheEntry {
+        PropertyCacheKey key;   /* Points into data[], behind the serialized value */
+        size_t size;
+        uint8_t data[];
+} PropertyCacheEntry;
+
+typedef struct PropertyCacheObject {
+        char *path;
+        Hashmap *entries;       /* PropertyCacheKey → PropertyCacheEntry */
+} PropertyCacheObject;
+
+static void property_cache_key_hash_func(const PropertyCacheKey *k, struct siphash *state) {
+        assert(k);
+
+        string_hash_func(k->interface, state);
+        string_hash_func(k->member, state);
+}
+
+static int property_cache_key_compare_func(const PropertyCacheKey *x, const PropertyCacheKey *y) {
+        int r;
+
+        assert(x);
+        assert(y);
+
+        r = strcmp(x->interface, y->interface);
+        if (r != 0)
+                return r;
+
+        return strcmp(x->member, y->member);
+}
+
+DEFINE_PRIVATE_HASH_OPS_WITH_VALUE_DESTRUCTOR(
+                property_cache_entry_hash_ops,
+                PropertyCacheKey, property_cache_key_hash_func, property_cache_key_compare_func,
+                PropertyCacheEntry, free);
+
+static PropertyCacheObject* property_cache_object_free(PropertyCacheObject *o) {
+        if (!o)
+                return NULL;
+
+        hashmap_free(o->entries);
+        free(o->path);
+        return mfree(o);
+}
+
+DEFINE_TRIVIAL_CLEANUP_FUNC(PropertyCacheObject*, property_cache_object_free);
+
+DEFINE_PRIVATE_HASH_OPS_WITH_VALUE_DESTRUCTOR(
+                property_cache_object_hash_ops,
+                char, string_hash_func, string_compare_func,
+                PropertyCacheObject, property_cache_object_free);
+
+static void property_cache_drop_object(sd_bus *bus, PropertyCacheObject *o) {
+        assert(bus);
+        assert(o);
+
+        assert(bus->n_property_cache_entries >= hashmap_size(o->entries));
+        bus->n_property_cache_entries -= hashmap_size(o->entries);
+
+        hashmap_remove(bus->property_cache, o->path);
+        property_cache_object_free(o);
+}
+
+int bus_property_cache_append(
+                sd_bus *bus,
+                sd_bus_message *m,
+                const char *path,
+                const char *interface,
+                const char *member) {
+
+        PropertyCacheObject *o;
+        PropertyCacheEntry *e;
+        int r;
+
+        assert(bus);
+        assert(m);
+        assert(path);
+        assert(interface);
+        assert(member);
+
+        o = hashmap_get(bus->property_cache, path);
+        if (!o)
+                return 0;
+
+        e = hashmap_get(o->entries, &(const PropertyCacheKey) { interface, member });
+        if (!e)
+                return 0;
+
+        r = bus_message_append_dict_entry_raw(m, "sv", e->data, e->size);
+        if (r < 0)
+                return r;
+
+        return 1;
+}
+
+void bus_property_cache_put(
+                sd_bus *bus,
+                sd_bus_message *m,
+                size_t begin,
+                const char *path,
+                const char *interface,
+                const char *member) {
+
+        _cleanup_(property_cache_object_freep) PropertyCacheObject *new_object = NULL;
+        _cleanup_free_ PropertyCacheEntry *e = NULL;
+        PropertyCacheObject *o;
+        PropertyCacheEntry *old;
+        const void *p;
+        size_t sz, il, ml;
+        char *s;
+        int r;
+
+        assert(bus);
+        assert(m);
+        assert(path);
+        assert(interface);
+        assert(member);
+
+        /* This is purely an optimization, hence all errors are ignored here */
+
+        if (m->sensitive)
+                return;
+
+        r = bus_message_peek_body(m, begin, &p, &sz);
+        if (r < 0 || sz == 0)
+                return;
+
+        if (bus->n_property_cache_entries >= BUS_PROPERTY_CACHE_ENTRIES_MAX)
+                bus_property_cache_flush(bus);
+
+        il = strlen(interface);
+        ml = strlen(member);
+
+        e = malloc(offsetof(PropertyCacheEntry, data) + sz + il + 1 + ml + 1);
+        if (!e)
+                return;
+
+        e->size = sz;
+        memcpy(e->data, p, sz);
+        s = (char*) e->data + sz;
+        e->key.interface = memcpy(s, interface, il + 1);
+        e->key.member = memcpy(s + il + 1, member, ml + 1);
+
+        o = hashmap_get(bus->property_cache, path);
+        if (!o) {
+                new_object = new0(PropertyCacheObject, 1);
+                if (!new_object)
+                        return;
+
+                new_object->path = strdup(path);
+                if (!new_object->path)
+                        return;
+
+                if (hashmap_ensure_put(&bus->property_cache, &property_cache_object_hash_ops, new_object->path, new_object) < 0)
+                        return;
+
+                o = TAKE_PTR(new_object);
+        }
+
+        old = hashmap_remove(o->entries, &e->key);
+        if (old) {
+                bus->n_property_cache_entries--;
+                free(old);
+        }
+
+        if (hashmap_ensure_put(&o->entries, &property_cache_entry_hash_ops, &e->key, e) < 0) {
+                if (hashmap_isempty(o->entries))
+                        property_cache_drop_object(bus, o);
+                return;
+        }
+
+        TAKE_PTR(e);
+        bus->n_property_cache_entries++;
+}
+
+void bus_property_cache_invalidate(sd_bus *bus, const char *path, const char *interface, char **members) {
+        PropertyCacheObject *o;
+        PropertyCacheEntry *e;
+
+        assert(bus);
+        assert(path);
+
+        /* Drops the given properties, all properties of the interface if members is NULL, or all properties of
+         * the object if interface is NULL, too. */
+
+        o = hashmap_get(bus->property_cache, path);
+        if (!o)
+                return;
+
+        if (!interface) {
+                property_cache_drop_object(bus, o);
+                return;
+        }
+
+        if (members)
+                STRV_FOREACH(member, members) {
+                        e = hashmap_remove(o->entries, &(const PropertyCacheKey) { interface, *member });
+                        if (!e)
+                                continue;
+
+                        bus->n_property_cache_entries--;
+                        free(e);
+                }
+        else
+                HASHMAP_FOREACH(e, o->entries) {
+                        if (!streq(e->key.interface, interface))
+                                continue;
+
+                        assert_se(hashmap_remove(o->entries, &e->key) == e);
+                        bus->n_property_cache_entries--;
+                        free(e);
+                }
+
+        if (hashmap_isempty(o->entries))
+                property_cache_drop_object(bus, o);
+}
+
+void bus_property_cache_flush(sd_bus *bus) {
+        assert(bus);
+
+        bus->property_cache = hashmap_free(bus->property_cache);
+        bus->n_property_cache_entries = 0;
+}
@@ -0,0 +1,27 @@
+/* SPDX-License-Identifier: LGPL-2.1-or-later */
+#pragma once
+
+#include <stddef.h>
+
+#include "sd-bus.h"
+
+/* Upper bound for the number of properties cached per connection. Once reached, the cache starts over. */
+#define BUS_PROPERTY_CACHE_ENTRIES_MAX 16384U
+
+int bus_property_cache_append(
+                sd_bus *bus,
+                sd_bus_message *m,
+                const char *path,
+                const char *interface,
+                const char *member);
+
+void bus_property_cache_put(
+                sd_bus *bus,
+                sd_bus_message *m,
+                size_t begin,
+                const char *path,
+                const char *interface,
+                const char *member);
+
+void bus_property_cache_invalidate(sd_bus *bus, const char *path, const char *interface, char **members);
+void bus_property_cache_flush(sd_bus *bus);
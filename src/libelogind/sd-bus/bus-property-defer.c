@@ -0,0 +1,187 @@
+/* SPDX-License-Identifier: LGPL-2.1-or-later */
+
+#include "alloc-util.h"
+#include "bus-internal.h"
+#include "bus-message.h"
+#include "bus-property-defer.h"
+#include "hashmap.h"
+#include "string-util.h"
+
+/* Getters of properties flagged with SD_BUS_VTABLE_PROPERTY_ASYNC may decline to provide their value right
+ * away while a Get() or GetAll() call is processed, by calling sd_bus_property_defer(). The reply built so
+ * far is dropped, and the call is remembered here, per sender. Until sd_bus_property_resume() is called for
+ * it, all further method calls of the same sender are held back, so that a peer never sees the replies to
+ * its calls reordered. Once resumed, the deferred call is put back at the front of the read queue, followed
+ * by the held back calls, in the order they were received. The call is then dispatched again, just like
+ * polkit queries re-dispatch the calls they were started for, and the getter is expected to provide the
+ * value it obtained in the meantime. Signals and replies are never held back, since the getter may well be
+ * waiting for one of these. */
+
+typedef struct BusDeferredRead {
+        sd_bus *bus;
+        sd_bus_message *message;
+        sd_bus_message **held;
+        size_t n_held;
+} BusDeferredRead;
+
+static BusDeferredRead* bus_deferred_read_free(BusDeferredRead *d) {
+        if (!d)
+                return NULL;
+
+        /* Like the read queue, we only keep queued references, so that these don't pin the bus */
+        for (size_t i = 0; i < d->n_held; i++)
+                bus_message_unref_queued(d->held[i], d->bus);
+        free(d->held);
+
+        bus_message_unref_queued(d->message, d->bus);
+        return mfree(d);
+}
+
+DEFINE_TRIVIAL_CLEANUP_FUNC(BusDeferredRead*, bus_deferred_read_free);
+
+DEFINE_PRIVATE_HASH_OPS_WITH_VALUE_DESTRUCTOR(
+                bus_deferred_read_hash_ops,
+                char, string_hash_func, string_compare_func,
+                BusDeferredRead, bus_deferred_read_free);
+
+static const char* bus_deferred_read_key(sd_bus_message *m) {
+        assert(m);
+
+        /* On direct connections there is no sender, and all calls come from the same peer */
+        return strempty(m->sender);
+}
+
+bool bus_property_defer_possible(sd_bus *bus, sd_bus_message *reply) {
+        sd_bus_message *m;
+
+        assert(bus);
+        assert(reply);
+
+        /* Only replies to Get() and GetAll() calls currently being dispatched may be deferred, everything
+         * else (signals, GetManagedObjects() replies, …) needs the value right away. */
+
+        m = bus->current_message;
+        if (!m)
+                return false;
+
+        if (reply->header->type != SD_BUS_MESSAGE_METHOD_RETURN ||
+            reply->reply_cookie != BUS_MESSAGE_COOKIE(m))
+                return false;
+
+        return sd_bus_message_is_method_call(m, "org.freedesktop.DBus.Properties", "Get") > 0 ||
+                sd_bus_message_is_method_call(m, "org.freedesktop.DBus.Properties", "GetAll") > 0;
+}
+
+int bus_property_defer_hold(sd_bus *bus, sd_bus_message *m) {
+        BusDeferredRead *d;
+
+        assert(bus);
+        assert(m);
+
+        if (m->header->type != SD_BUS_MESSAGE_METHOD_CALL)
+                return 0;
+
+        d = hashmap_get(bus->deferred_reads, bus_deferred_read_key(m));
+        if (!d || d->message == m)
+                return 0;
+
+        if (!GREEDY_REALLOC(d->held, d->n_held + 1))
+                return -ENOMEM;
+
+        d->held[d->n_held++] = bus_message_ref_queued(m, bus);
+
+        log_debug("Holding back call %s.%s() from %s until property read is resumed.",
+                  strna(m->interface), strna(m->member), strna(m->sender));
+        return 1;
+}
+
+void bus_property_defer_flush(sd_bus *bus) {
+        assert(bus);
+
+        bus->deferred_reads = hashmap_free(bus->deferred_reads);
+}
+
+_public_ int sd_bus_property_defer(sd_bus_message *reply, sd_bus_message **ret_call) {
+        _cleanup_(bus_deferred_read_freep) BusDeferredRead *d = NULL;
+        sd_bus_message *m;
+        sd_bus *bus;
+        int r;
+
+        assert_return(reply, -EINVAL);
+        assert_return(ret_call, -EINVAL);
+
+        bus = reply->bus;
+        assert_return(bus, -ENOTCONN);
+        assert_return(bus = bus_resolve(bus), -ENOPKG);
+        assert_return(!bus_origin_changed(bus), -ECHILD);
+
+        if (!BUS_IS_OPEN(bus->state))
+                return -ENOTCONN;
+
+        /* Not called from an SD_BUS_VTABLE_PROPERTY_ASYNC getter while a Get() or GetAll() call is
+         * dispatched, the caller has to provide the value synchronously. */
+        if (!bus->property_defer_allowed)
+                return -EOPNOTSUPP;
+
+        m = ASSERT_PTR(bus->current_message);
+
+        if (hashmap_contains(bus->deferred_reads, bus_deferred_read_key(m)))
+                return -EBUSY;
+
+        d = new0(BusDeferredRead, 1);
+        if (!d)
+                return -ENOMEM;
+
+        d->bus = bus;
+        d->message = bus_message_ref_queued(m, bus);
+
+        r = hashmap_ensure_put(&bus->deferred_reads, &bus_deferred_read_hash_ops, bus_deferred_read_key(m), d);
+        if (r < 0)
+                return r;
+
+        TAKE_PTR(d);
+
+        bus->property_defer_allowed = false;
+        bus->property_deferred = true;
+
+        *ret_call = sd_bus_message_ref(m);
+        return 1;
+}
+
+_public_ int sd_bus_property_resume(sd_bus_message *call) {
+        BusDeferredRead *d;
+        sd_bus *bus;
+        size_t n;
+
+        assert_return(call, -EINVAL);
+
+        bus = call->bus;
+        assert_return(bus, -ENOTCONN);
+        assert_return(bus = bus_resolve(bus), -ENOPKG);
+        assert_return(!bus_origin_changed(bus), -ECHILD);
+
+        if (!BUS_IS_OPEN(bus->state))
+                return -ENOTCONN;
+
+        d = hashmap_get(bus->deferred_reads, bus_deferred_read_key(call));
+        if (!d || d->message != call)
+                return -ENXIO;
+
+        /* All of these have been counted against BUS_RQUEUE_MAX already when they were read, hence don't
+         * refuse to put them back. */
+        n = 1 + d->n_held;
+        if (!GREEDY_REALLOC(bus->rqueue, bus->rqueue_size + n))
+                return -ENOMEM;
+
+        assert_se(hashmap_remove(bus->deferred_reads, bus_deferred_read_key(call)) == d);
+
+        /* Insert at the very front, the deferred call first */
+        memmove(bus->rqueue + n, bus->rqueue, sizeof(sd_bus_message*) * bus->rqueue_size);
+        bus->rqueue[0] = bus_message_ref_queued(d->message, bus);
+        for (size_t i = 0; i < d->n_held; i++)
+                bus->rqueue[1 + i] = bus_message_ref_queued(d->held[i], bus);
+        bus->rqueue_size += n;
+
+        bus_deferred_read_free(d);
+        return 1;
+}
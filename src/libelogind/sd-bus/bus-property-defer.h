@@ -0,0 +1,10 @@
+/* SPDX-License-Identifier: LGPL-2.1-or-later */
+#pragma once
+
+#include <stdbool.h>
+
+#include "sd-bus.h"
+
+bool bus_property_defer_possible(sd_bus *bus, sd_bus_message *reply);
+int bus_property_defer_hold(sd_bus *bus, sd_bus_message *m);
+void bus_property_defer_flush(sd_bus *bus);
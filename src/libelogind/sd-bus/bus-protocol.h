@@ -40,6 +40,9 @@ enum {
         BUS_MESSAGE_NO_REPLY_EXPECTED               = 1 << 0,
         BUS_MESSAGE_NO_AUTO_START                   = 1 << 1,
         BUS_MESSAGE_ALLOW_INTERACTIVE_AUTHORIZATION = 1 << 2,
+#if 1 /// elogind: private extension, only ever sent to peers that agreed to NEGOTIATE_ELOGIND_MEMFD
+        BUS_MESSAGE_BODY_MEMFD                      = 1 << 7,
+#endif // 1
 };
 
 /* Header fields */
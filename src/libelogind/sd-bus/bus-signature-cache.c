@@ -0,0 +1,172 @@
+/* SPDX-License-Identifier: LGPL-2.1-or-later */
+
+#include <pthread.h>
+
+#include "alloc-util.h"
+#include "bus-internal.h"
+#include "bus-signature.h"
+#include "bus-signature-cache.h"
+#include "string-util.h"
+
+/* sd_bus_message_append() and sd_bus_message_read() are nearly always called with the same few constant
+ * signatures. Instead of determining the length of every complete type each time an array element or struct
+ * is processed, and validating the contents signature again when opening or entering the container, the
+ * signature is compiled once into one op per character, which carries the precomputed length and the
+ * already validated contents of each container. Compiled signatures are kept per connection in a small
+ * direct-mapped table, keyed by the pointer passed in, and a hit is only taken if the string still matches.
+ * Signatures that cannot be compiled are simply processed the regular way.
+ *
+ * Messages may be built or read in another thread than the one owning the connection, hence the table is
+ * protected by a mutex, and each user holds a reference on the compiled signature it walks, so that it stays
+ * valid even if the slot is replaced meanwhile. */
+
+static BusSignature* bus_signature_free(BusSignature *s) {
+        if (!s)
+                return NULL;
+
+        for (size_t i = 0; i < s->length; i++)
+                free(s->ops[i].contents);
+
+        free(s->signature);
+        return mfree(s);
+}
+
+DEFINE_TRIVIAL_CLEANUP_FUNC(BusSignature*, bus_signature_free);
+
+static BusSignature* bus_signature_ref(BusSignature *s) {
+        assert(s);
+
+        __atomic_add_fetch(&s->n_ref, 1, __ATOMIC_RELAXED);
+        return s;
+}
+
+BusSignature* bus_signature_unref(BusSignature *s) {
+        if (!s)
+                return NULL;
+
+        if (__atomic_sub_fetch(&s->n_ref, 1, __ATOMIC_ACQ_REL) > 0)
+                return NULL;
+
+        return bus_signature_free(s);
+}
+
+static int bus_signature_compile_element(BusSignature *s, size_t i, size_t l) {
+        const char *p = s->signature + i;
+        size_t n;
+        int r;
+
+        assert(s);
+        assert(l > 0);
+        assert(i + l <= s->length);
+
+        s->ops[i].type = *p;
+        s->ops[i].length = l;
+
+        switch (*p) {
+
+        case SD_BUS_TYPE_ARRAY:
+                s->ops[i].contents = strndup(p + 1, l - 1);
+                if (!s->ops[i].contents)
+                        return -ENOMEM;
+
+                return bus_signature_compile_element(s, i + 1, l - 1);
+
+        case SD_BUS_TYPE_STRUCT_BEGIN:
+        case SD_BUS_TYPE_DICT_ENTRY_BEGIN:
+                s->ops[i].contents = strndup(p + 1, l - 2);
+                if (!s->ops[i].contents)
+                        return -ENOMEM;
+
+                for (size_t j = i + 1; j < i + l - 1; j += n) {
+                        r = signature_element_length(s->signature + j, &n);
+                        if (r < 0)
+                                return r;
+
+                        r = bus_signature_compile_element(s, j, n);
+                        if (r < 0)
+                                return r;
+                }
+
+                s->ops[i + l - 1].type = s->signature[i + l - 1];
+                return 0;
+
+        default:
+                return 0;
+        }
+}
+
+static int bus_signature_compile(const char *types, BusSignature **ret) {
+        _cleanup_(bus_signature_freep) BusSignature *s = NULL;
+        size_t l, n;
+        int r;
+
+        assert(types);
+        assert(ret);
+
+        l = strlen(types);
+        if (l > SD_BUS_MAXIMUM_SIGNATURE_LENGTH)
+                return -EINVAL;
+
+        s = malloc0(offsetof(BusSignature, ops) + l * sizeof(BusSignatureOp));
+        if (!s)
+                return -ENOMEM;
+
+        s->n_ref = 1;
+        s->key = types;
+        s->length = l;
+        s->signature = strdup(types);
+        if (!s->signature)
+                return -ENOMEM;
+
+        /* signature_element_length() validates each complete type as a whole, nested types included, hence
+         * the contents recorded for each container are valid as well. */
+        for (size_t i = 0; i < l; i += n) {
+                r = signature_element_length(s->signature + i, &n);
+                if (r < 0)
+                        return r;
+
+                r = bus_signature_compile_element(s, i, n);
+                if (r < 0)
+                        return r;
+        }
+
+        *ret = TAKE_PTR(s);
+        return 0;
+}
+
+BusSignature* bus_signature_cache_get(sd_bus *bus, const char *types) {
+        BusSignature **slot, *s = NULL, *old = NULL;
+
+        assert(bus);
+        assert(types);
+
+        /* Returns a new reference, or NULL if the signature could not be compiled */
+
+        slot = bus->signature_cache + (((uintptr_t) types * UINT64_C(0x9E3779B97F4A7C15)) >> 32) % BUS_SIGNATURE_CACHE_SIZE;
+
+        assert_se(pthread_mutex_lock(&bus->signature_cache_mutex) == 0);
+
+        if (*slot && (*slot)->key == types && streq((*slot)->signature, types))
+                s = bus_signature_ref(*slot);
+        else {
+                /* Signatures that don't compile are left to the regular code paths, which report the
+                 * error. The old entry is released outside of the lock, it might be the last reference. */
+                old = TAKE_PTR(*slot);
+                if (bus_signature_compile(types, slot) >= 0)
+                        s = bus_signature_ref(*slot);
+        }
+
+        assert_se(pthread_mutex_unlock(&bus->signature_cache_mutex) == 0);
+
+        bus_signature_unref(old);
+        return s;
+}
+
+void bus_signature_cache_flush(sd_bus *bus) {
+        assert(bus);
+
+        assert_se(pthread_mutex_lock(&bus->signature_cache_mutex) == 0);
+        FOREACH_ELEMENT(s, bus->signature_cache)
+                *s = bus_signature_unref(*s);
+        assert_se(pthread_mutex_unlock(&bus->signature_cache_mutex) == 0);
+}
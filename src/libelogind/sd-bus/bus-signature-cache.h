@@ -0,0 +1,41 @@
+/* SPDX-License-Identifier: LGPL-2.1-or-later */
+#pragma once
+
+#include <inttypes.h>
+#include <stddef.h>
+
+#include "sd-bus.h"
+
+#include "macro.h"
+
+/* Number of compiled signatures kept per connection, must be a power of two */
+#define BUS_SIGNATURE_CACHE_SIZE 64U
+
+typedef struct BusSignatureOp {
+        char type;              /* The type character at this position of the signature */
+        uint8_t length;         /* Length of the complete type beginning here, 0 for closing brackets */
+        char *contents;         /* Contents signature of arrays, structs and dict entries, NULL otherwise */
+} BusSignatureOp;
+
+typedef struct BusSignature {
+        unsigned n_ref;         /* Atomic, held by the cache slot and by each user */
+        const char *key;        /* The pointer the signature was looked up with */
+        char *signature;        /* Our own copy, op[i] describes signature[i] */
+        size_t length;
+        BusSignatureOp ops[];
+} BusSignature;
+
+BusSignature* bus_signature_unref(BusSignature *s);
+DEFINE_TRIVIAL_CLEANUP_FUNC(BusSignature*, bus_signature_unref);
+
+BusSignature* bus_signature_cache_get(sd_bus *bus, const char *types);
+void bus_signature_cache_flush(sd_bus *bus);
+
+static inline const BusSignatureOp* bus_signature_op(const BusSignature *s, const char *t) {
+        /* Returns the op for t if it points into the compiled signature, NULL otherwise */
+
+        if (!s || t < s->signature || t >= s->signature + s->length)
+                return NULL;
+
+        return s->ops + (t - s->signature);
+}
@@ -7,6 +7,8 @@
 #include "bus-objects.h"
 #include "bus-slot.h"
 #include "string-util.h"
+/// Additional includes needed by elogind
+#include "bus-property-cache.h"
 
 sd_bus_slot *bus_slot_allocate(
                 sd_bus *bus,
@@ -117,6 +119,10 @@ void bus_slot_disconnect(sd_bus_slot *slot, bool unref) {
                 if (slot->node_vtable.node && slot->node_vtable.interface && slot->node_vtable.vtable) {
                         const sd_bus_vtable *v;
 
+#if 1 /// elogind: cached properties may belong to this vtable, see bus-property-cache.c
+                        bus_property_cache_flush(slot->bus);
+#endif // 1
+
                         for (v = slot->node_vtable.vtable; v->type != _SD_BUS_VTABLE_END; v = bus_vtable_next(slot->node_vtable.vtable, v)) {
                                 struct vtable_member *x = NULL;
 
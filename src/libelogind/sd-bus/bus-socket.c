@@ -29,9 +29,17 @@
 #include "string-util.h"
 #include "user-util.h"
 #include "utf8.h"
+/// Additional includes needed by elogind
+#include "unaligned.h"
 
 #define SNDBUF_SIZE (8*1024*1024)
 
+#if 1 /// elogind: read ahead, see bus_socket_read_message()
+/* The minimal size of the read buffer of a connection, i.e. how much we read at once at least, if the
+ * socket has that much queued. */
+#define RBUFFER_SIZE_MIN (64U*1024U)
+#endif // 1
+
 static void iovec_advance(struct iovec iov[], unsigned *idx, size_t size) {
 
         while (size > 0) {
@@ -74,6 +82,13 @@ static int bus_message_setup_iovec(sd_bus_message *m) {
 
         assert(!m->iovec);
 
+#if 1 /// elogind: a body passed as memfd is not part of the byte stream
+        if (BUS_MESSAGE_BODY_IN_MEMFD(m)) {
+                m->iovec = m->iovec_fixed;
+                return append_iovec(m, m->header, BUS_MESSAGE_BODY_BEGIN(m));
+        }
+#endif // 1
+
         n = 1 + m->n_body_parts;
         if (n < ELEMENTSOF(m->iovec_fixed))
                 m->iovec = m->iovec_fixed;
@@ -125,8 +140,20 @@ bool bus_socket_auth_needs_write(sd_bus *b) {
         return false;
 }
 
+#if 1 /// elogind: large bodies as sealed memfd are only negotiated with peers, never with a bus broker
+static bool bus_socket_wants_memfd(sd_bus *b) {
+        assert(b);
+
+        return b->accept_fd && b->accept_memfd && !b->bus_client;
+}
+#endif // 1
+
 static int bus_socket_auth_verify_client(sd_bus *b) {
+#if 0 /// elogind may expect a fourth line, see below
         char *l, *lines[4] = {};
+#else // 0
+        char *l, *lines[5] = {};
+#endif // 0
         sd_id128_t peer;
         size_t i, n;
         int r;
@@ -142,7 +169,11 @@ static int bus_socket_auth_verify_client(sd_bus *b) {
 
         n = 0;
         lines[n] = b->rbuffer;
+#if 0 /// elogind may expect a fourth line
         for (i = 0; i < 3; ++i) {
+#else // 0
+        for (i = 0; i < 4; ++i) {
+#endif // 0
                 l = memmem_safe(lines[n], b->rbuffer_size - (lines[n] - (char*) b->rbuffer), "\r\n", 2);
                 if (l)
                         lines[++n] = l + 2;
@@ -159,7 +190,11 @@ static int bus_socket_auth_verify_client(sd_bus *b) {
          * If FD negotiation was requested, we additionally expect
          * an AGREE_UNIX_FD response in all cases.
          */
+#if 0 /// elogind: if memfd negotiation was requested, we expect a reply to that, too
         if (n < (b->anonymous_auth ? 1U : 2U) + !!b->accept_fd)
+#else // 0
+        if (n < (b->anonymous_auth ? 1U : 2U) + !!b->accept_fd + bus_socket_wants_memfd(b))
+#endif // 0
                 return 0; /* wait for more data */
 
         i = 0;
@@ -220,6 +255,13 @@ static int bus_socket_auth_verify_client(sd_bus *b) {
                 b->can_fds = memory_startswith(l, lines[i] - l, "AGREE_UNIX_FD");
         }
 
+#if 1 /// elogind: and the fourth one. The server replies ERROR if it does not know the extension.
+        if (bus_socket_wants_memfd(b)) {
+                l = lines[i++];
+                b->can_memfd = b->can_fds && memory_startswith(l, lines[i] - l, "AGREE_ELOGIND_MEMFD");
+        }
+#endif // 1
+
         assert(i == n);
 
         b->rbuffer_size -= (lines[i] - (char*) b->rbuffer);
@@ -470,6 +512,15 @@ static int bus_socket_auth_verify_server(sd_bus *b) {
                                 b->can_fds = true;
                                 r = bus_socket_auth_write(b, "AGREE_UNIX_FD\r\n");
                         }
+#if 1 /// elogind: passing large bodies as sealed memfd requires fd passing
+                } else if (line_equals(line, l, "NEGOTIATE_ELOGIND_MEMFD")) {
+                        if (b->auth == _BUS_AUTH_INVALID || !b->can_fds || !b->accept_memfd)
+                                r = bus_socket_auth_write(b, "ERROR\r\n");
+                        else {
+                                b->can_memfd = true;
+                                r = bus_socket_auth_write(b, "AGREE_ELOGIND_MEMFD\r\n");
+                        }
+#endif // 1
                 } else
                         r = bus_socket_auth_write(b, "ERROR\r\n");
 
@@ -747,6 +798,11 @@ static int bus_socket_start_auth_client(sd_bus *b) {
         static const char sasl_negotiate_unix_fd[] = {
                 "NEGOTIATE_UNIX_FD\r\n"
         };
+#if 1 /// elogind: private extension, see bus_socket_wants_memfd()
+        static const char sasl_negotiate_elogind_memfd[] = {
+                "NEGOTIATE_ELOGIND_MEMFD\r\n"
+        };
+#endif // 1
         static const char sasl_begin[] = {
                 "BEGIN\r\n"
         };
@@ -762,6 +818,11 @@ static int bus_socket_start_auth_client(sd_bus *b) {
         if (b->accept_fd)
                 b->auth_iovec[i++] = IOVEC_MAKE_STRING(sasl_negotiate_unix_fd);
 
+#if 1 /// elogind: must come after NEGOTIATE_UNIX_FD, as it depends on its outcome
+        if (bus_socket_wants_memfd(b))
+                b->auth_iovec[i++] = IOVEC_MAKE_STRING(sasl_negotiate_elogind_memfd);
+#endif // 1
+
         b->auth_iovec[i++] = IOVEC_MAKE_STRING(sasl_begin);
 
         return bus_socket_write_auth(b);
@@ -1274,6 +1335,80 @@ int bus_socket_write_message(sd_bus *bus, sd_bus_message *m, size_t *idx) {
         return 1;
 }
 
+#if 1 /// elogind: write coalescing, see dispatch_wqueue()
+int bus_socket_write_messages(sd_bus *bus, sd_bus_message **m, size_t n, size_t idx, size_t *ret_written) {
+        _cleanup_free_ struct iovec *iov = NULL;
+        size_t n_iov = 0, i;
+        unsigned j = 0;
+        ssize_t k;
+        int r;
+
+        assert(bus);
+        assert(m);
+        assert(n > 0);
+        assert(ret_written);
+        assert(IN_SET(bus->state, BUS_RUNNING, BUS_HELLO));
+
+        /* Writes out as much of the given messages as possible with a single syscall, starting at idx of
+         * the first one. The iovecs of consecutive messages are gathered, up to the first one that carries
+         * fds, since the fds are sent along with the first byte of their message, and up to IOV_MAX
+         * iovecs. A message with fds that has not been started yet is written on its own. */
+
+        if (m[0]->n_fds > 0 && idx == 0) {
+                size_t written = 0;
+
+                r = bus_socket_write_message(bus, m[0], &written);
+                *ret_written = written;
+                return r;
+        }
+
+        for (i = 0; i < n; i++) {
+                if (i > 0 && m[i]->n_fds > 0)
+                        break;
+
+                r = bus_message_setup_iovec(m[i]);
+                if (r < 0)
+                        return r;
+
+                /* Never split a message's iovecs over several batches, but always take the first message */
+                if (i > 0 && n_iov + m[i]->n_iovec > IOV_MAX)
+                        break;
+
+                if (!GREEDY_REALLOC(iov, n_iov + m[i]->n_iovec))
+                        return -ENOMEM;
+
+                memcpy_safe(iov + n_iov, m[i]->iovec, sizeof(struct iovec) * m[i]->n_iovec);
+                n_iov += m[i]->n_iovec;
+        }
+
+        iovec_advance(iov, &j, idx);
+
+        if (bus->prefer_writev)
+                k = writev(bus->output_fd, iov + j, n_iov - j);
+        else {
+                struct msghdr mh = {
+                        .msg_iov = iov + j,
+                        .msg_iovlen = n_iov - j,
+                };
+
+                k = sendmsg(bus->output_fd, &mh, MSG_DONTWAIT|MSG_NOSIGNAL);
+                if (k < 0 && errno == ENOTSOCK) {
+                        bus->prefer_writev = true;
+                        k = writev(bus->output_fd, iov + j, n_iov - j);
+                }
+        }
+
+        if (k < 0) {
+                *ret_written = 0;
+                return ERRNO_IS_TRANSIENT(errno) ? 0 : -errno;
+        }
+
+        *ret_written = (size_t) k;
+        return 1;
+}
+#endif // 1
+
+#if 0 /// elogind needs the size of messages anywhere in the read buffer, see bus_socket_make_messages()
 static int bus_socket_read_message_need(sd_bus *bus, size_t *need) {
         uint32_t a, b;
         uint8_t e;
@@ -1325,7 +1460,284 @@ static int bus_socket_read_message_need(sd_bus *bus, size_t *need) {
         *need = (size_t) sum;
         return 0;
 }
+#else // 0
+static int bus_socket_message_size(const uint8_t *p, size_t avail, size_t *need) {
+        const struct bus_header *h = (const struct bus_header*) p;
+        uint32_t a, b;
+        uint64_t sum;
+
+        assert(p || avail == 0);
+        assert(need);
+
+        /* Returns the size of the message starting at p, or the minimum message size if not even its
+         * header is available yet. See bus_socket_read_message_need() upstream for details. */
+
+        if (avail < sizeof(struct bus_header)) {
+                *need = sizeof(struct bus_header) + 8;
+                return 0;
+        }
+
+        if (h->endian == BUS_LITTLE_ENDIAN) {
+                a = le32toh(unaligned_read_ne32(&h->body_size));
+                b = le32toh(unaligned_read_ne32(&h->fields_size));
+        } else if (h->endian == BUS_BIG_ENDIAN) {
+                a = be32toh(unaligned_read_ne32(&h->body_size));
+                b = be32toh(unaligned_read_ne32(&h->fields_size));
+        } else
+                return -EBADMSG;
+
+        sum = (uint64_t) sizeof(struct bus_header) + (uint64_t) ALIGN8(b) + (uint64_t) a;
+        if (sum >= BUS_MESSAGE_SIZE_MAX)
+                return -ENOBUFS;
+
+        /* A body passed as memfd is not part of the byte stream, see message_body_to_memfd() */
+        if (h->flags & BUS_MESSAGE_BODY_MEMFD)
+                sum -= a;
+
+        *need = (size_t) sum;
+        return 0;
+}
+
+static int bus_socket_read_message_need(sd_bus *bus, size_t *need) {
+        assert(bus);
+        assert(IN_SET(bus->state, BUS_RUNNING, BUS_HELLO));
+
+        return bus_socket_message_size(bus->rbuffer, bus->rbuffer_size, need);
+}
+
+static uint32_t bus_socket_read_u32(const uint8_t *p, bool le) {
+        uint32_t u = unaligned_read_ne32(p);
+
+        return le ? le32toh(u) : be32toh(u);
+}
+
+static int bus_socket_peek_unix_fds(const uint8_t *p, size_t size, size_t *ret) {
+        const struct bus_header *h = (const struct bus_header*) p;
+        bool le = h->endian == BUS_LITTLE_ENDIAN;
+        size_t i, end;
+
+        assert(p);
+        assert(size >= sizeof(struct bus_header));
+        assert(ret);
+
+        /* Returns the number of fds the complete message at p announces in its UNIX_FDS header field. With
+         * read-ahead, several messages may have been read at once, and this is how we know which of the
+         * received fds belong to which message. The kernel hands out the fds sent along with a message
+         * together with the first byte of it, hence they are always queued in order of the messages.
+         *
+         * Only the header fields the spec defines need to be understood here, all of them have single
+         * character signatures. Returns -EBADMSG for anything else, message_parse_fields() will
+         * take care of it. */
+
+        i = sizeof(struct bus_header);
+        end = i + bus_socket_read_u32((const uint8_t*) &h->fields_size, le);
+        if (end > size)
+                return -EBADMSG;
 
+        while (i < end) {
+                uint8_t code;
+                char type;
+                size_t l;
+
+                i = ALIGN8(i);
+                if (i + 4 > end)
+                        return -EBADMSG;
+
+                code = p[i];
+                if (p[i + 1] != 1 || p[i + 3] != 0) /* signature must be a single type */
+                        return -EBADMSG;
+                type = p[i + 2];
+                i += 4;
+
+                switch (type) {
+
+                case SD_BUS_TYPE_UINT32:
+                        i = ALIGN4(i);
+                        if (i + 4 > end)
+                                return -EBADMSG;
+
+                        if (code == BUS_MESSAGE_HEADER_UNIX_FDS) {
+                                *ret = bus_socket_read_u32(p + i, le);
+                                return 0;
+                        }
+
+                        i += 4;
+                        break;
+
+                case SD_BUS_TYPE_STRING:
+                case SD_BUS_TYPE_OBJECT_PATH:
+                        i = ALIGN4(i);
+                        if (i + 4 > end)
+                                return -EBADMSG;
+
+                        l = bus_socket_read_u32(p + i, le);
+                        if (l > end - i - 4 - 1)
+                                return -EBADMSG;
+
+                        i += 4 + l + 1;
+                        break;
+
+                case SD_BUS_TYPE_SIGNATURE:
+                        if (i + 1 > end)
+                                return -EBADMSG;
+
+                        l = p[i];
+                        if (l > end - i - 1 - 1)
+                                return -EBADMSG;
+
+                        i += 1 + l + 1;
+                        break;
+
+                default:
+                        return -EBADMSG;
+                }
+        }
+
+        *ret = 0;
+        return 0;
+}
+
+static int bus_socket_enqueue_message(sd_bus *bus, size_t offset, size_t size) {
+        _cleanup_free_ int *fds_copy = NULL;
+        _cleanup_free_ void *copy = NULL;
+        sd_bus_message *t = NULL;
+        size_t n_fds = 0;
+        void *b;
+        int *fds = NULL;
+        bool whole;
+        int r;
+
+        assert(bus);
+        assert(offset + size <= bus->rbuffer_size);
+
+        /* Turns the complete message at offset in rbuffer into a queued message. Its bytes and fds are only
+         * consumed once the message has been created, so that on failure the caller may simply try again
+         * later, just like bus_socket_make_message() does. Returns > 0 if the message was consumed (or
+         * dropped as invalid). */
+
+        r = bus_rqueue_make_room(bus);
+        if (r < 0)
+                return r;
+
+        if (bus->n_fds > 0) {
+                if (bus_socket_peek_unix_fds((const uint8_t*) bus->rbuffer + offset, size, &n_fds) < 0 || n_fds > bus->n_fds)
+                        n_fds = bus->n_fds; /* Hand out all of them, the message will be refused */
+
+                if (n_fds == bus->n_fds)
+                        fds = bus->fds;
+                else if (n_fds > 0) {
+                        fds = fds_copy = newdup(int, bus->fds, n_fds);
+                        if (!fds)
+                                return -ENOMEM;
+                }
+        }
+
+        /* A message that makes up the whole buffer, which isn't much bigger than it, gets the buffer itself */
+        whole = offset == 0 && size == bus->rbuffer_size && MALLOC_SIZEOF_SAFE(bus->rbuffer) <= size * 2;
+        if (whole)
+                b = bus->rbuffer;
+        else {
+                b = copy = memdup((const uint8_t*) bus->rbuffer + offset, size);
+                if (!b)
+                        return -ENOMEM;
+        }
+
+        r = bus_message_from_malloc(bus,
+                                    b, size,
+                                    fds, n_fds,
+                                    NULL,
+                                    &t);
+        if (r < 0 && r != -EBADMSG)
+                return r;
+
+        /* From here on the message, or if it is invalid nobody, owns the bytes and fds */
+        if (r < 0) {
+                log_debug_errno(r, "Received invalid message from connection %s, dropping.", strna(bus->description));
+                close_many(fds, n_fds);
+                if (whole)
+                        free(b);
+        } else {
+                TAKE_PTR(copy);
+                TAKE_PTR(fds_copy);
+        }
+
+        if (n_fds == bus->n_fds) {
+                if (r < 0)
+                        bus->fds = mfree(bus->fds);
+                else
+                        bus->fds = NULL;
+                bus->n_fds = 0;
+        } else if (n_fds > 0) {
+                memmove(bus->fds, bus->fds + n_fds, sizeof(int) * (bus->n_fds - n_fds));
+                bus->n_fds -= n_fds;
+        }
+
+        if (whole) {
+                bus->rbuffer = NULL;
+                bus->rbuffer_size = 0;
+        }
+
+        if (r < 0)
+                return 1;
+
+        t->read_counter = ++bus->read_counter;
+        bus->rqueue[bus->rqueue_size++] = bus_message_ref_queued(t, bus);
+        sd_bus_message_unref(t);
+
+        bus->stats.n_messages_received++;
+        bus->stats.n_bytes_received += size;
+        bus->stats.rqueue_max = MAX(bus->stats.rqueue_max, bus->rqueue_size);
+
+        return 1;
+}
+
+static int bus_socket_make_messages(sd_bus *bus) {
+        size_t offset = 0, n = 0;
+        int r = 0;
+
+        assert(bus);
+        assert(IN_SET(bus->state, BUS_RUNNING, BUS_HELLO));
+
+        /* Slices all complete messages out of the read buffer and puts them into rqueue, until the buffer
+         * runs out of complete messages or rqueue is full. Whatever remains is moved to the front once at
+         * the end, and picked up again by the next call. */
+
+        for (;;) {
+                size_t size;
+
+                r = bus_socket_message_size((const uint8_t*) bus->rbuffer + offset, bus->rbuffer_size - offset, &size);
+                if (r < 0)
+                        break;
+                if (bus->rbuffer_size - offset < size)
+                        break;
+
+                /* Nothing is consumed if this fails, in particular if rqueue is full */
+                r = bus_socket_enqueue_message(bus, offset, size);
+                if (r < 0)
+                        break;
+
+                n++;
+
+                /* The message got the buffer itself */
+                if (!bus->rbuffer)
+                        break;
+
+                offset += size;
+        }
+
+        if (offset > 0) {
+                memmove(bus->rbuffer, (const uint8_t*) bus->rbuffer + offset, bus->rbuffer_size - offset);
+                bus->rbuffer_size -= offset;
+        }
+
+        if (r < 0 && n == 0)
+                return r;
+
+        return n > 0;
+}
+#endif // 0
+
+#if 0 /// UNNEEDED by elogind, see bus_socket_make_messages()
 static int bus_socket_make_message(sd_bus *bus, size_t size) {
         sd_bus_message *t = NULL;
         void *b;
@@ -1375,6 +1787,7 @@ static int bus_socket_make_message(sd_bus *bus, size_t size) {
 
         return 1;
 }
+#endif // 0
 
 int bus_socket_read_message(sd_bus *bus) {
         struct msghdr mh;
@@ -1393,6 +1806,7 @@ int bus_socket_read_message(sd_bus *bus) {
         if (r < 0)
                 return r;
 
+#if 0 /// elogind reads ahead, and slices out all complete messages at once
         if (bus->rbuffer_size >= need)
                 return bus_socket_make_message(bus, need);
 
@@ -1403,6 +1817,23 @@ int bus_socket_read_message(sd_bus *bus) {
         bus->rbuffer = b;
 
         iov = IOVEC_MAKE((uint8_t *)bus->rbuffer + bus->rbuffer_size, need - bus->rbuffer_size);
+#else // 0
+        if (bus->rbuffer_size >= need)
+                return bus_socket_make_messages(bus);
+
+        /* Don't just read what the current message needs, but as much as the socket has, so that a burst of
+         * messages costs one syscall rather than two per message. The buffer is kept around for the next
+         * read. */
+        if (MALLOC_SIZEOF_SAFE(bus->rbuffer) < MAX(need, (size_t) RBUFFER_SIZE_MIN)) {
+                b = realloc(bus->rbuffer, MAX(need, (size_t) RBUFFER_SIZE_MIN));
+                if (!b)
+                        return -ENOMEM;
+
+                bus->rbuffer = b;
+        }
+
+        iov = IOVEC_MAKE((uint8_t *)bus->rbuffer + bus->rbuffer_size, MALLOC_SIZEOF_SAFE(bus->rbuffer) - bus->rbuffer_size);
+#endif // 0
 
         if (bus->prefer_readv) {
                 k = readv(bus->input_fd, &iov, 1);
@@ -1447,8 +1878,13 @@ int bus_socket_read_message(sd_bus *bus) {
         if (r < 0)
                 return r;
 
+#if 0 /// elogind reads ahead, and slices out all complete messages at once
         if (bus->rbuffer_size >= need)
                 return bus_socket_make_message(bus, need);
+#else // 0
+        if (bus->rbuffer_size >= need)
+                return bus_socket_make_messages(bus);
+#endif // 0
 
         return 1;
 }
@@ -11,6 +11,9 @@ int bus_socket_take_fd(sd_bus *b);
 int bus_socket_start_auth(sd_bus *b);
 
 int bus_socket_write_message(sd_bus *bus, sd_bus_message *m, size_t *idx);
+#if 1 /// elogind: write coalescing, see dispatch_wqueue()
+int bus_socket_write_messages(sd_bus *bus, sd_bus_message **m, size_t n, size_t idx, size_t *ret_written);
+#endif // 1
 int bus_socket_read_message(sd_bus *bus);
 
 int bus_socket_process_opening(sd_bus *b);
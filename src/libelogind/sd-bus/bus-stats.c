@@ -0,0 +1,296 @@
+/* SPDX-License-Identifier: LGPL-2.1-or-later */
+
+#include "sd-json.h"
+
+#include "alloc-util.h"
+#include "bus-internal.h"
+#include "bus-message.h"
+#include "bus-message-pool.h"
+#include "bus-stats.h"
+#include "hashmap.h"
+#include "logarithm.h"
+#include "string-util.h"
+
+/* Statistics are collected per connection once enabled with sd_bus_set_collect_stats(). The plain counters
+ * are cheap and always maintained, everything that requires reading the clock or looking up the
+ * per-interface/member entries is only done while collecting. */
+
+static void bus_stats_entry_hash_func(const BusStatsEntry *e, struct siphash *state) {
+        assert(e);
+
+        siphash24_compress_typesafe(e->kind, state);
+        string_hash_func(e->interface, state);
+        string_hash_func(e->member, state);
+}
+
+static int bus_stats_entry_compare_func(const BusStatsEntry *x, const BusStatsEntry *y) {
+        int r;
+
+        assert(x);
+        assert(y);
+
+        r = CMP(x->kind, y->kind);
+        if (r != 0)
+                return r;
+
+        r = strcmp(x->interface, y->interface);
+        if (r != 0)
+                return r;
+
+        return strcmp(x->member, y->member);
+}
+
+DEFINE_PRIVATE_HASH_OPS_WITH_KEY_DESTRUCTOR(
+                bus_stats_entry_hash_ops,
+                BusStatsEntry, bus_stats_entry_hash_func, bus_stats_entry_compare_func,
+                free);
+
+BusStatsEntry* bus_stats_get_entry(sd_bus *bus, BusStatsKind kind, const char *interface, const char *member) {
+        _cleanup_free_ BusStatsEntry *e = NULL;
+        BusStatsEntry *found;
+        size_t il, ml;
+        char *s;
+
+        assert(bus);
+        assert(kind >= 0 && kind < _BUS_STATS_KIND_MAX);
+        assert(interface);
+        assert(member);
+
+        /* Returns NULL if not collecting or on OOM, statistics are best effort */
+
+        if (!bus->collect_stats)
+                return NULL;
+
+        found = hashmap_get(bus->stats.entries, &(const BusStatsEntry) {
+                        .kind = kind,
+                        .interface = interface,
+                        .member = member,
+                });
+        if (found)
+                return found;
+
+        il = strlen(interface);
+        ml = strlen(member);
+
+        e = malloc0(sizeof(BusStatsEntry) + il + 1 + ml + 1);
+        if (!e)
+                return NULL;
+
+        s = (char*) (e + 1);
+        e->kind = kind;
+        e->interface = memcpy(s, interface, il + 1);
+        e->member = memcpy(s + il + 1, member, ml + 1);
+
+        if (hashmap_ensure_put(&bus->stats.entries, &bus_stats_entry_hash_ops, e, e) < 0)
+                return NULL;
+
+        return TAKE_PTR(e);
+}
+
+void bus_stats_entry_record(BusStatsEntry *e, usec_t usec, bool error) {
+        assert(e);
+
+        e->n++;
+        if (error)
+                e->n_errors++;
+
+        e->total_usec = usec_add(e->total_usec, usec);
+        e->max_usec = MAX(e->max_usec, usec);
+        e->histogram[log2u64(usec)]++;
+}
+
+void bus_stats_record_match(sd_bus *bus, usec_t usec) {
+        assert(bus);
+
+        bus->stats.n_match_runs++;
+        bus->stats.match_usec = usec_add(bus->stats.match_usec, usec);
+        bus->stats.match_max_usec = MAX(bus->stats.match_max_usec, usec);
+}
+
+void bus_stats_record_sent(sd_bus *bus, sd_bus_message *m) {
+        assert(bus);
+        assert(m);
+
+        if (!m->dont_send) {
+                bus->stats.n_messages_sent++;
+                bus->stats.n_bytes_sent += BUS_MESSAGE_SIZE(m);
+        }
+
+        /* Replies carry the entry of the method call they answer, see method_callbacks_run() */
+        if (m->stats_entry) {
+                bus_stats_entry_record(m->stats_entry,
+                                       usec_sub_unsigned(now(CLOCK_MONOTONIC), m->stats_begin),
+                                       m->header->type == SD_BUS_MESSAGE_METHOD_ERROR);
+                m->stats_entry = NULL;
+        }
+}
+
+void bus_stats_reset(BusStats *s) {
+        BusStatsEntry *e;
+
+        assert(s);
+
+        HASHMAP_FOREACH(e, s->entries) {
+                e->n = e->n_errors = 0;
+                e->total_usec = e->max_usec = 0;
+                zero(e->histogram);
+        }
+
+        *s = (BusStats) {
+                .auth_usec = s->auth_usec,
+                .entries = s->entries,
+        };
+}
+
+void bus_stats_done(BusStats *s) {
+        assert(s);
+
+        s->entries = hashmap_free(s->entries);
+}
+
+static int bus_stats_entry_build_json(BusStatsEntry *e, sd_json_variant **ret) {
+        _cleanup_(sd_json_variant_unrefp) sd_json_variant *h = NULL;
+        size_t n;
+        int r;
+
+        assert(e);
+        assert(ret);
+
+        /* Trailing empty buckets are left out */
+        for (n = ELEMENTSOF(e->histogram); n > 0; n--)
+                if (e->histogram[n - 1] > 0)
+                        break;
+
+        r = sd_json_variant_new_array(&h, NULL, 0);
+        if (r < 0)
+                return r;
+
+        for (size_t i = 0; i < n; i++) {
+                r = sd_json_variant_append_arrayb(&h, SD_JSON_BUILD_UNSIGNED(e->histogram[i]));
+                if (r < 0)
+                        return r;
+        }
+
+        return sd_json_buildo(
+                        ret,
+                        SD_JSON_BUILD_PAIR_STRING("interface", e->interface),
+                        SD_JSON_BUILD_PAIR_STRING("member", e->member),
+                        SD_JSON_BUILD_PAIR_UNSIGNED("count", e->n),
+                        SD_JSON_BUILD_PAIR_UNSIGNED("errors", e->n_errors),
+                        SD_JSON_BUILD_PAIR_UNSIGNED("totalUSec", e->total_usec),
+                        SD_JSON_BUILD_PAIR_UNSIGNED("maxUSec", e->max_usec),
+                        SD_JSON_BUILD_PAIR_VARIANT("histogram", h));
+}
+
+_public_ int sd_bus_set_collect_stats(sd_bus *bus, int b) {
+        assert_return(bus, -EINVAL);
+        assert_return(bus = bus_resolve(bus), -ENOPKG);
+        assert_return(!bus_origin_changed(bus), -ECHILD);
+
+        bus->collect_stats = b;
+        return 0;
+}
+
+_public_ int sd_bus_get_collect_stats(sd_bus *bus) {
+        assert_return(bus, -EINVAL);
+        assert_return(bus = bus_resolve(bus), -ENOPKG);
+        assert_return(!bus_origin_changed(bus), -ECHILD);
+
+        return bus->collect_stats;
+}
+
+static int bus_message_pool_build_json(BusMessagePool *p, sd_json_variant **ret) {
+        BusMessagePoolStats s;
+
+        assert(p);
+        assert(ret);
+
+        bus_message_pool_get_stats(p, &s);
+
+        return sd_json_buildo(
+                        ret,
+                        SD_JSON_BUILD_PAIR_UNSIGNED("messagesAllocated", s.n_messages_allocated),
+                        SD_JSON_BUILD_PAIR_UNSIGNED("messagesReused", s.n_messages_reused),
+                        SD_JSON_BUILD_PAIR_UNSIGNED("messagesLive", s.n_messages_live),
+                        SD_JSON_BUILD_PAIR_UNSIGNED("messagesLiveMax", s.n_messages_live_max),
+                        SD_JSON_BUILD_PAIR_UNSIGNED("partsAllocated", s.n_parts_allocated),
+                        SD_JSON_BUILD_PAIR_UNSIGNED("partsReused", s.n_parts_reused),
+                        SD_JSON_BUILD_PAIR_UNSIGNED("buffersReused", s.n_buffers_reused),
+                        SD_JSON_BUILD_PAIR_UNSIGNED("buffersMissed", s.n_buffers_missed),
+                        SD_JSON_BUILD_PAIR_UNSIGNED("buffersDropped", s.n_buffers_dropped),
+                        SD_JSON_BUILD_PAIR_UNSIGNED("trims", s.n_trims));
+}
+
+_public_ int sd_bus_get_stats(sd_bus *bus, sd_json_variant **ret) {
+        _cleanup_(sd_json_variant_unrefp) sd_json_variant *methods = NULL, *properties = NULL, *pool = NULL;
+        BusStatsEntry *e;
+        int r;
+
+        assert_return(bus, -EINVAL);
+        assert_return(bus = bus_resolve(bus), -ENOPKG);
+        assert_return(!bus_origin_changed(bus), -ECHILD);
+        assert_return(ret, -EINVAL);
+
+        r = sd_json_variant_new_array(&methods, NULL, 0);
+        if (r < 0)
+                return r;
+
+        r = sd_json_variant_new_array(&properties, NULL, 0);
+        if (r < 0)
+                return r;
+
+        HASHMAP_FOREACH(e, bus->stats.entries) {
+                _cleanup_(sd_json_variant_unrefp) sd_json_variant *v = NULL;
+
+                if (e->n == 0)
+                        continue;
+
+                r = bus_stats_entry_build_json(e, &v);
+                if (r < 0)
+                        return r;
+
+                r = sd_json_variant_append_array(e->kind == BUS_STATS_METHOD ? &methods : &properties, v);
+                if (r < 0)
+                        return r;
+        }
+
+        if (bus->message_pool) {
+                r = bus_message_pool_build_json(bus->message_pool, &pool);
+                if (r < 0)
+                        return r;
+        }
+
+        r = sd_json_buildo(
+                        ret,
+                        SD_JSON_BUILD_PAIR_BOOLEAN("collecting", bus->collect_stats),
+                        SD_JSON_BUILD_PAIR_UNSIGNED("authUSec", bus->stats.auth_usec),
+                        SD_JSON_BUILD_PAIR_UNSIGNED("messagesReceived", bus->stats.n_messages_received),
+                        SD_JSON_BUILD_PAIR_UNSIGNED("bytesReceived", bus->stats.n_bytes_received),
+                        SD_JSON_BUILD_PAIR_UNSIGNED("messagesSent", bus->stats.n_messages_sent),
+                        SD_JSON_BUILD_PAIR_UNSIGNED("bytesSent", bus->stats.n_bytes_sent),
+                        SD_JSON_BUILD_PAIR_UNSIGNED("readQueueMax", bus->stats.rqueue_max),
+                        SD_JSON_BUILD_PAIR_UNSIGNED("writeQueueMax", bus->stats.wqueue_max),
+                        SD_JSON_BUILD_PAIR_UNSIGNED("readQueued", bus->rqueue_size),
+                        SD_JSON_BUILD_PAIR_UNSIGNED("writeQueued", bus->wqueue_size),
+                        SD_JSON_BUILD_PAIR_UNSIGNED("matchRuns", bus->stats.n_match_runs),
+                        SD_JSON_BUILD_PAIR_UNSIGNED("matchUSec", bus->stats.match_usec),
+                        SD_JSON_BUILD_PAIR_UNSIGNED("matchMaxUSec", bus->stats.match_max_usec),
+                        SD_JSON_BUILD_PAIR_VARIANT("methods", methods),
+                        SD_JSON_BUILD_PAIR_VARIANT("properties", properties),
+                        SD_JSON_BUILD_PAIR_CONDITION(!!pool, "messagePool", SD_JSON_BUILD_VARIANT(pool)));
+        if (r < 0)
+                return r;
+
+        return 0;
+}
+
+_public_ int sd_bus_reset_stats(sd_bus *bus) {
+        assert_return(bus, -EINVAL);
+        assert_return(bus = bus_resolve(bus), -ENOPKG);
+        assert_return(!bus_origin_changed(bus), -ECHILD);
+
+        bus_stats_reset(&bus->stats);
+        if (bus->message_pool)
+                bus_message_pool_reset_stats(bus->message_pool);
+        return 0;
+}
@@ -0,0 +1,57 @@
+/* SPDX-License-Identifier: LGPL-2.1-or-later */
+#pragma once
+
+#include <inttypes.h>
+#include <stdbool.h>
+
+#include "sd-bus.h"
+
+#include "hashmap.h"
+#include "time-util.h"
+
+typedef enum BusStatsKind {
+        BUS_STATS_METHOD,       /* Time from dispatching a method call to sending its reply */
+        BUS_STATS_PROPERTY,     /* Time spent in a property getter */
+        _BUS_STATS_KIND_MAX,
+        _BUS_STATS_KIND_INVALID = -EINVAL,
+} BusStatsKind;
+
+typedef struct BusStatsEntry {
+        BusStatsKind kind;
+        const char *interface;  /* Both point into the entry itself */
+        const char *member;
+
+        uint64_t n;
+        uint64_t n_errors;
+        usec_t total_usec;
+        usec_t max_usec;
+        uint64_t histogram[sizeof(usec_t) * 8];  /* Bucket i counts durations in [2^i, 2^(i+1)) µs */
+} BusStatsEntry;
+
+typedef struct BusStats {
+        usec_t auth_usec;
+
+        uint64_t n_messages_received;
+        uint64_t n_bytes_received;
+        uint64_t n_messages_sent;
+        uint64_t n_bytes_sent;
+
+        size_t rqueue_max;
+        size_t wqueue_max;
+
+        uint64_t n_match_runs;
+        usec_t match_usec;
+        usec_t match_max_usec;
+
+        /* Entries are only freed together with the connection, as messages in flight point to them */
+        Hashmap *entries;
+} BusStats;
+
+BusStatsEntry* bus_stats_get_entry(sd_bus *bus, BusStatsKind kind, const char *interface, const char *member);
+void bus_stats_entry_record(BusStatsEntry *e, usec_t usec, bool error);
+
+void bus_stats_record_match(sd_bus *bus, usec_t usec);
+void bus_stats_record_sent(sd_bus *bus, sd_bus_message *m);
+
+void bus_stats_reset(BusStats *s);
+void bus_stats_done(BusStats *s);
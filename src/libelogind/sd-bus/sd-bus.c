@@ -47,6 +47,11 @@
 #include "string-util.h"
 #include "strv.h"
 #include "user-util.h"
+/// Additional includes needed by elogind
+#include "bus-message-pool.h"
+#include "bus-property-cache.h"
+#include "bus-property-defer.h"
+#include "mempool.h"
 
 #define log_debug_bus_message(m)                                         \
         do {                                                             \
@@ -172,6 +177,10 @@ static void bus_reset_queues(sd_bus *b) {
                 bus_message_unref_queued(b->wqueue[--b->wqueue_size], b);
 
         b->wqueue = mfree(b->wqueue);
+
+#if 1 /// elogind: property reads may be deferred, see bus-property-defer.c
+        bus_property_defer_flush(b);
+#endif // 1
 }
 
 static sd_bus* bus_free(sd_bus *b) {
@@ -228,6 +237,16 @@ static sd_bus* bus_free(sd_bus *b) {
 
         hashmap_free_free(b->vtable_methods);
         hashmap_free_free(b->vtable_properties);
+#if 1 /// elogind: properties may be served from a cache, see bus-property-cache.c
+        bus_property_cache_flush(b);
+#endif // 1
+#if 1 /// elogind: see bus-signature-cache.c
+        bus_signature_cache_flush(b);
+        assert_se(pthread_mutex_destroy(&b->signature_cache_mutex) == 0);
+#endif // 1
+#if 1 /// elogind: per-connection statistics, see bus-stats.c
+        bus_stats_done(&b->stats);
+#endif // 1
 
         assert(hashmap_isempty(b->nodes));
         hashmap_free(b->nodes);
@@ -236,6 +255,11 @@ static sd_bus* bus_free(sd_bus *b) {
 
         assert_se(pthread_mutex_destroy(&b->memfd_cache_mutex) == 0);
 
+#if 1 /// elogind: messages are recycled per connection, see bus-message-pool.c
+        /* Messages still alive keep the pool around until they are gone */
+        bus_message_pool_unref(b->message_pool);
+#endif // 1
+
         return mfree(b);
 }
 
@@ -245,6 +269,9 @@ DEFINE_ORIGIN_ID_HELPERS(sd_bus, bus);
 
 _public_ int sd_bus_new(sd_bus **ret) {
         _cleanup_free_ sd_bus *b = NULL;
+#if 1 /// elogind: messages are recycled per connection, see bus-message-pool.c
+        int r;
+#endif // 1
 
         assert_return(ret, -EINVAL);
 
@@ -274,7 +301,20 @@ _public_ int sd_bus_new(sd_bus **ret) {
         if (!GREEDY_REALLOC(b->wqueue, 1))
                 return -ENOMEM;
 
+#if 1 /// elogind: messages are recycled per connection, see bus-message-pool.c
+        if (mempool_enabled && mempool_enabled()) { /* mempool_enabled is a weak symbol */
+                r = bus_message_pool_new(&b->message_pool);
+                if (r < 0) {
+                        free(b->wqueue);
+                        return r;
+                }
+        }
+#endif // 1
+
         assert_se(pthread_mutex_init(&b->memfd_cache_mutex, NULL) == 0);
+#if 1 /// elogind: see bus-signature-cache.c
+        assert_se(pthread_mutex_init(&b->signature_cache_mutex, NULL) == 0);
+#endif // 1
 
         *ret = TAKE_PTR(b);
         return 0;
@@ -356,6 +396,18 @@ _public_ int sd_bus_negotiate_fds(sd_bus *bus, int b) {
         return 0;
 }
 
+#if 1 /// elogind: pass large bodies as sealed memfd, see message_body_to_memfd()
+_public_ int sd_bus_negotiate_memfd(sd_bus *bus, int b) {
+        assert_return(bus, -EINVAL);
+        assert_return(bus = bus_resolve(bus), -ENOPKG);
+        assert_return(bus->state == BUS_UNSET, -EPERM);
+        assert_return(!bus_origin_changed(bus), -ECHILD);
+
+        bus->accept_memfd = b;
+        return 0;
+}
+#endif // 1
+
 _public_ int sd_bus_negotiate_timestamp(sd_bus *bus, int b) {
         assert_return(bus, -EINVAL);
         assert_return(bus = bus_resolve(bus), -ENOPKG);
@@ -635,6 +687,11 @@ int bus_start_running(sd_bus *bus) {
                 c->timeout_usec = usec_add(n, c->timeout_usec);
         }
 
+#if 1 /// elogind: per-connection statistics, the auth timeout was set when authentication began
+        if (bus->auth_timeout > 0)
+                bus->stats.auth_usec = usec_sub_unsigned(n, usec_sub_unsigned(bus->auth_timeout, BUS_AUTH_TIMEOUT));
+#endif // 1
+
         if (bus->bus_client) {
                 bus_set_state(bus, BUS_HELLO);
                 return 1;
@@ -2018,6 +2075,11 @@ static int bus_remarshal_message(sd_bus *b, sd_bus_message **m) {
         if (b->message_endian != 0 && b->message_endian != (*m)->header->endian)
                 remarshal = true;
 
+#if 1 /// elogind: bodies passed as memfd are inlined again for peers that did not agree to that
+        if (BUS_MESSAGE_BODY_IN_MEMFD(*m) && !b->can_memfd)
+                remarshal = true;
+#endif // 1
+
         return remarshal ? bus_message_remarshal(b, m) : 0;
 }
 
@@ -2043,6 +2105,7 @@ int bus_seal_synthetic_message(sd_bus *b, sd_bus_message *m) {
         return sd_bus_message_seal(m, UINT32_MAX, 0);
 }
 
+#if 0 /// elogind logs sent messages from dispatch_wqueue() too, see log_message_sent()
 static int bus_write_message(sd_bus *bus, sd_bus_message *m, size_t *idx) {
         int r;
 
@@ -2071,6 +2134,42 @@ static int bus_write_message(sd_bus *bus, sd_bus_message *m, size_t *idx) {
 
         return r;
 }
+#else // 0
+static void log_message_sent(sd_bus_message *m) {
+        assert(m);
+
+        log_debug("Sent message type=%s sender=%s destination=%s path=%s interface=%s member=%s"
+                  " cookie=%" PRIu64 " reply_cookie=%" PRIu64
+                  " signature=%s error-name=%s error-message=%s",
+                  bus_message_type_to_string(m->header->type),
+                  strna(sd_bus_message_get_sender(m)),
+                  strna(sd_bus_message_get_destination(m)),
+                  strna(sd_bus_message_get_path(m)),
+                  strna(sd_bus_message_get_interface(m)),
+                  strna(sd_bus_message_get_member(m)),
+                  BUS_MESSAGE_COOKIE(m),
+                  m->reply_cookie,
+                  strna(m->root_container.signature),
+                  strna(m->error.name),
+                  strna(m->error.message));
+}
+
+static int bus_write_message(sd_bus *bus, sd_bus_message *m, size_t *idx) {
+        int r;
+
+        assert(bus);
+        assert(m);
+
+        r = bus_socket_write_message(bus, m, idx);
+        if (r <= 0)
+                return r;
+
+        if (*idx >= BUS_MESSAGE_SIZE(m))
+                log_message_sent(m);
+
+        return r;
+}
+#endif // 0
 
 static int dispatch_wqueue(sd_bus *bus) {
         int r, ret = 0;
@@ -2078,6 +2177,7 @@ static int dispatch_wqueue(sd_bus *bus) {
         assert(bus);
         assert(IN_SET(bus->state, BUS_RUNNING, BUS_HELLO));
 
+#if 0 /// elogind writes out as many queued messages as possible per syscall
         while (bus->wqueue_size > 0) {
 
                 r = bus_write_message(bus, bus->wqueue[0], &bus->windex);
@@ -2107,6 +2207,39 @@ static int dispatch_wqueue(sd_bus *bus) {
         }
 
         return ret;
+#else // 0
+        /* Gather the queued messages into as few sendmsg() calls as possible. Each call may complete any
+         * number of messages, and leave the one after them partially written. The fully written ones are
+         * dropped from the queue in one go. */
+        while (bus->wqueue_size > 0) {
+                size_t written, n_done = 0;
+
+                r = bus_socket_write_messages(bus, bus->wqueue, bus->wqueue_size, bus->windex, &written);
+                if (r < 0)
+                        return r;
+                if (r == 0 || written == 0)
+                        /* Didn't do anything this time */
+                        return ret;
+
+                written += bus->windex;
+                while (n_done < bus->wqueue_size && written >= BUS_MESSAGE_SIZE(bus->wqueue[n_done])) {
+                        written -= BUS_MESSAGE_SIZE(bus->wqueue[n_done]);
+                        log_message_sent(bus->wqueue[n_done]);
+                        bus_message_unref_queued(bus->wqueue[n_done], bus);
+                        n_done++;
+                }
+
+                if (n_done > 0) {
+                        bus->wqueue_size -= n_done;
+                        memmove(bus->wqueue, bus->wqueue + n_done, sizeof(sd_bus_message*) * bus->wqueue_size);
+                        ret = 1;
+                }
+
+                bus->windex = written;
+        }
+
+        return ret;
+#endif // 0
 }
 
 static int bus_read_message(sd_bus *bus) {
@@ -2202,12 +2335,21 @@ _public_ int sd_bus_send(sd_bus *bus, sd_bus_message *_m, uint64_t *cookie) {
         if (r < 0)
                 return r;
 
+#if 1 /// elogind: per-connection statistics, see bus-stats.c
+        bus_stats_record_sent(bus, m);
+#endif // 1
+
         /* If this is a reply and no reply was requested, then let's
          * suppress this, if we can */
         if (m->dont_send)
                 goto finish;
 
+#if 0 /// elogind: with coalescing enabled, attached busses leave it to prepare_callback() to write the queue
         if (IN_SET(bus->state, BUS_RUNNING, BUS_HELLO) && bus->wqueue_size <= 0) {
+#else // 0
+        if (IN_SET(bus->state, BUS_RUNNING, BUS_HELLO) && bus->wqueue_size <= 0 &&
+            !(bus->coalesce_writes && bus->event)) {
+#endif // 0
                 size_t idx = 0;
 
                 r = bus_write_message(bus, m, &idx);
@@ -2238,6 +2380,9 @@ _public_ int sd_bus_send(sd_bus *bus, sd_bus_message *_m, uint64_t *cookie) {
                         return -ENOMEM;
 
                 bus->wqueue[bus->wqueue_size++] = bus_message_ref_queued(m, bus);
+#if 1 /// elogind: per-connection statistics, see bus-stats.c
+                bus->stats.wqueue_max = MAX(bus->stats.wqueue_max, bus->wqueue_size);
+#endif // 1
         }
 
 finish:
@@ -2902,6 +3047,9 @@ static int process_filter(sd_bus *bus, sd_bus_message *m) {
 }
 
 static int process_match(sd_bus *bus, sd_bus_message *m) {
+#if 1 /// elogind: per-connection statistics, see bus-stats.c
+        usec_t begin = bus->collect_stats ? now(CLOCK_MONOTONIC) : 0;
+#endif // 1
         int r;
 
         assert(bus);
@@ -2912,11 +3060,23 @@ static int process_match(sd_bus *bus, sd_bus_message *m) {
 
                 r = bus_match_run(bus, &bus->match_callbacks, m);
                 if (r != 0)
+#if 0 /// elogind: per-connection statistics, see bus-stats.c
                         return r;
+#else // 0
+                        break;
+#endif // 0
 
         } while (bus->match_callbacks_modified);
 
+#if 0 /// elogind: per-connection statistics, see bus-stats.c
         return 0;
+#else // 0
+        /* Note that the match callbacks run from here, so this is the time spent in them too */
+        if (begin > 0)
+                bus_stats_record_match(bus, usec_sub_unsigned(now(CLOCK_MONOTONIC), begin));
+
+        return r;
+#endif // 0
 }
 
 static int process_builtin(sd_bus *bus, sd_bus_message *m) {
@@ -3025,6 +3185,12 @@ static int process_message(sd_bus *bus, sd_bus_message *m) {
         if (r != 0)
                 goto finish;
 
+#if 1 /// elogind: keep calls in order while a property read of the same sender is deferred
+        r = bus_property_defer_hold(bus, m);
+        if (r != 0)
+                goto finish;
+#endif // 1
+
         r = process_filter(bus, m);
         if (r != 0)
                 goto finish;
@@ -3705,6 +3871,16 @@ static int prepare_callback(sd_event_source *s, void *userdata) {
 
         assert(s);
 
+#if 1 /// elogind: write out all messages queued during this event loop iteration at once
+        if (bus->coalesce_writes && IN_SET(bus->state, BUS_RUNNING, BUS_HELLO)) {
+                r = dispatch_wqueue(bus);
+                if (ERRNO_IS_NEG_DISCONNECT(r))
+                        bus_enter_closing(bus);
+                else if (r < 0)
+                        goto fail;
+        }
+#endif // 1
+
         e = sd_bus_get_events(bus);
         if (e < 0) {
                 r = e;
@@ -4449,6 +4625,42 @@ _public_ int sd_bus_get_close_on_exit(sd_bus *bus) {
         return bus->close_on_exit;
 }
 
+#if 1 /// elogind: write coalescing, see dispatch_wqueue()
+_public_ int sd_bus_set_coalesce_writes(sd_bus *bus, int b) {
+        assert_return(bus, -EINVAL);
+        assert_return(bus = bus_resolve(bus), -ENOPKG);
+        assert_return(!bus_origin_changed(bus), -ECHILD);
+
+        if (bus->coalesce_writes == !!b)
+                return 0;
+
+        bus->coalesce_writes = b;
+
+        /* Whatever was held back is flushed right away when coalescing is turned off, so that callers can
+         * rely on messages being on the wire before they block. */
+        if (!b && IN_SET(bus->state, BUS_RUNNING, BUS_HELLO)) {
+                int r;
+
+                r = dispatch_wqueue(bus);
+                if (ERRNO_IS_NEG_DISCONNECT(r)) {
+                        bus_enter_closing(bus);
+                        return -ECONNRESET;
+                }
+                if (r < 0)
+                        return r;
+        }
+
+        return 0;
+}
+
+_public_ int sd_bus_get_coalesce_writes(sd_bus *bus) {
+        assert_return(bus, -EINVAL);
+        assert_return(bus = bus_resolve(bus), -ENOPKG);
+
+        return bus->coalesce_writes;
+}
+#endif // 1
+
 _public_ int sd_bus_enqueue_for_read(sd_bus *bus, sd_bus_message *m) {
         int r;
 
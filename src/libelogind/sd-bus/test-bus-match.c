@@ -7,6 +7,9 @@
 #include "macro.h"
 #include "memory-util.h"
 #include "tests.h"
+#if 1 /// Additional includes needed by elogind
+#include "time-util.h"
+#endif // 1
 
 static bool mask[32];
 
@@ -66,6 +69,64 @@ static void test_match_scope(const char *match, enum bus_match_scope scope) {
         assert_se(bus_match_get_scope(components, n_components) == scope);
 }
 
+#if 1 /// elogind: see bus_match_run_prefixes()
+static int count_filter(sd_bus_message *m, void *userdata, sd_bus_error *ret_error) {
+        unsigned *n = ASSERT_PTR(userdata);
+
+        (*n)++;
+        return 0;
+}
+
+static void test_match_benchmark(sd_bus *bus, unsigned n_matches) {
+        _cleanup_(sd_bus_message_unrefp) sd_bus_message *m = NULL;
+        _cleanup_free_ sd_bus_slot *slots = NULL;
+        struct bus_match_node root = {
+                .type = BUS_MATCH_ROOT,
+        };
+        unsigned n_called = 0, n_runs = 1000;
+        usec_t t;
+
+        /* Clients tracking every session install one match per session object, either on the path or on
+         * the path namespace. Each message must only cost the lookups, not a walk over all matches. */
+
+        assert_se(slots = new0(sd_bus_slot, n_matches * 2));
+
+        for (unsigned i = 0; i < n_matches * 2; i++) {
+                struct bus_match_component *components = NULL;
+                _cleanup_free_ char *match = NULL;
+                size_t n_components = 0;
+
+                CLEANUP_ARRAY(components, n_components, bus_match_parse_free);
+
+                assert_se(asprintf(&match,
+                                   i % 2 == 0 ?
+                                   "type='signal',interface='org.freedesktop.DBus.Properties',member='PropertiesChanged',path='/org/freedesktop/login1/session/_%u'" :
+                                   "type='signal',path_namespace='/org/freedesktop/login1/session/_%u'",
+                                   i / 2) >= 0);
+                assert_se(bus_match_parse(match, &components, &n_components) >= 0);
+
+                slots[i].userdata = &n_called;
+                slots[i].match_callback.callback = count_filter;
+                assert_se(bus_match_add(&root, components, n_components, &slots[i].match_callback) >= 0);
+        }
+
+        assert_se(sd_bus_message_new_signal(bus, &m, "/org/freedesktop/login1/session/_1", "org.freedesktop.DBus.Properties", "PropertiesChanged") >= 0);
+        assert_se(sd_bus_message_append(m, "sa{sv}as", "org.freedesktop.login1.Session", 0, 0) >= 0);
+        assert_se(sd_bus_message_seal(m, 1, 0) >= 0);
+
+        t = now(CLOCK_MONOTONIC);
+        for (unsigned i = 0; i < n_runs; i++)
+                assert_se(bus_match_run(NULL, &root, m) == 0);
+        t = now(CLOCK_MONOTONIC) - t;
+
+        assert_se(n_called == n_runs * 2);
+
+        log_info("%u matches: %s per message", n_matches * 2, FORMAT_TIMESPAN(t / n_runs, 1));
+
+        bus_match_free(&root);
+}
+#endif // 1
+
 int main(int argc, char *argv[]) {
         struct bus_match_node root = {
                 .type = BUS_MATCH_ROOT,
@@ -73,7 +134,12 @@ int main(int argc, char *argv[]) {
 
         _cleanup_(sd_bus_message_unrefp) sd_bus_message *m = NULL;
         _cleanup_(sd_bus_flush_close_unrefp) sd_bus *bus = NULL;
+#if 0 /// elogind tests a few more namespace and path prefix matches
         sd_bus_slot slots[19] = {};
+#else // 0
+        _cleanup_(sd_bus_message_unrefp) sd_bus_message *m2 = NULL;
+        sd_bus_slot slots[29] = {};
+#endif // 0
         int r;
 
         test_setup_logging(LOG_INFO);
@@ -102,6 +168,18 @@ int main(int argc, char *argv[]) {
         assert_se(match_add(slots, &root, "arg4has='pa'", 16) >= 0);
         assert_se(match_add(slots, &root, "arg4has='po'", 17) >= 0);
         assert_se(match_add(slots, &root, "arg4='pi'", 18) >= 0);
+#if 1 /// elogind: see bus_match_run_prefixes()
+        assert_se(match_add(slots, &root, "path_namespace='/'", 19) >= 0);
+        assert_se(match_add(slots, &root, "path_namespace='/foo/b'", 20) >= 0);
+        assert_se(match_add(slots, &root, "arg2path='/prefix/three/four'", 21) >= 0);
+        assert_se(match_add(slots, &root, "arg2path='/'", 22) >= 0);
+        assert_se(match_add(slots, &root, "arg3namespace='prefix.fo'", 23) >= 0);
+        assert_se(match_add(slots, &root, "arg3namespace='prefix.four'", 24) >= 0);
+        assert_se(match_add(slots, &root, "arg0path='/a/b/c'", 25) >= 0);
+        assert_se(match_add(slots, &root, "arg0path='/ab/c'", 26) >= 0);
+        assert_se(match_add(slots, &root, "arg0path='/a/'", 27) >= 0);
+        assert_se(match_add(slots, &root, "arg0path='/a'", 28) >= 0);
+#endif // 1
 
         bus_match_dump(stdout, &root, 0);
 
@@ -111,7 +189,11 @@ int main(int argc, char *argv[]) {
 
         zero(mask);
         assert_se(bus_match_run(NULL, &root, m) == 0);
+#if 0 /// elogind tests a few more namespace and path prefix matches
         assert_se(mask_contains((unsigned[]) { 9, 8, 7, 5, 10, 12, 13, 14, 15, 16, 17 }, 11));
+#else // 0
+        assert_se(mask_contains((unsigned[]) { 9, 8, 7, 5, 10, 12, 13, 14, 15, 16, 17, 19, 22, 24 }, 14));
+#endif // 0
 
         assert_se(bus_match_remove(&root, &slots[8].match_callback) >= 0);
         assert_se(bus_match_remove(&root, &slots[13].match_callback) >= 0);
@@ -120,7 +202,26 @@ int main(int argc, char *argv[]) {
 
         zero(mask);
         assert_se(bus_match_run(NULL, &root, m) == 0);
+#if 0 /// elogind tests a few more namespace and path prefix matches
         assert_se(mask_contains((unsigned[]) { 9, 5, 10, 12, 14, 7, 15, 16, 17 }, 9));
+#else // 0
+        assert_se(mask_contains((unsigned[]) { 9, 5, 10, 12, 14, 7, 15, 16, 17, 19, 22, 24 }, 12));
+
+        /* An argNpath value ending in '/' matches longer paths, too */
+        assert_se(sd_bus_message_new_signal(bus, &m2, "/a", "x.y", "z") >= 0);
+        assert_se(sd_bus_message_append(m2, "s", "/a/") >= 0);
+        assert_se(sd_bus_message_seal(m2, 2, 0) >= 0);
+
+        zero(mask);
+        assert_se(bus_match_run(NULL, &root, m2) == 0);
+        assert_se(mask_contains((unsigned[]) { 5, 19, 25, 27 }, 4));
+
+        assert_se(bus_match_remove(&root, &slots[25].match_callback) >= 0);
+
+        zero(mask);
+        assert_se(bus_match_run(NULL, &root, m2) == 0);
+        assert_se(mask_contains((unsigned[]) { 5, 19, 27 }, 3));
+#endif // 0
 
         for (enum bus_match_node_type i = 0; i < _BUS_MATCH_NODE_TYPE_MAX; i++) {
                 char buf[32];
@@ -141,5 +242,10 @@ int main(int argc, char *argv[]) {
         test_match_scope("member='gurke',path='/org/freedesktop/DBus/Local'", BUS_MATCH_LOCAL);
         test_match_scope("arg2='piep',sender='org.freedesktop.DBus',member='waldo'", BUS_MATCH_DRIVER);
 
+#if 1 /// elogind: see bus_match_run_prefixes()
+        for (unsigned n = 10; n <= 10000; n *= 10)
+                test_match_benchmark(bus, n);
+#endif // 1
+
         return 0;
 }
@@ -0,0 +1,180 @@
+/* SPDX-License-Identifier: LGPL-2.1-or-later */
+
+#include <sys/socket.h>
+
+#include "sd-bus.h"
+#include "sd-json.h"
+
+#include "bus-internal.h"
+#include "bus-message.h"
+#include "bus-message-pool.h"
+#include "fd-util.h"
+#include "tests.h"
+
+TEST(pool_tiles) {
+        _cleanup_(bus_message_pool_unrefp) BusMessagePool *p = NULL;
+        BusMessagePoolStats stats;
+        sd_bus_message *m[3];
+        struct bus_body_part *part;
+
+        assert_se(bus_message_pool_new(&p) >= 0);
+
+        FOREACH_ELEMENT(i, m) {
+                assert_se(*i = bus_message_pool_alloc_message(p));
+                assert_se((*i)->pool == p);
+        }
+
+        FOREACH_ELEMENT(i, m)
+                bus_message_pool_free_message(*i);
+
+        FOREACH_ELEMENT(i, m)
+                assert_se(*i = bus_message_pool_alloc_message(p));
+
+        assert_se(part = bus_message_pool_alloc_part(p));
+        bus_message_pool_free_part(p, part);
+        assert_se(part = bus_message_pool_alloc_part(p));
+        bus_message_pool_free_part(p, part);
+
+        bus_message_pool_get_stats(p, &stats);
+        assert_se(stats.n_messages_allocated == 3);
+        assert_se(stats.n_messages_reused == 3);
+        assert_se(stats.n_messages_live == 3);
+        assert_se(stats.n_messages_live_max == 3);
+        assert_se(stats.n_parts_allocated == 1);
+        assert_se(stats.n_parts_reused == 1);
+
+        /* Live messages pin the pool */
+        p = bus_message_pool_unref(p);
+
+        FOREACH_ELEMENT(i, m)
+                bus_message_pool_free_message(*i);
+}
+
+TEST(pool_buffers) {
+        _cleanup_(bus_message_pool_unrefp) BusMessagePool *p = NULL;
+        BusMessagePoolStats stats;
+        size_t allocated = 0;
+        void *b;
+
+        assert_se(bus_message_pool_new(&p) >= 0);
+
+        assert_se(!bus_message_pool_take_buffer(p, 64, &allocated));
+
+        assert_se(b = malloc(128));
+        bus_message_pool_put_buffer(p, b, 128);
+        assert_se(!bus_message_pool_take_buffer(p, 256, &allocated));
+        assert_se(bus_message_pool_take_buffer(p, 64, &allocated) == b);
+        assert_se(allocated == 128);
+        free(b);
+
+        assert_se(b = malloc(BUS_MESSAGE_POOL_BUFFER_SIZE_MAX + 1));
+        bus_message_pool_put_buffer(p, b, BUS_MESSAGE_POOL_BUFFER_SIZE_MAX + 1);
+
+        for (unsigned i = 0; i < BUS_MESSAGE_POOL_BUFFERS_MAX + 1; i++)
+                bus_message_pool_put_buffer(p, malloc(64), 64);
+
+        bus_message_pool_get_stats(p, &stats);
+        assert_se(stats.n_buffers_reused == 1);
+        assert_se(stats.n_buffers_missed == 2);
+        assert_se(stats.n_buffers_dropped == 2);
+}
+
+TEST(pool_trim) {
+        _cleanup_(bus_message_pool_unrefp) BusMessagePool *p = NULL;
+        sd_bus_message *m[BUS_MESSAGE_POOL_TRIM_THRESHOLD + 1];
+        BusMessagePoolStats stats;
+
+        assert_se(bus_message_pool_new(&p) >= 0);
+
+        FOREACH_ELEMENT(i, m)
+                assert_se(*i = bus_message_pool_alloc_message(p));
+
+        /* Nothing is released as long as a single message of the burst is in use */
+        for (size_t i = 1; i < ELEMENTSOF(m); i++)
+                bus_message_pool_free_message(m[i]);
+
+        bus_message_pool_get_stats(p, &stats);
+        assert_se(stats.n_trims == 0);
+
+        bus_message_pool_free_message(m[0]);
+
+        bus_message_pool_get_stats(p, &stats);
+        assert_se(stats.n_trims == 1);
+        assert_se(stats.n_messages_live == 0);
+
+        /* Afterwards messages come from fresh memory again, and a few of them don't cause another trim */
+        FOREACH_ARRAY(i, m, 3)
+                assert_se(*i = bus_message_pool_alloc_message(p));
+        FOREACH_ARRAY(i, m, 3)
+                bus_message_pool_free_message(*i);
+
+        bus_message_pool_get_stats(p, &stats);
+        assert_se(stats.n_messages_allocated == ELEMENTSOF(m) + 3);
+        assert_se(stats.n_messages_reused == 0);
+        assert_se(stats.n_trims == 1);
+}
+
+TEST(pool_messages) {
+        _cleanup_(sd_bus_close_unrefp) sd_bus *bus = NULL;
+        _cleanup_(sd_bus_message_unrefp) sd_bus_message *m = NULL;
+        _cleanup_(sd_json_variant_unrefp) sd_json_variant *v = NULL;
+        _cleanup_close_pair_ int pair[2] = EBADF_PAIR;
+        BusMessagePoolStats stats;
+        sd_json_variant *e;
+        const char *s;
+
+        assert_se(socketpair(AF_UNIX, SOCK_STREAM|SOCK_CLOEXEC|SOCK_NONBLOCK, 0, pair) >= 0);
+
+        assert_se(sd_bus_new(&bus) >= 0);
+        assert_se(sd_bus_set_fd(bus, pair[0], pair[0]) >= 0);
+        TAKE_FD(pair[0]);
+        assert_se(sd_bus_start(bus) >= 0);
+
+        /* Connections only use a pool where memory pools are enabled, see mempool_enabled() */
+        if (!bus->message_pool)
+                return (void) log_tests_skipped("memory pools are disabled");
+
+        for (unsigned i = 0; i < 16; i++) {
+                assert_se(sd_bus_message_new_method_call(bus, &m, "org.freedesktop.login1", "/org/freedesktop/login1",
+                                                         "org.freedesktop.login1.Manager", "ListSessions") >= 0);
+                assert_se(sd_bus_message_append(m, "ss", "foo", "bar") >= 0);
+                assert_se(sd_bus_message_seal(m, i + 1, 0) >= 0);
+
+                /* The header fields fit into the room reserved in the pooled message */
+                assert_se(!m->free_header);
+
+                assert_se(sd_bus_message_rewind(m, true) >= 0);
+                assert_se(sd_bus_message_read(m, "s", &s) >= 0);
+                assert_se(streq(s, "foo"));
+                assert_se(streq(m->member, "ListSessions"));
+
+                m = sd_bus_message_unref(m);
+        }
+
+        bus_message_pool_get_stats(bus->message_pool, &stats);
+        assert_se(stats.n_messages_allocated == 1);
+        assert_se(stats.n_messages_reused == 15);
+        assert_se(stats.n_buffers_reused == 15);
+        assert_se(stats.n_messages_live == 0);
+
+        /* The same numbers are reported through sd_bus_get_stats() */
+        assert_se(sd_bus_get_stats(bus, &v) >= 0);
+        assert_se(e = sd_json_variant_by_key(v, "messagePool"));
+        assert_se(sd_json_variant_unsigned(sd_json_variant_by_key(e, "messagesAllocated")) == 1);
+        assert_se(sd_json_variant_unsigned(sd_json_variant_by_key(e, "messagesReused")) == 15);
+        assert_se(sd_json_variant_unsigned(sd_json_variant_by_key(e, "messagesLive")) == 0);
+
+        assert_se(sd_bus_reset_stats(bus) >= 0);
+        v = sd_json_variant_unref(v);
+        assert_se(sd_bus_get_stats(bus, &v) >= 0);
+        assert_se(e = sd_json_variant_by_key(v, "messagePool"));
+        assert_se(sd_json_variant_unsigned(sd_json_variant_by_key(e, "messagesReused")) == 0);
+
+        /* The last message drops the last reference on the bus before it is returned to the pool */
+        assert_se(sd_bus_message_new_signal(bus, &m, "/foo", "org.foo", "Bar") >= 0);
+        bus = sd_bus_close_unref(bus);
+        assert_se(sd_bus_message_append(m, "s", "baz") >= 0);
+        m = sd_bus_message_unref(m);
+}
+
+DEFINE_TEST_MAIN(LOG_DEBUG);
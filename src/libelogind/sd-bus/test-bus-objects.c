@@ -13,6 +13,8 @@
 #include "macro.h"
 #include "strv.h"
 #include "tests.h"
+/// Additional includes needed by elogind
+#include "json-util.h"
 
 struct context {
         int fds[2];
@@ -20,6 +22,15 @@ struct context {
         char *something;
         char *automatic_string_property;
         uint32_t automatic_integer_property;
+#if 1 /// elogind: see the sd-bus property cache
+        char *cached;
+        unsigned n_cached_get;
+#endif // 1
+#if 1 /// elogind: see sd_bus_property_defer()
+        sd_bus_message *deferred_call;
+        sd_bus_message *resumed_call;
+        unsigned n_deferred;
+#endif // 1
 };
 
 static int something_handler(sd_bus_message *m, void *userdata, sd_bus_error *error) {
@@ -182,6 +193,143 @@ static int emit_object_removed(sd_bus_message *m, void *userdata, sd_bus_error *
         return 1;
 }
 
+#if 1 /// elogind: see the sd-bus property cache
+static int cached_get_handler(sd_bus *bus, const char *path, const char *interface, const char *property, sd_bus_message *reply, void *userdata, sd_bus_error *error) {
+        struct context *c = userdata;
+
+        c->n_cached_get++;
+
+        return ASSERT_SE_NONNEG(sd_bus_message_append(reply, "s", c->cached));
+}
+
+static int alter_cached(sd_bus_message *m, void *userdata, sd_bus_error *error) {
+        struct context *c = userdata;
+        const char *s;
+
+        assert_se(sd_bus_message_read(m, "s", &s) > 0);
+        assert_se(free_and_strdup(&c->cached, s) >= 0);
+
+        assert_se(sd_bus_emit_properties_changed(sd_bus_message_get_bus(m), m->path, m->interface, "Cached", NULL) >= 0);
+
+        return ASSERT_SE_NONNEG(sd_bus_reply_method_return(m, NULL));
+}
+
+/* Objects that are also reachable as /peer/self, which resolves to a different object for each sender, like
+ * logind's /org/freedesktop/login1/session/self */
+struct peer {
+        const char *sender;
+        const char *name;
+        unsigned n_get;
+};
+
+static struct peer peers[] = {
+        { ":1.1", "a" },
+        { ":1.2", "b" },
+};
+
+static int peer_object_find(sd_bus *bus, const char *path, const char *interface, void *userdata, void **found, sd_bus_error *error) {
+        sd_bus_message *m;
+        const char *p;
+
+        p = object_path_startswith(path, "/peer");
+        if (!p)
+                return 0;
+
+        if (streq(p, "self")) {
+                m = sd_bus_get_current_message(bus);
+                if (!m)
+                        return 0;
+
+                p = sd_bus_message_get_sender(m);
+                FOREACH_ELEMENT(i, peers)
+                        if (streq_ptr(i->sender, p)) {
+                                *found = i;
+                                return 1;
+                        }
+
+                return 0;
+        }
+
+        FOREACH_ELEMENT(i, peers)
+                if (streq(i->name, p)) {
+                        *found = i;
+                        return 1;
+                }
+
+        return 0;
+}
+
+static int peer_name_get_handler(sd_bus *bus, const char *path, const char *interface, const char *property, sd_bus_message *reply, void *userdata, sd_bus_error *error) {
+        struct peer *i = ASSERT_PTR(userdata);
+
+        i->n_get++;
+
+        return ASSERT_SE_NONNEG(sd_bus_message_append(reply, "s", i->name));
+}
+#endif // 1
+
+#if 1 /// elogind: see sd_bus_property_defer()
+static int deferred_get_handler(sd_bus *bus, const char *path, const char *interface, const char *property, sd_bus_message *reply, void *userdata, sd_bus_error *error) {
+        struct context *c = userdata;
+        int r;
+
+        /* The value becomes available once the server loop resumed the call */
+        if (c->resumed_call && sd_bus_get_current_message(bus) == c->resumed_call)
+                return ASSERT_SE_NONNEG(sd_bus_message_append(reply, "s", "deferred"));
+
+        r = sd_bus_property_defer(reply, &c->deferred_call);
+        if (r == -EOPNOTSUPP)
+                return ASSERT_SE_NONNEG(sd_bus_message_append(reply, "s", "synchronous"));
+        assert_se(r > 0);
+
+        /* A read can only be deferred once */
+        assert_se(sd_bus_property_defer(reply, &c->deferred_call) == -EOPNOTSUPP);
+
+        c->n_deferred++;
+        return 0;
+}
+
+static void resume_deferred(struct context *c) {
+        if (!c->deferred_call)
+                return;
+
+        assert_se(sd_bus_property_resume(c->deferred_call) > 0);
+        assert_se(sd_bus_property_resume(c->deferred_call) == -ENXIO);
+
+        sd_bus_message_unref(c->resumed_call);
+        c->resumed_call = TAKE_PTR(c->deferred_call);
+}
+
+static void get_deferred(sd_bus *bus, struct context *c) {
+        _cleanup_(sd_bus_message_unrefp) sd_bus_message *get = NULL, *reply = NULL;
+        _cleanup_(sd_bus_error_free) sd_bus_error error = SD_BUS_ERROR_NULL;
+        unsigned n_deferred = c->n_deferred;
+        uint64_t cookie, reply_cookie;
+        const char *s;
+        size_t n;
+
+        /* Send Get() and, without waiting, another call. The reply to the Get() call has to arrive first,
+         * even though the server only completes it after it saw the second call. */
+        assert_se(sd_bus_message_new_method_call(bus, &get, "org.freedesktop.systemd.test", "/foo", "org.freedesktop.DBus.Properties", "Get") >= 0);
+        assert_se(sd_bus_message_append(get, "ss", "org.freedesktop.systemd.test", "Deferred") >= 0);
+        assert_se(sd_bus_send(bus, get, &cookie) >= 0);
+
+        assert_se(sd_bus_call_method(bus, "org.freedesktop.systemd.test", "/foo", "org.freedesktop.systemd.test", "NoOperation", &error, NULL, NULL) >= 0);
+
+        assert_se(sd_bus_get_n_queued_read(bus, &n) >= 0);
+        assert_se(n == 1);
+
+        assert_se(sd_bus_process(bus, &reply) > 0);
+        assert_se(reply);
+        assert_se(sd_bus_message_get_reply_cookie(reply, &reply_cookie) >= 0);
+        assert_se(reply_cookie == cookie);
+        assert_se(sd_bus_message_read(reply, "v", "s", &s) > 0);
+        assert_se(streq(s, "deferred"));
+
+        assert_se(c->n_deferred == n_deferred + 1);
+}
+#endif // 1
+
 static const sd_bus_vtable vtable[] = {
         SD_BUS_VTABLE_START(0),
         SD_BUS_METHOD("AlterSomething", "s", "s", something_handler, 0),
@@ -195,9 +343,24 @@ static const sd_bus_vtable vtable[] = {
         SD_BUS_METHOD("EmitObjectAdded", NULL, NULL, emit_object_added, 0),
         SD_BUS_METHOD("EmitObjectWithManagerAdded", NULL, NULL, emit_object_with_manager_added, 0),
         SD_BUS_METHOD("EmitObjectRemoved", NULL, NULL, emit_object_removed, 0),
+#if 1 /// elogind: see the sd-bus property cache
+        SD_BUS_PROPERTY("Cached", "s", cached_get_handler, 0, SD_BUS_VTABLE_PROPERTY_EMITS_CHANGE|SD_BUS_VTABLE_PROPERTY_CACHED),
+        SD_BUS_METHOD("AlterCached", "s", NULL, alter_cached, 0),
+#endif // 1
+#if 1 /// elogind: see sd_bus_property_defer()
+        SD_BUS_PROPERTY("Deferred", "s", deferred_get_handler, 0, SD_BUS_VTABLE_PROPERTY_ASYNC),
+#endif // 1
         SD_BUS_VTABLE_END
 };
 
+#if 1 /// elogind: see the sd-bus property cache
+static const sd_bus_vtable peer_vtable[] = {
+        SD_BUS_VTABLE_START(0),
+        SD_BUS_PROPERTY("Name", "s", peer_name_get_handler, 0, SD_BUS_VTABLE_PROPERTY_CONST|SD_BUS_VTABLE_PROPERTY_CACHED),
+        SD_BUS_VTABLE_END
+};
+#endif // 1
+
 static const sd_bus_vtable vtable2[] = {
         SD_BUS_VTABLE_START(0),
         SD_BUS_METHOD("NotifyTest", "", "", notify_test, 0),
@@ -239,6 +402,46 @@ static int enumerator3_callback(sd_bus *bus, const char *path, void *userdata, c
         return 1;
 }
 
+#if 1 /// elogind: per-connection statistics
+static void check_stats(sd_bus *bus) {
+        _cleanup_(sd_json_variant_unrefp) sd_json_variant *v = NULL;
+        sd_json_variant *e;
+        bool found = false;
+
+        assert_se(sd_bus_get_stats(bus, &v) >= 0);
+        sd_json_variant_dump(v, SD_JSON_FORMAT_PRETTY_AUTO|SD_JSON_FORMAT_COLOR_AUTO, NULL, NULL);
+
+        assert_se(sd_json_variant_unsigned(sd_json_variant_by_key(v, "messagesReceived")) > 0);
+        assert_se(sd_json_variant_unsigned(sd_json_variant_by_key(v, "messagesSent")) > 0);
+        assert_se(sd_json_variant_unsigned(sd_json_variant_by_key(v, "readQueueMax")) > 0);
+
+        JSON_VARIANT_ARRAY_FOREACH(e, sd_json_variant_by_key(v, "methods")) {
+                if (!streq(sd_json_variant_string(sd_json_variant_by_key(e, "member")), "Exit"))
+                        continue;
+
+                assert_se(streq(sd_json_variant_string(sd_json_variant_by_key(e, "interface")), "org.freedesktop.systemd.test"));
+                assert_se(sd_json_variant_unsigned(sd_json_variant_by_key(e, "count")) == 1);
+                assert_se(sd_json_variant_unsigned(sd_json_variant_by_key(e, "errors")) == 0);
+                assert_se(sd_json_variant_elements(sd_json_variant_by_key(e, "histogram")) > 0);
+                found = true;
+        }
+        assert_se(found);
+
+        assert_se(!sd_json_variant_is_blank_array(sd_json_variant_by_key(v, "properties")));
+
+        /* The server runs in a thread of its own, where messages are not recycled, see mempool_enabled() */
+        assert_se(!sd_json_variant_by_key(v, "messagePool"));
+
+        assert_se(sd_bus_reset_stats(bus) >= 0);
+        v = sd_json_variant_unref(v);
+
+        assert_se(sd_bus_get_stats(bus, &v) >= 0);
+        assert_se(sd_json_variant_unsigned(sd_json_variant_by_key(v, "messagesReceived")) == 0);
+        assert_se(sd_json_variant_is_blank_array(sd_json_variant_by_key(v, "methods")));
+        assert_se(sd_json_variant_is_blank_array(sd_json_variant_by_key(v, "properties")));
+}
+#endif // 1
+
 static void *server(void *p) {
         struct context *c = p;
         sd_bus *bus = NULL;
@@ -261,6 +464,14 @@ static void *server(void *p) {
         assert_se(sd_bus_add_node_enumerator(bus, NULL, "/value/b", enumerator3_callback, NULL) >= 0);
         assert_se(sd_bus_add_object_manager(bus, NULL, "/value") >= 0);
         assert_se(sd_bus_add_object_manager(bus, NULL, "/value/a") >= 0);
+#if 1 /// elogind: see the sd-bus property cache
+        assert_se(sd_bus_add_fallback_vtable(bus, NULL, "/peer", "org.freedesktop.systemd.PeerTest", peer_vtable, peer_object_find, NULL) >= 0);
+#endif // 1
+
+#if 1 /// elogind: per-connection statistics
+        assert_se(sd_bus_set_collect_stats(bus, true) >= 0);
+        assert_se(sd_bus_get_collect_stats(bus) > 0);
+#endif // 1
 
         assert_se(sd_bus_start(bus) >= 0);
 
@@ -276,6 +487,12 @@ static void *server(void *p) {
                 }
 
                 if (r == 0) {
+#if 1 /// elogind: complete deferred property reads once idle
+                        if (c->deferred_call) {
+                                resume_deferred(c);
+                                continue;
+                        }
+#endif // 1
                         r = sd_bus_wait(bus, UINT64_MAX);
                         if (r < 0) {
                                 log_error_errno(r, "Failed to wait: %m");
@@ -286,6 +503,15 @@ static void *server(void *p) {
                 }
         }
 
+#if 1 /// elogind: per-connection statistics
+        check_stats(bus);
+#endif // 1
+
+#if 1 /// elogind: see sd_bus_property_defer()
+        assert_se(!c->deferred_call);
+        c->resumed_call = sd_bus_message_unref(c->resumed_call);
+#endif // 1
+
         r = 0;
 
 fail:
@@ -297,12 +523,53 @@ fail:
         return INT_TO_PTR(r);
 }
 
+#if 1 /// elogind: see the sd-bus property cache
+static void get_all_cached(sd_bus *bus, const char *expected) {
+        _cleanup_(sd_bus_message_unrefp) sd_bus_message *reply = NULL;
+        const char *name, *s = NULL;
+
+        assert_se(sd_bus_call_method(bus, "org.freedesktop.systemd.test", "/foo", "org.freedesktop.DBus.Properties", "GetAll", NULL, &reply, "s", "org.freedesktop.systemd.test") >= 0);
+
+        assert_se(sd_bus_message_enter_container(reply, SD_BUS_TYPE_ARRAY, "{sv}") > 0);
+        while (ASSERT_SE_NONNEG(sd_bus_message_enter_container(reply, SD_BUS_TYPE_DICT_ENTRY, "sv")) > 0) {
+                assert_se(sd_bus_message_read_basic(reply, 's', &name) > 0);
+
+                if (streq(name, "Cached"))
+                        assert_se(sd_bus_message_read(reply, "v", "s", &s) > 0);
+                else
+                        assert_se(sd_bus_message_skip(reply, "v") >= 0);
+
+                assert_se(sd_bus_message_exit_container(reply) >= 0);
+        }
+        assert_se(sd_bus_message_exit_container(reply) >= 0);
+
+        assert_se(streq_ptr(s, expected));
+}
+
+static void get_all_peer(sd_bus *bus, const char *sender, const char *path, const char *expected) {
+        _cleanup_(sd_bus_message_unrefp) sd_bus_message *m = NULL, *reply = NULL;
+        const char *name, *s;
+
+        assert_se(sd_bus_message_new_method_call(bus, &m, "org.freedesktop.systemd.test", path, "org.freedesktop.DBus.Properties", "GetAll") >= 0);
+        assert_se(sd_bus_message_set_sender(m, sender) >= 0);
+        assert_se(sd_bus_message_append(m, "s", "org.freedesktop.systemd.PeerTest") >= 0);
+        assert_se(sd_bus_call(bus, m, 0, NULL, &reply) >= 0);
+
+        assert_se(sd_bus_message_read(reply, "a{sv}", 1, &name, "s", &s) > 0);
+        assert_se(streq(name, "Name"));
+        assert_se(streq(s, expected));
+}
+#endif // 1
+
 static int client(struct context *c) {
         _cleanup_(sd_bus_message_unrefp) sd_bus_message *reply = NULL;
         _cleanup_(sd_bus_unrefp) sd_bus *bus = NULL;
         _cleanup_(sd_bus_error_free) sd_bus_error error = SD_BUS_ERROR_NULL;
         _cleanup_strv_free_ char **lines = NULL;
         const char *s;
+#if 1 /// elogind: see the sd-bus property cache
+        unsigned n_get;
+#endif // 1
         int r;
 
         assert_se(sd_bus_new(&bus) >= 0);
@@ -632,6 +899,41 @@ static int client(struct context *c) {
 
         reply = sd_bus_message_unref(reply);
 
+#if 1 /// elogind: see the sd-bus property cache
+        /* The getter is called once after each change, later GetAll() calls are served from the cache */
+        n_get = c->n_cached_get;
+
+        assert_se(sd_bus_call_method(bus, "org.freedesktop.systemd.test", "/foo", "org.freedesktop.systemd.test", "AlterCached", &error, NULL, "s", "altered") >= 0);
+        get_all_cached(bus, "altered");
+        get_all_cached(bus, "altered");
+        assert_se(c->n_cached_get == n_get + 1);
+
+        assert_se(sd_bus_call_method(bus, "org.freedesktop.systemd.test", "/foo", "org.freedesktop.systemd.test", "AlterCached", &error, NULL, "s", "altered again") >= 0);
+        get_all_cached(bus, "altered again");
+        get_all_cached(bus, "altered again");
+        assert_se(c->n_cached_get == n_get + 2);
+
+        /* Two peers querying the same alias get their own object each, and it is never served from the
+         * cache, while the canonical paths are */
+        get_all_peer(bus, ":1.1", "/peer/self", "a");
+        get_all_peer(bus, ":1.2", "/peer/self", "b");
+        get_all_peer(bus, ":1.1", "/peer/self", "a");
+        get_all_peer(bus, ":1.2", "/peer/self", "b");
+        assert_se(peers[0].n_get == 2);
+        assert_se(peers[1].n_get == 2);
+
+        get_all_peer(bus, ":1.2", "/peer/a", "a");
+        get_all_peer(bus, ":1.1", "/peer/a", "a");
+        get_all_peer(bus, ":1.1", "/peer/self", "a");
+        assert_se(peers[0].n_get == 4);
+        assert_se(peers[1].n_get == 2);
+#endif // 1
+
+#if 1 /// elogind: see sd_bus_property_defer()
+        get_deferred(bus, c);
+        get_deferred(bus, c);
+#endif // 1
+
         r = sd_bus_call_method(bus, "org.freedesktop.systemd.test", "/foo", "org.freedesktop.systemd.test", "Exit", &error, NULL, NULL);
         assert_se(r >= 0);
 
@@ -650,6 +952,9 @@ int main(int argc, char *argv[]) {
 
         c.automatic_integer_property = 4711;
         assert_se(c.automatic_string_property = strdup("dudeldu"));
+#if 1 /// elogind: see the sd-bus property cache
+        assert_se(c.cached = strdup("cached"));
+#endif // 1
 
         assert_se(socketpair(AF_UNIX, SOCK_STREAM, 0, c.fds) >= 0);
 
@@ -671,6 +976,9 @@ int main(int argc, char *argv[]) {
 
         free(c.something);
         free(c.automatic_string_property);
+#if 1 /// elogind: see the sd-bus property cache
+        free(c.cached);
+#endif // 1
 
         return EXIT_SUCCESS;
 }
@@ -0,0 +1,517 @@
+/* SPDX-License-Identifier: LGPL-2.1-or-later */
+
+#include <pthread.h>
+#include <sys/socket.h>
+
+#include "sd-bus.h"
+#include "sd-json.h"
+
+#include "alloc-util.h"
+#include "bus-internal.h"
+#include "bus-match.h"
+#include "bus-message.h"
+#include "fd-util.h"
+#include "sort-util.h"
+#include "string-util.h"
+#include "strv.h"
+#include "tests.h"
+#include "time-util.h"
+
+/* Micro benchmarks for the sd-bus code paths logind depends on. Human readable results are logged, the
+ * machine readable ones are written to stdout as one JSON array, so that runs can be compared against each
+ * other when carrying sd-bus patches. Usage: test-bus-perf [TIME-PER-BENCHMARK] */
+
+#define N_MATCHES 4096U
+#define N_PEERS 64U
+#define N_LATENCY_SAMPLES_MAX (1024U*1024U)
+#define N_LIST_ENTRIES 16U
+
+static usec_t arg_loop_usec = 200 * USEC_PER_MSEC;
+
+typedef struct SessionData {
+        char *string;
+        uint32_t u;
+        int b;
+        uint64_t t;
+        char **strv;
+} SessionData;
+
+static int property_get_user(
+                sd_bus *bus,
+                const char *path,
+                const char *interface,
+                const char *property,
+                sd_bus_message *reply,
+                void *userdata,
+                sd_bus_error *error) {
+
+        return sd_bus_message_append(reply, "(uo)", UINT32_C(1000), "/org/freedesktop/login1/user/_1000");
+}
+
+static int property_get_seat(
+                sd_bus *bus,
+                const char *path,
+                const char *interface,
+                const char *property,
+                sd_bus_message *reply,
+                void *userdata,
+                sd_bus_error *error) {
+
+        return sd_bus_message_append(reply, "(so)", "seat0", "/org/freedesktop/login1/seat/seat0");
+}
+
+static int method_ping(sd_bus_message *m, void *userdata, sd_bus_error *error) {
+        return sd_bus_reply_method_return(m, NULL);
+}
+
+static int method_exit(sd_bus_message *m, void *userdata, sd_bus_error *error) {
+        bool *quit = ASSERT_PTR(userdata);
+
+        *quit = true;
+        return sd_bus_reply_method_return(m, NULL);
+}
+
+/* Modelled after the Session and Manager objects of logind, 40 properties in total */
+static const sd_bus_vtable session_vtable[] = {
+        SD_BUS_VTABLE_START(0),
+        SD_BUS_PROPERTY("Id", "s", NULL, offsetof(SessionData, string), SD_BUS_VTABLE_PROPERTY_CONST),
+        SD_BUS_PROPERTY("User", "(uo)", property_get_user, 0, SD_BUS_VTABLE_PROPERTY_CONST),
+        SD_BUS_PROPERTY("Name", "s", NULL, offsetof(SessionData, string), SD_BUS_VTABLE_PROPERTY_CONST),
+        SD_BUS_PROPERTY("Timestamp", "t", NULL, offsetof(SessionData, t), SD_BUS_VTABLE_PROPERTY_CONST),
+        SD_BUS_PROPERTY("TimestampMonotonic", "t", NULL, offsetof(SessionData, t), SD_BUS_VTABLE_PROPERTY_CONST),
+        SD_BUS_PROPERTY("VTNr", "u", NULL, offsetof(SessionData, u), SD_BUS_VTABLE_PROPERTY_CONST),
+        SD_BUS_PROPERTY("Seat", "(so)", property_get_seat, 0, SD_BUS_VTABLE_PROPERTY_CONST),
+        SD_BUS_PROPERTY("TTY", "s", NULL, offsetof(SessionData, string), SD_BUS_VTABLE_PROPERTY_EMITS_CHANGE),
+        SD_BUS_PROPERTY("Display", "s", NULL, offsetof(SessionData, string), SD_BUS_VTABLE_PROPERTY_EMITS_CHANGE),
+        SD_BUS_PROPERTY("Remote", "b", NULL, offsetof(SessionData, b), SD_BUS_VTABLE_PROPERTY_CONST),
+        SD_BUS_PROPERTY("RemoteHost", "s", NULL, offsetof(SessionData, string), SD_BUS_VTABLE_PROPERTY_CONST),
+        SD_BUS_PROPERTY("RemoteUser", "s", NULL, offsetof(SessionData, string), SD_BUS_VTABLE_PROPERTY_CONST),
+        SD_BUS_PROPERTY("Service", "s", NULL, offsetof(SessionData, string), SD_BUS_VTABLE_PROPERTY_CONST),
+        SD_BUS_PROPERTY("Desktop", "s", NULL, offsetof(SessionData, string), SD_BUS_VTABLE_PROPERTY_CONST),
+        SD_BUS_PROPERTY("Scope", "s", NULL, offsetof(SessionData, string), SD_BUS_VTABLE_PROPERTY_CONST),
+        SD_BUS_PROPERTY("Leader", "u", NULL, offsetof(SessionData, u), SD_BUS_VTABLE_PROPERTY_CONST),
+        SD_BUS_PROPERTY("Audit", "u", NULL, offsetof(SessionData, u), SD_BUS_VTABLE_PROPERTY_CONST),
+        SD_BUS_PROPERTY("Type", "s", NULL, offsetof(SessionData, string), SD_BUS_VTABLE_PROPERTY_EMITS_CHANGE),
+        SD_BUS_PROPERTY("Class", "s", NULL, offsetof(SessionData, string), SD_BUS_VTABLE_PROPERTY_EMITS_CHANGE),
+        SD_BUS_PROPERTY("Active", "b", NULL, offsetof(SessionData, b), SD_BUS_VTABLE_PROPERTY_EMITS_CHANGE),
+        SD_BUS_PROPERTY("State", "s", NULL, offsetof(SessionData, string), 0),
+        SD_BUS_PROPERTY("IdleHint", "b", NULL, offsetof(SessionData, b), SD_BUS_VTABLE_PROPERTY_EMITS_CHANGE),
+        SD_BUS_PROPERTY("IdleSinceHint", "t", NULL, offsetof(SessionData, t), SD_BUS_VTABLE_PROPERTY_EMITS_CHANGE),
+        SD_BUS_PROPERTY("IdleSinceHintMonotonic", "t", NULL, offsetof(SessionData, t), SD_BUS_VTABLE_PROPERTY_EMITS_CHANGE),
+        SD_BUS_PROPERTY("CanIdle", "b", NULL, offsetof(SessionData, b), SD_BUS_VTABLE_PROPERTY_EMITS_CHANGE),
+        SD_BUS_PROPERTY("CanLock", "b", NULL, offsetof(SessionData, b), SD_BUS_VTABLE_PROPERTY_EMITS_CHANGE),
+        SD_BUS_PROPERTY("LockedHint", "b", NULL, offsetof(SessionData, b), SD_BUS_VTABLE_PROPERTY_EMITS_CHANGE),
+        SD_BUS_PROPERTY("NAutoVTs", "u", NULL, offsetof(SessionData, u), SD_BUS_VTABLE_PROPERTY_CONST),
+        SD_BUS_PROPERTY("KillUserProcesses", "b", NULL, offsetof(SessionData, b), SD_BUS_VTABLE_PROPERTY_CONST),
+        SD_BUS_PROPERTY("KillOnlyUsers", "as", NULL, offsetof(SessionData, strv), SD_BUS_VTABLE_PROPERTY_CONST),
+        SD_BUS_PROPERTY("KillExcludeUsers", "as", NULL, offsetof(SessionData, strv), SD_BUS_VTABLE_PROPERTY_CONST),
+        SD_BUS_PROPERTY("IdleAction", "s", NULL, offsetof(SessionData, string), SD_BUS_VTABLE_PROPERTY_CONST),
+        SD_BUS_PROPERTY("IdleActionUSec", "t", NULL, offsetof(SessionData, t), SD_BUS_VTABLE_PROPERTY_CONST),
+        SD_BUS_PROPERTY("InhibitDelayMaxUSec", "t", NULL, offsetof(SessionData, t), SD_BUS_VTABLE_PROPERTY_CONST),
+        SD_BUS_PROPERTY("HandlePowerKey", "s", NULL, offsetof(SessionData, string), SD_BUS_VTABLE_PROPERTY_CONST),
+        SD_BUS_PROPERTY("HandleLidSwitch", "s", NULL, offsetof(SessionData, string), SD_BUS_VTABLE_PROPERTY_CONST),
+        SD_BUS_PROPERTY("PreparingForShutdown", "b", NULL, offsetof(SessionData, b), 0),
+        SD_BUS_PROPERTY("PreparingForSleep", "b", NULL, offsetof(SessionData, b), 0),
+        SD_BUS_PROPERTY("Docked", "b", NULL, offsetof(SessionData, b), 0),
+        SD_BUS_PROPERTY("NCurrentSessions", "t", NULL, offsetof(SessionData, t), 0),
+        SD_BUS_VTABLE_END
+};
+
+static const sd_bus_vtable benchmark_vtable[] = {
+        SD_BUS_VTABLE_START(0),
+        SD_BUS_METHOD("Ping", NULL, NULL, method_ping, 0),
+        SD_BUS_METHOD("Exit", NULL, NULL, method_exit, 0),
+        SD_BUS_VTABLE_END
+};
+
+static void connect_pair(sd_bus **ret_server, sd_bus **ret_client) {
+        _cleanup_(sd_bus_flush_close_unrefp) sd_bus *server = NULL, *client = NULL;
+        _cleanup_close_pair_ int pair[2] = EBADF_PAIR;
+        sd_id128_t id;
+
+        assert_se(ret_server);
+        assert_se(ret_client);
+
+        assert_se(socketpair(AF_UNIX, SOCK_STREAM|SOCK_CLOEXEC|SOCK_NONBLOCK, 0, pair) >= 0);
+        assert_se(sd_id128_randomize(&id) >= 0);
+
+        assert_se(sd_bus_new(&server) >= 0);
+        assert_se(sd_bus_set_fd(server, pair[0], pair[0]) >= 0);
+        TAKE_FD(pair[0]);
+        assert_se(sd_bus_set_server(server, true, id) >= 0);
+        assert_se(sd_bus_start(server) >= 0);
+
+        assert_se(sd_bus_new(&client) >= 0);
+        assert_se(sd_bus_set_fd(client, pair[1], pair[1]) >= 0);
+        TAKE_FD(pair[1]);
+        assert_se(sd_bus_start(client) >= 0);
+
+        /* Both ends live in the same thread here, hence drive the authentication of both alternately */
+        while (sd_bus_is_ready(server) <= 0 || sd_bus_is_ready(client) <= 0) {
+                assert_se(sd_bus_process(server, NULL) >= 0);
+                assert_se(sd_bus_process(client, NULL) >= 0);
+        }
+
+        *ret_server = TAKE_PTR(server);
+        *ret_client = TAKE_PTR(client);
+}
+
+static void add_result(
+                sd_json_variant **results,
+                const char *name,
+                uint64_t n,
+                nsec_t elapsed,
+                const char *unit) {
+
+        assert_se(results);
+        assert_se(name);
+        assert_se(n > 0);
+        assert_se(unit);
+
+        log_info("%-40s %10" PRIu64 " %s/s %10" PRIu64 " ns/%s",
+                 name, n * NSEC_PER_SEC / MAX(elapsed, UINT64_C(1)), unit, elapsed / n, unit);
+
+        assert_se(sd_json_variant_append_arraybo(
+                                  results,
+                                  SD_JSON_BUILD_PAIR_STRING("benchmark", name),
+                                  SD_JSON_BUILD_PAIR_STRING("unit", unit),
+                                  SD_JSON_BUILD_PAIR_UNSIGNED("count", n),
+                                  SD_JSON_BUILD_PAIR_UNSIGNED("elapsedNSec", elapsed),
+                                  SD_JSON_BUILD_PAIR_UNSIGNED("nsecPerOp", elapsed / n),
+                                  SD_JSON_BUILD_PAIR_UNSIGNED("opsPerSec", n * NSEC_PER_SEC / MAX(elapsed, UINT64_C(1))))
+                  >= 0);
+}
+
+typedef struct MarshalCase {
+        const char *name;
+        const char *signature;
+        void (*build)(sd_bus *bus, sd_bus_message *call, sd_bus_message **ret);
+} MarshalCase;
+
+static void build_session_new(sd_bus *bus, sd_bus_message *call, sd_bus_message **ret) {
+        _cleanup_(sd_bus_message_unrefp) sd_bus_message *m = NULL;
+
+        assert_se(sd_bus_message_new_signal(bus, &m, "/org/freedesktop/login1", "org.freedesktop.login1.Manager", "SessionNew") >= 0);
+        assert_se(sd_bus_message_append(m, "so", "1", "/org/freedesktop/login1/session/_1") >= 0);
+
+        *ret = TAKE_PTR(m);
+}
+
+static void build_properties_changed(sd_bus *bus, sd_bus_message *call, sd_bus_message **ret) {
+        _cleanup_(sd_bus_message_unrefp) sd_bus_message *m = NULL;
+
+        assert_se(sd_bus_message_new_signal(bus, &m, "/org/freedesktop/login1/session/_1", "org.freedesktop.DBus.Properties", "PropertiesChanged") >= 0);
+        assert_se(sd_bus_message_append(m, "sa{sv}as",
+                                        "org.freedesktop.login1.Session",
+                                        4,
+                                        "Active", "b", true,
+                                        "State", "s", "active",
+                                        "IdleHint", "b", false,
+                                        "IdleSinceHint", "t", UINT64_C(0),
+                                        1, "Display") >= 0);
+
+        *ret = TAKE_PTR(m);
+}
+
+static void build_list_sessions_reply(sd_bus *bus, sd_bus_message *call, sd_bus_message **ret) {
+        _cleanup_(sd_bus_message_unrefp) sd_bus_message *m = NULL;
+
+        assert_se(sd_bus_message_new_method_return(call, &m) >= 0);
+        assert_se(sd_bus_message_open_container(m, 'a', "(susso)") >= 0);
+        for (unsigned i = 0; i < N_LIST_ENTRIES; i++)
+                assert_se(sd_bus_message_append(m, "(susso)", "c1", UINT32_C(1000), "user", "seat0",
+                                                "/org/freedesktop/login1/session/c1") >= 0);
+        assert_se(sd_bus_message_close_container(m) >= 0);
+
+        *ret = TAKE_PTR(m);
+}
+
+static void build_create_session(sd_bus *bus, sd_bus_message *call, sd_bus_message **ret) {
+        _cleanup_(sd_bus_message_unrefp) sd_bus_message *m = NULL;
+
+        assert_se(sd_bus_message_new_method_call(bus, &m, "org.freedesktop.login1", "/org/freedesktop/login1",
+                                                 "org.freedesktop.login1.Manager", "CreateSession") >= 0);
+        assert_se(sd_bus_message_append(m, "uusssssussbss",
+                                        UINT32_C(1000), UINT32_C(4711), "sshd", "tty", "user",
+                                        "", "", UINT32_C(0), "", "", true, "example.com", "") >= 0);
+        assert_se(sd_bus_message_append(m, "a(sv)", 0) >= 0);
+
+        *ret = TAKE_PTR(m);
+}
+
+static const MarshalCase marshal_cases[] = {
+        { "SessionNew",         "so",                 build_session_new         },
+        { "PropertiesChanged",  "sa{sv}as",           build_properties_changed  },
+        { "ListSessions-reply", "a(susso)",           build_list_sessions_reply },
+        { "CreateSession",      "uusssssussbssa(sv)", build_create_session      },
+};
+
+static void bench_marshal(sd_bus *bus, sd_json_variant **results) {
+        _cleanup_(sd_bus_message_unrefp) sd_bus_message *call = NULL;
+        uint64_t cookie = 0;
+
+        /* Replies need a sealed method call to refer to */
+        assert_se(sd_bus_message_new_method_call(bus, &call, "org.freedesktop.login1", "/org/freedesktop/login1",
+                                                 "org.freedesktop.login1.Manager", "ListSessions") >= 0);
+        assert_se(sd_bus_message_seal(call, ++cookie, 0) >= 0);
+
+        FOREACH_ELEMENT(c, marshal_cases) {
+                _cleanup_(sd_bus_message_unrefp) sd_bus_message *sample = NULL;
+                _cleanup_free_ char *name = NULL;
+                _cleanup_free_ void *blob = NULL;
+                size_t size;
+                uint64_t n;
+                nsec_t t;
+
+                c->build(bus, call, &sample);
+                assert_se(sd_bus_message_seal(sample, ++cookie, 0) >= 0);
+                assert_se(streq(sd_bus_message_get_signature(sample, true), c->signature));
+                assert_se(bus_message_get_blob(sample, &blob, &size) >= 0);
+
+                t = now_nsec(CLOCK_MONOTONIC);
+                for (n = 0; now_nsec(CLOCK_MONOTONIC) < t + arg_loop_usec * NSEC_PER_USEC; n++) {
+                        _cleanup_(sd_bus_message_unrefp) sd_bus_message *m = NULL;
+
+                        c->build(bus, call, &m);
+                        assert_se(sd_bus_message_seal(m, ++cookie, 0) >= 0);
+                }
+                t = now_nsec(CLOCK_MONOTONIC) - t;
+
+                assert_se(name = strjoin("construct/", c->name, "(", c->signature, ")"));
+                add_result(results, name, n, t, "msg");
+                name = mfree(name);
+
+                t = now_nsec(CLOCK_MONOTONIC);
+                for (n = 0; now_nsec(CLOCK_MONOTONIC) < t + arg_loop_usec * NSEC_PER_USEC; n++) {
+                        _cleanup_(sd_bus_message_unrefp) sd_bus_message *m = NULL;
+                        void *copy;
+
+                        /* The message takes possession of the copy */
+                        assert_se(copy = memdup(blob, size));
+                        assert_se(bus_message_from_malloc(bus, copy, size, NULL, 0, NULL, &m) >= 0);
+                        assert_se(sd_bus_message_skip(m, c->signature) >= 0);
+                }
+                t = now_nsec(CLOCK_MONOTONIC) - t;
+
+                assert_se(name = strjoin("parse/", c->name, "(", c->signature, ")"));
+                add_result(results, name, n, t, "msg");
+        }
+}
+
+static int match_count(sd_bus_message *m, void *userdata, sd_bus_error *ret_error) {
+        unsigned *n_called = ASSERT_PTR(userdata);
+
+        (*n_called)++;
+        return 0;
+}
+
+static void bench_match(sd_bus *bus, sd_json_variant **results) {
+        _cleanup_(sd_bus_message_unrefp) sd_bus_message *m = NULL;
+        unsigned n_called = 0;
+        uint64_t n;
+        nsec_t t;
+
+        /* Adds floating matches, which go away together with the connection */
+        for (unsigned i = 0; i < N_MATCHES; i++) {
+                _cleanup_free_ char *match = NULL;
+
+                assert_se(asprintf(&match,
+                                   i % 2 == 0 ?
+                                   "type='signal',interface='org.freedesktop.DBus.Properties',member='PropertiesChanged',path='/org/freedesktop/login1/session/_%u'" :
+                                   "type='signal',sender='org.freedesktop.login1',path_namespace='/org/freedesktop/login1/user/_%u'",
+                                   i / 2) >= 0);
+                assert_se(sd_bus_add_match(bus, NULL, match, match_count, &n_called) >= 0);
+        }
+
+        assert_se(sd_bus_message_new_signal(bus, &m, "/org/freedesktop/login1/session/_1", "org.freedesktop.DBus.Properties", "PropertiesChanged") >= 0);
+        assert_se(sd_bus_message_append(m, "sa{sv}as", "org.freedesktop.login1.Session", 0, 0) >= 0);
+        assert_se(sd_bus_message_seal(m, 1, 0) >= 0);
+
+        t = now_nsec(CLOCK_MONOTONIC);
+        for (n = 0; now_nsec(CLOCK_MONOTONIC) < t + arg_loop_usec * NSEC_PER_USEC; n++) {
+                /* Every match callback is invoked at most once per iteration, see process_match() */
+                bus->iteration_counter++;
+                assert_se(bus_match_run(bus, &bus->match_callbacks, m) >= 0);
+        }
+        t = now_nsec(CLOCK_MONOTONIC) - t;
+
+        assert_se(n_called == n);
+        add_result(results, "match/" STRINGIFY(N_MATCHES) "-matches", n, t, "msg");
+}
+
+static void bench_fanout(sd_json_variant **results) {
+        sd_bus *servers[N_PEERS] = {}, *clients[N_PEERS] = {};
+        uint64_t n;
+        nsec_t t;
+
+        for (unsigned i = 0; i < N_PEERS; i++)
+                connect_pair(servers + i, clients + i);
+
+        t = now_nsec(CLOCK_MONOTONIC);
+        for (n = 0; now_nsec(CLOCK_MONOTONIC) < t + arg_loop_usec * NSEC_PER_USEC; n++) {
+                for (unsigned i = 0; i < N_PEERS; i++)
+                        assert_se(sd_bus_emit_signal(servers[i], "/org/freedesktop/login1", "org.freedesktop.login1.Manager",
+                                                     "SessionNew", "so", "1", "/org/freedesktop/login1/session/_1") >= 0);
+
+                for (unsigned i = 0; i < N_PEERS; i++)
+                        for (;;) {
+                                _cleanup_(sd_bus_message_unrefp) sd_bus_message *m = NULL;
+                                int r;
+
+                                r = sd_bus_process(clients[i], &m);
+                                assert_se(r >= 0);
+                                if (m) {
+                                        assert_se(sd_bus_message_is_signal(m, "org.freedesktop.login1.Manager", "SessionNew"));
+                                        break;
+                                }
+                                if (r == 0)
+                                        assert_se(sd_bus_wait(clients[i], UINT64_MAX) >= 0);
+                        }
+        }
+        t = now_nsec(CLOCK_MONOTONIC) - t;
+
+        add_result(results, "fanout/" STRINGIFY(N_PEERS) "-peers", n, t, "round");
+        add_result(results, "fanout/" STRINGIFY(N_PEERS) "-peers-per-signal", n * N_PEERS, t, "msg");
+
+        for (unsigned i = 0; i < N_PEERS; i++) {
+                sd_bus_flush_close_unref(servers[i]);
+                sd_bus_flush_close_unref(clients[i]);
+        }
+}
+
+typedef struct Context {
+        sd_bus *bus;
+        SessionData data;
+        bool quit;
+} Context;
+
+static void *server(void *p) {
+        Context *c = ASSERT_PTR(p);
+
+        assert_se(sd_bus_add_object_vtable(c->bus, NULL, "/org/freedesktop/login1/session/_1",
+                                           "org.freedesktop.login1.Session", session_vtable, &c->data) >= 0);
+        assert_se(sd_bus_add_object_vtable(c->bus, NULL, "/", "benchmark.server", benchmark_vtable, &c->quit) >= 0);
+
+        while (!c->quit) {
+                int r;
+
+                r = sd_bus_process(c->bus, NULL);
+                assert_se(r >= 0);
+                if (r == 0)
+                        assert_se(sd_bus_wait(c->bus, UINT64_MAX) >= 0);
+        }
+
+        assert_se(sd_bus_flush(c->bus) >= 0);
+        return NULL;
+}
+
+static int nsec_compare(const nsec_t *a, const nsec_t *b) {
+        return CMP(*a, *b);
+}
+
+static void bench_getall(sd_bus *bus, sd_json_variant **results) {
+        uint64_t n;
+        nsec_t t;
+
+        t = now_nsec(CLOCK_MONOTONIC);
+        for (n = 0; now_nsec(CLOCK_MONOTONIC) < t + arg_loop_usec * NSEC_PER_USEC; n++) {
+                _cleanup_(sd_bus_message_unrefp) sd_bus_message *reply = NULL;
+
+                assert_se(sd_bus_call_method(bus, NULL, "/org/freedesktop/login1/session/_1",
+                                             "org.freedesktop.DBus.Properties", "GetAll",
+                                             NULL, &reply, "s", "org.freedesktop.login1.Session") >= 0);
+                assert_se(sd_bus_message_skip(reply, "a{sv}") >= 0);
+        }
+        t = now_nsec(CLOCK_MONOTONIC) - t;
+
+        add_result(results, "getall/40-properties", n, t, "call");
+}
+
+static void bench_call_latency(sd_bus *bus, sd_json_variant **results) {
+        _cleanup_free_ nsec_t *samples = NULL;
+        size_t n = 0;
+        nsec_t t;
+
+        assert_se(samples = new(nsec_t, N_LATENCY_SAMPLES_MAX));
+
+        t = now_nsec(CLOCK_MONOTONIC);
+        while (n < N_LATENCY_SAMPLES_MAX && now_nsec(CLOCK_MONOTONIC) < t + arg_loop_usec * NSEC_PER_USEC) {
+                nsec_t begin;
+
+                begin = now_nsec(CLOCK_MONOTONIC);
+                assert_se(sd_bus_call_method(bus, NULL, "/", "benchmark.server", "Ping", NULL, NULL, NULL) >= 0);
+                samples[n++] = now_nsec(CLOCK_MONOTONIC) - begin;
+        }
+        t = now_nsec(CLOCK_MONOTONIC) - t;
+
+        assert_se(n > 0);
+        typesafe_qsort(samples, n, nsec_compare);
+
+#define PERCENTILE(p) samples[(n - 1) * (p) / 1000]
+
+        log_info("%-40s p50=%" PRIu64 "ns p90=%" PRIu64 "ns p99=%" PRIu64 "ns p99.9=%" PRIu64 "ns max=%" PRIu64 "ns",
+                 "call/latency", PERCENTILE(500), PERCENTILE(900), PERCENTILE(990), PERCENTILE(999), samples[n - 1]);
+
+        assert_se(sd_json_variant_append_arraybo(
+                                  results,
+                                  SD_JSON_BUILD_PAIR_STRING("benchmark", "call/latency"),
+                                  SD_JSON_BUILD_PAIR_STRING("unit", "call"),
+                                  SD_JSON_BUILD_PAIR_UNSIGNED("count", n),
+                                  SD_JSON_BUILD_PAIR_UNSIGNED("elapsedNSec", t),
+                                  SD_JSON_BUILD_PAIR_UNSIGNED("minNSec", samples[0]),
+                                  SD_JSON_BUILD_PAIR_UNSIGNED("p50NSec", PERCENTILE(500)),
+                                  SD_JSON_BUILD_PAIR_UNSIGNED("p90NSec", PERCENTILE(900)),
+                                  SD_JSON_BUILD_PAIR_UNSIGNED("p99NSec", PERCENTILE(990)),
+                                  SD_JSON_BUILD_PAIR_UNSIGNED("p999NSec", PERCENTILE(999)),
+                                  SD_JSON_BUILD_PAIR_UNSIGNED("maxNSec", samples[n - 1]))
+                  >= 0);
+
+#undef PERCENTILE
+}
+
+int main(int argc, char *argv[]) {
+        _cleanup_(sd_json_variant_unrefp) sd_json_variant *results = NULL;
+        _cleanup_(sd_bus_flush_close_unrefp) sd_bus *a = NULL, *b = NULL;
+        _cleanup_strv_free_ char **users = NULL;
+        Context c = {};
+        pthread_t s;
+
+        test_setup_logging(LOG_INFO);
+
+        if (argc > 1)
+                assert_se(parse_sec(argv[1], &arg_loop_usec) >= 0);
+        assert_se(arg_loop_usec > 0);
+
+        assert_se(sd_json_variant_new_array(&results, NULL, 0) >= 0);
+
+        connect_pair(&a, &b);
+        bench_marshal(b, &results);
+        bench_match(a, &results);
+        a = sd_bus_flush_close_unref(a);
+        b = sd_bus_flush_close_unref(b);
+
+        bench_fanout(&results);
+
+        assert_se(users = strv_new("root", "gdm"));
+        c.data = (SessionData) {
+                .string = (char*) "active",
+                .u = 1000,
+                .b = true,
+                .t = UINT64_C(1700000000000000),
+                .strv = users,
+        };
+
+        connect_pair(&c.bus, &b);
+        assert_se(pthread_create(&s, NULL, server, &c) == 0);
+
+        bench_getall(b, &results);
+        bench_call_latency(b, &results);
+
+        assert_se(sd_bus_call_method(b, NULL, "/", "benchmark.server", "Exit", NULL, NULL, NULL) >= 0);
+        assert_se(pthread_join(s, NULL) == 0);
+        c.bus = sd_bus_flush_close_unref(c.bus);
+
+        assert_se(sd_json_variant_dump(results, SD_JSON_FORMAT_NEWLINE|SD_JSON_FORMAT_FLUSH, stdout, NULL) >= 0);
+
+        return 0;
+}
@@ -11,6 +11,9 @@
 #include "memory-util.h"
 #include "string-util.h"
 #include "tests.h"
+/// Additional includes needed by elogind
+#include "bus-kernel.h"
+#include "bus-message.h"
 
 struct context {
         int fds[2];
@@ -20,8 +23,40 @@ struct context {
 
         bool client_anonymous_auth;
         bool server_anonymous_auth;
+#if 1 /// elogind: large bodies passed as sealed memfd
+        bool client_negotiate_memfd;
+        bool server_negotiate_memfd;
+#endif // 1
 };
 
+#if 1 /// elogind: large bodies passed as sealed memfd
+#define BLOB_SIZE (MEMFD_MIN_SIZE + 17)
+
+static void blob_fill(uint8_t *p, size_t n) {
+        for (size_t i = 0; i < n; i++)
+                p[i] = (uint8_t) (i * 7 + (i >> 12));
+}
+
+static void blob_check(const uint8_t *p, size_t n) {
+        assert_se(n == BLOB_SIZE);
+
+        for (size_t i = 0; i < n; i++)
+                assert_se(p[i] == (uint8_t) (i * 7 + (i >> 12)));
+}
+
+static int append_blob(sd_bus_message *m) {
+        void *p;
+        int r;
+
+        r = sd_bus_message_append_array_space(m, 'y', BLOB_SIZE, &p);
+        if (r < 0)
+                return r;
+
+        blob_fill(p, BLOB_SIZE);
+        return 0;
+}
+#endif // 1
+
 static int _server(struct context *c) {
         _cleanup_(sd_bus_flush_close_unrefp) sd_bus *bus = NULL;
         sd_id128_t id;
@@ -35,6 +70,9 @@ static int _server(struct context *c) {
         assert_se(sd_bus_set_server(bus, 1, id) >= 0);
         assert_se(sd_bus_set_anonymous(bus, c->server_anonymous_auth) >= 0);
         assert_se(sd_bus_negotiate_fds(bus, c->server_negotiate_unix_fds) >= 0);
+#if 1 /// elogind: large bodies passed as sealed memfd
+        assert_se(sd_bus_negotiate_memfd(bus, c->server_negotiate_memfd) >= 0);
+#endif // 1
         assert_se(sd_bus_start(bus) >= 0);
 
         while (!quit) {
@@ -65,8 +103,33 @@ static int _server(struct context *c) {
                         if (r < 0)
                                 return log_error_errno(r, "Failed to allocate return: %m");
 
+#if 1 /// elogind: large bodies passed as sealed memfd
+                        assert_se(bus->can_memfd ==
+                                  (c->server_negotiate_unix_fds && c->client_negotiate_unix_fds &&
+                                   c->server_negotiate_memfd && c->client_negotiate_memfd));
+#endif // 1
+
                         quit = true;
 
+#if 1 /// elogind: large bodies passed as sealed memfd, echo them back
+                } else if (sd_bus_message_is_method_call(m, "org.freedesktop.systemd.test", "Echo")) {
+                        const void *p;
+                        size_t sz;
+
+                        assert_se(BUS_MESSAGE_BODY_IN_MEMFD(m) == bus->can_memfd);
+
+                        assert_se(sd_bus_message_read_array(m, 'y', &p, &sz) >= 0);
+                        blob_check(p, sz);
+
+                        r = sd_bus_message_new_method_return(m, &reply);
+                        if (r < 0)
+                                return log_error_errno(r, "Failed to allocate return: %m");
+
+                        r = append_blob(reply);
+                        if (r < 0)
+                                return log_error_errno(r, "Failed to append to return: %m");
+#endif // 1
+
                 } else if (sd_bus_message_is_method_call(m, NULL, NULL)) {
                         r = sd_bus_message_new_method_error(
                                         m,
@@ -92,6 +155,10 @@ static void* server(void *p) {
 
 static int client(struct context *c) {
         _cleanup_(sd_bus_message_unrefp) sd_bus_message *m = NULL, *reply = NULL;
+#if 1 /// elogind: large bodies passed as sealed memfd
+        _cleanup_(sd_bus_message_unrefp) sd_bus_message *echo = NULL, *echo_reply = NULL;
+        uint64_t echo_cookie = 0;
+#endif // 1
         _cleanup_(sd_bus_unrefp) sd_bus *bus = NULL;
         _cleanup_(sd_bus_error_free) sd_bus_error error = SD_BUS_ERROR_NULL;
         int r;
@@ -99,6 +166,9 @@ static int client(struct context *c) {
         assert_se(sd_bus_new(&bus) >= 0);
         assert_se(sd_bus_set_fd(bus, c->fds[1], c->fds[1]) >= 0);
         assert_se(sd_bus_negotiate_fds(bus, c->client_negotiate_unix_fds) >= 0);
+#if 1 /// elogind: large bodies passed as sealed memfd
+        assert_se(sd_bus_negotiate_memfd(bus, c->client_negotiate_memfd) >= 0);
+#endif // 1
         assert_se(sd_bus_set_anonymous(bus, c->client_anonymous_auth) >= 0);
         assert_se(sd_bus_start(bus) >= 0);
 
@@ -112,15 +182,73 @@ static int client(struct context *c) {
         if (r < 0)
                 return log_error_errno(r, "Failed to allocate method call: %m");
 
+#if 1 /// elogind: large bodies passed as sealed memfd
+        /* Queue the large body right in front of the Exit call, so that the latter follows it immediately
+         * in the byte stream. Only the header of the former is part of it if passed as memfd. */
+        if (c->client_negotiate_memfd) {
+                r = sd_bus_message_new_method_call(
+                                bus,
+                                &echo,
+                                "org.freedesktop.systemd.test",
+                                "/",
+                                "org.freedesktop.systemd.test",
+                                "Echo");
+                if (r < 0)
+                        return log_error_errno(r, "Failed to allocate method call: %m");
+
+                r = append_blob(echo);
+                if (r < 0)
+                        return log_error_errno(r, "Failed to append to method call: %m");
+
+                r = sd_bus_send(bus, echo, &echo_cookie);
+                if (r < 0)
+                        return log_error_errno(r, "Failed to send method call: %m");
+
+                assert_se(BUS_MESSAGE_BODY_IN_MEMFD(echo) == bus->can_memfd);
+        }
+#endif // 1
+
         r = sd_bus_call(bus, m, 0, &error, &reply);
         if (r < 0)
                 return log_error_errno(r, "Failed to issue method call: %s", bus_error_message(&error, r));
 
+#if 1 /// elogind: large bodies passed as sealed memfd
+        /* The reply to Echo came in first, and has been queued by sd_bus_call() */
+        if (c->client_negotiate_memfd) {
+                const void *p;
+                uint64_t cookie;
+                size_t sz;
+
+                for (;;) {
+                        r = sd_bus_process(bus, &echo_reply);
+                        if (r < 0)
+                                return log_error_errno(r, "Failed to process: %m");
+                        if (echo_reply)
+                                break;
+                        if (r == 0)
+                                return log_error_errno(SYNTHETIC_ERRNO(EIO), "Reply to Echo is missing.");
+                }
+
+                assert_se(sd_bus_message_get_reply_cookie(echo_reply, &cookie) >= 0);
+                assert_se(cookie == echo_cookie);
+                assert_se(BUS_MESSAGE_BODY_IN_MEMFD(echo_reply) == bus->can_memfd);
+
+                assert_se(sd_bus_message_read_array(echo_reply, 'y', &p, &sz) >= 0);
+                blob_check(p, sz);
+        }
+#endif // 1
+
         return 0;
 }
 
+#if 0 /// elogind also tests the negotiation of large bodies passed as sealed memfd
 static int test_one(bool client_negotiate_unix_fds, bool server_negotiate_unix_fds,
                     bool client_anonymous_auth, bool server_anonymous_auth) {
+#else // 0
+static int test_one_full(bool client_negotiate_unix_fds, bool server_negotiate_unix_fds,
+                         bool client_anonymous_auth, bool server_anonymous_auth,
+                         bool client_negotiate_memfd, bool server_negotiate_memfd) {
+#endif // 0
 
         struct context c;
         pthread_t s;
@@ -135,6 +263,10 @@ static int test_one(bool client_negotiate_unix_fds, bool server_negotiate_unix_f
         c.server_negotiate_unix_fds = server_negotiate_unix_fds;
         c.client_anonymous_auth = client_anonymous_auth;
         c.server_anonymous_auth = server_anonymous_auth;
+#if 1 /// elogind: large bodies passed as sealed memfd
+        c.client_negotiate_memfd = client_negotiate_memfd;
+        c.server_negotiate_memfd = server_negotiate_memfd;
+#endif // 1
 
         r = pthread_create(&s, NULL, server, &c);
         if (r != 0)
@@ -155,6 +287,16 @@ static int test_one(bool client_negotiate_unix_fds, bool server_negotiate_unix_f
         return 0;
 }
 
+#if 1 /// elogind: large bodies passed as sealed memfd
+static int test_one(bool client_negotiate_unix_fds, bool server_negotiate_unix_fds,
+                    bool client_anonymous_auth, bool server_anonymous_auth) {
+
+        return test_one_full(client_negotiate_unix_fds, server_negotiate_unix_fds,
+                             client_anonymous_auth, server_anonymous_auth,
+                             false, false);
+}
+#endif // 1
+
 int main(int argc, char *argv[]) {
         int r;
 
@@ -181,5 +323,22 @@ int main(int argc, char *argv[]) {
         r = test_one(true, true, true, false);
         assert_se(r == -EPERM);
 
+#if 1 /// elogind: large bodies passed as sealed memfd
+        r = test_one_full(true, true, false, false, true, true);
+        assert_se(r >= 0);
+
+        r = test_one_full(true, true, false, false, true, false);
+        assert_se(r >= 0);
+
+        r = test_one_full(true, true, true, true, true, true);
+        assert_se(r >= 0);
+
+        r = test_one_full(false, true, false, false, true, true);
+        assert_se(r >= 0);
+
+        r = test_one_full(true, false, false, false, true, true);
+        assert_se(r >= 0);
+#endif // 1
+
         return EXIT_SUCCESS;
 }
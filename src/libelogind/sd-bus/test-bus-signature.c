@@ -5,6 +5,149 @@
 #include "log.h"
 #include "string-util.h"
 #include "tests.h"
+/// Additional includes needed by elogind
+#include <pthread.h>
+#include <sys/socket.h>
+
+#include "bus-signature-cache.h"
+#include "fd-util.h"
+
+#if 1 /// elogind: see bus-signature-cache.c
+static void test_signature_cache(void) {
+        _cleanup_(sd_bus_close_unrefp) sd_bus *bus = NULL;
+        _cleanup_(sd_bus_message_unrefp) sd_bus_message *m = NULL;
+        _cleanup_close_pair_ int pair[2] = EBADF_PAIR;
+        const char *id1, *id2, *seat, *path, *key, *value;
+        _cleanup_(bus_signature_unrefp) BusSignature *sig = NULL, *other = NULL, *again = NULL;
+        char copy[] = "a(susso)";
+        uint32_t uid;
+        int b;
+
+        assert_se(socketpair(AF_UNIX, SOCK_STREAM|SOCK_CLOEXEC|SOCK_NONBLOCK, 0, pair) >= 0);
+
+        assert_se(sd_bus_new(&bus) >= 0);
+        assert_se(sd_bus_set_fd(bus, pair[0], pair[0]) >= 0);
+        TAKE_FD(pair[0]);
+        assert_se(sd_bus_start(bus) >= 0);
+
+        assert_se(sig = bus_signature_cache_get(bus, "a(susso)a{sv}"));
+        assert_se(sig->length == 13);
+        assert_se(sig->ops[0].type == 'a' && sig->ops[0].length == 8 && streq(sig->ops[0].contents, "(susso)"));
+        assert_se(sig->ops[1].type == '(' && sig->ops[1].length == 7 && streq(sig->ops[1].contents, "susso"));
+        assert_se(sig->ops[2].type == 's' && sig->ops[2].length == 1 && !sig->ops[2].contents);
+        assert_se(sig->ops[7].type == ')' && sig->ops[7].length == 0);
+        assert_se(sig->ops[8].type == 'a' && sig->ops[8].length == 5 && streq(sig->ops[8].contents, "{sv}"));
+        assert_se(sig->ops[9].type == '{' && sig->ops[9].length == 4 && streq(sig->ops[9].contents, "sv"));
+        assert_se(bus_signature_op(sig, sig->signature + 9) == sig->ops + 9);
+        assert_se(!bus_signature_op(sig, sig->signature + 13));
+        assert_se(!bus_signature_op(NULL, "s"));
+
+        /* Hits only for the same pointer */
+        assert_se(again = bus_signature_cache_get(bus, sig->key));
+        assert_se(again == sig);
+        again = bus_signature_unref(again);
+        assert_se(other = bus_signature_cache_get(bus, copy));
+        assert_se(other != sig);
+        assert_se(streq(other->signature, copy));
+
+        /* The string behind a cached pointer changed. The replaced entry stays valid for whoever still
+         * holds a reference on it. */
+        copy[1] = '{';
+        copy[7] = '}';
+        assert_se(!bus_signature_cache_get(bus, copy));
+        assert_se(streq(other->signature, "a(susso)"));
+        other = bus_signature_unref(other);
+        strcpy(copy, "a{sv}");
+        assert_se(other = bus_signature_cache_get(bus, copy));
+        assert_se(streq(other->signature, "a{sv}"));
+
+        assert_se(!bus_signature_cache_get(bus, "a"));
+        assert_se(!bus_signature_cache_get(bus, "(s"));
+        assert_se(!bus_signature_cache_get(bus, "()"));
+        assert_se(again = bus_signature_cache_get(bus, "{sv}"));
+        again = bus_signature_unref(again);
+
+        /* Compiled and regular paths produce the same */
+        assert_se(sd_bus_message_new_method_call(bus, &m, "org.freedesktop.login1", "/org/freedesktop/login1",
+                                                 "org.freedesktop.login1.Manager", "ListSessions") >= 0);
+        assert_se(sd_bus_message_append(m, "a(susso)a{sv}",
+                                        2,
+                                        "c1", UINT32_C(1000), "user", "seat0", "/org/freedesktop/login1/session/c1",
+                                        "c2", UINT32_C(1001), "other", "", "/org/freedesktop/login1/session/c2",
+                                        1,
+                                        "Active", "b", true) >= 0);
+        assert_se(sd_bus_message_append(m, "v", "a(susso)", 1, "c3", UINT32_C(0), "root", "seat0", "/") >= 0);
+        assert_se(sd_bus_message_append(m, "(s)", "x") >= 0);
+        assert_se(sd_bus_message_append(m, "(", "x") == -EINVAL);
+        assert_se(sd_bus_message_seal(m, 1, 0) >= 0);
+        assert_se(streq(sd_bus_message_get_signature(m, true), "a(susso)a{sv}v(s)"));
+
+        assert_se(sd_bus_message_read(m, "a(susso)", 2, &id1, &uid, NULL, &seat, &path, &id2, NULL, NULL, NULL, NULL) > 0);
+        assert_se(streq(id1, "c1") && uid == 1000 && streq(seat, "seat0") && streq(path, "/org/freedesktop/login1/session/c1"));
+        assert_se(streq(id2, "c2"));
+        assert_se(sd_bus_message_read(m, "a{sv}", 1, &key, "b", &b) > 0);
+        assert_se(streq(key, "Active") && b);
+        assert_se(sd_bus_message_read(m, "v", "a(susso)", 1, &id1, &uid, NULL, NULL, NULL) > 0);
+        assert_se(streq(id1, "c3") && uid == 0);
+        assert_se(sd_bus_message_read(m, "(i)", &b) == -ENXIO);
+        assert_se(sd_bus_message_read(m, "(s)", &value) > 0);
+        assert_se(streq(value, "x"));
+        assert_se(sd_bus_message_read(m, "s", &value) == -ENXIO);
+}
+
+static void *signature_cache_thread(void *p) {
+        sd_bus *bus = ASSERT_PTR(p);
+        char buffers[BUS_SIGNATURE_CACHE_SIZE][sizeof("a(su)")];
+
+        /* Signatures are looked up by pointer. Going through as many buffers as the cache has slots, and
+         * changing their contents each round, makes each lookup miss, and replace entries that another
+         * thread might be walking right now. */
+        for (unsigned i = 0; i < 16 * BUS_SIGNATURE_CACHE_SIZE; i++) {
+                _cleanup_(sd_bus_message_unrefp) sd_bus_message *m = NULL;
+                char *types = buffers[i % BUS_SIGNATURE_CACHE_SIZE];
+                bool swapped = (i / BUS_SIGNATURE_CACHE_SIZE) % 2;
+                const char *s;
+                uint32_t u;
+
+                strcpy(types, swapped ? "a(us)" : "a(su)");
+
+                assert_se(sd_bus_message_new_signal(bus, &m, "/", "org.freedesktop.systemd.test", "Test") >= 0);
+                if (swapped)
+                        assert_se(sd_bus_message_append(m, types, 1, i, "x") >= 0);
+                else
+                        assert_se(sd_bus_message_append(m, types, 1, "x", i) >= 0);
+                assert_se(sd_bus_message_seal(m, 1, 0) >= 0);
+                if (swapped)
+                        assert_se(sd_bus_message_read(m, types, 1, &u, &s) > 0);
+                else
+                        assert_se(sd_bus_message_read(m, types, 1, &s, &u) > 0);
+                assert_se(streq(s, "x") && u == i);
+        }
+
+        return NULL;
+}
+
+static void test_signature_cache_threads(void) {
+        _cleanup_(sd_bus_close_unrefp) sd_bus *bus = NULL;
+        _cleanup_close_pair_ int pair[2] = EBADF_PAIR;
+        pthread_t t[4];
+
+        /* sd-bus allows building and reading messages in another thread than the one owning the
+         * connection, the compiled signatures they share must stay valid */
+
+        assert_se(socketpair(AF_UNIX, SOCK_STREAM|SOCK_CLOEXEC|SOCK_NONBLOCK, 0, pair) >= 0);
+
+        assert_se(sd_bus_new(&bus) >= 0);
+        assert_se(sd_bus_set_fd(bus, pair[0], pair[0]) >= 0);
+        TAKE_FD(pair[0]);
+        assert_se(sd_bus_start(bus) >= 0);
+
+        FOREACH_ELEMENT(i, t)
+                assert_se(pthread_create(i, NULL, signature_cache_thread, bus) == 0);
+        FOREACH_ELEMENT(i, t)
+                assert_se(pthread_join(*i, NULL) == 0);
+}
+#endif // 1
 
 int main(int argc, char *argv[]) {
         char prefix[256];
@@ -146,5 +289,10 @@ int main(int argc, char *argv[]) {
         }
         assert_se(r == 3);
 
+#if 1 /// elogind: see bus-signature-cache.c
+        test_signature_cache();
+        test_signature_cache_threads();
+#endif // 1
+
         return 0;
 }
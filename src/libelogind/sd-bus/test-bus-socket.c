@@ -0,0 +1,274 @@
+/* SPDX-License-Identifier: LGPL-2.1-or-later */
+
+#include <fcntl.h>
+#include <sys/socket.h>
+#include <unistd.h>
+
+#include "sd-bus.h"
+#include "sd-event.h"
+
+#include "alloc-util.h"
+#include "bus-internal.h"
+#include "bus-message.h"
+#include "fd-util.h"
+#include "iovec-util.h"
+#include "socket-util.h"
+#include "tests.h"
+
+#define N_MESSAGES 64U
+#define N_BURST 16U
+
+typedef struct Receiver {
+        unsigned n;
+        unsigned n_fds;
+} Receiver;
+
+static size_t payload_size(unsigned i) {
+        /* Mix large messages, which are written partially, with small ones, several of which fit into one
+         * write */
+        return i % 4 == 0 ? 20000 + i : 16 + i;
+}
+
+static bool payload_has_fd(unsigned i) {
+        /* Single messages with fds as well as several in a row */
+        return IN_SET(i % 5, 0, 1);
+}
+
+static uint8_t payload_byte(unsigned i, size_t j) {
+        return (uint8_t) (i * 31 + j);
+}
+
+static void connect_pair(bool small_buffers, sd_bus **ret_server, sd_bus **ret_client) {
+        _cleanup_(sd_bus_flush_close_unrefp) sd_bus *server = NULL, *client = NULL;
+        _cleanup_close_pair_ int pair[2] = EBADF_PAIR;
+        int sz = 4096;
+        sd_id128_t id;
+
+        assert_se(ret_server);
+        assert_se(ret_client);
+
+        assert_se(socketpair(AF_UNIX, SOCK_STREAM|SOCK_CLOEXEC|SOCK_NONBLOCK, 0, pair) >= 0);
+        assert_se(sd_id128_randomize(&id) >= 0);
+
+        /* Keep the socket buffers small, so that large messages can only be written in pieces */
+        if (small_buffers) {
+                assert_se(setsockopt(pair[1], SOL_SOCKET, SO_SNDBUF, &sz, sizeof(sz)) >= 0);
+                assert_se(setsockopt(pair[0], SOL_SOCKET, SO_RCVBUF, &sz, sizeof(sz)) >= 0);
+        }
+
+        assert_se(sd_bus_new(&server) >= 0);
+        assert_se(sd_bus_set_fd(server, pair[0], pair[0]) >= 0);
+        TAKE_FD(pair[0]);
+        assert_se(sd_bus_set_server(server, true, id) >= 0);
+        assert_se(sd_bus_negotiate_fds(server, true) >= 0);
+        assert_se(sd_bus_start(server) >= 0);
+
+        assert_se(sd_bus_new(&client) >= 0);
+        assert_se(sd_bus_set_fd(client, pair[1], pair[1]) >= 0);
+        TAKE_FD(pair[1]);
+        assert_se(sd_bus_negotiate_fds(client, true) >= 0);
+        assert_se(sd_bus_start(client) >= 0);
+
+        /* Both ends live in the same thread here, hence drive the authentication of both alternately */
+        while (sd_bus_is_ready(server) <= 0 || sd_bus_is_ready(client) <= 0) {
+                assert_se(sd_bus_process(server, NULL) >= 0);
+                assert_se(sd_bus_process(client, NULL) >= 0);
+        }
+
+        assert_se(sd_bus_can_send(client, SD_BUS_TYPE_UNIX_FD) > 0);
+
+        *ret_server = TAKE_PTR(server);
+        *ret_client = TAKE_PTR(client);
+}
+
+static sd_bus_message* make_payload(sd_bus *bus, unsigned i) {
+        _cleanup_(sd_bus_message_unrefp) sd_bus_message *m = NULL;
+        _cleanup_close_pair_ int p[2] = EBADF_PAIR;
+        size_t n = payload_size(i);
+        uint8_t *data;
+
+        assert_se(sd_bus_message_new_signal(bus, &m, "/", "org.freedesktop.systemd.test", "Payload") >= 0);
+        assert_se(sd_bus_message_append(m, "u", i) >= 0);
+        assert_se(sd_bus_message_append_array_space(m, 'y', n, (void**) &data) >= 0);
+        for (size_t j = 0; j < n; j++)
+                data[j] = payload_byte(i, j);
+
+        /* The fd is a pipe with the index of its message in it, so that the receiver can tell if it got
+         * the right one */
+        if (payload_has_fd(i)) {
+                assert_se(pipe2(p, O_CLOEXEC) >= 0);
+                assert_se(write(p[1], &i, sizeof(i)) == sizeof(i));
+                assert_se(sd_bus_message_append(m, "h", p[0]) >= 0);
+        }
+
+        return TAKE_PTR(m);
+}
+
+static void send_payload(sd_bus *bus, unsigned i) {
+        _cleanup_(sd_bus_message_unrefp) sd_bus_message *m = NULL;
+
+        m = make_payload(bus, i);
+        assert_se(sd_bus_send(bus, m, NULL) >= 0);
+}
+
+static int on_payload(sd_bus_message *m, void *userdata, sd_bus_error *error) {
+        Receiver *r = ASSERT_PTR(userdata);
+        const void *data;
+        unsigned i, k;
+        size_t n;
+        int fd;
+
+        if (!sd_bus_message_is_signal(m, "org.freedesktop.systemd.test", "Payload"))
+                return 0;
+
+        /* In order, and complete */
+        assert_se(sd_bus_message_read(m, "u", &i) > 0);
+        assert_se(i == r->n);
+
+        assert_se(sd_bus_message_read_array(m, 'y', &data, &n) > 0);
+        assert_se(n == payload_size(i));
+        for (size_t j = 0; j < n; j++)
+                assert_se(((const uint8_t*) data)[j] == payload_byte(i, j));
+
+        /* Each message has exactly the fds that were sent along with it */
+        if (payload_has_fd(i)) {
+                assert_se(sd_bus_message_has_signature(m, "uayh"));
+                assert_se(sd_bus_message_read(m, "h", &fd) > 0);
+                assert_se(read(fd, &k, sizeof(k)) == sizeof(k));
+                assert_se(k == i);
+                r->n_fds++;
+        } else
+                assert_se(sd_bus_message_has_signature(m, "uay"));
+
+        assert_se(sd_bus_message_at_end(m, true) > 0);
+
+        r->n++;
+        return 0;
+}
+
+TEST(coalesce_writes) {
+        _cleanup_(sd_bus_flush_close_unrefp) sd_bus *server = NULL, *client = NULL;
+        _cleanup_(sd_event_unrefp) sd_event *e = NULL;
+        Receiver r = {};
+        bool partial = false;
+        unsigned n_fds = 0;
+
+        connect_pair(/* small_buffers= */ true, &server, &client);
+        assert_se(sd_bus_add_filter(server, NULL, on_payload, &r) >= 0);
+
+        /* Only the sender is attached to the event loop, so that it flushes its queue exactly once per
+         * iteration, while we decide when the receiver reads */
+        assert_se(sd_event_new(&e) >= 0);
+        assert_se(sd_bus_attach_event(client, e, SD_EVENT_PRIORITY_NORMAL) >= 0);
+        assert_se(sd_bus_set_coalesce_writes(client, true) >= 0);
+        assert_se(sd_bus_get_coalesce_writes(client) > 0);
+
+        for (unsigned i = 0; i < N_MESSAGES; i++) {
+                send_payload(client, i);
+                n_fds += payload_has_fd(i);
+        }
+
+        /* Everything is held back until the event loop runs */
+        assert_se(client->wqueue_size == N_MESSAGES);
+
+        while (r.n < N_MESSAGES) {
+                assert_se(sd_event_run(e, 0) >= 0);
+
+                /* The socket is too small for everything, the queue is written in pieces, and some of
+                 * these end in the middle of a message */
+                if (client->wqueue_size > 0 && client->windex > 0)
+                        partial = true;
+
+                while (sd_bus_process(server, NULL) > 0)
+                        ;
+        }
+
+        assert_se(partial);
+        assert_se(r.n == N_MESSAGES);
+        assert_se(r.n_fds == n_fds);
+        assert_se(client->wqueue_size == 0);
+
+        /* Turning coalescing off writes out what is queued right away, as far as the socket takes it */
+        send_payload(client, N_MESSAGES);
+        assert_se(client->wqueue_size == 1);
+        assert_se(client->windex == 0);
+        assert_se(sd_bus_set_coalesce_writes(client, false) >= 0);
+        assert_se(client->wqueue_size == 0 || client->windex > 0);
+
+        while (r.n < N_MESSAGES + 1) {
+                assert_se(sd_bus_process(client, NULL) >= 0);
+                assert_se(sd_bus_process(server, NULL) >= 0);
+        }
+}
+
+TEST(read_burst) {
+        _cleanup_(sd_bus_flush_close_unrefp) sd_bus *server = NULL, *client = NULL;
+        _cleanup_free_ int *fds = NULL;
+        _cleanup_free_ uint8_t *buf = NULL;
+        size_t size = 0, n_fds = 0;
+        Receiver r = {};
+        ssize_t k;
+
+        connect_pair(/* small_buffers= */ false, &server, &client);
+        assert_se(sd_bus_add_filter(server, NULL, on_payload, &r) >= 0);
+
+        /* Write a burst of messages, with and without fds, in a single sendmsg() call, bypassing the
+         * sender's queue. All fds arrive together with the first byte, and the receiver has to hand them
+         * to the right messages according to their UNIX_FDS header fields. */
+        for (unsigned i = 0; i < N_BURST; i++) {
+                _cleanup_(sd_bus_message_unrefp) sd_bus_message *m = NULL;
+                _cleanup_free_ void *blob = NULL;
+                size_t sz;
+
+                m = make_payload(client, i);
+                assert_se(sd_bus_message_seal(m, i + 1, 0) >= 0);
+                assert_se(bus_message_get_blob(m, &blob, &sz) >= 0);
+
+                assert_se(buf = realloc(buf, size + sz));
+                memcpy(buf + size, blob, sz);
+                size += sz;
+
+                /* The message closes its own fds when it is freed, keep copies until they are sent */
+                if (m->n_fds > 0)
+                        assert_se(fds = reallocarray(fds, n_fds + m->n_fds, sizeof(int)));
+                for (unsigned j = 0; j < m->n_fds; j++)
+                        assert_se((fds[n_fds++] = fcntl(m->fds[j], F_DUPFD_CLOEXEC, 3)) >= 0);
+        }
+
+        CMSG_BUFFER_TYPE(CMSG_SPACE(sizeof(int) * N_BURST)) control = {};
+        struct iovec iov = IOVEC_MAKE(buf, size);
+        struct msghdr mh = {
+                .msg_iov = &iov,
+                .msg_iovlen = 1,
+                .msg_control = &control,
+                .msg_controllen = CMSG_SPACE(sizeof(int) * n_fds),
+        };
+        struct cmsghdr *cmsg = CMSG_FIRSTHDR(&mh);
+
+        assert_se(n_fds > 1);
+        *cmsg = (struct cmsghdr) {
+                .cmsg_level = SOL_SOCKET,
+                .cmsg_type = SCM_RIGHTS,
+                .cmsg_len = CMSG_LEN(sizeof(int) * n_fds),
+        };
+        memcpy(CMSG_DATA(cmsg), fds, sizeof(int) * n_fds);
+
+        k = sendmsg(client->output_fd, &mh, MSG_NOSIGNAL);
+        assert_se(k >= 0);
+        assert_se((size_t) k == size);
+
+        close_many(fds, n_fds);
+
+        /* The first read picks up more than one message, the rest are queued */
+        while (r.n == 0)
+                assert_se(sd_bus_process(server, NULL) >= 0);
+        assert_se(server->rqueue_size > 0);
+
+        while (r.n < N_BURST)
+                assert_se(sd_bus_process(server, NULL) >= 0);
+
+        assert_se(r.n_fds == n_fds);
+        assert_se(server->n_fds == 0);
+}
+
+DEFINE_TEST_MAIN(LOG_INFO);
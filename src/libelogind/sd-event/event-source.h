@@ -12,6 +12,9 @@
 #include "list.h"
 #include "prioq.h"
 #include "ratelimit.h"
+/// Additional includes needed by elogind
+#include "event-timer-wheel.h"
+#include "event-work.h"
 
 typedef enum EventSourceType {
         SOURCE_IO,
@@ -28,6 +31,9 @@ typedef enum EventSourceType {
         SOURCE_WATCHDOG,
         SOURCE_INOTIFY,
         SOURCE_MEMORY_PRESSURE,
+#if 1 /// elogind: functions run in a pool of worker threads, see sd_event_add_work()
+        SOURCE_WORK,
+#endif // 1
         _SOURCE_EVENT_SOURCE_TYPE_MAX,
         _SOURCE_EVENT_SOURCE_TYPE_INVALID = -EINVAL,
 } EventSourceType;
@@ -40,6 +46,9 @@ typedef enum WakeupType {
         WAKEUP_CLOCK_DATA,
         WAKEUP_SIGNAL_DATA,
         WAKEUP_INOTIFY_DATA,
+#if 1 /// elogind: functions run in a pool of worker threads, see sd_event_add_work()
+        WAKEUP_WORK_DATA,
+#endif // 1
         _WAKEUP_TYPE_MAX,
         _WAKEUP_TYPE_INVALID = -EINVAL,
 } WakeupType;
@@ -70,6 +79,9 @@ struct sd_event_source {
         unsigned prepare_index;
         uint64_t pending_iteration;
         uint64_t prepare_iteration;
+#if 1 /// elogind: per-source dispatch statistics, see sd_event_get_stats()
+        usec_t pending_usec;
+#endif // 1
 
         sd_event_destroy_t destroy_callback;
         sd_event_handler_t ratelimit_expire_callback;
@@ -95,6 +107,9 @@ struct sd_event_source {
                 struct {
                         sd_event_time_handler_t callback;
                         usec_t next, accuracy;
+#if 1 /// elogind: time sources may be queued in a timer wheel, see event_source_uses_timer_wheel()
+                        TimerWheelEntry wheel_entry;
+#endif // 1
                 } time;
                 struct {
                         sd_event_signal_handler_t callback;
@@ -141,6 +156,12 @@ struct sd_event_source {
                         bool locked:1;
                         bool in_write_list:1;
                 } memory_pressure;
+#if 1 /// elogind: functions run in a pool of worker threads, see sd_event_add_work()
+                struct {
+                        sd_event_work_handler_t callback;
+                        EventWorkItem item;
+                } work;
+#endif // 1
         };
 };
 
@@ -159,6 +180,10 @@ struct clock_data {
         Prioq *latest;
         usec_t next;
 
+#if 1 /// elogind: optionally, time sources with sufficient accuracy are queued here instead
+        TimerWheel *wheel;
+#endif // 1
+
         bool needs_rearm:1;
 };
 
@@ -240,3 +265,13 @@ struct inotify_data {
          * to make it efficient to figure out what inotify objects to process data on next. */
         LIST_FIELDS(struct inotify_data, buffered);
 };
+
+#if 1 /// elogind: functions run in a pool of worker threads, see sd_event_add_work()
+struct work_data {
+        WakeupType wakeup;
+
+        /* Started with the first work event source, its eventfd is watched in the epoll */
+        EventWorkPool *pool;
+        unsigned n_threads_max;
+};
+#endif // 1
@@ -0,0 +1,166 @@
+/* SPDX-License-Identifier: LGPL-2.1-or-later */
+
+#include "alloc-util.h"
+#include "event-stats.h"
+#include "logarithm.h"
+#include "string-util.h"
+
+/* Dispatch statistics are collected per event source description once enabled with
+ * sd_event_set_collect_stats(). Sources sharing a description and type (e.g. all sessions' FIFOs) are
+ * accounted together, so that the numbers remain meaningful for sources that come and go. Entries are only
+ * freed together with the event loop, hence pointers to them stay valid across callbacks. */
+
+static void event_stats_entry_hash_func(const EventStatsEntry *e, struct siphash *state) {
+        assert(e);
+
+        string_hash_func(e->type, state);
+        string_hash_func(e->description, state);
+}
+
+static int event_stats_entry_compare_func(const EventStatsEntry *x, const EventStatsEntry *y) {
+        int r;
+
+        assert(x);
+        assert(y);
+
+        r = strcmp(x->type, y->type);
+        if (r != 0)
+                return r;
+
+        return strcmp(x->description, y->description);
+}
+
+DEFINE_PRIVATE_HASH_OPS_WITH_KEY_DESTRUCTOR(
+                event_stats_entry_hash_ops,
+                EventStatsEntry, event_stats_entry_hash_func, event_stats_entry_compare_func,
+                free);
+
+EventStatsEntry* event_stats_get_entry(Hashmap **entries, const char *type, const char *description) {
+        _cleanup_free_ EventStatsEntry *e = NULL;
+        EventStatsEntry *found;
+        size_t l;
+
+        assert(entries);
+        assert(type);
+
+        /* Returns NULL on OOM, statistics are best effort */
+
+        description = strempty(description);
+
+        found = hashmap_get(*entries, &(const EventStatsEntry) {
+                        .type = type,
+                        .description = description,
+                });
+        if (found)
+                return found;
+
+        l = strlen(description);
+
+        e = malloc0(sizeof(EventStatsEntry) + l + 1);
+        if (!e)
+                return NULL;
+
+        e->type = type;
+        e->description = memcpy(e + 1, description, l + 1);
+
+        if (hashmap_ensure_put(entries, &event_stats_entry_hash_ops, e, e) < 0)
+                return NULL;
+
+        return TAKE_PTR(e);
+}
+
+void event_stats_entry_record(EventStatsEntry *e, usec_t latency, usec_t usec, bool error) {
+        assert(e);
+
+        e->n++;
+        if (error)
+                e->n_errors++;
+
+        e->total_usec = usec_add(e->total_usec, usec);
+        e->max_usec = MAX(e->max_usec, usec);
+
+        /* Exit sources are never pending, and latency is not known for sources that became pending
+         * before collecting was enabled */
+        if (latency != USEC_INFINITY) {
+                e->latency_max_usec = MAX(e->latency_max_usec, latency);
+                e->latency_histogram[log2u64(latency)]++;
+        }
+}
+
+void event_stats_reset(Hashmap *entries) {
+        EventStatsEntry *e;
+
+        HASHMAP_FOREACH(e, entries) {
+                e->n = e->n_errors = 0;
+                e->total_usec = e->max_usec = e->latency_max_usec = 0;
+                zero(e->latency_histogram);
+        }
+}
+
+static int event_stats_entry_build_json(EventStatsEntry *e, sd_json_variant **ret) {
+        _cleanup_(sd_json_variant_unrefp) sd_json_variant *h = NULL;
+        size_t n;
+        int r;
+
+        assert(e);
+        assert(ret);
+
+        /* Trailing empty buckets are left out */
+        for (n = ELEMENTSOF(e->latency_histogram); n > 0; n--)
+                if (e->latency_histogram[n - 1] > 0)
+                        break;
+
+        r = sd_json_variant_new_array(&h, NULL, 0);
+        if (r < 0)
+                return r;
+
+        for (size_t i = 0; i < n; i++) {
+                r = sd_json_variant_append_arrayb(&h, SD_JSON_BUILD_UNSIGNED(e->latency_histogram[i]));
+                if (r < 0)
+                        return r;
+        }
+
+        return sd_json_buildo(
+                        ret,
+                        SD_JSON_BUILD_PAIR_STRING("type", e->type),
+                        SD_JSON_BUILD_PAIR_STRING("description", empty_to_null(e->description)),
+                        SD_JSON_BUILD_PAIR_UNSIGNED("count", e->n),
+                        SD_JSON_BUILD_PAIR_UNSIGNED("errors", e->n_errors),
+                        SD_JSON_BUILD_PAIR_UNSIGNED("totalUSec", e->total_usec),
+                        SD_JSON_BUILD_PAIR_UNSIGNED("maxUSec", e->max_usec),
+                        SD_JSON_BUILD_PAIR_UNSIGNED("latencyMaxUSec", e->latency_max_usec),
+                        SD_JSON_BUILD_PAIR_VARIANT("latencyHistogram", h));
+}
+
+int event_stats_build_json(Hashmap *entries, bool collecting, uint64_t iteration, sd_json_variant **ret) {
+        _cleanup_(sd_json_variant_unrefp) sd_json_variant *sources = NULL;
+        EventStatsEntry *e;
+        int r;
+
+        assert(ret);
+
+        r = sd_json_variant_new_array(&sources, NULL, 0);
+        if (r < 0)
+                return r;
+
+        HASHMAP_FOREACH(e, entries) {
+                _cleanup_(sd_json_variant_unrefp) sd_json_variant *v = NULL;
+
+                if (e->n == 0)
+                        continue;
+
+                r = event_stats_entry_build_json(e, &v);
+                if (r < 0)
+                        return r;
+
+                r = sd_json_variant_append_array(&sources, v);
+                if (r < 0)
+                        return r;
+        }
+
+        return sd_json_buildo(
+                        ret,
+                        SD_JSON_BUILD_PAIR_BOOLEAN("collecting", collecting),
+                        SD_JSON_BUILD_PAIR_UNSIGNED("iteration", iteration),
+                        SD_JSON_BUILD_PAIR_VARIANT("sources", sources));
+}
@@ -0,0 +1,28 @@
+/* SPDX-License-Identifier: LGPL-2.1-or-later */
+#pragma once
+
+#include <inttypes.h>
+#include <stdbool.h>
+
+#include "sd-json.h"
+
+#include "hashmap.h"
+#include "time-util.h"
+
+typedef struct EventStatsEntry {
+        const char *type;               /* Static string, see event_source_type_to_string() */
+        const char *description;        /* Points into the entry itself, empty if the source has none */
+
+        uint64_t n;
+        uint64_t n_errors;
+        usec_t total_usec;              /* Time spent in the callback */
+        usec_t max_usec;
+        usec_t latency_max_usec;        /* Time from becoming pending to being dispatched */
+        uint64_t latency_histogram[sizeof(usec_t) * 8];  /* Bucket i counts latencies in [2^i, 2^(i+1)) µs */
+} EventStatsEntry;
+
+EventStatsEntry* event_stats_get_entry(Hashmap **entries, const char *type, const char *description);
+void event_stats_entry_record(EventStatsEntry *e, usec_t latency, usec_t usec, bool error);
+
+void event_stats_reset(Hashmap *entries);
+int event_stats_build_json(Hashmap *entries, bool collecting, uint64_t iteration, sd_json_variant **ret);
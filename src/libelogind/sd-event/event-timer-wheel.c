@@ -0,0 +1,298 @@
+/* SPDX-License-Identifier: LGPL-2.1-or-later */
+
+#include "alloc-util.h"
+#include "event-timer-wheel.h"
+#include "logarithm.h"
+
+/* A hierarchical timer wheel, for time event sources that are fine with elapsing anywhere between their
+ * time and their time plus accuracy. Level L has TIMER_WHEEL_SLOTS buckets, each covering
+ * TIMER_WHEEL_GRANULARITY_USEC << (TIMER_WHEEL_LEVEL_SHIFT * L) µs. The requested time of an entry is rounded
+ * up to a multiple of the granularity of the coarsest level that is still finer than the accuracy, and the
+ * entry is queued in the bucket of that level covering this time. Since the buckets are aligned to the
+ * same grid for all entries (and all processes), entries with similar times and accuracies elapse
+ * together. Adding and removing entries are O(1), finding the next bucket to elapse is O(levels), using
+ * a bitmap of occupied buckets per level.
+ *
+ * Entries too far in the future to be covered by their level are queued in a coarser level first, and
+ * moved to a finer one once their bucket is reached, like in the classic hierarchical timer wheel. Each
+ * entry moves at most once per level. Entries whose time has already been reached are kept in a separate
+ * list.
+ *
+ * The wheel keeps track of the time up to which buckets have been processed. This time never moves
+ * backwards, hence the wheel may only be used with clocks that don't jump backwards either. */
+
+#define TIMER_WHEEL_SLOTS 64U
+#define TIMER_WHEEL_LEVEL_SHIFT 3U
+#define TIMER_WHEEL_LEVELS 8U
+
+assert_cc(TIMER_WHEEL_SLOTS == sizeof(uint64_t) * 8);
+
+typedef struct TimerWheelBucket {
+        LIST_HEAD(TimerWheelEntry, entries);
+        usec_t min_expiry;      /* Lower bound of the expiry of the entries, may be stale after removals */
+} TimerWheelBucket;
+
+struct TimerWheel {
+        usec_t clk;             /* All buckets covering times up to here have been processed */
+        size_t n_entries;
+        uint64_t occupied[TIMER_WHEEL_LEVELS];
+        TimerWheelBucket expired;
+        TimerWheelBucket buckets[TIMER_WHEEL_LEVELS * TIMER_WHEEL_SLOTS];
+};
+
+static usec_t level_granularity(unsigned level) {
+        assert(level < TIMER_WHEEL_LEVELS);
+
+        return TIMER_WHEEL_GRANULARITY_USEC << (TIMER_WHEEL_LEVEL_SHIFT * level);
+}
+
+static unsigned level_for_accuracy(usec_t accuracy) {
+        assert(accuracy >= TIMER_WHEEL_GRANULARITY_USEC);
+
+        return MIN(log2u64(accuracy / TIMER_WHEEL_GRANULARITY_USEC) / TIMER_WHEEL_LEVEL_SHIFT,
+                   TIMER_WHEEL_LEVELS - 1);
+}
+
+static TimerWheelBucket* timer_wheel_bucket(TimerWheel *w, unsigned bucket) {
+        assert(w);
+        assert(bucket > 0);
+        assert(bucket <= ELEMENTSOF(w->buckets) + 1);
+
+        /* Index 1 is the list of expired entries, the levels' buckets follow */
+        return bucket == 1 ? &w->expired : w->buckets + bucket - 2;
+}
+
+int timer_wheel_new(usec_t now, TimerWheel **ret) {
+        TimerWheel *w;
+
+        assert(ret);
+
+        w = new0(TimerWheel, 1);
+        if (!w)
+                return -ENOMEM;
+
+        w->clk = now;
+        w->expired.min_expiry = USEC_INFINITY;
+        FOREACH_ELEMENT(b, w->buckets)
+                b->min_expiry = USEC_INFINITY;
+
+        *ret = w;
+        return 0;
+}
+
+TimerWheel* timer_wheel_free(TimerWheel *w) {
+        if (!w)
+                return NULL;
+
+        /* The entries are owned by the caller, just make sure none is left behind */
+        assert(w->n_entries == 0);
+
+        return mfree(w);
+}
+
+static bool timer_wheel_find(const TimerWheel *w, unsigned level, uint64_t *ret_tick) {
+        uint64_t clk_tick, bits;
+        unsigned start;
+
+        assert(w);
+        assert(level < TIMER_WHEEL_LEVELS);
+
+        /* Looks for the first occupied bucket of the level after the current time. All occupied buckets
+         * cover ticks in (clk_tick, clk_tick + TIMER_WHEEL_SLOTS], and are hence found in this order
+         * when rotating the bitmap accordingly. */
+
+        bits = w->occupied[level];
+        if (bits == 0)
+                return false;
+
+        clk_tick = w->clk / level_granularity(level);
+        start = (clk_tick + 1) % TIMER_WHEEL_SLOTS;
+        if (start > 0)
+                bits = (bits >> start) | (bits << (TIMER_WHEEL_SLOTS - start));
+
+        *ret_tick = clk_tick + 1 + __builtin_ctzll(bits);
+        return true;
+}
+
+static void timer_wheel_enqueue(TimerWheel *w, TimerWheelEntry *e) {
+        TimerWheelBucket *b;
+        unsigned level;
+
+        assert(w);
+        assert(e);
+        assert(!timer_wheel_entry_queued(e));
+
+        if (e->expiry <= w->clk)
+                e->bucket = 1;
+        else
+                for (level = e->level;; level++) {
+                        usec_t g = level_granularity(level);
+                        uint64_t tick = e->expiry / g, clk_tick = w->clk / g;
+
+                        /* On the entry's own level the expiry is a multiple of the granularity, hence the
+                         * bucket elapses exactly at the expiry. On coarser levels it elapses earlier, and
+                         * the entry is moved to a finer level then. Entries beyond the coarsest level are
+                         * put in its last bucket for now. */
+                        assert(tick > clk_tick);
+                        if (tick - clk_tick > TIMER_WHEEL_SLOTS) {
+                                if (level < TIMER_WHEEL_LEVELS - 1)
+                                        continue;
+
+                                tick = clk_tick + TIMER_WHEEL_SLOTS;
+                        }
+
+                        w->occupied[level] |= UINT64_C(1) << (tick % TIMER_WHEEL_SLOTS);
+                        e->bucket = 2 + level * TIMER_WHEEL_SLOTS + tick % TIMER_WHEEL_SLOTS;
+                        break;
+                }
+
+        b = timer_wheel_bucket(w, e->bucket);
+        LIST_PREPEND(entries, b->entries, e);
+        b->min_expiry = MIN(b->min_expiry, e->expiry);
+}
+
+static void timer_wheel_dequeue(TimerWheel *w, TimerWheelEntry *e) {
+        TimerWheelBucket *b;
+
+        assert(w);
+        assert(e);
+        assert(timer_wheel_entry_queued(e));
+
+        b = timer_wheel_bucket(w, e->bucket);
+        LIST_REMOVE(entries, b->entries, e);
+
+        if (!b->entries) {
+                b->min_expiry = USEC_INFINITY;
+
+                if (e->bucket > 1) {
+                        unsigned i = e->bucket - 2;
+
+                        w->occupied[i / TIMER_WHEEL_SLOTS] &= ~(UINT64_C(1) << (i % TIMER_WHEEL_SLOTS));
+                }
+        }
+
+        e->bucket = 0;
+}
+
+void timer_wheel_add(TimerWheel *w, TimerWheelEntry *e, usec_t next, usec_t accuracy) {
+        usec_t g;
+
+        assert(w);
+        assert(e);
+        assert(next != USEC_INFINITY);
+
+        e->level = level_for_accuracy(accuracy);
+
+        /* Rounding up is fine, as it adds less than the granularity, which is at most the accuracy */
+        g = level_granularity(e->level);
+        e->expiry = usec_add(next / g * g, next % g > 0 ? g : 0);
+
+        timer_wheel_enqueue(w, e);
+        w->n_entries++;
+}
+
+void timer_wheel_remove(TimerWheel *w, TimerWheelEntry *e) {
+        assert(w);
+        assert(e);
+
+        if (!timer_wheel_entry_queued(e))
+                return;
+
+        timer_wheel_dequeue(w, e);
+
+        assert(w->n_entries > 0);
+        w->n_entries--;
+}
+
+size_t timer_wheel_size(const TimerWheel *w) {
+        return w ? w->n_entries : 0;
+}
+
+usec_t timer_wheel_next(const TimerWheel *w) {
+        usec_t t;
+
+        assert(w);
+
+        if (w->expired.entries)
+                return w->expired.min_expiry;
+
+        /* All entries in a bucket have their expiry within the range covered by it, and the first occupied
+         * bucket of each level hence carries the earliest expiry of the level. */
+        t = USEC_INFINITY;
+        for (unsigned level = 0; level < TIMER_WHEEL_LEVELS; level++) {
+                uint64_t tick;
+
+                if (!timer_wheel_find(w, level, &tick))
+                        continue;
+
+                t = MIN(t, w->buckets[level * TIMER_WHEEL_SLOTS + tick % TIMER_WHEEL_SLOTS].min_expiry);
+        }
+
+        return t;
+}
+
+static void timer_wheel_advance(TimerWheel *w, usec_t n) {
+        assert(w);
+
+        for (;;) {
+                usec_t t = USEC_INFINITY, clk;
+
+                /* Find the time the next bucket elapses at, on whichever level */
+                for (unsigned level = 0; level < TIMER_WHEEL_LEVELS; level++) {
+                        uint64_t tick;
+
+                        if (timer_wheel_find(w, level, &tick))
+                                t = MIN(t, tick * level_granularity(level));
+                }
+
+                if (t > n)
+                        break;
+
+                /* Process the buckets of all levels elapsing at this time. Entries that have been reached
+                 * end up in the list of expired ones, the others are moved to a finer level, at a time
+                 * later than this one. */
+                clk = w->clk;
+                w->clk = t;
+
+                for (unsigned level = 0; level < TIMER_WHEEL_LEVELS; level++) {
+                        usec_t g = level_granularity(level);
+                        LIST_HEAD(TimerWheelEntry, entries);
+                        unsigned slot;
+                        TimerWheelEntry *e;
+
+                        if (t % g != 0 || t / g <= clk / g)
+                                continue;
+
+                        /* Detach the whole bucket first: entries beyond the coarsest level go back into the
+                         * very same bucket, now covering a later time */
+                        slot = (t / g) % TIMER_WHEEL_SLOTS;
+                        entries = TAKE_PTR(w->buckets[level * TIMER_WHEEL_SLOTS + slot].entries);
+                        w->buckets[level * TIMER_WHEEL_SLOTS + slot].min_expiry = USEC_INFINITY;
+                        w->occupied[level] &= ~(UINT64_C(1) << slot);
+
+                        while ((e = LIST_POP(entries, entries))) {
+                                e->bucket = 0;
+                                timer_wheel_enqueue(w, e);
+                        }
+                }
+        }
+
+        w->clk = MAX(w->clk, n);
+}
+
+TimerWheelEntry* timer_wheel_pop(TimerWheel *w, usec_t n) {
+        TimerWheelEntry *e;
+
+        assert(w);
+
+        /* Returns the entries that elapsed up to the specified time, one by one */
+
+        timer_wheel_advance(w, n);
+
+        e = w->expired.entries;
+        if (!e)
+                return NULL;
+
+        timer_wheel_remove(w, e);
+        return e;
+}
@@ -0,0 +1,35 @@
+/* SPDX-License-Identifier: LGPL-2.1-or-later */
+#pragma once
+
+#include <stdbool.h>
+#include <stddef.h>
+
+#include "list.h"
+#include "time-util.h"
+
+/* Granularity of the finest level, timers with a lower accuracy cannot be queued in the wheel */
+#define TIMER_WHEEL_GRANULARITY_USEC USEC_PER_MSEC
+
+typedef struct TimerWheel TimerWheel;
+
+typedef struct TimerWheelEntry {
+        LIST_FIELDS(struct TimerWheelEntry, entries);
+        usec_t expiry;          /* The time the entry elapses, i.e. the requested time rounded up */
+        unsigned level;         /* The level whose granularity the expiry was rounded up to */
+        unsigned bucket;        /* 1-based index of the bucket the entry is queued in, 0 if not queued */
+} TimerWheelEntry;
+
+int timer_wheel_new(usec_t now, TimerWheel **ret);
+TimerWheel* timer_wheel_free(TimerWheel *w);
+DEFINE_TRIVIAL_CLEANUP_FUNC(TimerWheel*, timer_wheel_free);
+
+static inline bool timer_wheel_entry_queued(const TimerWheelEntry *e) {
+        return e->bucket > 0;
+}
+
+void timer_wheel_add(TimerWheel *w, TimerWheelEntry *e, usec_t next, usec_t accuracy);
+void timer_wheel_remove(TimerWheel *w, TimerWheelEntry *e);
+
+size_t timer_wheel_size(const TimerWheel *w);
+usec_t timer_wheel_next(const TimerWheel *w);
+TimerWheelEntry* timer_wheel_pop(TimerWheel *w, usec_t n);
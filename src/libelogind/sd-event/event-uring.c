@@ -0,0 +1,212 @@
+/* SPDX-License-Identifier: LGPL-2.1-or-later */
+
+#include <linux/io_uring.h>
+#include <sys/mman.h>
+#include <sys/syscall.h>
+#include <unistd.h>
+
+#include "alloc-util.h"
+#include "errno-util.h"
+#include "event-uring.h"
+#include "fd-util.h"
+#include "macro.h"
+#include "memory-util.h"
+
+/* A minimal io_uring, only used to read from a number of fds with a single syscall. After epoll reported a
+ * number of timerfds and signalfds readable, the reads following up on these are submitted together, and
+ * all completions are waited for in the same io_uring_enter() call. Reads are submitted with RWF_NOWAIT, so
+ * every read is executed inline in the submitting thread (which matters for signalfds, whose reads dequeue
+ * the signals of the reading thread), and a read that would block fails with -EAGAIN just like read() on a
+ * non-blocking fd would, instead of waiting. Files that don't support that (inotify, for example) fail with
+ * -EOPNOTSUPP. We talk to the kernel directly instead of using liburing, as we only need a tiny part of it. */
+
+struct EventUring {
+        int fd;
+        unsigned entries;
+
+        void *sq_ring, *cq_ring;
+        size_t sq_ring_size, cq_ring_size;
+        struct io_uring_sqe *sqes;
+        size_t sqes_size;
+
+        unsigned *sq_head, *sq_tail, *sq_mask, *sq_array;
+        unsigned *cq_head, *cq_tail, *cq_mask;
+        struct io_uring_cqe *cqes;
+};
+
+static int io_uring_setup(unsigned entries, struct io_uring_params *p) {
+#ifdef __NR_io_uring_setup
+        return RET_NERRNO(syscall(__NR_io_uring_setup, entries, p));
+#else
+        return -ENOSYS;
+#endif
+}
+
+static int io_uring_enter(int fd, unsigned to_submit, unsigned min_complete, unsigned flags) {
+#ifdef __NR_io_uring_enter
+        return RET_NERRNO(syscall(__NR_io_uring_enter, fd, to_submit, min_complete, flags, NULL, 0));
+#else
+        return -ENOSYS;
+#endif
+}
+
+EventUring* event_uring_free(EventUring *u) {
+        if (!u)
+                return NULL;
+
+        if (u->sqes)
+                (void) munmap(u->sqes, u->sqes_size);
+        if (u->cq_ring)
+                (void) munmap(u->cq_ring, u->cq_ring_size);
+        if (u->sq_ring)
+                (void) munmap(u->sq_ring, u->sq_ring_size);
+
+        safe_close(u->fd);
+        return mfree(u);
+}
+
+DEFINE_TRIVIAL_CLEANUP_FUNC(EventUring*, event_uring_free);
+
+int event_uring_new(unsigned entries, EventUring **ret) {
+        _cleanup_(event_uring_freep) EventUring *u = NULL;
+        struct io_uring_params p = {};
+        void *m;
+        int r;
+
+        assert(entries > 0);
+        assert(ret);
+
+        u = new(EventUring, 1);
+        if (!u)
+                return -ENOMEM;
+
+        *u = (EventUring) {
+                .fd = -EBADF,
+        };
+
+        r = io_uring_setup(entries, &p);
+        if (r < 0)
+                return r;
+
+        u->fd = fd_move_above_stdio(r);
+        u->entries = p.sq_entries;
+
+        /* IORING_OP_READ appeared in 5.6, IORING_FEAT_FAST_POLL in 5.7. Insist on the latter, so that
+         * we know the former is there, without having to probe for it. */
+        if (!FLAGS_SET(p.features, IORING_FEAT_FAST_POLL))
+                return -EOPNOTSUPP;
+
+        u->sq_ring_size = p.sq_off.array + p.sq_entries * sizeof(unsigned);
+        m = mmap(NULL, u->sq_ring_size, PROT_READ|PROT_WRITE, MAP_SHARED|MAP_POPULATE, u->fd, IORING_OFF_SQ_RING);
+        if (m == MAP_FAILED)
+                return -errno;
+        u->sq_ring = m;
+
+        u->cq_ring_size = p.cq_off.cqes + p.cq_entries * sizeof(struct io_uring_cqe);
+        m = mmap(NULL, u->cq_ring_size, PROT_READ|PROT_WRITE, MAP_SHARED|MAP_POPULATE, u->fd, IORING_OFF_CQ_RING);
+        if (m == MAP_FAILED)
+                return -errno;
+        u->cq_ring = m;
+
+        u->sqes_size = p.sq_entries * sizeof(struct io_uring_sqe);
+        m = mmap(NULL, u->sqes_size, PROT_READ|PROT_WRITE, MAP_SHARED|MAP_POPULATE, u->fd, IORING_OFF_SQES);
+        if (m == MAP_FAILED)
+                return -errno;
+        u->sqes = m;
+
+        u->sq_head = (unsigned*) ((uint8_t*) u->sq_ring + p.sq_off.head);
+        u->sq_tail = (unsigned*) ((uint8_t*) u->sq_ring + p.sq_off.tail);
+        u->sq_mask = (unsigned*) ((uint8_t*) u->sq_ring + p.sq_off.ring_mask);
+        u->sq_array = (unsigned*) ((uint8_t*) u->sq_ring + p.sq_off.array);
+
+        u->cq_head = (unsigned*) ((uint8_t*) u->cq_ring + p.cq_off.head);
+        u->cq_tail = (unsigned*) ((uint8_t*) u->cq_ring + p.cq_off.tail);
+        u->cq_mask = (unsigned*) ((uint8_t*) u->cq_ring + p.cq_off.ring_mask);
+        u->cqes = (struct io_uring_cqe*) ((uint8_t*) u->cq_ring + p.cq_off.cqes);
+
+        *ret = TAKE_PTR(u);
+        return 0;
+}
+
+static int event_uring_reap(EventUring *u, EventUringRead *reads, size_t n, size_t *n_done) {
+        unsigned head, tail;
+
+        assert(u);
+        assert(reads);
+        assert(n_done);
+
+        head = *u->cq_head;
+        tail = __atomic_load_n(u->cq_tail, __ATOMIC_ACQUIRE);
+
+        for (; head != tail; head++) {
+                struct io_uring_cqe *cqe = u->cqes + (head & *u->cq_mask);
+
+                if (_unlikely_(cqe->user_data >= n))
+                        return -EIO;
+
+                reads[cqe->user_data].result = cqe->res;
+                reads[cqe->user_data].done = true;
+                (*n_done)++;
+        }
+
+        __atomic_store_n(u->cq_head, head, __ATOMIC_RELEASE);
+        return 0;
+}
+
+int event_uring_read_batch(EventUring *u, EventUringRead *reads, size_t n) {
+        size_t n_done = 0;
+        int r;
+
+        assert(u);
+        assert(reads || n == 0);
+
+        /* Submits a read for each entry, and waits until all of them completed. On failure, some of the
+         * entries may have completed nonetheless, those are marked as done. */
+
+        for (size_t i = 0; i < n; ) {
+                unsigned tail, k;
+                size_t n_wait;
+
+                k = (unsigned) MIN(n - i, (size_t) u->entries);
+
+                /* The submission queue is always drained completely below, hence there's room for k */
+                tail = *u->sq_tail;
+                for (unsigned j = 0; j < k; j++) {
+                        unsigned idx = (tail + j) & *u->sq_mask;
+                        struct io_uring_sqe *sqe = u->sqes + idx;
+
+                        zero(*sqe);
+                        sqe->opcode = IORING_OP_READ;
+                        sqe->fd = reads[i + j].fd;
+                        sqe->addr = (uintptr_t) reads[i + j].buf;
+                        sqe->len = reads[i + j].size;
+                        sqe->off = UINT64_MAX; /* Use and advance the file position, like read() */
+                        sqe->rw_flags = RWF_NOWAIT; /* Never wait for data, fail with -EAGAIN instead */
+                        sqe->user_data = i + j;
+
+                        u->sq_array[idx] = idx;
+                }
+
+                __atomic_store_n(u->sq_tail, tail + k, __ATOMIC_RELEASE);
+
+                n_wait = i + k;
+                for (unsigned to_submit = k;;) {
+                        r = io_uring_enter(u->fd, to_submit, n_wait - n_done, IORING_ENTER_GETEVENTS);
+                        if (r < 0 && r != -EINTR)
+                                return r;
+                        if (r > 0)
+                                to_submit -= MIN((unsigned) r, to_submit);
+
+                        r = event_uring_reap(u, reads, n, &n_done);
+                        if (r < 0)
+                                return r;
+
+                        if (to_submit == 0 && n_done >= n_wait)
+                                break;
+                }
+
+                i += k;
+        }
+
+        return 0;
+}
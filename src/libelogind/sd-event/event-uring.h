@@ -0,0 +1,21 @@
+/* SPDX-License-Identifier: LGPL-2.1-or-later */
+#pragma once
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <sys/types.h>
+
+typedef struct EventUring EventUring;
+
+typedef struct EventUringRead {
+        int fd;
+        void *buf;
+        size_t size;
+        ssize_t result;         /* Like read(), but -errno on failure */
+        bool done;              /* Set once result is valid, cleared again when the result is consumed */
+} EventUringRead;
+
+int event_uring_new(unsigned entries, EventUring **ret);
+EventUring* event_uring_free(EventUring *u);
+
+int event_uring_read_batch(EventUring *u, EventUringRead *reads, size_t n);
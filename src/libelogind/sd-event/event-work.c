@@ -0,0 +1,297 @@
+/* SPDX-License-Identifier: LGPL-2.1-or-later */
+
+#include <pthread.h>
+#include <signal.h>
+#include <sys/eventfd.h>
+
+#include "alloc-util.h"
+#include "errno-util.h"
+#include "event-work.h"
+#include "fd-util.h"
+#include "log.h"
+
+/* A bounded pool of worker threads, which run the functions of work event sources, see sd_event_add_work().
+ * Threads are started lazily as work is submitted, up to the configured maximum, and then stay around until
+ * the pool is freed together with the event loop. Completed items are collected in a list and announced via
+ * an eventfd, which the event loop watches, so that the completion is dispatched in the loop's thread. The
+ * worker threads never touch the event sources themselves, only the items embedded into them. */
+
+struct EventWorkPool {
+        pthread_mutex_t mutex;
+        pthread_cond_t queued_cond;     /* Signalled when work is queued, or on shutdown */
+        pthread_cond_t done_cond;       /* Broadcast when work completed */
+
+        int fd;
+
+        LIST_HEAD(EventWorkItem, queued);
+        LIST_HEAD(EventWorkItem, done);
+        unsigned n_queued;
+        unsigned n_idle;
+
+        pthread_t *threads;
+        unsigned n_threads;
+        unsigned n_threads_max;
+
+        bool shutdown;
+};
+
+int event_work_pool_new(unsigned n_threads_max, EventWorkPool **ret) {
+        _cleanup_free_ EventWorkPool *p = NULL;
+        _cleanup_close_ int fd = -EBADF;
+
+        assert(n_threads_max > 0);
+        assert(ret);
+
+        fd = eventfd(0, EFD_CLOEXEC|EFD_NONBLOCK);
+        if (fd < 0)
+                return -errno;
+
+        p = new(EventWorkPool, 1);
+        if (!p)
+                return -ENOMEM;
+
+        *p = (EventWorkPool) {
+                .fd = fd_move_above_stdio(TAKE_FD(fd)),
+                .n_threads_max = n_threads_max,
+        };
+
+        assert_se(pthread_mutex_init(&p->mutex, NULL) == 0);
+        assert_se(pthread_cond_init(&p->queued_cond, NULL) == 0);
+        assert_se(pthread_cond_init(&p->done_cond, NULL) == 0);
+
+        *ret = TAKE_PTR(p);
+        return 0;
+}
+
+EventWorkPool* event_work_pool_free(EventWorkPool *p) {
+        if (!p)
+                return NULL;
+
+        assert_se(pthread_mutex_lock(&p->mutex) == 0);
+        p->shutdown = true;
+        assert_se(pthread_cond_broadcast(&p->queued_cond) == 0);
+        assert_se(pthread_mutex_unlock(&p->mutex) == 0);
+
+        for (unsigned i = 0; i < p->n_threads; i++)
+                assert_se(pthread_join(p->threads[i], NULL) == 0);
+        free(p->threads);
+
+        /* All work event sources have been disconnected, and thus cancelled, before */
+        assert(!p->queued);
+        assert(!p->done);
+
+        assert_se(pthread_cond_destroy(&p->done_cond) == 0);
+        assert_se(pthread_cond_destroy(&p->queued_cond) == 0);
+        assert_se(pthread_mutex_destroy(&p->mutex) == 0);
+
+        safe_close(p->fd);
+        return mfree(p);
+}
+
+int event_work_pool_get_fd(EventWorkPool *p) {
+        assert(p);
+
+        return p->fd;
+}
+
+void event_work_pool_set_threads_max(EventWorkPool *p, unsigned n) {
+        assert(p);
+        assert(n > 0);
+
+        /* Threads already running are kept, the new limit applies to threads started from now on */
+        p->n_threads_max = n;
+}
+
+static void* event_work_thread(void *userdata) {
+        EventWorkPool *p = ASSERT_PTR(userdata);
+
+        (void) pthread_setname_np(pthread_self(), "sd-event-work");
+
+        assert_se(pthread_mutex_lock(&p->mutex) == 0);
+
+        for (;;) {
+                EventWorkItem *i;
+                int r;
+
+                while (!p->queued && !p->shutdown) {
+                        p->n_idle++;
+                        assert_se(pthread_cond_wait(&p->queued_cond, &p->mutex) == 0);
+                        p->n_idle--;
+                }
+
+                if (p->shutdown)
+                        break;
+
+                i = LIST_POP(items, p->queued);
+                p->n_queued--;
+                i->state = EVENT_WORK_RUNNING;
+
+                assert_se(pthread_mutex_unlock(&p->mutex) == 0);
+                r = i->func(i->userdata);
+                assert_se(pthread_mutex_lock(&p->mutex) == 0);
+
+                i->result = r;
+                i->state = EVENT_WORK_DONE;
+                LIST_PREPEND(items, p->done, i);
+
+                assert_se(pthread_cond_broadcast(&p->done_cond) == 0);
+
+                if (eventfd_write(p->fd, 1) < 0)
+                        log_debug_errno(errno, "Failed to signal completed work, ignoring: %m");
+        }
+
+        assert_se(pthread_mutex_unlock(&p->mutex) == 0);
+        return NULL;
+}
+
+static int event_work_pool_start_thread(EventWorkPool *p) {
+        sigset_t ss, saved_ss;
+        int r;
+
+        assert(p);
+
+        /* Must be called with the mutex held */
+
+        if (!GREEDY_REALLOC(p->threads, p->n_threads + 1))
+                return -ENOMEM;
+
+        /* Signals are handled by the event loop via signalfd(), which relies on them being blocked in every
+         * thread. Hence start the thread with all signals blocked. */
+        assert_se(sigfillset(&ss) >= 0);
+        r = pthread_sigmask(SIG_SETMASK, &ss, &saved_ss);
+        if (r != 0)
+                return -r;
+
+        r = pthread_create(p->threads + p->n_threads, NULL, event_work_thread, p);
+
+        assert_se(pthread_sigmask(SIG_SETMASK, &saved_ss, NULL) == 0);
+
+        if (r != 0)
+                return -r;
+
+        p->n_threads++;
+        return 0;
+}
+
+int event_work_pool_submit(EventWorkPool *p, EventWorkItem *i) {
+        int r = 0;
+
+        assert(p);
+        assert(i);
+        assert(i->func);
+        assert(i->state == EVENT_WORK_IDLE);
+
+        assert_se(pthread_mutex_lock(&p->mutex) == 0);
+
+        /* Start another thread if there are more items queued than idle threads to pick them up. If that
+         * fails, the item is left to the threads we have, if any. */
+        if (p->n_queued + 1 > p->n_idle && p->n_threads < p->n_threads_max) {
+                r = event_work_pool_start_thread(p);
+                if (r < 0) {
+                        if (p->n_threads == 0)
+                                goto finish;
+
+                        log_debug_errno(r, "Failed to start worker thread, leaving work to the %u running ones: %m",
+                                        p->n_threads);
+                        r = 0;
+                }
+        }
+
+        i->state = EVENT_WORK_QUEUED;
+        LIST_APPEND(items, p->queued, i);
+        p->n_queued++;
+
+        assert_se(pthread_cond_signal(&p->queued_cond) == 0);
+
+finish:
+        assert_se(pthread_mutex_unlock(&p->mutex) == 0);
+        return r;
+}
+
+void event_work_pool_cancel(EventWorkPool *p, EventWorkItem *i) {
+        assert(p);
+        assert(i);
+
+        /* Work that did not start yet is dropped, but functions cannot be interrupted, hence we wait for
+         * work that is currently running. A completion that was not picked up yet is dropped, too. */
+
+        assert_se(pthread_mutex_lock(&p->mutex) == 0);
+
+        while (i->state == EVENT_WORK_RUNNING)
+                assert_se(pthread_cond_wait(&p->done_cond, &p->mutex) == 0);
+
+        switch (i->state) {
+
+        case EVENT_WORK_QUEUED:
+                LIST_REMOVE(items, p->queued, i);
+                p->n_queued--;
+                break;
+
+        case EVENT_WORK_DONE:
+                LIST_REMOVE(items, p->done, i);
+                break;
+
+        case EVENT_WORK_IDLE:
+                break;
+
+        default:
+                assert_not_reached();
+        }
+
+        i->state = EVENT_WORK_IDLE;
+
+        assert_se(pthread_mutex_unlock(&p->mutex) == 0);
+}
+
+int event_work_pool_flush(EventWorkPool *p) {
+        eventfd_t v;
+
+        assert(p);
+
+        /* Resets the eventfd. Call this before picking up completions with event_work_pool_pop_done(), so
+         * that work completing in the meantime triggers another wakeup. */
+
+        if (eventfd_read(p->fd, &v) < 0) {
+                if (ERRNO_IS_TRANSIENT(errno))
+                        return 0;
+
+                return -errno;
+        }
+
+        return 1;
+}
+
+EventWorkItem* event_work_pool_pop_done(EventWorkPool *p) {
+        EventWorkItem *i;
+
+        assert(p);
+
+        assert_se(pthread_mutex_lock(&p->mutex) == 0);
+
+        i = LIST_POP(items, p->done);
+        if (i)
+                i->state = EVENT_WORK_IDLE;
+
+        assert_se(pthread_mutex_unlock(&p->mutex) == 0);
+
+        return i;
+}
+
+void event_work_pool_push_done(EventWorkPool *p, EventWorkItem *i) {
+        assert(p);
+        assert(i);
+        assert(i->state == EVENT_WORK_IDLE);
+
+        /* Returns an item obtained from event_work_pool_pop_done() that could not be processed, so that it is
+         * picked up again on the next wakeup */
+
+        assert_se(pthread_mutex_lock(&p->mutex) == 0);
+
+        i->state = EVENT_WORK_DONE;
+        LIST_PREPEND(items, p->done, i);
+
+        if (eventfd_write(p->fd, 1) < 0)
+                log_debug_errno(errno, "Failed to signal completed work, ignoring: %m");
+
+        assert_se(pthread_mutex_unlock(&p->mutex) == 0);
+}
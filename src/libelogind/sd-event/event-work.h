@@ -0,0 +1,42 @@
+/* SPDX-License-Identifier: LGPL-2.1-or-later */
+#pragma once
+
+#include "sd-event.h"
+
+#include "list.h"
+
+/* Upper bound of worker threads per event loop, unless changed with sd_event_set_work_threads_max() */
+#define EVENT_WORK_THREADS_MAX_DEFAULT 4U
+
+typedef struct EventWorkPool EventWorkPool;
+
+typedef enum EventWorkState {
+        EVENT_WORK_IDLE,        /* Not submitted, or completion picked up already */
+        EVENT_WORK_QUEUED,      /* Waiting for a worker thread */
+        EVENT_WORK_RUNNING,     /* The function is running in a worker thread */
+        EVENT_WORK_DONE,        /* Completed, waiting for the event loop to pick up the result */
+} EventWorkState;
+
+/* Embedded in the event source. All fields but func and userdata are protected by the pool's mutex while the
+ * item is submitted. */
+typedef struct EventWorkItem {
+        LIST_FIELDS(struct EventWorkItem, items);
+        sd_event_work_func_t func;
+        void *userdata;
+        int result;
+        EventWorkState state;
+} EventWorkItem;
+
+int event_work_pool_new(unsigned n_threads_max, EventWorkPool **ret);
+EventWorkPool* event_work_pool_free(EventWorkPool *p);
+DEFINE_TRIVIAL_CLEANUP_FUNC(EventWorkPool*, event_work_pool_free);
+
+int event_work_pool_get_fd(EventWorkPool *p);
+void event_work_pool_set_threads_max(EventWorkPool *p, unsigned n);
+
+int event_work_pool_submit(EventWorkPool *p, EventWorkItem *i);
+void event_work_pool_cancel(EventWorkPool *p, EventWorkItem *i);
+
+int event_work_pool_flush(EventWorkPool *p);
+EventWorkItem* event_work_pool_pop_done(EventWorkPool *p);
+void event_work_pool_push_done(EventWorkPool *p, EventWorkItem *i);
@@ -41,6 +41,9 @@
 #include "string-util.h"
 #include "strxcpyx.h"
 #include "time-util.h"
+/// Additional includes needed by elogind
+#include "event-stats.h"
+#include "event-uring.h"
 
 #define DEFAULT_ACCURACY_USEC (250 * USEC_PER_MSEC)
 
@@ -77,6 +80,9 @@ static const char* const event_source_type_table[_SOURCE_EVENT_SOURCE_TYPE_MAX]
         [SOURCE_WATCHDOG]            = "watchdog",
         [SOURCE_INOTIFY]             = "inotify",
         [SOURCE_MEMORY_PRESSURE]     = "memory-pressure",
+#if 1 /// elogind: functions run in a pool of worker threads, see sd_event_add_work()
+        [SOURCE_WORK]                = "work",
+#endif // 1
 };
 
 DEFINE_PRIVATE_STRING_TABLE_LOOKUP_TO_STRING(event_source_type, int);
@@ -107,6 +113,16 @@ DEFINE_PRIVATE_STRING_TABLE_LOOKUP_TO_STRING(event_source_type, int);
  * EVENT_SOURCE_CAN_RATE_LIMIT() macro. */
 #define EVENT_SOURCE_USES_TIME_PRIOQ(t) EVENT_SOURCE_CAN_RATE_LIMIT(t)
 
+#if 1 /// elogind: reads following up on wakeups may be batched, see event_uring_prefetch()
+/* Size of the submission queue, larger batches are submitted in multiple steps */
+#define EVENT_URING_ENTRIES 64U
+
+typedef union EventUringBuffer {
+        uint64_t expirations;
+        struct signalfd_siginfo siginfo;
+} EventUringBuffer;
+#endif // 1
+
 struct sd_event {
         unsigned n_ref;
 
@@ -176,6 +192,22 @@ struct sd_event {
 
         usec_t last_run_usec, last_log_usec;
         unsigned delays[sizeof(usec_t) * 8];
+
+#if 1 /// elogind: reads following up on wakeups may be batched, see event_uring_prefetch()
+        EventUring *uring;
+        EventUringRead *uring_reads;
+        size_t n_uring_reads;
+        EventUringBuffer *uring_buffers;
+#endif // 1
+
+#if 1 /// elogind: per-source dispatch statistics, see sd_event_get_stats()
+        bool collect_stats;
+        Hashmap *stats;
+#endif // 1
+
+#if 1 /// elogind: functions run in a pool of worker threads, see sd_event_add_work()
+        struct work_data work;
+#endif // 1
 };
 
 DEFINE_PRIVATE_ORIGIN_ID_HELPERS(sd_event, event);
@@ -316,6 +348,54 @@ static int latest_time_prioq_compare(const void *a, const void *b) {
         return time_prioq_compare(a, b, time_event_source_latest);
 }
 
+#if 1 /// elogind: the pending, prepare and time prioqs cache a key per event source, see prioq_new_with_key()
+/* The keys need not be exact, event sources with equal keys are ordered by the compare functions above. The
+ * topmost two bits carry the enabled and ratelimited (or not-a-timer-candidate) state, the remaining 62 bits
+ * a value that is clamped, which keeps the order. */
+#define EVENT_PRIOQ_KEY_VALUE_MAX ((UINT64_C(1) << 62) - 1)
+#define EVENT_PRIOQ_KEY_ITERATION_BITS 46
+
+static uint64_t event_prioq_key(bool off, bool late, uint64_t value) {
+        return (uint64_t) off << 63 | (uint64_t) late << 62 | MIN(value, EVENT_PRIOQ_KEY_VALUE_MAX);
+}
+
+static uint64_t pending_prioq_key(const void *a) {
+        const sd_event_source *s = a;
+        uint64_t iteration;
+
+        /* The priority is kept in 16 bits, and the pending iteration in the 46 bits below. Priorities beyond
+         * that are clamped, and then the iteration is left out, so that the compare function decides. */
+        if (s->priority <= INT16_MIN || s->priority >= INT16_MAX)
+                iteration = 0;
+        else
+                iteration = MIN(s->pending_iteration, (UINT64_C(1) << EVENT_PRIOQ_KEY_ITERATION_BITS) - 1);
+
+        return event_prioq_key(
+                        s->enabled == SD_EVENT_OFF,
+                        s->ratelimited,
+                        (uint64_t) (CLAMP(s->priority, (int64_t) INT16_MIN, (int64_t) INT16_MAX) - INT16_MIN) << EVENT_PRIOQ_KEY_ITERATION_BITS |
+                        iteration);
+}
+
+static uint64_t prepare_prioq_key(const void *a) {
+        const sd_event_source *s = a;
+
+        return event_prioq_key(s->enabled == SD_EVENT_OFF, s->ratelimited, s->prepare_iteration);
+}
+
+static uint64_t earliest_time_prioq_key(const void *a) {
+        const sd_event_source *s = a;
+
+        return event_prioq_key(s->enabled == SD_EVENT_OFF, !event_source_timer_candidate(s), time_event_source_next(s));
+}
+
+static uint64_t latest_time_prioq_key(const void *a) {
+        const sd_event_source *s = a;
+
+        return event_prioq_key(s->enabled == SD_EVENT_OFF, !event_source_timer_candidate(s), time_event_source_latest(s));
+}
+#endif // 1
+
 static int exit_prioq_compare(const void *a, const void *b) {
         const sd_event_source *x = a, *y = b;
         int r;
@@ -339,6 +419,9 @@ static void free_clock_data(struct clock_data *d) {
         safe_close(d->fd);
         prioq_free(d->earliest);
         prioq_free(d->latest);
+#if 1 /// elogind: optionally, time sources with sufficient accuracy are queued in a timer wheel
+        timer_wheel_free(d->wheel);
+#endif // 1
 }
 
 static sd_event* event_free(sd_event *e) {
@@ -382,6 +465,19 @@ static sd_event* event_free(sd_event *e) {
         set_free(e->post_sources);
 
         free(e->event_queue);
+#if 1 /// elogind: reads following up on wakeups may be batched, see event_uring_prefetch()
+        event_uring_free(e->uring);
+        free(e->uring_reads);
+        free(e->uring_buffers);
+#endif // 1
+#if 1 /// elogind: per-source dispatch statistics, see sd_event_get_stats()
+        hashmap_free(e->stats);
+#endif // 1
+#if 1 /// elogind: functions run in a pool of worker threads, see sd_event_add_work()
+        /* The worker threads don't exist in a forked off child, and can't be joined there */
+        if (!event_origin_changed(e))
+                event_work_pool_free(e->work.pool);
+#endif // 1
 
         return mfree(e);
 }
@@ -417,9 +513,17 @@ _public_ int sd_event_new(sd_event** ret) {
                 .boottime_alarm.next = USEC_INFINITY,
                 .perturb = USEC_INFINITY,
                 .origin_id = origin_id_query(),
+#if 1 /// elogind: functions run in a pool of worker threads, see sd_event_add_work()
+                .work.wakeup = WAKEUP_WORK_DATA,
+                .work.n_threads_max = EVENT_WORK_THREADS_MAX_DEFAULT,
+#endif // 1
         };
 
+#if 0 /// elogind: inline prioq keys
         r = prioq_ensure_allocated(&e->pending, pending_prioq_compare);
+#else // 0
+        r = prioq_ensure_allocated_with_key(&e->pending, pending_prioq_compare, pending_prioq_key);
+#endif // 0
         if (r < 0)
                 goto fail;
 
@@ -437,6 +541,22 @@ _public_ int sd_event_new(sd_event** ret) {
                 e->profile_delays = true;
         }
 
+#if 1 /// elogind: reads following up on wakeups may be batched, see event_uring_prefetch()
+        if (secure_getenv_bool("SD_EVENT_IO_URING") > 0) {
+                r = sd_event_set_io_uring(e, true);
+                if (r < 0)
+                        log_debug_errno(r, "Failed to set up io_uring, ignoring: %m");
+        }
+#endif // 1
+
+#if 1 /// elogind: optionally, time sources with sufficient accuracy are queued in a timer wheel
+        if (secure_getenv_bool("SD_EVENT_TIMER_WHEEL") > 0) {
+                r = sd_event_set_timer_wheel(e, true);
+                if (r < 0)
+                        log_debug_errno(r, "Failed to set up timer wheel, ignoring: %m");
+        }
+#endif // 1
+
         *ret = e;
         return 0;
 
@@ -884,6 +1004,38 @@ static void event_source_pp_prioq_reshuffle(sd_event_source *s) {
                 prioq_reshuffle(s->event->prepare, s, &s->prepare_index);
 }
 
+#if 1 /// elogind: optionally, time sources with sufficient accuracy are queued in a timer wheel
+static bool event_source_uses_timer_wheel(sd_event_source *s) {
+        struct clock_data *d;
+
+        assert(s);
+
+        /* Whether the timer wheel is the native queue of a time event source. This only depends on the
+         * accuracy, which is at least TIMER_WHEEL_GRANULARITY_USEC unless explicitly set lower. While
+         * ratelimited, the event source is queued in the CLOCK_MONOTONIC prioqs nonetheless. */
+
+        if (!EVENT_SOURCE_IS_TIME(s->type))
+                return false;
+
+        assert_se(d = event_get_clock_data(s->event, s->type));
+        return d->wheel && s->time.accuracy >= TIMER_WHEEL_GRANULARITY_USEC;
+}
+
+static void event_source_time_wheel_requeue(sd_event_source *s, struct clock_data *d) {
+        assert(s);
+        assert(d);
+        assert(d->wheel);
+
+        /* Unlike the prioqs, the wheel only holds what may elapse, i.e. neither disabled nor pending event
+         * sources. */
+        timer_wheel_remove(d->wheel, &s->time.wheel_entry);
+        if (s->enabled != SD_EVENT_OFF && !s->pending && s->time.next != USEC_INFINITY)
+                timer_wheel_add(d->wheel, &s->time.wheel_entry, s->time.next, s->time.accuracy);
+
+        d->needs_rearm = true;
+}
+#endif // 1
+
 static void event_source_time_prioq_reshuffle(sd_event_source *s) {
         struct clock_data *d;
 
@@ -900,6 +1052,13 @@ static void event_source_time_prioq_reshuffle(sd_event_source *s) {
         else
                 return; /* no-op for an event source which is neither a timer nor ratelimited. */
 
+#if 1 /// elogind: optionally, time sources with sufficient accuracy are queued in a timer wheel
+        if (!s->ratelimited && event_source_uses_timer_wheel(s)) {
+                event_source_time_wheel_requeue(s, d);
+                return;
+        }
+#endif // 1
+
         prioq_reshuffle(d->earliest, s, &s->earliest_index);
         prioq_reshuffle(d->latest, s, &s->latest_index);
         d->needs_rearm = true;
@@ -915,6 +1074,10 @@ static void event_source_time_prioq_remove(
         prioq_remove(d->earliest, s, &s->earliest_index);
         prioq_remove(d->latest, s, &s->latest_index);
         s->earliest_index = s->latest_index = PRIOQ_IDX_NULL;
+#if 1 /// elogind: optionally, time sources with sufficient accuracy are queued in a timer wheel
+        if (d->wheel && EVENT_SOURCE_IS_TIME(s->type) && d == event_get_clock_data(s->event, s->type))
+                timer_wheel_remove(d->wheel, &s->time.wheel_entry);
+#endif // 1
         d->needs_rearm = true;
 }
 
@@ -1051,6 +1214,14 @@ static void source_disconnect(sd_event_source *s) {
                 source_memory_pressure_unregister(s);
                 break;
 
+#if 1 /// elogind: functions run in a pool of worker threads, see sd_event_add_work()
+        case SOURCE_WORK:
+                /* Waits for the function if it is running right now */
+                if (!event_origin_changed(s->event))
+                        event_work_pool_cancel(s->event->work.pool, &s->work.item);
+                break;
+#endif // 1
+
         default:
                 assert_not_reached();
         }
@@ -1147,6 +1318,9 @@ static int source_set_pending(sd_event_source *s, bool b) {
 
         if (b) {
                 s->pending_iteration = s->event->iteration;
+#if 1 /// elogind: per-source dispatch statistics, see sd_event_get_stats()
+                s->pending_usec = s->event->collect_stats ? now(CLOCK_MONOTONIC) : USEC_INFINITY;
+#endif // 1
 
                 r = prioq_put(s->event->pending, s, &s->pending_index);
                 if (r < 0) {
@@ -1202,6 +1376,9 @@ static sd_event_source* source_new(sd_event *e, bool floating, EventSourceType t
                 [SOURCE_EXIT]                = endoffsetof_field(sd_event_source, exit),
                 [SOURCE_INOTIFY]             = endoffsetof_field(sd_event_source, inotify),
                 [SOURCE_MEMORY_PRESSURE]     = endoffsetof_field(sd_event_source, memory_pressure),
+#if 1 /// elogind: functions run in a pool of worker threads, see sd_event_add_work()
+                [SOURCE_WORK]                = endoffsetof_field(sd_event_source, work),
+#endif // 1
         };
 
         sd_event_source *s;
@@ -1351,6 +1528,7 @@ static int setup_clock_data(sd_event *e, struct clock_data *d, clockid_t clock)
                         return r;
         }
 
+#if 0 /// elogind: inline prioq keys
         r = prioq_ensure_allocated(&d->earliest, earliest_time_prioq_compare);
         if (r < 0)
                 return r;
@@ -1358,6 +1536,15 @@ static int setup_clock_data(sd_event *e, struct clock_data *d, clockid_t clock)
         r = prioq_ensure_allocated(&d->latest, latest_time_prioq_compare);
         if (r < 0)
                 return r;
+#else // 0
+        r = prioq_ensure_allocated_with_key(&d->earliest, earliest_time_prioq_compare, earliest_time_prioq_key);
+        if (r < 0)
+                return r;
+
+        r = prioq_ensure_allocated_with_key(&d->latest, latest_time_prioq_compare, latest_time_prioq_key);
+        if (r < 0)
+                return r;
+#endif // 0
 
         return 0;
 }
@@ -1387,6 +1574,25 @@ static int event_source_time_prioq_put(
         return 0;
 }
 
+#if 1 /// elogind: optionally, time sources with sufficient accuracy are queued in a timer wheel
+static int event_source_time_native_put(
+                sd_event_source *s,
+                struct clock_data *d) {
+
+        assert(s);
+        assert(d);
+        assert(EVENT_SOURCE_IS_TIME(s->type));
+
+        /* Puts a time event source in the queue for its own clock, which cannot fail for the wheel */
+        if (event_source_uses_timer_wheel(s)) {
+                event_source_time_wheel_requeue(s, d);
+                return 0;
+        }
+
+        return event_source_time_prioq_put(s, d);
+}
+#endif // 1
+
 _public_ int sd_event_add_time(
                 sd_event *e,
                 sd_event_source **ret,
@@ -1434,7 +1640,11 @@ _public_ int sd_event_add_time(
         s->userdata = userdata;
         s->enabled = SD_EVENT_ONESHOT;
 
+#if 0 /// elogind: optionally, time sources with sufficient accuracy are queued in a timer wheel
         r = event_source_time_prioq_put(s, d);
+#else // 0
+        r = event_source_time_native_put(s, d);
+#endif // 0
         if (r < 0)
                 return r;
 
@@ -2136,6 +2346,77 @@ _public_ int sd_event_add_memory_pressure(
         return 0;
 }
 
+#if 1 /// elogind: functions run in a pool of worker threads, see sd_event_add_work()
+static int event_setup_work_pool(sd_event *e) {
+        _cleanup_(event_work_pool_freep) EventWorkPool *p = NULL;
+        int r;
+
+        assert(e);
+
+        if (e->work.pool)
+                return 0;
+
+        r = event_work_pool_new(e->work.n_threads_max, &p);
+        if (r < 0)
+                return r;
+
+        struct epoll_event ev = {
+                .events = EPOLLIN,
+                .data.ptr = &e->work,
+        };
+
+        if (epoll_ctl(e->epoll_fd, EPOLL_CTL_ADD, event_work_pool_get_fd(p), &ev) < 0)
+                return -errno;
+
+        e->work.pool = TAKE_PTR(p);
+        return 0;
+}
+
+_public_ int sd_event_add_work(
+                sd_event *e,
+                sd_event_source **ret,
+                sd_event_work_func_t work,
+                sd_event_work_handler_t callback,
+                void *userdata) {
+
+        _cleanup_(source_freep) sd_event_source *s = NULL;
+        int r;
+
+        assert_return(e, -EINVAL);
+        assert_return(e = event_resolve(e), -ENOPKG);
+        assert_return(work, -EINVAL);
+        assert_return(callback, -EINVAL);
+        assert_return(e->state != SD_EVENT_FINISHED, -ESTALE);
+        assert_return(!event_origin_changed(e), -ECHILD);
+
+        r = event_setup_work_pool(e);
+        if (r < 0)
+                return r;
+
+        s = source_new(e, !ret, SOURCE_WORK);
+        if (!s)
+                return -ENOMEM;
+
+        s->work.callback = callback;
+        s->work.item = (EventWorkItem) {
+                .func = work,
+                .userdata = userdata,
+        };
+        s->userdata = userdata;
+        s->enabled = SD_EVENT_ONESHOT;
+
+        r = event_work_pool_submit(e->work.pool, &s->work.item);
+        if (r < 0)
+                return r;
+
+        if (ret)
+                *ret = s;
+        TAKE_PTR(s);
+
+        return 0;
+}
+#endif // 1
+
 static void event_free_inotify_data(sd_event *e, struct inotify_data *d) {
         assert(e);
 
@@ -2910,7 +3191,11 @@ static int event_source_offline(
         /* Unset the pending flag when this event source is disabled */
         if (s->enabled != SD_EVENT_OFF &&
             enabled == SD_EVENT_OFF &&
+#if 0 /// elogind: completions of work event sources are kept until they are enabled again
             !IN_SET(s->type, SOURCE_DEFER, SOURCE_EXIT)) {
+#else // 0
+            !IN_SET(s->type, SOURCE_DEFER, SOURCE_EXIT, SOURCE_WORK)) {
+#endif // 0
                 r = source_set_pending(s, false);
                 if (r < 0)
                         return r;
@@ -2958,6 +3243,9 @@ static int event_source_offline(
         case SOURCE_DEFER:
         case SOURCE_POST:
         case SOURCE_INOTIFY:
+#if 1 /// elogind: functions run in a pool of worker threads, see sd_event_add_work()
+        case SOURCE_WORK:
+#endif // 1
                 break;
 
         default:
@@ -2984,7 +3272,11 @@ static int event_source_online(
         /* Unset the pending flag when this event source is enabled */
         if (s->enabled == SD_EVENT_OFF &&
             enabled != SD_EVENT_OFF &&
+#if 0 /// elogind: completions of work event sources are kept until they are enabled again
             !IN_SET(s->type, SOURCE_DEFER, SOURCE_EXIT)) {
+#else // 0
+            !IN_SET(s->type, SOURCE_DEFER, SOURCE_EXIT, SOURCE_WORK)) {
+#endif // 0
                 r = source_set_pending(s, false);
                 if (r < 0)
                         return r;
@@ -3053,6 +3345,9 @@ static int event_source_online(
         case SOURCE_DEFER:
         case SOURCE_POST:
         case SOURCE_INOTIFY:
+#if 1 /// elogind: functions run in a pool of worker threads, see sd_event_add_work()
+        case SOURCE_WORK:
+#endif // 1
                 break;
 
         default:
@@ -3186,6 +3481,28 @@ _public_ int sd_event_source_set_time_accuracy(sd_event_source *s, uint64_t usec
         if (usec == 0)
                 usec = DEFAULT_ACCURACY_USEC;
 
+#if 1 /// elogind: the accuracy decides whether the event source is queued in the timer wheel or the prioqs
+        if (!s->ratelimited) {
+                struct clock_data *d;
+                bool wheel_before, wheel_after;
+
+                assert_se(d = event_get_clock_data(s->event, s->type));
+                wheel_before = event_source_uses_timer_wheel(s);
+                wheel_after = d->wheel && usec >= TIMER_WHEEL_GRANULARITY_USEC;
+
+                if (wheel_before && !wheel_after) {
+                        timer_wheel_remove(d->wheel, &s->time.wheel_entry);
+
+                        r = event_source_time_prioq_put(s, d);
+                        if (r < 0) {
+                                event_source_time_wheel_requeue(s, d);
+                                return r;
+                        }
+                } else if (!wheel_before && wheel_after)
+                        event_source_time_prioq_remove(s, d);
+        }
+#endif // 1
+
         s->time.accuracy = usec;
 
         event_source_time_prioq_reshuffle(s);
@@ -3350,7 +3667,11 @@ _public_ int sd_event_source_set_prepare(sd_event_source *s, sd_event_handler_t
                 return 0;
         }
 
+#if 0 /// elogind: inline prioq keys
         r = prioq_ensure_allocated(&s->event->prepare, prepare_prioq_compare);
+#else // 0
+        r = prioq_ensure_allocated_with_key(&s->event->prepare, prepare_prioq_compare, prepare_prioq_key);
+#endif // 0
         if (r < 0)
                 return r;
 
@@ -3428,7 +3749,11 @@ fail:
         /* Reinstall time event sources in the priority queue as before. This shouldn't fail, since the queue
          * space for it should already be allocated. */
         if (EVENT_SOURCE_IS_TIME(s->type))
+#if 0 /// elogind: optionally, time sources with sufficient accuracy are queued in a timer wheel
                 assert_se(event_source_time_prioq_put(s, event_get_clock_data(s->event, s->type)) >= 0);
+#else // 0
+                assert_se(event_source_time_native_put(s, event_get_clock_data(s->event, s->type)) >= 0);
+#endif // 0
 
         return r;
 }
@@ -3446,7 +3771,11 @@ static int event_source_leave_ratelimit(sd_event_source *s, bool run_callback) {
 
         /* Let's then add the event source to its native clock prioq again — if this is a timer event source */
         if (EVENT_SOURCE_IS_TIME(s->type)) {
+#if 0 /// elogind: optionally, time sources with sufficient accuracy are queued in a timer wheel
                 r = event_source_time_prioq_put(s, event_get_clock_data(s->event, s->type));
+#else // 0
+                r = event_source_time_native_put(s, event_get_clock_data(s->event, s->type));
+#endif // 0
                 if (r < 0)
                         goto fail;
         }
@@ -3585,6 +3914,9 @@ static int event_arm_timer(
 
         struct itimerspec its = {};
         sd_event_source *a, *b;
+#if 1 /// elogind: optionally, time sources with sufficient accuracy are queued in a timer wheel
+        usec_t earliest = USEC_INFINITY, latest = USEC_INFINITY;
+#endif // 1
         usec_t t;
 
         assert(e);
@@ -3597,7 +3929,28 @@ static int event_arm_timer(
 
         a = prioq_peek(d->earliest);
         assert(!a || EVENT_SOURCE_USES_TIME_PRIOQ(a->type));
+#if 0 /// elogind: the timer wheel's next bucket has to be taken into account, too
         if (!a || a->enabled == SD_EVENT_OFF || time_event_source_next(a) == USEC_INFINITY) {
+#else // 0
+        if (a && a->enabled != SD_EVENT_OFF) {
+                earliest = time_event_source_next(a);
+
+                b = prioq_peek(d->latest);
+                assert(!b || EVENT_SOURCE_USES_TIME_PRIOQ(b->type));
+                assert(b && b->enabled != SD_EVENT_OFF);
+                latest = time_event_source_latest(b);
+        }
+
+        /* The wheel already rounded up to a coalescing boundary within the accuracy of its entries */
+        if (d->wheel) {
+                usec_t w = timer_wheel_next(d->wheel);
+
+                earliest = MIN(earliest, w);
+                latest = MIN(latest, w);
+        }
+
+        if (earliest == USEC_INFINITY) {
+#endif // 0
 
                 if (d->fd < 0)
                         return 0;
@@ -3613,11 +3966,15 @@ static int event_arm_timer(
                 return 0;
         }
 
+#if 0 /// elogind: see above
         b = prioq_peek(d->latest);
         assert(!b || EVENT_SOURCE_USES_TIME_PRIOQ(b->type));
         assert(b && b->enabled != SD_EVENT_OFF);
 
         t = sleep_between(e, time_event_source_next(a), time_event_source_latest(b));
+#else // 0
+        t = sleep_between(e, earliest, latest);
+#endif // 0
         if (d->next == t)
                 return 0;
 
@@ -3656,6 +4013,121 @@ static int process_io(sd_event *e, sd_event_source *s, uint32_t revents) {
         return source_set_pending(s, true);
 }
 
+#if 1 /// elogind: reads following up on wakeups may be batched
+static int event_uring_prefetch(sd_event *e, size_t m) {
+        size_t n = 0;
+        int r;
+
+        assert(e);
+
+        /* epoll told us which timerfds and signalfds are readable, and the handlers below will read from
+         * each of them right away. If there are several of them, issue all these reads at once through
+         * io_uring, and let event_read() hand out the results. The conditions here have to match those of
+         * flush_timer() and process_signal(), so that every result is picked up in the same iteration:
+         * a prefetched signal that isn't picked up would be lost. inotify fds are not included, as they
+         * don't support non-blocking reads through io_uring. */
+
+        e->n_uring_reads = 0;
+
+        if (!e->uring || m < 2)
+                return 0;
+
+        if (!GREEDY_REALLOC(e->uring_reads, m) ||
+            !GREEDY_REALLOC(e->uring_buffers, m))
+                return -ENOMEM;
+
+        for (size_t i = 0; i < m; i++) {
+                struct epoll_event *ev = e->event_queue + i;
+                size_t size;
+                int fd;
+
+                if (ev->events != EPOLLIN)
+                        continue;
+
+                if (ev->data.ptr == INT_TO_PTR(SOURCE_WATCHDOG)) {
+                        fd = e->watchdog_fd;
+                        size = sizeof(uint64_t);
+                } else {
+                        WakeupType *t = ev->data.ptr;
+
+                        if (*t == WAKEUP_CLOCK_DATA) {
+                                struct clock_data *d = ev->data.ptr;
+
+                                fd = d->fd;
+                                size = sizeof(uint64_t);
+
+                        } else if (*t == WAKEUP_SIGNAL_DATA) {
+                                struct signal_data *d = ev->data.ptr;
+
+                                if (d->current)
+                                        continue;
+
+                                fd = d->fd;
+                                size = sizeof(struct signalfd_siginfo);
+                        } else
+                                continue;
+                }
+
+                e->uring_reads[n] = (EventUringRead) {
+                        .fd = fd,
+                        .buf = e->uring_buffers + n,
+                        .size = size,
+                };
+                n++;
+        }
+
+        /* A single read is done quicker directly */
+        if (n < 2)
+                return 0;
+
+        r = event_uring_read_batch(e->uring, e->uring_reads, n);
+
+        /* Even on failure, some of the reads may have completed */
+        e->n_uring_reads = n;
+
+        if (r < 0) {
+                log_debug_errno(r, "Failed to batch reads through io_uring, falling back to individual reads: %m");
+                e->uring = event_uring_free(e->uring);
+        }
+
+        return 0;
+}
+
+static ssize_t event_read(sd_event *e, int fd, void *buf, size_t size) {
+        assert(e);
+
+        FOREACH_ARRAY(p, e->uring_reads, e->n_uring_reads) {
+                if (p->fd != fd || !p->done)
+                        continue;
+
+                /* Each result is handed out once, further reads go to the fd again */
+                p->done = false;
+
+                if (p->result == -EAGAIN) {
+                        errno = EAGAIN;
+                        return -1;
+                }
+
+                if (p->result < 0) {
+                        /* Nothing has been read, hence retry the classic way. Kernels that don't support
+                         * RWF_NOWAIT for timerfds or signalfds will keep failing, stop batching then. */
+                        if (IN_SET(p->result, -EOPNOTSUPP, -EINVAL) && e->uring) {
+                                log_debug_errno(p->result, "io_uring reads are not supported for timerfds or signalfds, not batching reads anymore: %m");
+                                e->uring = event_uring_free(e->uring);
+                        }
+
+                        break;
+                }
+
+                assert((size_t) p->result <= size);
+                memcpy(buf, p->buf, p->result);
+                return p->result;
+        }
+
+        return read(fd, buf, size);
+}
+#endif // 1
+
 static int flush_timer(sd_event *e, int fd, uint32_t events, usec_t *next) {
         uint64_t x;
         ssize_t ss;
@@ -3665,7 +4137,11 @@ static int flush_timer(sd_event *e, int fd, uint32_t events, usec_t *next) {
 
         assert_return(events == EPOLLIN, -EIO);
 
+#if 0 /// elogind: the read may have been done already, see event_uring_prefetch()
         ss = read(fd, &x, sizeof(x));
+#else // 0
+        ss = event_read(e, fd, &x, sizeof(x));
+#endif // 0
         if (ss < 0) {
                 if (ERRNO_IS_TRANSIENT(errno))
                         return 0;
@@ -3725,6 +4201,28 @@ static int process_timer(
                 event_source_time_prioq_reshuffle(s);
         }
 
+#if 1 /// elogind: optionally, time sources with sufficient accuracy are queued in a timer wheel
+        if (d->wheel) {
+                TimerWheelEntry *entry;
+
+                /* Once the timer elapsed, buckets may have been processed without any event source being
+                 * popped, hence make sure to look for the next one */
+                if (n >= d->next)
+                        d->needs_rearm = true;
+
+                /* The wheel only holds enabled, non-pending and non-ratelimited event sources */
+                while ((entry = timer_wheel_pop(d->wheel, n))) {
+                        s = container_of(entry, sd_event_source, time.wheel_entry);
+
+                        r = source_set_pending(s, true);
+                        if (r < 0) {
+                                event_source_time_wheel_requeue(s, d);
+                                return r;
+                        }
+                }
+        }
+#endif // 1
+
         return callback_invoked;
 }
 
@@ -3862,7 +4360,11 @@ static int process_signal(sd_event *e, struct signal_data *d, uint32_t events, i
                 ssize_t n;
                 sd_event_source *s = NULL;
 
+#if 0 /// elogind: the read may have been done already, see event_uring_prefetch()
                 n = read(d->fd, &si, sizeof(si));
+#else // 0
+                n = event_read(e, d->fd, &si, sizeof(si));
+#endif // 0
                 if (n < 0) {
                         if (ERRNO_IS_TRANSIENT(errno))
                                 return 0;
@@ -4061,6 +4563,42 @@ static int process_memory_pressure(sd_event_source *s, uint32_t revents) {
         return source_set_pending(s, true);
 }
 
+#if 1 /// elogind: functions run in a pool of worker threads, see sd_event_add_work()
+static int process_work(sd_event *e, uint32_t revents) {
+        EventWorkItem *i;
+        bool something_new = false;
+        int r;
+
+        assert(e);
+        assert(e->work.pool);
+
+        if (revents != EPOLLIN)
+                log_debug("Received unexpected poll event for work pool eventfd, ignoring.");
+
+        r = event_work_pool_flush(e->work.pool);
+        if (r < 0)
+                return r;
+
+        /* Unlike other event sources, several work event sources may complete per wakeup. All of them are
+         * marked pending at once, and then dispatched in the order of their priorities. */
+        while ((i = event_work_pool_pop_done(e->work.pool))) {
+                sd_event_source *s = container_of(i, sd_event_source, work.item);
+
+                assert(s->type == SOURCE_WORK);
+
+                r = source_set_pending(s, true);
+                if (r < 0) {
+                        event_work_pool_push_done(e->work.pool, i);
+                        return r;
+                }
+
+                something_new = true;
+        }
+
+        return something_new;
+}
+#endif // 1
+
 static int source_memory_pressure_write(sd_event_source *s) {
         ssize_t n;
         int r;
@@ -4174,6 +4712,10 @@ static int source_memory_pressure_initiate_dispatch(sd_event_source *s) {
 static int source_dispatch(sd_event_source *s) {
         EventSourceType saved_type;
         sd_event *saved_event;
+#if 1 /// elogind: per-source dispatch statistics, see sd_event_get_stats()
+        EventStatsEntry *stats_entry = NULL;
+        usec_t stats_begin = USEC_INFINITY, stats_latency = USEC_INFINITY;
+#endif // 1
         int r = 0;
 
         assert(s);
@@ -4198,6 +4740,19 @@ static int source_dispatch(sd_event_source *s) {
                 return 1;
         }
 
+#if 1 /// elogind: per-source dispatch statistics, see sd_event_get_stats()
+        if (saved_event->collect_stats) {
+                /* The entry is looked up before the callback runs, as it might change the description or
+                 * free the source */
+                stats_entry = event_stats_get_entry(&saved_event->stats,
+                                                    event_source_type_to_string(saved_type),
+                                                    s->description);
+                stats_begin = now(CLOCK_MONOTONIC);
+                if (s->type != SOURCE_EXIT && s->pending_usec != USEC_INFINITY)
+                        stats_latency = usec_sub_unsigned(stats_begin, s->pending_usec);
+        }
+#endif // 1
+
         if (!IN_SET(s->type, SOURCE_DEFER, SOURCE_EXIT)) {
                 r = source_set_pending(s, false);
                 if (r < 0)
@@ -4319,6 +4874,12 @@ static int source_dispatch(sd_event_source *s) {
                 r = s->memory_pressure.callback(s, s->userdata);
                 break;
 
+#if 1 /// elogind: functions run in a pool of worker threads, see sd_event_add_work()
+        case SOURCE_WORK:
+                r = s->work.callback(s, s->work.item.result, s->userdata);
+                break;
+#endif // 1
+
         case SOURCE_WATCHDOG:
         case _SOURCE_EVENT_SOURCE_TYPE_MAX:
         case _SOURCE_EVENT_SOURCE_TYPE_INVALID:
@@ -4327,6 +4888,18 @@ static int source_dispatch(sd_event_source *s) {
 
         s->dispatching = false;
 
+#if 1 /// elogind: per-source dispatch statistics, see sd_event_get_stats()
+        if (stats_entry) {
+                usec_t stats_end = now(CLOCK_MONOTONIC);
+
+                event_stats_entry_record(stats_entry, stats_latency, usec_sub_unsigned(stats_end, stats_begin), r < 0);
+
+                /* Defer sources stay pending, count their latency from the end of this dispatch */
+                if (s->type == SOURCE_DEFER && s->pending)
+                        s->pending_usec = stats_end;
+        }
+#endif // 1
+
 finish:
         if (r < 0) {
                 log_debug_errno(r, "Event source %s (type %s) returned error, %s: %m",
@@ -4670,6 +5243,12 @@ static int process_epoll(sd_event *e, usec_t timeout, int64_t threshold, int64_t
         if (threshold == INT64_MAX)
                 triple_timestamp_now(&e->timestamp);
 
+#if 1 /// elogind: batch the reads following up on these wakeups
+        r = event_uring_prefetch(e, m);
+        if (r < 0)
+                return r;
+#endif // 1
+
         for (size_t i = 0; i < m; i++) {
 
                 if (e->event_queue[i].data.ptr == INT_TO_PTR(SOURCE_WATCHDOG))
@@ -4727,6 +5306,12 @@ static int process_epoll(sd_event *e, usec_t timeout, int64_t threshold, int64_t
                                 r = event_inotify_data_read(e, e->event_queue[i].data.ptr, e->event_queue[i].events, threshold);
                                 break;
 
+#if 1 /// elogind: functions run in a pool of worker threads, see sd_event_add_work()
+                        case WAKEUP_WORK_DATA:
+                                r = process_work(e, e->event_queue[i].events);
+                                break;
+#endif // 1
+
                         default:
                                 assert_not_reached();
                         }
@@ -4737,6 +5322,10 @@ static int process_epoll(sd_event *e, usec_t timeout, int64_t threshold, int64_t
                         something_new = true;
         }
 
+#if 1 /// elogind: all prefetched results have been picked up by now
+        e->n_uring_reads = 0;
+#endif // 1
+
         *ret_min_priority = min_priority;
         return something_new;
 }
@@ -5108,6 +5697,159 @@ _public_ int sd_event_get_watchdog(sd_event *e) {
         return e->watchdog;
 }
 
+#if 1 /// elogind: reads following up on wakeups may be batched, see event_uring_prefetch()
+_public_ int sd_event_set_io_uring(sd_event *e, int b) {
+        int r;
+
+        assert_return(e, -EINVAL);
+        assert_return(e = event_resolve(e), -ENOPKG);
+        assert_return(!event_origin_changed(e), -ECHILD);
+
+        if (!!e->uring == !!b)
+                return !!e->uring;
+
+        if (b) {
+                r = event_uring_new(EVENT_URING_ENTRIES, &e->uring);
+                if (ERRNO_IS_NEG_NOT_SUPPORTED(r) || ERRNO_IS_NEG_PRIVILEGE(r)) {
+                        /* Not available (too old kernel, disabled via sysctl, seccomp, …), stick to epoll */
+                        log_debug_errno(r, "io_uring not available, not batching reads: %m");
+                        return 0;
+                }
+                if (r < 0)
+                        return r;
+        } else
+                e->uring = event_uring_free(e->uring);
+
+        return !!e->uring;
+}
+
+_public_ int sd_event_get_io_uring(sd_event *e) {
+        assert_return(e, -EINVAL);
+        assert_return(e = event_resolve(e), -ENOPKG);
+        assert_return(!event_origin_changed(e), -ECHILD);
+
+        return !!e->uring;
+}
+#endif // 1
+
+#if 1 /// elogind: optionally, time sources with sufficient accuracy are queued in a timer wheel
+_public_ int sd_event_set_timer_wheel(sd_event *e, int b) {
+        static const EventSourceType types[] = {
+                SOURCE_TIME_BOOTTIME,
+                SOURCE_TIME_MONOTONIC,
+                SOURCE_TIME_BOOTTIME_ALARM,
+        };
+        int r;
+
+        assert_return(e, -EINVAL);
+        assert_return(e = event_resolve(e), -ENOPKG);
+        assert_return(!event_origin_changed(e), -ECHILD);
+
+        if (!!e->monotonic.wheel == !!b)
+                return 0;
+
+        /* Time event sources are not moved between the prioqs and the wheels, hence this may only be
+         * changed before the first one is added */
+        LIST_FOREACH(sources, s, e->sources)
+                if (EVENT_SOURCE_IS_TIME(s->type))
+                        return -EBUSY;
+
+        /* The wheels never go back in time, hence they are not used for the realtime clocks */
+        FOREACH_ELEMENT(t, types) {
+                struct clock_data *d;
+
+                assert_se(d = event_get_clock_data(e, *t));
+
+                d->wheel = timer_wheel_free(d->wheel);
+                if (!b)
+                        continue;
+
+                /* CLOCK_BOOTTIME_ALARM shares the timebase of CLOCK_BOOTTIME */
+                r = timer_wheel_new(now(*t == SOURCE_TIME_MONOTONIC ? CLOCK_MONOTONIC : CLOCK_BOOTTIME), &d->wheel);
+                if (r < 0)
+                        goto fail;
+        }
+
+        return 0;
+
+fail:
+        FOREACH_ELEMENT(t, types)
+                event_get_clock_data(e, *t)->wheel = timer_wheel_free(event_get_clock_data(e, *t)->wheel);
+
+        return r;
+}
+
+_public_ int sd_event_get_timer_wheel(sd_event *e) {
+        assert_return(e, -EINVAL);
+        assert_return(e = event_resolve(e), -ENOPKG);
+        assert_return(!event_origin_changed(e), -ECHILD);
+
+        return !!e->monotonic.wheel;
+}
+#endif // 1
+
+#if 1 /// elogind: per-source dispatch statistics, see event-stats.c
+_public_ int sd_event_set_collect_stats(sd_event *e, int b) {
+        assert_return(e, -EINVAL);
+        assert_return(e = event_resolve(e), -ENOPKG);
+        assert_return(!event_origin_changed(e), -ECHILD);
+
+        e->collect_stats = b;
+        return 0;
+}
+
+_public_ int sd_event_get_collect_stats(sd_event *e) {
+        assert_return(e, -EINVAL);
+        assert_return(e = event_resolve(e), -ENOPKG);
+        assert_return(!event_origin_changed(e), -ECHILD);
+
+        return e->collect_stats;
+}
+
+_public_ int sd_event_get_stats(sd_event *e, sd_json_variant **ret) {
+        assert_return(e, -EINVAL);
+        assert_return(e = event_resolve(e), -ENOPKG);
+        assert_return(!event_origin_changed(e), -ECHILD);
+        assert_return(ret, -EINVAL);
+
+        return event_stats_build_json(e->stats, e->collect_stats, e->iteration, ret);
+}
+
+_public_ int sd_event_reset_stats(sd_event *e) {
+        assert_return(e, -EINVAL);
+        assert_return(e = event_resolve(e), -ENOPKG);
+        assert_return(!event_origin_changed(e), -ECHILD);
+
+        event_stats_reset(e->stats);
+        return 0;
+}
+#endif // 1
+
+#if 1 /// elogind: functions run in a pool of worker threads, see event-work.c
+_public_ int sd_event_set_work_threads_max(sd_event *e, unsigned n) {
+        assert_return(e, -EINVAL);
+        assert_return(e = event_resolve(e), -ENOPKG);
+        assert_return(n > 0, -EINVAL);
+        assert_return(!event_origin_changed(e), -ECHILD);
+
+        e->work.n_threads_max = n;
+        if (e->work.pool)
+                event_work_pool_set_threads_max(e->work.pool, n);
+
+        return 0;
+}
+
+_public_ int sd_event_get_work_threads_max(sd_event *e, unsigned *ret) {
+        assert_return(e, -EINVAL);
+        assert_return(e = event_resolve(e), -ENOPKG);
+        assert_return(ret, -EINVAL);
+        assert_return(!event_origin_changed(e), -ECHILD);
+
+        *ret = e->work.n_threads_max;
+        return 0;
+}
+#endif // 1
+
 _public_ int sd_event_get_iteration(sd_event *e, uint64_t *ret) {
         assert_return(e, -EINVAL);
         assert_return(e = event_resolve(e), -ENOPKG);
@@ -0,0 +1,173 @@
+/* SPDX-License-Identifier: LGPL-2.1-or-later */
+
+#include <errno.h>
+
+#include "sd-event.h"
+#include "sd-json.h"
+
+#include "json-util.h"
+#include "string-util.h"
+#include "tests.h"
+#include "time-util.h"
+
+#define N_BUSY 5U
+#define BUSY_USEC (2 * USEC_PER_MSEC)
+
+typedef struct Counters {
+        unsigned n_busy;
+        unsigned n_busy_max;
+        unsigned n_shared;
+        unsigned n_time;
+        unsigned n_anonymous;
+        unsigned n_failing;
+} Counters;
+
+static int on_busy(sd_event_source *s, void *userdata) {
+        Counters *c = ASSERT_PTR(userdata);
+
+        (void) usleep_safe(BUSY_USEC);
+
+        /* Dispatched once per iteration until the limit is hit */
+        if (++c->n_busy < c->n_busy_max)
+                assert_se(sd_event_source_set_enabled(s, SD_EVENT_ONESHOT) >= 0);
+
+        return 0;
+}
+
+static int on_shared(sd_event_source *s, void *userdata) {
+        Counters *c = ASSERT_PTR(userdata);
+
+        c->n_shared++;
+        return 0;
+}
+
+static int on_anonymous(sd_event_source *s, void *userdata) {
+        Counters *c = ASSERT_PTR(userdata);
+
+        c->n_anonymous++;
+        return 0;
+}
+
+static int on_failing(sd_event_source *s, void *userdata) {
+        Counters *c = ASSERT_PTR(userdata);
+
+        c->n_failing++;
+        return -EIO;
+}
+
+static int on_time(sd_event_source *s, uint64_t usec, void *userdata) {
+        Counters *c = ASSERT_PTR(userdata);
+
+        c->n_time++;
+        return 0;
+}
+
+static sd_json_variant* find_source(sd_json_variant *v, const char *type, const char *description) {
+        sd_json_variant *i;
+
+        JSON_VARIANT_ARRAY_FOREACH(i, sd_json_variant_by_key(v, "sources"))
+                if (streq(sd_json_variant_string(sd_json_variant_by_key(i, "type")), type) &&
+                    streq_ptr(sd_json_variant_string(sd_json_variant_by_key(i, "description")), description))
+                        return i;
+
+        return NULL;
+}
+
+static uint64_t source_field(sd_json_variant *v, const char *type, const char *description, const char *field) {
+        sd_json_variant *s;
+
+        s = find_source(v, type, description);
+        assert_se(s);
+
+        return sd_json_variant_unsigned(sd_json_variant_by_key(s, field));
+}
+
+TEST(stats) {
+        _cleanup_(sd_event_unrefp) sd_event *e = NULL;
+        _cleanup_(sd_json_variant_unrefp) sd_json_variant *v = NULL;
+        _cleanup_(sd_event_source_unrefp) sd_event_source *busy = NULL, *shared_a = NULL, *shared_b = NULL,
+                *anonymous = NULL, *failing = NULL, *timer = NULL;
+        Counters c = {
+                .n_busy_max = N_BUSY,
+        };
+
+        assert_se(sd_event_new(&e) >= 0);
+
+        assert_se(sd_event_get_collect_stats(e) == 0);
+        assert_se(sd_event_set_collect_stats(e, true) >= 0);
+        assert_se(sd_event_get_collect_stats(e) > 0);
+
+        assert_se(sd_event_add_defer(e, &busy, on_busy, &c) >= 0);
+        assert_se(sd_event_source_set_description(busy, "busy") >= 0);
+
+        /* Sources sharing a description are accounted together */
+        assert_se(sd_event_add_defer(e, &shared_a, on_shared, &c) >= 0);
+        assert_se(sd_event_source_set_description(shared_a, "shared") >= 0);
+        assert_se(sd_event_add_defer(e, &shared_b, on_shared, &c) >= 0);
+        assert_se(sd_event_source_set_description(shared_b, "shared") >= 0);
+
+        assert_se(sd_event_add_defer(e, &anonymous, on_anonymous, &c) >= 0);
+
+        assert_se(sd_event_add_defer(e, &failing, on_failing, &c) >= 0);
+        assert_se(sd_event_source_set_description(failing, "failing") >= 0);
+
+        assert_se(sd_event_add_time_relative(e, &timer, CLOCK_MONOTONIC, 1, 1, on_time, &c) >= 0);
+        assert_se(sd_event_source_set_description(timer, "timer") >= 0);
+
+        while (c.n_busy < N_BUSY || c.n_shared < 2 || c.n_anonymous < 1 || c.n_failing < 1 || c.n_time < 1)
+                assert_se(sd_event_run(e, 100 * USEC_PER_MSEC) > 0);
+
+        assert_se(sd_event_get_stats(e, &v) >= 0);
+        sd_json_variant_dump(v, SD_JSON_FORMAT_PRETTY_AUTO|SD_JSON_FORMAT_COLOR_AUTO, NULL, NULL);
+
+        assert_se(sd_json_variant_boolean(sd_json_variant_by_key(v, "collecting")));
+        assert_se(sd_json_variant_unsigned(sd_json_variant_by_key(v, "iteration")) >= N_BUSY);
+
+        /* Each dispatch is counted, and the time spent in the callback is recorded */
+        assert_se(source_field(v, "defer", "busy", "count") == N_BUSY);
+        assert_se(source_field(v, "defer", "busy", "errors") == 0);
+        assert_se(source_field(v, "defer", "busy", "totalUSec") >= N_BUSY * BUSY_USEC);
+        assert_se(source_field(v, "defer", "busy", "maxUSec") >= BUSY_USEC);
+        assert_se(source_field(v, "defer", "busy", "maxUSec") <= source_field(v, "defer", "busy", "totalUSec"));
+        assert_se(sd_json_variant_elements(sd_json_variant_by_key(find_source(v, "defer", "busy"), "latencyHistogram")) > 0);
+
+        assert_se(source_field(v, "defer", "shared", "count") == 2);
+        assert_se(source_field(v, "defer", NULL, "count") == 1);
+        assert_se(source_field(v, "defer", "failing", "count") == 1);
+        assert_se(source_field(v, "defer", "failing", "errors") == 1);
+        assert_se(source_field(v, "monotonic", "timer", "count") == 1);
+
+        /* Resetting forgets about all dispatches, sources without any are not listed */
+        assert_se(sd_event_reset_stats(e) >= 0);
+        v = sd_json_variant_unref(v);
+
+        assert_se(sd_event_get_stats(e, &v) >= 0);
+        assert_se(sd_json_variant_boolean(sd_json_variant_by_key(v, "collecting")));
+        assert_se(sd_json_variant_is_blank_array(sd_json_variant_by_key(v, "sources")));
+
+        c.n_busy_max = N_BUSY + 1;
+        assert_se(sd_event_source_set_enabled(busy, SD_EVENT_ONESHOT) >= 0);
+        assert_se(sd_event_run(e, 0) > 0);
+        assert_se(c.n_busy == N_BUSY + 1);
+
+        v = sd_json_variant_unref(v);
+        assert_se(sd_event_get_stats(e, &v) >= 0);
+        assert_se(source_field(v, "defer", "busy", "count") == 1);
+        assert_se(!find_source(v, "defer", "shared"));
+
+        /* Once turned off, dispatches are no longer counted */
+        assert_se(sd_event_set_collect_stats(e, false) >= 0);
+        assert_se(sd_event_get_collect_stats(e) == 0);
+
+        c.n_busy_max = N_BUSY + 2;
+        assert_se(sd_event_source_set_enabled(busy, SD_EVENT_ONESHOT) >= 0);
+        assert_se(sd_event_run(e, 0) > 0);
+        assert_se(c.n_busy == N_BUSY + 2);
+
+        v = sd_json_variant_unref(v);
+        assert_se(sd_event_get_stats(e, &v) >= 0);
+        assert_se(!sd_json_variant_boolean(sd_json_variant_by_key(v, "collecting")));
+        assert_se(source_field(v, "defer", "busy", "count") == 1);
+}
+
+DEFINE_TEST_MAIN(LOG_INFO);
@@ -0,0 +1,273 @@
+/* SPDX-License-Identifier: LGPL-2.1-or-later */
+
+#include "sd-event.h"
+
+#include "alloc-util.h"
+#include "event-timer-wheel.h"
+#include "random-util.h"
+#include "tests.h"
+#include "time-util.h"
+
+#define N_ENTRIES 2000U
+#define N_SOURCES 10000U
+#define N_REARMS 200000U
+
+typedef struct Timer {
+        TimerWheelEntry entry;
+        usec_t next;
+        usec_t accuracy;
+        bool queued;
+} Timer;
+
+TEST(timer_wheel_rounding) {
+        _cleanup_(timer_wheel_freep) TimerWheel *w = NULL;
+        Timer a = {}, b = {}, c = {};
+        usec_t base = 100 * USEC_PER_SEC;
+
+        assert_se(timer_wheel_new(base, &w) >= 0);
+        assert_se(timer_wheel_next(w) == USEC_INFINITY);
+        assert_se(!timer_wheel_pop(w, base));
+
+        /* Entries with overlapping windows elapse together, on a boundary within both */
+        timer_wheel_add(w, &a.entry, base + 1100 * USEC_PER_MSEC + 7, 250 * USEC_PER_MSEC);
+        timer_wheel_add(w, &b.entry, base + 1110 * USEC_PER_MSEC, 250 * USEC_PER_MSEC);
+        assert_se(a.entry.expiry == b.entry.expiry);
+        assert_se(a.entry.expiry > base + 1100 * USEC_PER_MSEC + 7);
+        assert_se(a.entry.expiry <= base + 1350 * USEC_PER_MSEC + 7);
+
+        /* Times on the finest boundary are kept as they are */
+        timer_wheel_add(w, &c.entry, base + 3 * USEC_PER_MSEC, USEC_PER_MSEC);
+        assert_se(c.entry.expiry == base + 3 * USEC_PER_MSEC);
+        assert_se(timer_wheel_size(w) == 3);
+        assert_se(timer_wheel_next(w) == c.entry.expiry);
+
+        assert_se(!timer_wheel_pop(w, base + 2 * USEC_PER_MSEC));
+        assert_se(timer_wheel_pop(w, base + 3 * USEC_PER_MSEC) == &c.entry);
+        assert_se(!timer_wheel_entry_queued(&c.entry));
+        assert_se(timer_wheel_next(w) == a.entry.expiry);
+
+        timer_wheel_remove(w, &a.entry);
+        assert_se(!timer_wheel_entry_queued(&a.entry));
+        timer_wheel_remove(w, &a.entry);
+
+        assert_se(timer_wheel_pop(w, USEC_INFINITY - 1) == &b.entry);
+        assert_se(!timer_wheel_pop(w, USEC_INFINITY - 1));
+        assert_se(timer_wheel_size(w) == 0);
+
+        /* Entries in the past elapse right away */
+        timer_wheel_add(w, &a.entry, base, USEC_PER_SEC);
+        assert_se(timer_wheel_next(w) <= base + USEC_PER_SEC);
+        assert_se(timer_wheel_pop(w, 0) == &a.entry);
+}
+
+TEST(timer_wheel_random) {
+        static const usec_t accuracies[] = {
+                USEC_PER_MSEC,
+                5 * USEC_PER_MSEC,
+                250 * USEC_PER_MSEC,
+                USEC_PER_SEC,
+                USEC_PER_MINUTE,
+                USEC_PER_HOUR,
+                USEC_PER_DAY,
+        };
+        _cleanup_(timer_wheel_freep) TimerWheel *w = NULL;
+        _cleanup_free_ Timer *timers = NULL;
+        usec_t clk = 1000 * USEC_PER_SEC;
+        size_t n_popped = 0;
+
+        /* Compares the wheel against a trivial scan over all timers */
+
+        assert_se(timers = new0(Timer, N_ENTRIES));
+        assert_se(timer_wheel_new(clk, &w) >= 0);
+
+        for (unsigned i = 0; i < 50000; i++) {
+                Timer *t = timers + random_u64_range(N_ENTRIES);
+                uint64_t op = random_u64_range(10);
+
+                if (op < 7 && t->queued) {
+                        timer_wheel_remove(w, &t->entry);
+                        t->queued = false;
+                }
+
+                if (op < 5) {
+                        static const usec_t spans[] = { 2 * USEC_PER_SEC, USEC_PER_MINUTE, 3 * USEC_PER_DAY };
+
+                        t->accuracy = accuracies[random_u64_range(ELEMENTSOF(accuracies))];
+                        t->next = clk - USEC_PER_MSEC + random_u64_range(spans[random_u64_range(ELEMENTSOF(spans))]);
+
+                        timer_wheel_add(w, &t->entry, t->next, t->accuracy);
+                        t->queued = true;
+
+                        assert_se(t->entry.expiry >= t->next);
+                        assert_se(t->entry.expiry <= t->next + t->accuracy);
+
+                } else if (op >= 7) {
+                        usec_t n, next, min_expiry = USEC_INFINITY;
+                        TimerWheelEntry *e;
+                        size_t n_queued = 0;
+
+                        for (Timer *t2 = timers; t2 < timers + N_ENTRIES; t2++)
+                                if (t2->queued) {
+                                        min_expiry = MIN(min_expiry, t2->entry.expiry);
+                                        n_queued++;
+                                }
+
+                        assert_se(timer_wheel_size(w) == n_queued);
+
+                        /* The reported time may be early, but never late */
+                        next = timer_wheel_next(w);
+                        assert_se(next <= min_expiry);
+
+                        /* Either advance to the reported time, like the event loop does, or jump ahead */
+                        if (op == 7 && next != USEC_INFINITY)
+                                n = MAX(next, clk);
+                        else
+                                n = clk + random_u64_range(5 * USEC_PER_SEC);
+
+                        while ((e = timer_wheel_pop(w, n))) {
+                                Timer *p = container_of(e, Timer, entry);
+
+                                assert_se(p->queued);
+                                assert_se(p->entry.expiry <= n);
+                                p->queued = false;
+                                n_popped++;
+                        }
+
+                        for (Timer *t2 = timers; t2 < timers + N_ENTRIES; t2++)
+                                assert_se(!t2->queued || t2->entry.expiry > n);
+
+                        clk = n;
+                }
+        }
+
+        log_info("Popped %zu entries.", n_popped);
+        assert_se(n_popped > 0);
+
+        for (Timer *t = timers; t < timers + N_ENTRIES; t++)
+                timer_wheel_remove(w, &t->entry);
+}
+
+static int on_time(sd_event_source *s, uint64_t usec, void *userdata) {
+        unsigned *n = ASSERT_PTR(userdata);
+        uint64_t next, accuracy;
+
+        assert_se(sd_event_source_get_time(s, &next) >= 0);
+        assert_se(sd_event_source_get_time_accuracy(s, &accuracy) >= 0);
+        assert_se(usec >= next);
+
+        if (--(*n) == 0)
+                assert_se(sd_event_exit(sd_event_source_get_event(s), 0) >= 0);
+
+        return 0;
+}
+
+static void test_event_loop_one(bool wheel) {
+        _cleanup_(sd_event_unrefp) sd_event *e = NULL;
+        sd_event_source *sources[40] = {};
+        usec_t t_monotonic, t_boottime;
+        unsigned n = 0;
+
+        log_info("/* %s(wheel=%s) */", __func__, yes_no(wheel));
+
+        assert_se(sd_event_new(&e) >= 0);
+        assert_se(sd_event_set_timer_wheel(e, wheel) >= 0);
+        assert_se(sd_event_get_timer_wheel(e) == wheel);
+        assert_se(sd_event_now(e, CLOCK_MONOTONIC, &t_monotonic) >= 0);
+        assert_se(sd_event_now(e, CLOCK_BOOTTIME, &t_boottime) >= 0);
+
+        for (size_t i = 0; i < ELEMENTSOF(sources); i++) {
+                /* Mix of sources that go to the wheel and such that stay in the prioqs */
+                assert_se(sd_event_add_time(e, sources + i, i % 2 == 0 ? CLOCK_MONOTONIC : CLOCK_BOOTTIME,
+                                            (i % 2 == 0 ? t_monotonic : t_boottime) + random_u64_range(50 * USEC_PER_MSEC),
+                                            i % 4 == 1 ? 1 : i * USEC_PER_MSEC,
+                                            on_time, &n) >= 0);
+                n++;
+        }
+
+        /* A disabled source must not elapse, one moved into the past elapses right away */
+        assert_se(sd_event_source_set_enabled(sources[0], SD_EVENT_OFF) >= 0);
+        n--;
+        assert_se(sd_event_source_set_time(sources[2], 0) >= 0);
+
+        /* Moves sources between the wheel and the prioqs */
+        assert_se(sd_event_source_set_time_accuracy(sources[4], 1) >= 0);
+        assert_se(sd_event_source_set_time_accuracy(sources[5], 20 * USEC_PER_MSEC) >= 0);
+
+        /* Changing is refused once time sources exist */
+        assert_se(sd_event_set_timer_wheel(e, !wheel) == -EBUSY);
+
+        assert_se(sd_event_loop(e) >= 0);
+        assert_se(n == 0);
+
+        FOREACH_ELEMENT(s, sources)
+                *s = sd_event_source_unref(*s);
+
+        assert_se(sd_event_set_timer_wheel(e, !wheel) >= 0);
+}
+
+TEST(event_loop) {
+        test_event_loop_one(false);
+        test_event_loop_one(true);
+}
+
+static int on_never(sd_event_source *s, uint64_t usec, void *userdata) {
+        assert_not_reached();
+}
+
+static void benchmark_rearm_one(bool wheel) {
+        _cleanup_(sd_event_unrefp) sd_event *e = NULL;
+        _cleanup_free_ sd_event_source **sources = NULL;
+        _cleanup_free_ uint64_t *times = NULL;
+        nsec_t begin, elapsed;
+        usec_t t;
+
+        assert_se(sd_event_new(&e) >= 0);
+        assert_se(sd_event_set_timer_wheel(e, wheel) >= 0);
+        assert_se(sd_event_now(e, CLOCK_MONOTONIC, &t) >= 0);
+
+        assert_se(sources = new0(sd_event_source*, N_SOURCES));
+        assert_se(times = new(uint64_t, N_REARMS));
+
+        /* Like per-session and per-peer timeouts, spread over the next hour with the default accuracy */
+        for (size_t i = 0; i < N_SOURCES; i++)
+                assert_se(sd_event_add_time(e, sources + i, CLOCK_MONOTONIC,
+                                            t + USEC_PER_HOUR + random_u64_range(USEC_PER_HOUR), 0,
+                                            on_never, NULL) >= 0);
+
+        for (size_t i = 0; i < N_REARMS; i++)
+                times[i] = t + USEC_PER_HOUR + random_u64_range(USEC_PER_HOUR);
+
+        begin = now_nsec(CLOCK_MONOTONIC);
+        for (size_t i = 0; i < N_REARMS; i++)
+                assert_se(sd_event_source_set_time(sources[i % N_SOURCES], times[i]) >= 0);
+        elapsed = now_nsec(CLOCK_MONOTONIC) - begin;
+
+        log_info("%-30s %10u rearms %10" PRIu64 " ns/rearm",
+                 wheel ? "timer wheel" : "prioq", N_REARMS, elapsed / N_REARMS);
+
+        begin = now_nsec(CLOCK_MONOTONIC);
+        for (size_t i = 0; i < N_SOURCES; i++) {
+                assert_se(sd_event_source_set_enabled(sources[i], SD_EVENT_OFF) >= 0);
+                assert_se(sd_event_source_set_enabled(sources[i], SD_EVENT_ONESHOT) >= 0);
+        }
+        elapsed = now_nsec(CLOCK_MONOTONIC) - begin;
+
+        log_info("%-30s %10u toggles %9" PRIu64 " ns/toggle",
+                 wheel ? "timer wheel" : "prioq", N_SOURCES, elapsed / N_SOURCES);
+
+        /* Nothing elapses within the next hour */
+        assert_se(sd_event_run(e, 0) >= 0);
+
+        for (size_t i = 0; i < N_SOURCES; i++)
+                sources[i] = sd_event_source_unref(sources[i]);
+}
+
+TEST(benchmark_rearm) {
+        if (!slow_tests_enabled())
+                return (void) log_tests_skipped("slow tests are disabled");
+
+        benchmark_rearm_one(false);
+        benchmark_rearm_one(true);
+}
+
+DEFINE_TEST_MAIN(LOG_INFO);
@@ -0,0 +1,134 @@
+/* SPDX-License-Identifier: LGPL-2.1-or-later */
+
+#include <signal.h>
+
+#include "sd-event.h"
+
+#include "tests.h"
+#include "time-util.h"
+
+static const clockid_t clocks[] = {
+        CLOCK_MONOTONIC,
+        CLOCK_REALTIME,
+        CLOCK_BOOTTIME,
+};
+
+static const int signals[] = {
+        SIGUSR1,
+        SIGUSR2,
+        SIGURG,
+};
+
+typedef struct Counters {
+        unsigned n_time;
+        unsigned n_signal;
+        unsigned signal_mask;
+} Counters;
+
+static int on_time(sd_event_source *s, uint64_t usec, void *userdata) {
+        Counters *c = ASSERT_PTR(userdata);
+
+        c->n_time++;
+        return 0;
+}
+
+static int on_signal(sd_event_source *s, const struct signalfd_siginfo *si, void *userdata) {
+        Counters *c = ASSERT_PTR(userdata);
+
+        for (size_t i = 0; i < ELEMENTSOF(signals); i++)
+                if (signals[i] == (int) si->ssi_signo) {
+                        assert_se(!(c->signal_mask & (1U << i)));
+                        c->signal_mask |= 1U << i;
+                }
+
+        c->n_signal++;
+        return 0;
+}
+
+static void test_batch_one(bool uring) {
+        _cleanup_(sd_event_unrefp) sd_event *e = NULL;
+        sd_event_source *time_sources[ELEMENTSOF(clocks)] = {}, *signal_sources[ELEMENTSOF(signals)] = {};
+        Counters c = {};
+        int r;
+
+        log_info("/* %s(uring=%s) */", __func__, yes_no(uring));
+
+        assert_se(sd_event_new(&e) >= 0);
+
+        r = sd_event_set_io_uring(e, uring);
+        assert_se(r >= 0);
+        if (uring && r == 0)
+                log_info("io_uring not available, reads are not batched.");
+
+        /* Each clock has its own timerfd, and each priority its own signalfd, hence all of these are
+         * readable at once in the first iteration */
+        for (size_t i = 0; i < ELEMENTSOF(clocks); i++)
+                assert_se(sd_event_add_time_relative(e, time_sources + i, clocks[i], 1, 1, on_time, &c) >= 0);
+
+        for (size_t i = 0; i < ELEMENTSOF(signals); i++) {
+                assert_se(sd_event_add_signal(e, signal_sources + i, signals[i] | SD_EVENT_SIGNAL_PROCMASK, on_signal, &c) >= 0);
+                assert_se(sd_event_source_set_priority(signal_sources[i], (int64_t) i) >= 0);
+        }
+
+        FOREACH_ELEMENT(sig, signals)
+                assert_se(raise(*sig) >= 0);
+
+        (void) usleep_safe(10 * USEC_PER_MSEC);
+
+        /* Falls back to plain reads if the kernel does not support batching them, but must never fail */
+        while (c.n_time < ELEMENTSOF(clocks) || c.n_signal < ELEMENTSOF(signals))
+                assert_se(sd_event_run(e, 100 * USEC_PER_MSEC) > 0);
+
+        assert_se(c.n_time == ELEMENTSOF(clocks));
+        assert_se(c.n_signal == ELEMENTSOF(signals));
+        assert_se(c.signal_mask == (1U << ELEMENTSOF(signals)) - 1);
+
+        /* Nothing left over */
+        assert_se(sd_event_run(e, 0) == 0);
+
+        if (!uring)
+                assert_se(sd_event_get_io_uring(e) == 0);
+
+        FOREACH_ELEMENT(s, time_sources)
+                *s = sd_event_source_unref(*s);
+        FOREACH_ELEMENT(s, signal_sources)
+                *s = sd_event_source_unref(*s);
+}
+
+TEST(batch) {
+        test_batch_one(false);
+        test_batch_one(true);
+}
+
+TEST(batch_repeated) {
+        _cleanup_(sd_event_unrefp) sd_event *e = NULL;
+        sd_event_source *signal_sources[ELEMENTSOF(signals)] = {};
+        Counters c = {};
+
+        /* Several iterations, each with all signalfds readable at once */
+
+        assert_se(sd_event_new(&e) >= 0);
+        assert_se(sd_event_set_io_uring(e, true) >= 0);
+
+        for (size_t i = 0; i < ELEMENTSOF(signals); i++) {
+                assert_se(sd_event_add_signal(e, signal_sources + i, signals[i] | SD_EVENT_SIGNAL_PROCMASK, on_signal, &c) >= 0);
+                assert_se(sd_event_source_set_priority(signal_sources[i], (int64_t) i) >= 0);
+        }
+
+        for (unsigned k = 1; k <= 10; k++) {
+                c.signal_mask = 0;
+
+                FOREACH_ELEMENT(sig, signals)
+                        assert_se(raise(*sig) >= 0);
+
+                while (c.n_signal < k * ELEMENTSOF(signals))
+                        assert_se(sd_event_run(e, 100 * USEC_PER_MSEC) > 0);
+
+                assert_se(c.signal_mask == (1U << ELEMENTSOF(signals)) - 1);
+        }
+
+        FOREACH_ELEMENT(s, signal_sources)
+                *s = sd_event_source_unref(*s);
+}
+
+DEFINE_TEST_MAIN(LOG_INFO);
@@ -0,0 +1,193 @@
+/* SPDX-License-Identifier: LGPL-2.1-or-later */
+
+#include <pthread.h>
+#include <unistd.h>
+
+#include "sd-event.h"
+
+#include "tests.h"
+#include "time-util.h"
+
+#define N_WORK 32U
+
+typedef struct Counters {
+        pthread_mutex_t mutex;
+        unsigned n_running;
+        unsigned n_running_max;
+        unsigned n_done;
+        pid_t loop_tid;
+} Counters;
+
+typedef struct Work {
+        Counters *counters;
+        unsigned index;
+        usec_t sleep_usec;
+        bool ran;
+        bool dispatched;
+} Work;
+
+static int work_func(void *userdata) {
+        Work *w = ASSERT_PTR(userdata);
+        Counters *c = w->counters;
+
+        /* Runs in a worker thread, never in the thread of the event loop */
+        assert_se(gettid() != c->loop_tid);
+
+        assert_se(pthread_mutex_lock(&c->mutex) == 0);
+        c->n_running++;
+        c->n_running_max = MAX(c->n_running_max, c->n_running);
+        assert_se(pthread_mutex_unlock(&c->mutex) == 0);
+
+        (void) usleep_safe(w->sleep_usec);
+
+        assert_se(pthread_mutex_lock(&c->mutex) == 0);
+        c->n_running--;
+        w->ran = true;
+        assert_se(pthread_mutex_unlock(&c->mutex) == 0);
+
+        return (int) w->index;
+}
+
+static int work_handler(sd_event_source *s, int result, void *userdata) {
+        Work *w = ASSERT_PTR(userdata);
+        Counters *c = w->counters;
+
+        assert_se(gettid() == c->loop_tid);
+        assert_se(w->ran);
+        assert_se(!w->dispatched);
+        assert_se(result == (int) w->index);
+
+        w->dispatched = true;
+
+        if (++c->n_done == N_WORK)
+                assert_se(sd_event_exit(sd_event_source_get_event(s), 0) >= 0);
+
+        return 0;
+}
+
+TEST(work) {
+        _cleanup_(sd_event_unrefp) sd_event *e = NULL;
+        Counters c = {
+                .mutex = PTHREAD_MUTEX_INITIALIZER,
+                .loop_tid = gettid(),
+        };
+        Work works[N_WORK];
+        unsigned n;
+
+        assert_se(sd_event_new(&e) >= 0);
+        assert_se(sd_event_get_work_threads_max(e, &n) >= 0);
+        assert_se(n > 0);
+
+        assert_se(sd_event_set_work_threads_max(e, 0) == -EINVAL);
+        assert_se(sd_event_set_work_threads_max(e, 3) >= 0);
+        assert_se(sd_event_get_work_threads_max(e, &n) >= 0);
+        assert_se(n == 3);
+
+        for (unsigned i = 0; i < N_WORK; i++) {
+                works[i] = (Work) {
+                        .counters = &c,
+                        .index = i,
+                        .sleep_usec = 2 * USEC_PER_MSEC,
+                };
+
+                /* Floating, they go away with the event loop */
+                assert_se(sd_event_add_work(e, NULL, work_func, work_handler, works + i) >= 0);
+        }
+
+        assert_se(sd_event_loop(e) >= 0);
+
+        assert_se(c.n_done == N_WORK);
+        assert_se(c.n_running == 0);
+        assert_se(c.n_running_max > 0);
+        assert_se(c.n_running_max <= 3);
+        log_info("Ran up to %u functions concurrently.", c.n_running_max);
+
+        FOREACH_ELEMENT(w, works)
+                assert_se(w->dispatched);
+}
+
+TEST(work_cancel) {
+        _cleanup_(sd_event_unrefp) sd_event *e = NULL;
+        Counters c = {
+                .mutex = PTHREAD_MUTEX_INITIALIZER,
+                .loop_tid = gettid(),
+        };
+        Work running = {
+                .counters = &c,
+                .sleep_usec = 100 * USEC_PER_MSEC,
+        }, queued = {
+                .counters = &c,
+                .index = 1,
+        };
+        sd_event_source *a, *b;
+        int enabled;
+
+        assert_se(sd_event_new(&e) >= 0);
+        assert_se(sd_event_set_work_threads_max(e, 1) >= 0);
+
+        assert_se(sd_event_add_work(e, &a, work_func, work_handler, &running) >= 0);
+        assert_se(sd_event_add_work(e, &b, work_func, work_handler, &queued) >= 0);
+        assert_se(sd_event_source_get_enabled(a, &enabled) > 0);
+        assert_se(enabled == SD_EVENT_ONESHOT);
+
+        /* Wait until the first function is running. With a single thread, the second is still queued then,
+         * and never runs once dropped. */
+        for (;;) {
+                bool running_now;
+
+                assert_se(pthread_mutex_lock(&c.mutex) == 0);
+                running_now = c.n_running > 0 || running.ran;
+                assert_se(pthread_mutex_unlock(&c.mutex) == 0);
+
+                if (running_now)
+                        break;
+
+                (void) usleep_safe(USEC_PER_MSEC);
+        }
+
+        b = sd_event_source_unref(b);
+
+        /* Waits for the running function, whose completion is then not dispatched anymore */
+        a = sd_event_source_unref(a);
+        assert_se(running.ran);
+
+        assert_se(sd_event_run(e, 50 * USEC_PER_MSEC) >= 0);
+
+        assert_se(!queued.ran);
+        assert_se(!running.dispatched);
+        assert_se(!queued.dispatched);
+}
+
+TEST(work_disabled) {
+        _cleanup_(sd_event_unrefp) sd_event *e = NULL;
+        _cleanup_(sd_event_source_unrefp) sd_event_source *s = NULL;
+        Counters c = {
+                .mutex = PTHREAD_MUTEX_INITIALIZER,
+                .loop_tid = gettid(),
+        };
+        Work w = {
+                .counters = &c,
+                .index = 7,
+        };
+
+        assert_se(sd_event_new(&e) >= 0);
+        assert_se(sd_event_add_work(e, &s, work_func, work_handler, &w) >= 0);
+        assert_se(sd_event_source_set_enabled(s, SD_EVENT_OFF) >= 0);
+
+        /* The completion is kept while the source is disabled */
+        while (sd_event_source_get_pending(s) == 0)
+                assert_se(sd_event_run(e, 10 * USEC_PER_MSEC) >= 0);
+
+        assert_se(w.ran);
+        assert_se(!w.dispatched);
+
+        assert_se(sd_event_source_set_enabled(s, SD_EVENT_ONESHOT) >= 0);
+        assert_se(sd_event_source_get_pending(s) > 0);
+        assert_se(sd_event_run(e, 0) >= 0);
+
+        assert_se(w.dispatched);
+        assert_se(sd_event_source_get_pending(s) == 0);
+        assert_se(sd_event_source_get_enabled(s, NULL) == 0);
+}
+
+DEFINE_TEST_MAIN(LOG_INFO);
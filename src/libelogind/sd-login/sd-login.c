@@ -19,6 +19,9 @@
 #include "hostname-util.h"
 #include "io-util.h"
 #include "login-util.h"
+#if 1 /// elogind: memory mapped login state database
+#include "login-db.h"
+#endif // 1
 #include "macro.h"
 #include "parse-util.h"
 #include "path-util.h"
@@ -497,6 +500,18 @@ _public_ int sd_uid_get_state(uid_t uid, char**state) {
         if (r < 0)
                 return r;
 
+#if 1 /// elogind: try the memory mapped database first, it is cheaper than parsing the state file
+        r = login_db_uid_get_state(uid, &s);
+        if (r == -ENXIO)
+                r = free_and_strdup(&s, "offline");
+        if (r >= 0) {
+                *state = TAKE_PTR(s);
+                return 0;
+        }
+        if (r != -ENOMEDIUM)
+                return r;
+#endif // 1
+
         r = parse_env_file(NULL, p, "STATE", &s);
         if (r == -ENOENT)
                 r = free_and_strdup(&s, "offline");
@@ -612,7 +627,11 @@ _public_ int sd_uid_is_on_seat(uid_t uid, int require_active, const char *seat)
         return string_contains_word(content, NULL, FORMAT_UID(uid));
 }
 
+#if 0 /// elogind: the memory mapped database needs to know what was asked for
 static int uid_get_array(uid_t uid, const char *variable, char ***array) {
+#else // 0
+static int uid_get_array(uid_t uid, int require_active, bool seats, const char *variable, char ***array) {
+#endif // 0
         _cleanup_free_ char *p = NULL, *s = NULL;
         char **a;
         int r;
@@ -623,6 +642,17 @@ static int uid_get_array(uid_t uid, const char *variable, char ***array) {
         if (r < 0)
                 return r;
 
+#if 1 /// elogind: try the memory mapped database first, it is cheaper than parsing the state file
+        r = login_db_uid_get_array(uid, require_active, seats, array);
+        if (r == -ENXIO) {
+                if (array)
+                        *array = NULL;
+                return 0;
+        }
+        if (r != -ENOMEDIUM)
+                return r;
+#endif // 1
+
         r = parse_env_file(NULL, p, variable, &s);
         if (r == -ENOENT || (r >= 0 && isempty(s))) {
                 if (array)
@@ -650,6 +680,10 @@ static int uid_get_array(uid_t uid, const char *variable, char ***array) {
 _public_ int sd_uid_get_sessions(uid_t uid, int require_active, char ***sessions) {
         return uid_get_array(
                         uid,
+#if 1 /// elogind: the memory mapped database needs to know what was asked for
+                        require_active,
+                        /* seats= */ false,
+#endif // 1
                         require_active == 0 ? "ONLINE_SESSIONS" :
                         require_active > 0  ? "ACTIVE_SESSIONS" :
                                               "SESSIONS",
@@ -659,6 +693,10 @@ _public_ int sd_uid_get_sessions(uid_t uid, int require_active, char ***sessions
 _public_ int sd_uid_get_seats(uid_t uid, int require_active, char ***seats) {
         return uid_get_array(
                         uid,
+#if 1 /// elogind: the memory mapped database needs to know what was asked for
+                        require_active,
+                        /* seats= */ true,
+#endif // 1
                         require_active == 0 ? "ONLINE_SEATS" :
                         require_active > 0  ? "ACTIVE_SEATS" :
                                               "SEATS",
@@ -916,6 +954,286 @@ _public_ int sd_session_get_leader(const char *session, pid_t *leader) {
         return 0;
 }
 
+#if 1 /// elogind: read all fields of a session file with a single parse
+struct sd_session_snapshot {
+        unsigned n_ref;
+
+        char *id;
+
+        /* The raw values as found in the session file. They are validated and converted by the getters
+         * below, so that those return the very same results as the sd_session_get_*() calls. */
+        char *active;
+        char *remote;
+        char *state;
+        char *uid;
+        char *username;
+        char *seat;
+        char *realtime;
+        char *tty;
+        char *vtnr;
+        char *service;
+        char *type;
+        char *class;
+        char *desktop;
+        char *display;
+        char *remote_user;
+        char *remote_host;
+        char *leader;
+
+        /* Unescaped DESKTOP=, filled in on first use */
+        char *desktop_unescaped;
+};
+
+static sd_session_snapshot* session_snapshot_free(sd_session_snapshot *s) {
+        if (!s)
+                return NULL;
+
+        free(s->id);
+        free(s->active);
+        free(s->remote);
+        free(s->state);
+        free(s->uid);
+        free(s->username);
+        free(s->seat);
+        free(s->realtime);
+        free(s->tty);
+        free(s->vtnr);
+        free(s->service);
+        free(s->type);
+        free(s->class);
+        free(s->desktop);
+        free(s->display);
+        free(s->remote_user);
+        free(s->remote_host);
+        free(s->leader);
+        free(s->desktop_unescaped);
+
+        return mfree(s);
+}
+
+DEFINE_PUBLIC_TRIVIAL_REF_UNREF_FUNC(sd_session_snapshot, sd_session_snapshot, session_snapshot_free);
+
+static int session_snapshot_load(const char *id, sd_session_snapshot **ret) {
+        _cleanup_(sd_session_snapshot_unrefp) sd_session_snapshot *s = NULL;
+        _cleanup_free_ char *p = NULL;
+        int r;
+
+        assert(id);
+        assert(ret);
+
+        p = path_join("/run/systemd/sessions", id);
+        if (!p)
+                return -ENOMEM;
+
+        s = new0(sd_session_snapshot, 1);
+        if (!s)
+                return -ENOMEM;
+
+        s->n_ref = 1;
+
+        s->id = strdup(id);
+        if (!s->id)
+                return -ENOMEM;
+
+        r = parse_env_file(NULL, p,
+                           "ACTIVE",      &s->active,
+                           "REMOTE",      &s->remote,
+                           "STATE",       &s->state,
+                           "UID",         &s->uid,
+                           "USER",        &s->username,
+                           "SEAT",        &s->seat,
+                           "REALTIME",    &s->realtime,
+                           "TTY",         &s->tty,
+                           "VTNR",        &s->vtnr,
+                           "SERVICE",     &s->service,
+                           "TYPE",        &s->type,
+                           "CLASS",       &s->class,
+                           "DESKTOP",     &s->desktop,
+                           "DISPLAY",     &s->display,
+                           "REMOTE_USER", &s->remote_user,
+                           "REMOTE_HOST", &s->remote_host,
+                           "LEADER",      &s->leader);
+        if (r == -ENOENT)
+                return -ENXIO;
+        if (r < 0)
+                return r;
+
+        *ret = TAKE_PTR(s);
+        return 0;
+}
+
+_public_ int sd_session_snapshot_new(const char *session, sd_session_snapshot **ret) {
+        _cleanup_free_ char *buf = NULL;
+        int r;
+
+        assert_return(ret, -EINVAL);
+
+        if (session) {
+                if (!session_id_valid(session))
+                        return -EINVAL;
+        } else {
+                r = sd_pid_get_session(0, &buf);
+                if (r < 0)
+                        return r;
+
+                session = buf;
+        }
+
+        return session_snapshot_load(session, ret);
+}
+
+_public_ int sd_session_snapshot_get_id(sd_session_snapshot *s, const char **ret) {
+        assert_return(s, -EINVAL);
+        assert_return(ret, -EINVAL);
+
+        *ret = s->id;
+        return 0;
+}
+
+_public_ int sd_session_snapshot_is_active(sd_session_snapshot *s) {
+        assert_return(s, -EINVAL);
+
+        if (isempty(s->active))
+                return -EIO;
+
+        return parse_boolean(s->active);
+}
+
+_public_ int sd_session_snapshot_is_remote(sd_session_snapshot *s) {
+        assert_return(s, -EINVAL);
+
+        if (isempty(s->remote))
+                return -ENODATA;
+
+        return parse_boolean(s->remote);
+}
+
+_public_ int sd_session_snapshot_get_state(sd_session_snapshot *s, const char **ret) {
+        assert_return(s, -EINVAL);
+        assert_return(ret, -EINVAL);
+
+        if (isempty(s->state))
+                return -EIO;
+
+        *ret = s->state;
+        return 0;
+}
+
+_public_ int sd_session_snapshot_get_uid(sd_session_snapshot *s, uid_t *ret) {
+        assert_return(s, -EINVAL);
+        assert_return(ret, -EINVAL);
+
+        if (isempty(s->uid))
+                return -EIO;
+
+        return parse_uid(s->uid, ret);
+}
+
+static int session_snapshot_get_string(const char *field, const char **ret) {
+        assert_return(ret, -EINVAL);
+
+        if (isempty(field))
+                return -ENODATA;
+
+        *ret = field;
+        return 0;
+}
+
+_public_ int sd_session_snapshot_get_username(sd_session_snapshot *s, const char **ret) {
+        assert_return(s, -EINVAL);
+        return session_snapshot_get_string(s->username, ret);
+}
+
+_public_ int sd_session_snapshot_get_seat(sd_session_snapshot *s, const char **ret) {
+        assert_return(s, -EINVAL);
+        return session_snapshot_get_string(s->seat, ret);
+}
+
+_public_ int sd_session_snapshot_get_start_time(sd_session_snapshot *s, uint64_t *ret) {
+        assert_return(s, -EINVAL);
+        assert_return(ret, -EINVAL);
+
+        if (isempty(s->realtime))
+                return -EIO;
+
+        return safe_atou64(s->realtime, ret);
+}
+
+_public_ int sd_session_snapshot_get_tty(sd_session_snapshot *s, const char **ret) {
+        assert_return(s, -EINVAL);
+        return session_snapshot_get_string(s->tty, ret);
+}
+
+_public_ int sd_session_snapshot_get_vt(sd_session_snapshot *s, unsigned *ret) {
+        assert_return(s, -EINVAL);
+        assert_return(ret, -EINVAL);
+
+        if (isempty(s->vtnr))
+                return -ENODATA;
+
+        return safe_atou(s->vtnr, ret);
+}
+
+_public_ int sd_session_snapshot_get_service(sd_session_snapshot *s, const char **ret) {
+        assert_return(s, -EINVAL);
+        return session_snapshot_get_string(s->service, ret);
+}
+
+_public_ int sd_session_snapshot_get_type(sd_session_snapshot *s, const char **ret) {
+        assert_return(s, -EINVAL);
+        return session_snapshot_get_string(s->type, ret);
+}
+
+_public_ int sd_session_snapshot_get_class(sd_session_snapshot *s, const char **ret) {
+        assert_return(s, -EINVAL);
+        return session_snapshot_get_string(s->class, ret);
+}
+
+_public_ int sd_session_snapshot_get_desktop(sd_session_snapshot *s, const char **ret) {
+        ssize_t l;
+
+        assert_return(s, -EINVAL);
+        assert_return(ret, -EINVAL);
+
+        if (isempty(s->desktop))
+                return -ENODATA;
+
+        if (!s->desktop_unescaped) {
+                l = cunescape(s->desktop, 0, &s->desktop_unescaped);
+                if (l < 0)
+                        return l;
+        }
+
+        *ret = s->desktop_unescaped;
+        return 0;
+}
+
+_public_ int sd_session_snapshot_get_display(sd_session_snapshot *s, const char **ret) {
+        assert_return(s, -EINVAL);
+        return session_snapshot_get_string(s->display, ret);
+}
+
+_public_ int sd_session_snapshot_get_remote_user(sd_session_snapshot *s, const char **ret) {
+        assert_return(s, -EINVAL);
+        return session_snapshot_get_string(s->remote_user, ret);
+}
+
+_public_ int sd_session_snapshot_get_remote_host(sd_session_snapshot *s, const char **ret) {
+        assert_return(s, -EINVAL);
+        return session_snapshot_get_string(s->remote_host, ret);
+}
+
+_public_ int sd_session_snapshot_get_leader(sd_session_snapshot *s, pid_t *ret) {
+        assert_return(s, -EINVAL);
+        assert_return(ret, -EINVAL);
+
+        if (isempty(s->leader))
+                return -ENODATA;
+
+        return parse_pid(s->leader, ret);
+}
+#endif // 1
+
 _public_ int sd_seat_get_active(const char *seat, char **session, uid_t *uid) {
         _cleanup_free_ char *p = NULL, *s = NULL, *t = NULL;
         int r;
@@ -926,6 +1244,14 @@ _public_ int sd_seat_get_active(const char *seat, char **session, uid_t *uid) {
         if (r < 0)
                 return r;
 
+#if 1 /// elogind: try the memory mapped database first, it is cheaper than parsing the state file
+        if (seat) {
+                r = login_db_seat_get_active(seat, session, uid);
+                if (r != -ENOMEDIUM)
+                        return r;
+        }
+#endif // 1
+
         r = parse_env_file(NULL, p,
                            "ACTIVE", &s,
                            "ACTIVE_UID", &t);
@@ -1076,6 +1402,64 @@ _public_ int sd_get_sessions(char ***sessions) {
         return r;
 }
 
+#if 1 /// elogind: enumerate all sessions together with their data
+static sd_session_snapshot** session_snapshot_free_many(sd_session_snapshot **l) {
+        if (!l)
+                return NULL;
+
+        for (sd_session_snapshot **i = l; *i; i++)
+                sd_session_snapshot_unref(*i);
+
+        return mfree(l);
+}
+
+DEFINE_TRIVIAL_CLEANUP_FUNC(sd_session_snapshot**, session_snapshot_free_many);
+
+_public_ int sd_get_sessions_snapshot(sd_session_snapshot ***ret) {
+        _cleanup_(session_snapshot_free_manyp) sd_session_snapshot **l = NULL;
+        _cleanup_strv_free_ char **ids = NULL;
+        size_t n = 0;
+        int r;
+
+        r = get_files_in_directory("/run/systemd/sessions/", &ids);
+        if (r == -ENOENT) {
+                if (ret)
+                        *ret = NULL;
+                return 0;
+        }
+        if (r < 0)
+                return r;
+
+        STRV_FOREACH(id, ids) {
+                _cleanup_(sd_session_snapshot_unrefp) sd_session_snapshot *s = NULL;
+
+                if (!session_id_valid(*id))
+                        continue;
+
+                r = session_snapshot_load(*id, &s);
+                if (r == -ENXIO) /* Session went away while we were enumerating, skip it */
+                        continue;
+                if (r < 0)
+                        return r;
+
+                /* one extra slot is needed for the terminating NULL */
+                if (!GREEDY_REALLOC(l, n + 2))
+                        return -ENOMEM;
+
+                l[n++] = TAKE_PTR(s);
+                l[n] = NULL;
+        }
+
+        if (n > INT_MAX)
+                return -EOVERFLOW;
+
+        if (ret)
+                *ret = TAKE_PTR(l);
+
+        return (int) n;
+}
+#endif // 1
+
 _public_ int sd_get_uids(uid_t **users) {
         _cleanup_closedir_ DIR *d = NULL;
         _cleanup_free_ uid_t *l = NULL;
@@ -301,6 +301,65 @@ TEST(login) {
         }
 }
 
+#if 1 /// elogind: check that session snapshots agree with the per-field calls
+TEST(session_snapshot) {
+        _cleanup_(sd_session_snapshot_unrefp) sd_session_snapshot *own = NULL, *invalid = NULL;
+        sd_session_snapshot **snapshots = NULL;
+        int r, n;
+
+        r = sd_session_snapshot_new(NULL, &own);
+        log_info("sd_session_snapshot_new(NULL, …) → %s", e(r));
+
+        assert_se(sd_session_snapshot_new("../foo", &invalid) == -EINVAL);
+        assert_se(!invalid);
+
+        n = sd_get_sessions_snapshot(&snapshots);
+        assert_se(n >= 0);
+        log_info("sd_get_sessions_snapshot(…) → [%i]", n);
+
+        for (int i = 0; i < n; i++) {
+                _cleanup_free_ char *state = NULL, *class = NULL, *tty = NULL;
+                const char *id, *s;
+                uid_t u, u2;
+
+                assert_se(snapshots[i]);
+                assert_se(sd_session_snapshot_get_id(snapshots[i], &id) >= 0);
+
+                /* The session might have changed or gone away since the snapshot was taken, hence only
+                 * compare the data that cannot change during the lifetime of a session. */
+                if (sd_session_get_uid(id, &u) < 0)
+                        continue;
+
+                assert_se(sd_session_snapshot_get_uid(snapshots[i], &u2) >= 0);
+                assert_se(u == u2);
+
+                r = sd_session_get_class(id, &class);
+                if (r >= 0) {
+                        assert_se(sd_session_snapshot_get_class(snapshots[i], &s) >= 0);
+                        assert_se(streq(s, class));
+                }
+
+                r = sd_session_get_tty(id, &tty);
+                if (r >= 0) {
+                        assert_se(sd_session_snapshot_get_tty(snapshots[i], &s) >= 0);
+                        assert_se(streq(s, tty));
+                } else if (r == -ENODATA)
+                        assert_se(sd_session_snapshot_get_tty(snapshots[i], &s) == -ENODATA);
+
+                assert_se(sd_session_snapshot_get_state(snapshots[i], &s) >= 0);
+                log_info("snapshot \"%s\": uid="UID_FMT" state=%s class=%s tty=%s",
+                         id, u2, s, strna(class), strna(tty));
+        }
+        assert_se(!snapshots || !snapshots[n]);
+
+        for (int i = 0; i < n; i++)
+                sd_session_snapshot_unref(snapshots[i]);
+        free(snapshots);
+
+        assert_se(sd_get_sessions_snapshot(NULL) >= 0);
+}
+#endif // 1
+
 TEST(monitor) {
         sd_login_monitor *m = NULL;
         int r;
@@ -25,6 +25,7 @@
 #include "fd-util.h"
 #include "fileio.h"
 #include "fs-util.h"
+#include "logind-db.h"
 #include "logind-dbus.h"
 #include "mount-setup.h"
 #include "musl_missing.h"
@@ -466,6 +467,8 @@ void elogind_manager_free( Manager* m ) {
         if ( !m->do_interrupt )
                 manager_shutdown_cgroup( m, true );
 
+        manager_close_login_db( m );
+
         sd_event_source_unref( m->cgroups_agent_event_source );
 
         safe_close( m->cgroups_agent_fd );
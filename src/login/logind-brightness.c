@@ -159,6 +159,10 @@ static int brightness_writer_fork(BrightnessWriter *w) {
         if (r < 0)
                 return log_error_errno(r, "Failed to watch brightness writer child " PID_FMT ": %m", w->child);
 
+#if 1 /// elogind: name the source for the event loop statistics, see org.freedesktop.login1.Debug
+        (void) sd_event_source_set_description(w->child_event_source, "brightness-writer");
+#endif // 1
+
         return 0;
 }
 
@@ -371,6 +371,45 @@ int manager_process_button_device(Manager *m, sd_device *d) {
         return 0;
 }
 
+#if 1 /// elogind: sessions are indexed by the IDs of their cgroups
+static bool pidfd_cgroupid_unsupported = false;
+
+Session* manager_get_session_by_cgroupid(Manager *m, const PidRef *pid) {
+        _cleanup_(pidref_done) PidRef p = PIDREF_NULL;
+        uint64_t id;
+        int r;
+
+        assert(m);
+        assert(pidref_is_set(pid));
+
+        /* Determines the cgroup ID of the process with one ioctl() on its pidfd, and looks it up in the
+         * index of session cgroups. Returns NULL if this does not work, in which case the caller should
+         * look at /proc/$PID/cgroup instead. */
+
+        if (pidfd_cgroupid_unsupported || hashmap_isempty(m->sessions_by_cgroup_id))
+                return NULL;
+
+        if (pid->fd < 0) {
+                r = pidref_set_pid(&p, pid->pid);
+                if (r < 0 || p.fd < 0)
+                        return NULL;
+
+                pid = &p;
+        }
+
+        r = pidfd_get_cgroupid(pid->fd, &id);
+        if (r == -EOPNOTSUPP) {
+                log_debug_errno(r, "Kernel cannot tell the cgroup ID of a pidfd, looking sessions up via /proc/ only.");
+                pidfd_cgroupid_unsupported = true;
+                return NULL;
+        }
+        if (r < 0)
+                return NULL;
+
+        return hashmap_get(m->sessions_by_cgroup_id, &id);
+}
+#endif // 1
+
 int manager_get_session_by_pidref(Manager *m, const PidRef *pid, Session **ret) {
 #if 0 /// elogind does not support systemd units, but its own session system
         _cleanup_free_ char *unit = NULL;
@@ -396,14 +435,17 @@ int manager_get_session_by_pidref(Manager *m, const PidRef *pid, Session **ret)
                 if (r >= 0)
                         s = hashmap_get(m->session_units, unit);
 #else // 0
-                log_debug_elogind("Searching session for PID %d", pid->pid);
-                r = cg_pid_get_session(pid->pid, &session_name);
+                s = manager_get_session_by_cgroupid(m, pid);
+                if (!s) {
+                        log_debug_elogind("Searching session for PID %d", pid->pid);
+                        r = cg_pid_get_session(pid->pid, &session_name);
 
-                if (r >= 0)
-                        s = hashmap_get(m->sessions, session_name);
+                        if (r >= 0)
+                                s = hashmap_get(m->sessions, session_name);
 
-                log_debug_elogind("Session Name \"%s\" -> Session \"%s\"",
-                                  strnull(session_name), s && s->id ? s->id : "(null)");
+                        log_debug_elogind("Session Name \"%s\" -> Session \"%s\"",
+                                          strnull(session_name), s && s->id ? s->id : "(null)");
+                }
 #endif // 0
         }
 
@@ -434,6 +476,13 @@ int manager_get_user_by_pid(Manager *m, pid_t pid, User **ret) {
                 u = hashmap_get(m->user_units, unit);
 
 #else // 0
+        s = manager_get_session_by_cgroupid(m, &PIDREF_MAKE_FROM_PID(pid));
+        if (s && session_get_state(s) != SESSION_CLOSING) {
+                if (ret)
+                        *ret = s->user;
+                return 1;
+        }
+
         r = cg_pid_get_session(pid, &session);
         if (r >= 0)
                 u = hashmap_get(m->user_units, session);
@@ -909,3 +958,154 @@ int manager_read_efi_boot_loader_entries(Manager *m) {
         return 0;
 #endif
 }
+
+#if 1 /// elogind: state files are written lazily, see manager_flush_save_queue()
+void manager_flush_save_queue(Manager *m) {
+        uint64_t n_writes;
+        Inhibitor *inhibitor;
+        Session *session;
+        User *user;
+        Seat *seat;
+
+        assert(m);
+
+        /* A single login or logout usually saves the same session, user and seat several times. Hence
+         * the *_save() functions only queue the object, and the state files of all queued objects are
+         * written here, once per event loop iteration. Objects that were stopped in the meantime are
+         * skipped entirely. */
+
+        n_writes = m->n_save_writes;
+
+        while ((session = LIST_POP(save_queue, m->session_save_queue))) {
+                session->in_save_queue = false;
+
+                if (session->started && session->user) {
+                        (void) session_save_now(session);
+                        m->n_save_writes++;
+                }
+        }
+
+        while ((user = LIST_POP(save_queue, m->user_save_queue))) {
+                user->in_save_queue = false;
+
+                if (user->started) {
+                        (void) user_save_now(user);
+                        m->n_save_writes++;
+                }
+        }
+
+        while ((seat = LIST_POP(save_queue, m->seat_save_queue))) {
+                seat->in_save_queue = false;
+
+                if (seat->started) {
+                        (void) seat_save_now(seat);
+                        m->n_save_writes++;
+                }
+        }
+
+        while ((inhibitor = LIST_POP(save_queue, m->inhibitor_save_queue))) {
+                inhibitor->in_save_queue = false;
+
+                if (inhibitor->started) {
+                        (void) inhibitor_save_now(inhibitor);
+                        m->n_save_writes++;
+                }
+        }
+
+        if (m->n_save_writes != n_writes)
+                log_debug("Wrote %" PRIu64 " state files, %" PRIu64 " of %" PRIu64 " save requests coalesced so far.",
+                          m->n_save_writes - n_writes,
+                          m->n_save_requests - m->n_save_writes,
+                          m->n_save_requests);
+}
+
+static int manager_dispatch_save_queue(sd_event_source *s, void *userdata) {
+        Manager *m = ASSERT_PTR(userdata);
+
+        manager_flush_save_queue(m);
+        return 0;
+}
+
+void manager_enqueue_save_queue(Manager *m) {
+        int r;
+
+        assert(m);
+
+        if (m->save_queue_event_source)
+                r = sd_event_source_set_enabled(m->save_queue_event_source, SD_EVENT_ONESHOT);
+        else {
+                /* Defer event sources start out in SD_EVENT_ONESHOT mode */
+                r = sd_event_add_defer(m->event, &m->save_queue_event_source, manager_dispatch_save_queue, m);
+                if (r >= 0)
+                        (void) sd_event_source_set_description(m->save_queue_event_source, "logind-save-queue");
+        }
+        if (r >= 0)
+                return;
+
+        /* Better write too often than never */
+        log_warning_errno(r, "Failed to enqueue writing state files, writing them right away: %m");
+        manager_flush_save_queue(m);
+}
+#endif // 1
+
+#if 1 /// elogind: sessions can be killed in batches, see manager_kill_sessions()
+int manager_kill_sessions(Manager *m, Set *sessions, int signo) {
+        _cleanup_set_free_ Set *pids = NULL;
+        Session *s;
+        int r = 0, k;
+
+        assert(m);
+
+        /* Kills the processes of all the given sessions in one go. For SIGKILL cgroup.kill is used where the
+         * kernel supports it, which kills a whole cgroup subtree atomically without us enumerating it.
+         * Everything else walks the cgroups of all sessions, remembering all signalled processes in one
+         * set, so that nothing is signalled twice. */
+
+        SET_FOREACH(s, sessions) {
+                const char *path = s->cgroup_path ?: s->id;
+
+                if (signo == SIGKILL && cg_kill_supported()) {
+                        k = cg_kill_kernel_sigkill(path);
+                        if (k >= 0 || k == -ENOENT)
+                                continue;
+
+                        log_debug_errno(k, "Failed to kill cgroup of session %s via cgroup.kill, killing processes one by one: %m", s->id);
+                }
+
+                if (!pids) {
+                        pids = set_new(NULL);
+                        if (!pids)
+                                return -ENOMEM;
+                }
+
+                k = cg_kill_recursive(path, signo, CGROUP_IGNORE_SELF, pids, NULL, NULL);
+                if (k < 0)
+                        log_debug_errno(k, "Failed to kill processes of session %s: %m", s->id);
+                RET_GATHER(r, k);
+        }
+
+        return r;
+}
+
+void manager_begin_session_kill_batch(Manager *m) {
+        assert(m);
+        assert(!m->session_kill_batch);
+
+        /* If this fails, session_stop() just kills right away as usual */
+        m->session_kill_batch = set_new(NULL);
+}
+
+int manager_end_session_kill_batch(Manager *m, int signo) {
+        _cleanup_set_free_ Set *batch = NULL;
+
+        assert(m);
+
+        batch = TAKE_PTR(m->session_kill_batch);
+        if (set_isempty(batch))
+                return 0;
+
+        log_debug("Killing processes of %u stopped session(s).", set_size(batch));
+
+        return manager_kill_sessions(m, batch, signo);
+}
+#endif // 1
@@ -0,0 +1,409 @@
+/* SPDX-License-Identifier: LGPL-2.1-or-later */
+
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#include "alloc-util.h"
+#include "fd-util.h"
+#include "fs-util.h"
+#include "login-db.h"
+#include "logind-db.h"
+#include "logind-seat.h"
+#include "logind-session.h"
+#include "logind-user.h"
+#include "memory-util.h"
+#include "mkdir-label.h"
+#include "sort-util.h"
+#include "string-util.h"
+#include "tmpfile-util.h"
+
+/* Minimal size of the database file. The file is replaced by one of twice the needed size whenever the
+ * current one turns out to be too small, so that this should happen rarely. */
+#define LOGIN_DB_SIZE_MIN (64U * 1024U)
+
+void login_db_image_done(LoginDbImage *image) {
+        assert(image);
+
+        image->data = mfree(image->data);
+        image->size = 0;
+}
+
+int login_db_image_reserve(LoginDbImage *image, size_t size, uint64_t *ret_offset) {
+        size_t offset;
+
+        assert(image);
+
+        /* Keeps all tables 8 byte aligned. Strings are aligned too, which wastes a few bytes but keeps
+         * things simple. */
+        offset = ALIGN8(image->size);
+        if (size > SIZE_MAX - offset)
+                return -ENOMEM;
+
+        if (!GREEDY_REALLOC(image->data, offset + size))
+                return -ENOMEM;
+
+        memzero(image->data + image->size, offset + size - image->size);
+        image->size = offset + size;
+
+        if (ret_offset)
+                *ret_offset = offset;
+        return 0;
+}
+
+int login_db_image_add_string(LoginDbImage *image, const char *s, uint64_t *ret_offset) {
+        uint64_t offset;
+        size_t l;
+        int r;
+
+        assert(image);
+        assert(ret_offset);
+
+        if (!s) {
+                *ret_offset = 0;
+                return 0;
+        }
+
+        l = strlen(s) + 1;
+        r = login_db_image_reserve(image, l, &offset);
+        if (r < 0)
+                return r;
+
+        memcpy(image->data + offset, s, l);
+        *ret_offset = offset;
+        return 0;
+}
+
+static int user_compare_by_uid(User * const *a, User * const *b) {
+        return CMP((*a)->user_record->uid, (*b)->user_record->uid);
+}
+
+static int login_db_image_build(Manager *m, LoginDbImage *ret) {
+        _cleanup_(login_db_image_done) LoginDbImage image = {};
+        _cleanup_free_ LoginDbSession *sessions = NULL;
+        _cleanup_free_ LoginDbUser *users = NULL;
+        _cleanup_free_ LoginDbSeat *seats = NULL;
+        _cleanup_free_ User **sorted = NULL;
+        size_t n_sorted = 0, n_sessions = 0, n_seats = 0;
+        LoginDbHeader h;
+        User *u;
+        Seat *seat;
+        int r;
+
+        assert(m);
+        assert(ret);
+
+        /* Only started objects are included, as only those have state files. */
+        sorted = new(User*, hashmap_size(m->users));
+        if (!sorted)
+                return -ENOMEM;
+
+        HASHMAP_FOREACH(u, m->users) {
+                if (!u->started)
+                        continue;
+
+                sorted[n_sorted++] = u;
+                LIST_FOREACH(sessions_by_user, s, u->sessions)
+                        n_sessions++;
+        }
+
+        typesafe_qsort(sorted, n_sorted, user_compare_by_uid);
+
+        users = new0(LoginDbUser, n_sorted);
+        sessions = new0(LoginDbSession, n_sessions);
+        seats = new0(LoginDbSeat, hashmap_size(m->seats));
+        if (!users || !sessions || !seats)
+                return -ENOMEM;
+
+        h = (LoginDbHeader) {
+                .version = LOGIN_DB_VERSION,
+                .n_sessions = n_sessions,
+                .n_users = n_sorted,
+        };
+        memcpy(h.signature, LOGIN_DB_SIGNATURE, sizeof(h.signature));
+
+        r = login_db_image_reserve(&image, sizeof(LoginDbHeader), NULL);
+        if (r < 0)
+                return r;
+        r = login_db_image_reserve(&image, n_sessions * sizeof(LoginDbSession), &h.sessions_offset);
+        if (r < 0)
+                return r;
+        r = login_db_image_reserve(&image, n_sorted * sizeof(LoginDbUser), &h.users_offset);
+        if (r < 0)
+                return r;
+
+        n_sessions = 0;
+        for (size_t i = 0; i < n_sorted; i++) {
+                LoginDbUser *du = users + i;
+
+                u = sorted[i];
+
+                *du = (LoginDbUser) {
+                        .uid = u->user_record->uid,
+                        .first_session = n_sessions,
+                };
+
+                r = login_db_image_add_string(&image, user_state_to_string(user_get_state(u)), &du->state);
+                if (r < 0)
+                        return r;
+
+                LIST_FOREACH(sessions_by_user, s, u->sessions) {
+                        LoginDbSession *ds = sessions + n_sessions++;
+
+                        *ds = (LoginDbSession) {
+                                .uid = u->user_record->uid,
+                                .flags = (session_is_active(s) ? LOGIN_DB_SESSION_ACTIVE : 0) |
+                                         (session_get_state(s) != SESSION_CLOSING ? LOGIN_DB_SESSION_ONLINE : 0),
+                        };
+
+                        r = login_db_image_add_string(&image, s->id, &ds->id);
+                        if (r < 0)
+                                return r;
+
+                        r = login_db_image_add_string(&image, s->seat ? s->seat->id : NULL, &ds->seat);
+                        if (r < 0)
+                                return r;
+
+                        du->n_sessions++;
+                }
+        }
+
+        HASHMAP_FOREACH(seat, m->seats) {
+                LoginDbSeat *ds;
+
+                if (!seat->started)
+                        continue;
+
+                ds = seats + n_seats++;
+                *ds = (LoginDbSeat) {
+                        .active_uid = seat->active ? seat->active->user->user_record->uid : UID_INVALID,
+                        .flags = (seat_can_tty(seat) ? LOGIN_DB_SEAT_CAN_TTY : 0) |
+                                 (seat_can_graphical(seat) ? LOGIN_DB_SEAT_CAN_GRAPHICAL : 0),
+                };
+
+                r = login_db_image_add_string(&image, seat->id, &ds->id);
+                if (r < 0)
+                        return r;
+
+                r = login_db_image_add_string(&image, seat->active ? seat->active->id : NULL, &ds->active_session);
+                if (r < 0)
+                        return r;
+        }
+
+        h.n_seats = n_seats;
+        r = login_db_image_reserve(&image, n_seats * sizeof(LoginDbSeat), &h.seats_offset);
+        if (r < 0)
+                return r;
+
+        h.size = image.size;
+
+        memcpy(image.data, &h, sizeof(h));
+        memcpy_safe(image.data + h.sessions_offset, sessions, n_sessions * sizeof(LoginDbSession));
+        memcpy_safe(image.data + h.users_offset, users, n_sorted * sizeof(LoginDbUser));
+        memcpy_safe(image.data + h.seats_offset, seats, n_seats * sizeof(LoginDbSeat));
+
+        *ret = TAKE_STRUCT(image);
+        return 0;
+}
+
+static void login_db_mark_obsolete(uint8_t *data) {
+        LoginDbHeader *h = (LoginDbHeader*) ASSERT_PTR(data);
+
+        /* Readers that are currently looking at the file see the generation change and retry, and then
+         * notice that they need to map the new file. */
+        __atomic_fetch_add(&h->generation, 1, __ATOMIC_RELAXED);
+        __atomic_thread_fence(__ATOMIC_RELEASE);
+        __atomic_fetch_or(&h->flags, LOGIN_DB_OBSOLETE, __ATOMIC_RELEASE);
+        __atomic_fetch_add(&h->generation, 1, __ATOMIC_RELEASE);
+}
+
+static int login_db_open_stale(void) {
+        _cleanup_close_ int fd = -EBADF;
+        struct stat st;
+
+        /* Returns the database file left behind by a previous instance, so that it can be marked obsolete
+         * once the new one is in place. Clients that mapped the old file would otherwise never notice. */
+
+        fd = open(login_db_path(), O_RDWR|O_CLOEXEC|O_NOCTTY|O_NOFOLLOW);
+        if (fd < 0)
+                return -errno;
+
+        if (fstat(fd, &st) < 0)
+                return -errno;
+
+        if (!S_ISREG(st.st_mode) || st.st_size < (off_t) sizeof(LoginDbHeader))
+                return -EBADMSG;
+
+        return TAKE_FD(fd);
+}
+
+static void login_db_obsolete_stale(int fd) {
+        void *p;
+
+        assert(fd >= 0);
+
+        p = mmap(NULL, sizeof(LoginDbHeader), PROT_READ|PROT_WRITE, MAP_SHARED, fd, 0);
+        if (p == MAP_FAILED) {
+                log_debug_errno(errno, "Failed to map stale %s, ignoring: %m", login_db_path());
+                return;
+        }
+
+        if (memcmp(p, LOGIN_DB_SIGNATURE, sizeof_field(LoginDbHeader, signature)) == 0)
+                login_db_mark_obsolete(p);
+
+        (void) munmap(p, sizeof(LoginDbHeader));
+}
+
+static int login_db_replace(uint8_t **file, size_t *file_size, const LoginDbImage *image) {
+        _cleanup_(unlink_and_freep) char *t = NULL;
+        _cleanup_close_ int fd = -EBADF, stale_fd = -EBADF;
+        const char *path;
+        size_t size;
+        void *p;
+        int r;
+
+        assert(file);
+        assert(file_size);
+        assert(image);
+
+        path = login_db_path();
+        size = PAGE_ALIGN(MAX(image->size * 2, (size_t) LOGIN_DB_SIZE_MIN));
+
+        if (streq(path, LOGIN_DB_PATH)) {
+                r = mkdir_safe_label("/run/systemd", 0755, 0, 0, MKDIR_WARN_MODE);
+                if (r < 0)
+                        return r;
+        }
+
+        r = tempfn_random(path, NULL, &t);
+        if (r < 0)
+                return r;
+
+        fd = open(t, O_RDWR|O_CREAT|O_EXCL|O_CLOEXEC|O_NOCTTY|O_NOFOLLOW, 0644);
+        if (fd < 0)
+                return -errno;
+
+        /* Allocate all blocks right away, so that we will never get SIGBUS when writing to the mapping. */
+        r = posix_fallocate(fd, 0, size);
+        if (r != 0)
+                return -r;
+
+        p = mmap(NULL, size, PROT_READ|PROT_WRITE, MAP_SHARED, fd, 0);
+        if (p == MAP_FAILED)
+                return -errno;
+
+        memcpy(p, image->data, image->size);
+
+        if (!*file)
+                stale_fd = login_db_open_stale();
+
+        r = RET_NERRNO(rename(t, path));
+
+        /* Even if the rename failed, the stale file must not be used anymore. */
+        if (stale_fd >= 0)
+                login_db_obsolete_stale(stale_fd);
+
+        if (r < 0) {
+                (void) munmap(p, size);
+                return r;
+        }
+
+        t = mfree(t);
+
+        if (*file) {
+                login_db_mark_obsolete(*file);
+                (void) munmap(*file, *file_size);
+        }
+
+        *file = p;
+        *file_size = size;
+
+        return 0;
+}
+
+static void login_db_update(uint8_t *file, size_t file_size, const LoginDbImage *image) {
+        LoginDbHeader *h;
+        uint64_t g;
+
+        assert(file);
+        assert(image);
+        assert(image->size <= file_size);
+
+        h = (LoginDbHeader*) file;
+        g = h->generation;
+
+        /* Sequence lock: readers retry while the generation is odd, or if it changed while they looked at
+         * the data. The header fields before the generation never change while the file is in use. */
+        __atomic_store_n(&h->generation, g + 1, __ATOMIC_RELAXED);
+        __atomic_thread_fence(__ATOMIC_RELEASE);
+
+        memcpy(file + offsetof(LoginDbHeader, size),
+               image->data + offsetof(LoginDbHeader, size),
+               image->size - offsetof(LoginDbHeader, size));
+
+        __atomic_store_n(&h->generation, g + 2, __ATOMIC_RELEASE);
+}
+
+int login_db_write(uint8_t **file, size_t *file_size, const LoginDbImage *image) {
+        assert(file);
+        assert(file_size);
+        assert(image);
+
+        if (*file && image->size <= *file_size) {
+                login_db_update(*file, *file_size, image);
+                return 0;
+        }
+
+        return login_db_replace(file, file_size, image);
+}
+
+void login_db_close(uint8_t **file, size_t *file_size) {
+        assert(file);
+        assert(file_size);
+
+        if (!*file)
+                return;
+
+        login_db_mark_obsolete(*file);
+        (void) unlink(login_db_path());
+        (void) munmap(*file, *file_size);
+
+        *file = NULL;
+        *file_size = 0;
+}
+
+int manager_flush_login_db(Manager *m) {
+        _cleanup_(login_db_image_done) LoginDbImage image = {};
+        int r;
+
+        assert(m);
+
+        if (!m->login_db_dirty)
+                return 0;
+
+        /* Whatever happens, don't try again before the next change. Clients fall back to the state files if
+         * the database is not available. */
+        m->login_db_dirty = false;
+
+        r = login_db_image_build(m, &image);
+        if (r < 0)
+                return log_warning_errno(r, "Failed to serialize login state database: %m");
+
+        r = login_db_write(&m->login_db, &m->login_db_size, &image);
+        if (r < 0) {
+                log_warning_errno(r, "Failed to write %s, ignoring: %m", login_db_path());
+
+                /* Make sure nobody keeps reading outdated data */
+                manager_close_login_db(m);
+                return r;
+        }
+
+        return 0;
+}
+
+void manager_close_login_db(Manager *m) {
+        assert(m);
+
+        login_db_close(&m->login_db, &m->login_db_size);
+}
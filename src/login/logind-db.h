@@ -0,0 +1,29 @@
+/* SPDX-License-Identifier: LGPL-2.1-or-later */
+#pragma once
+
+#include "logind.h"
+
+/* Maintains the memory mapped login state database at LOGIN_DB_PATH, see login-db.h for the format. */
+
+/* The serialized database, built in memory before it is copied into the file */
+typedef struct LoginDbImage {
+        uint8_t *data;
+        size_t size;
+} LoginDbImage;
+
+void login_db_image_done(LoginDbImage *image);
+int login_db_image_reserve(LoginDbImage *image, size_t size, uint64_t *ret_offset);
+int login_db_image_add_string(LoginDbImage *image, const char *s, uint64_t *ret_offset);
+
+/* Copies the image into the mapped file, and replaces the file by a larger one if needed. */
+int login_db_write(uint8_t **file, size_t *file_size, const LoginDbImage *image);
+void login_db_close(uint8_t **file, size_t *file_size);
+
+static inline void manager_login_db_mark_dirty(Manager *m) {
+        assert(m);
+
+        m->login_db_dirty = true;
+}
+
+int manager_flush_login_db(Manager *m);
+void manager_close_login_db(Manager *m);
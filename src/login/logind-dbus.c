@@ -61,9 +61,11 @@
 /// Additional includes needed by elogind
 #include <stdio.h>
 #include "exec-elogind.h"
+#include "logind-linger.h"
 #include "os-util.h"
 #include "sd-login.h"
 #include "sleep.h"
+#include "sort-util.h"
 #include "update-utmp.h"
 #include "wall.h"
 
@@ -763,6 +765,292 @@ static int method_list_users(sd_bus_message *message, void *userdata, sd_bus_err
         return sd_bus_send(NULL, reply, NULL);
 }
 
+#if 1 /// elogind: paginated and filtered variants of ListSessionsEx() and ListUsers()
+typedef struct ListFilter {
+        uid_t uid;
+        const char *seat;
+        SessionClass class;
+        int state;
+        int remote;
+} ListFilter;
+
+static int list_filter_parse(sd_bus_message *message, bool sessions, ListFilter *ret, sd_bus_error *error) {
+        ListFilter f = {
+                .uid = UID_INVALID,
+                .class = _SESSION_CLASS_INVALID,
+                .state = -1,
+                .remote = -1,
+        };
+        int r;
+
+        assert(message);
+        assert(ret);
+
+        r = sd_bus_message_enter_container(message, 'a', "{sv}");
+        if (r < 0)
+                return r;
+
+        for (;;) {
+                const char *key;
+
+                r = sd_bus_message_enter_container(message, 'e', "sv");
+                if (r < 0)
+                        return r;
+                if (r == 0)
+                        break;
+
+                r = sd_bus_message_read(message, "s", &key);
+                if (r < 0)
+                        return r;
+
+                if (streq(key, "UID")) {
+                        uint32_t uid;
+
+                        r = sd_bus_message_read(message, "v", "u", &uid);
+                        if (r < 0)
+                                return r;
+                        if (!uid_is_valid(uid))
+                                return sd_bus_error_setf(error, SD_BUS_ERROR_INVALID_ARGS, "Invalid UID filter " UID_FMT, uid);
+
+                        f.uid = uid;
+
+                } else if (streq(key, "State")) {
+                        const char *state;
+
+                        r = sd_bus_message_read(message, "v", "s", &state);
+                        if (r < 0)
+                                return r;
+
+                        f.state = sessions ? (int) session_state_from_string(state) : (int) user_state_from_string(state);
+                        if (f.state < 0)
+                                return sd_bus_error_setf(error, SD_BUS_ERROR_INVALID_ARGS, "Invalid state filter '%s'", state);
+
+                } else if (sessions && streq(key, "Seat")) {
+                        r = sd_bus_message_read(message, "v", "s", &f.seat);
+                        if (r < 0)
+                                return r;
+
+                } else if (sessions && streq(key, "Class")) {
+                        const char *class;
+
+                        r = sd_bus_message_read(message, "v", "s", &class);
+                        if (r < 0)
+                                return r;
+
+                        f.class = session_class_from_string(class);
+                        if (f.class < 0)
+                                return sd_bus_error_setf(error, SD_BUS_ERROR_INVALID_ARGS, "Invalid class filter '%s'", class);
+
+                } else if (sessions && streq(key, "Remote")) {
+                        int b;
+
+                        r = sd_bus_message_read(message, "v", "b", &b);
+                        if (r < 0)
+                                return r;
+
+                        f.remote = b;
+
+                } else
+                        return sd_bus_error_setf(error, SD_BUS_ERROR_INVALID_ARGS, "Unknown filter '%s'", key);
+
+                r = sd_bus_message_exit_container(message);
+                if (r < 0)
+                        return r;
+        }
+
+        r = sd_bus_message_exit_container(message);
+        if (r < 0)
+                return r;
+
+        *ret = f;
+        return 0;
+}
+
+static bool session_matches_filter(Session *s, const ListFilter *f) {
+        assert(s);
+        assert(s->user);
+        assert(f);
+
+        if (uid_is_valid(f->uid) && s->user->user_record->uid != f->uid)
+                return false;
+
+        /* An empty seat name matches sessions not attached to any seat, as in ListSessionsEx() */
+        if (f->seat && !streq(s->seat ? s->seat->id : "", f->seat))
+                return false;
+
+        if (f->class >= 0 && s->class != f->class)
+                return false;
+
+        if (f->state >= 0 && (int) session_get_state(s) != f->state)
+                return false;
+
+        if (f->remote >= 0 && s->remote != f->remote)
+                return false;
+
+        return true;
+}
+
+static int session_compare_by_id(Session * const *a, Session * const *b) {
+        return strverscmp_improved((*a)->id, (*b)->id);
+}
+
+static int user_compare_by_uid(User * const *a, User * const *b) {
+        return CMP((*a)->user_record->uid, (*b)->user_record->uid);
+}
+
+static int method_list_sessions_filtered(sd_bus_message *message, void *userdata, sd_bus_error *error) {
+        _cleanup_(sd_bus_message_unrefp) sd_bus_message *reply = NULL;
+        _cleanup_free_ Session **sessions = NULL;
+        Manager *m = ASSERT_PTR(userdata);
+        uint64_t offset, limit;
+        size_t n = 0;
+        ListFilter filter;
+        Session *s;
+        int r;
+
+        assert(message);
+
+        r = list_filter_parse(message, /* sessions= */ true, &filter, error);
+        if (r < 0)
+                return r;
+
+        r = sd_bus_message_read(message, "tt", &offset, &limit);
+        if (r < 0)
+                return r;
+
+        sessions = new(Session*, hashmap_size(m->sessions));
+        if (!sessions)
+                return -ENOMEM;
+
+        HASHMAP_FOREACH(s, m->sessions)
+                if (session_matches_filter(s, &filter))
+                        sessions[n++] = s;
+
+        /* Hashmap iteration order is not stable between calls, hence sort to make the cursor meaningful */
+        typesafe_qsort(sessions, n, session_compare_by_id);
+
+        r = sd_bus_message_new_method_return(message, &reply);
+        if (r < 0)
+                return r;
+
+        r = sd_bus_message_open_container(reply, 'a', "(sussussbto)");
+        if (r < 0)
+                return r;
+
+        for (size_t i = MIN(offset, (uint64_t) n); i < n && (limit == 0 || i - offset < limit); i++) {
+                _cleanup_free_ char *path = NULL;
+                dual_timestamp idle_ts;
+                bool idle;
+
+                s = sessions[i];
+
+                path = session_bus_path(s);
+                if (!path)
+                        return -ENOMEM;
+
+                r = session_get_idle_hint(s, &idle_ts);
+                if (r < 0)
+                        return r;
+                idle = r > 0;
+
+                r = sd_bus_message_append(reply, "(sussussbto)",
+                                          s->id,
+                                          (uint32_t) s->user->user_record->uid,
+                                          s->user->user_record->user_name,
+                                          s->seat ? s->seat->id : "",
+                                          (uint32_t) s->leader.pid,
+                                          session_class_to_string(s->class),
+                                          s->tty,
+                                          idle,
+                                          idle_ts.monotonic,
+                                          path);
+                if (r < 0)
+                        return r;
+        }
+
+        r = sd_bus_message_close_container(reply);
+        if (r < 0)
+                return r;
+
+        r = sd_bus_message_append(reply, "t", (uint64_t) n);
+        if (r < 0)
+                return r;
+
+        return sd_bus_send(NULL, reply, NULL);
+}
+
+static int method_list_users_filtered(sd_bus_message *message, void *userdata, sd_bus_error *error) {
+        _cleanup_(sd_bus_message_unrefp) sd_bus_message *reply = NULL;
+        _cleanup_free_ User **users = NULL;
+        Manager *m = ASSERT_PTR(userdata);
+        uint64_t offset, limit;
+        size_t n = 0;
+        ListFilter filter;
+        User *user;
+        int r;
+
+        assert(message);
+
+        r = list_filter_parse(message, /* sessions= */ false, &filter, error);
+        if (r < 0)
+                return r;
+
+        r = sd_bus_message_read(message, "tt", &offset, &limit);
+        if (r < 0)
+                return r;
+
+        users = new(User*, hashmap_size(m->users));
+        if (!users)
+                return -ENOMEM;
+
+        HASHMAP_FOREACH(user, m->users) {
+                if (uid_is_valid(filter.uid) && user->user_record->uid != filter.uid)
+                        continue;
+                if (filter.state >= 0 && (int) user_get_state(user) != filter.state)
+                        continue;
+
+                users[n++] = user;
+        }
+
+        typesafe_qsort(users, n, user_compare_by_uid);
+
+        r = sd_bus_message_new_method_return(message, &reply);
+        if (r < 0)
+                return r;
+
+        r = sd_bus_message_open_container(reply, 'a', "(uso)");
+        if (r < 0)
+                return r;
+
+        for (size_t i = MIN(offset, (uint64_t) n); i < n && (limit == 0 || i - offset < limit); i++) {
+                _cleanup_free_ char *p = NULL;
+
+                user = users[i];
+
+                p = user_bus_path(user);
+                if (!p)
+                        return -ENOMEM;
+
+                r = sd_bus_message_append(reply, "(uso)",
+                                          (uint32_t) user->user_record->uid,
+                                          user->user_record->user_name,
+                                          p);
+                if (r < 0)
+                        return r;
+        }
+
+        r = sd_bus_message_close_container(reply);
+        if (r < 0)
+                return r;
+
+        r = sd_bus_message_append(reply, "t", (uint64_t) n);
+        if (r < 0)
+                return r;
+
+        return sd_bus_send(NULL, reply, NULL);
+}
+#endif // 1
+
 static int method_list_seats(sd_bus_message *message, void *userdata, sd_bus_error *error) {
         _cleanup_(sd_bus_message_unrefp) sd_bus_message *reply = NULL;
         Manager *m = ASSERT_PTR(userdata);
@@ -1554,6 +1842,76 @@ static int method_terminate_session(sd_bus_message *message, void *userdata, sd_
         return bus_session_method_terminate(message, session, error);
 }
 
+#if 1 /// elogind: bulk variant of TerminateSession()
+static int method_terminate_sessions(sd_bus_message *message, void *userdata, sd_bus_error *error) {
+        _cleanup_strv_free_ char **names = NULL;
+        _cleanup_free_ Session **sessions = NULL;
+        Manager *m = ASSERT_PTR(userdata);
+        uid_t uid = UID_INVALID;
+        bool same_uid = true;
+        size_t n = 0;
+        int r;
+
+        assert(message);
+
+        r = sd_bus_message_read_strv(message, &names);
+        if (r < 0)
+                return r;
+
+        sessions = new(Session*, strv_length(names));
+        if (!sessions)
+                return -ENOMEM;
+
+        STRV_FOREACH(name, names) {
+                Session *session;
+
+                r = manager_get_session_from_creds(m, message, *name, error, &session);
+                if (r < 0)
+                        return r;
+
+                /* If all sessions belong to the same user, the user may terminate them without privileges,
+                 * just like with TerminateSession() */
+                if (n == 0)
+                        uid = session->user->user_record->uid;
+                else if (uid != session->user->user_record->uid)
+                        same_uid = false;
+
+                sessions[n++] = session;
+        }
+
+        if (n == 0)
+                return sd_bus_reply_method_return(message, NULL);
+
+        r = bus_verify_polkit_async_full(
+                        message,
+                        "org.freedesktop.login1.manage",
+                        /* details= */ NULL,
+                        same_uid ? uid : UID_INVALID,
+                        /* flags= */ 0,
+                        &m->polkit_registry,
+                        error);
+        if (r < 0)
+                return r;
+        if (r == 0)
+                return 1; /* Will call us back */
+
+        log_debug("Terminating %zu session(s).", n);
+
+        /* Stop all sessions first, and only then kill all their processes in one go */
+        manager_begin_session_kill_batch(m);
+
+        r = 0;
+        FOREACH_ARRAY(session, sessions, n)
+                RET_GATHER(r, session_stop(*session, /* force = */ true));
+
+        RET_GATHER(r, manager_end_session_kill_batch(m, SIGTERM));
+        if (r < 0)
+                return r;
+
+        return sd_bus_reply_method_return(message, NULL);
+}
+#endif // 1
+
 static int method_terminate_user(sd_bus_message *message, void *userdata, sd_bus_error *error) {
         Manager *m = ASSERT_PTR(userdata);
         uint32_t uid;
@@ -1661,6 +2019,9 @@ static int method_set_user_linger(sd_bus_message *message, void *userdata, sd_bu
                 r = touch(path);
                 if (r < 0)
                         return r;
+#if 1 /// elogind: linger files are tracked through inotify, see logind-linger.c
+                manager_linger_update(m, pw->pw_name, true);
+#endif // 1
 
                 if (manager_add_user_by_uid(m, uid, &u) >= 0) {
                         r = user_start(u);
@@ -1674,6 +2035,9 @@ static int method_set_user_linger(sd_bus_message *message, void *userdata, sd_bu
                 r = unlink(path);
                 if (r < 0 && errno != ENOENT)
                         return -errno;
+#if 1 /// elogind: linger files are tracked through inotify, see logind-linger.c
+                manager_linger_update(m, pw->pw_name, false);
+#endif // 1
 
                 u = hashmap_get(m->users, UID_TO_PTR(uid));
                 if (u) {
@@ -1999,6 +2363,12 @@ int send_prepare_for(Manager *m, const HandleActionData *a, bool _active) {
         assert(a);
         assert(IN_SET(a->inhibit_what, INHIBIT_SHUTDOWN, INHIBIT_SLEEP));
 
+#if 1 /// elogind: the signals must not be held back, as the system may be suspended right after this
+        bool coalesce = sd_bus_get_coalesce_writes(m->bus) > 0;
+        if (coalesce)
+                (void) sd_bus_set_coalesce_writes(m->bus, false);
+#endif // 1
+
         /* We need to send both old and new signal for backward compatibility. The newer one allows clients
          * to know which type of reboot is going to happen, as they might be doing different actions (e.g.:
          * on soft-reboot), and it is sent first, so that clients know that if they receive the old one
@@ -2028,6 +2398,11 @@ int send_prepare_for(Manager *m, const HandleActionData *a, bool _active) {
         if (r < 0)
                 log_debug_errno(r, "Failed to emit PrepareForShutdown(): %m");
 
+#if 1 /// elogind: the signals must not be held back, as the system may be suspended right after this
+        if (coalesce)
+                (void) sd_bus_set_coalesce_writes(m->bus, true);
+#endif // 1
+
         return RET_GATHER(k, r);
 }
 
@@ -4324,6 +4699,18 @@ static const sd_bus_vtable manager_vtable[] = {
                                 SD_BUS_RESULT("a(uso)", users),
                                 method_list_users,
                                 SD_BUS_VTABLE_UNPRIVILEGED),
+#if 1 /// elogind: paginated and filtered variants of ListSessionsEx() and ListUsers()
+        SD_BUS_METHOD_WITH_ARGS("ListSessionsFiltered",
+                                SD_BUS_ARGS("a{sv}", filter, "t", offset, "t", limit),
+                                SD_BUS_RESULT("a(sussussbto)", sessions, "t", n_total),
+                                method_list_sessions_filtered,
+                                SD_BUS_VTABLE_UNPRIVILEGED),
+        SD_BUS_METHOD_WITH_ARGS("ListUsersFiltered",
+                                SD_BUS_ARGS("a{sv}", filter, "t", offset, "t", limit),
+                                SD_BUS_RESULT("a(uso)", users, "t", n_total),
+                                method_list_users_filtered,
+                                SD_BUS_VTABLE_UNPRIVILEGED),
+#endif // 1
         SD_BUS_METHOD_WITH_ARGS("ListSeats",
                                 SD_BUS_NO_ARGS,
                                 SD_BUS_RESULT("a(so)", seats),
@@ -4435,6 +4822,13 @@ static const sd_bus_vtable manager_vtable[] = {
                                 SD_BUS_NO_RESULT,
                                 method_terminate_session,
                                 SD_BUS_VTABLE_UNPRIVILEGED),
+#if 1 /// elogind: bulk variant of TerminateSession()
+        SD_BUS_METHOD_WITH_ARGS("TerminateSessions",
+                                SD_BUS_ARGS("as", session_ids),
+                                SD_BUS_NO_RESULT,
+                                method_terminate_sessions,
+                                SD_BUS_VTABLE_UNPRIVILEGED),
+#endif // 1
         SD_BUS_METHOD_WITH_ARGS("TerminateUser",
                                 SD_BUS_ARGS("u", uid),
                                 SD_BUS_NO_RESULT,
@@ -4670,13 +5064,118 @@ static const sd_bus_vtable manager_vtable[] = {
         SD_BUS_VTABLE_END
 };
 
+#if 1 /// elogind: debug interface, exposes the statistics of the bus connection and the event loop, see sd_bus_get_stats() and sd_event_get_stats()
+static int method_get_bus_statistics(sd_bus_message *message, void *userdata, sd_bus_error *error) {
+        _cleanup_(sd_json_variant_unrefp) sd_json_variant *v = NULL;
+        _cleanup_free_ char *text = NULL;
+        int r;
+
+        assert(message);
+
+        r = sd_bus_get_stats(sd_bus_message_get_bus(message), &v);
+        if (r < 0)
+                return r;
+
+        r = sd_json_variant_format(v, 0, &text);
+        if (r < 0)
+                return r;
+
+        return sd_bus_reply_method_return(message, "s", text);
+}
+
+static int method_reset_bus_statistics(sd_bus_message *message, void *userdata, sd_bus_error *error) {
+        int r;
+
+        assert(message);
+
+        r = sd_bus_reset_stats(sd_bus_message_get_bus(message));
+        if (r < 0)
+                return r;
+
+        return sd_bus_reply_method_return(message, NULL);
+}
+
+static int method_get_event_statistics(sd_bus_message *message, void *userdata, sd_bus_error *error) {
+        _cleanup_(sd_json_variant_unrefp) sd_json_variant *v = NULL;
+        _cleanup_free_ char *text = NULL;
+        Manager *m = ASSERT_PTR(userdata);
+        int r;
+
+        assert(message);
+
+        r = sd_event_get_stats(m->event, &v);
+        if (r < 0)
+                return r;
+
+        r = sd_json_variant_format(v, 0, &text);
+        if (r < 0)
+                return r;
+
+        return sd_bus_reply_method_return(message, "s", text);
+}
+
+static int method_reset_event_statistics(sd_bus_message *message, void *userdata, sd_bus_error *error) {
+        Manager *m = ASSERT_PTR(userdata);
+        int r;
+
+        assert(message);
+
+        r = sd_event_reset_stats(m->event);
+        if (r < 0)
+                return r;
+
+        return sd_bus_reply_method_return(message, NULL);
+}
+
+/* None of these is flagged unprivileged, and the bus policy only lets root talk to this interface */
+static const sd_bus_vtable debug_vtable[] = {
+        SD_BUS_VTABLE_START(0),
+
+        SD_BUS_METHOD_WITH_ARGS("GetBusStatistics",
+                                SD_BUS_NO_ARGS,
+                                SD_BUS_RESULT("s", statistics),
+                                method_get_bus_statistics,
+                                0),
+        SD_BUS_METHOD_WITH_ARGS("ResetBusStatistics",
+                                SD_BUS_NO_ARGS,
+                                SD_BUS_NO_RESULT,
+                                method_reset_bus_statistics,
+                                0),
+        SD_BUS_METHOD_WITH_ARGS("GetEventStatistics",
+                                SD_BUS_NO_ARGS,
+                                SD_BUS_RESULT("s", statistics),
+                                method_get_event_statistics,
+                                0),
+        SD_BUS_METHOD_WITH_ARGS("ResetEventStatistics",
+                                SD_BUS_NO_ARGS,
+                                SD_BUS_NO_RESULT,
+                                method_reset_event_statistics,
+                                0),
+
+        SD_BUS_VTABLE_END
+};
+
+static const BusObjectImplementation debug_object = {
+        "/org/freedesktop/login1",
+        "org.freedesktop.login1.Debug",
+        .vtables = BUS_VTABLES(debug_vtable),
+};
+#endif // 1
+
 const BusObjectImplementation manager_object = {
         "/org/freedesktop/login1",
         "org.freedesktop.login1.Manager",
         .vtables = BUS_VTABLES(manager_vtable),
+#if 0 /// elogind also serves its debug interface on the manager object
         .children = BUS_IMPLEMENTATIONS(&seat_object,
                                         &session_object,
                                         &user_object),
+#else // 0
+        .children = BUS_IMPLEMENTATIONS(&seat_object,
+                                        &session_object,
+                                        &user_object,
+                                        &debug_object),
+#endif // 0
 };
 
 #if 0 /// UNNEEDED by elogind
@@ -79,6 +79,11 @@ Inhibitor* inhibitor_free(Inhibitor *i) {
 
         hashmap_remove(i->manager->inhibitors, i->id);
 
+#if 1 /// elogind: state files are written lazily, see manager_flush_save_queue()
+        if (i->in_save_queue)
+                LIST_REMOVE(save_queue, i->manager->inhibitor_save_queue, i);
+#endif // 1
+
         /* Note that we don't remove neither the state file nor the fifo path here, since we want both to
          * survive daemon restarts */
         free(i->fifo_path);
@@ -90,13 +95,22 @@ Inhibitor* inhibitor_free(Inhibitor *i) {
         return mfree(i);
 }
 
+#if 0 /// elogind: state files are written lazily, inhibitor_save() only queues the inhibitor
 static int inhibitor_save(Inhibitor *i) {
+#else // 0
+int inhibitor_save_now(Inhibitor *i) {
+#endif // 0
         _cleanup_(unlink_and_freep) char *temp_path = NULL;
         _cleanup_fclose_ FILE *f = NULL;
         int r;
 
         assert(i);
 
+#if 1 /// elogind: the inhibitor might have been stopped while it was queued
+        if (!i->started)
+                return 0;
+#endif // 1
+
         r = mkdir_safe_label("/run/systemd/inhibit", 0755, 0, 0, MKDIR_WARN_MODE);
         if (r < 0)
                 goto fail;
@@ -163,6 +177,22 @@ fail:
         return log_error_errno(r, "Failed to save inhibit data %s: %m", i->state_file);
 }
 
+#if 1 /// elogind: state files are written lazily, see manager_flush_save_queue()
+static void inhibitor_save(Inhibitor *i) {
+        assert(i);
+
+        i->manager->n_save_requests++;
+
+        if (i->in_save_queue)
+                return;
+
+        LIST_PREPEND(save_queue, i->manager->inhibitor_save_queue, i);
+        i->in_save_queue = true;
+
+        manager_enqueue_save_queue(i->manager);
+}
+#endif // 1
+
 static int bus_manager_send_inhibited_change(Inhibitor *i) {
         const char *property;
 
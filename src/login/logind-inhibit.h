@@ -50,6 +50,11 @@ struct Inhibitor {
 
         char *fifo_path;
         int fifo_fd;
+
+#if 1 /// elogind: state files are written lazily, see manager_flush_save_queue()
+        bool in_save_queue;
+        LIST_FIELDS(Inhibitor, save_queue);
+#endif // 1
 };
 
 int inhibitor_new(Manager *m, const char* id, Inhibitor **ret);
@@ -58,6 +63,9 @@ Inhibitor* inhibitor_free(Inhibitor *i);
 DEFINE_TRIVIAL_CLEANUP_FUNC(Inhibitor*, inhibitor_free);
 
 int inhibitor_load(Inhibitor *i);
+#if 1 /// elogind: state files are written lazily, see manager_flush_save_queue()
+int inhibitor_save_now(Inhibitor *i);
+#endif // 1
 
 int inhibitor_start(Inhibitor *i);
 void inhibitor_stop(Inhibitor *i);
@@ -0,0 +1,251 @@
+/* SPDX-License-Identifier: LGPL-2.1-or-later */
+
+#include <sys/inotify.h>
+#include <unistd.h>
+
+#include "alloc-util.h"
+#include "dirent-util.h"
+#include "escape.h"
+#include "fd-util.h"
+#include "logind-linger.h"
+#include "string-util.h"
+
+/* Whether a user lingers is checked whenever a user might be garbage collected, and /var/lib/ might be slow
+ * to access. Hence the directory is read once, kept in sync through inotify, and only the in-memory set
+ * is looked at afterwards. As long as nobody ever lingered, the directory does not exist, and its parent is
+ * watched for it to appear instead. Should neither be watchable, or the set not be readable, the linger files
+ * are checked directly again, see user_check_linger_file(). */
+
+#define LINGER_PARENT_DIR "/var/lib/elogind"
+#define LINGER_DIR LINGER_PARENT_DIR "/linger"
+
+static int linger_users_add(Manager *m, const char *escaped) {
+        _cleanup_free_ char *n = NULL;
+        ssize_t l;
+
+        assert(m);
+        assert(escaped);
+
+        l = cunescape(escaped, 0, &n);
+        if (l < 0)
+                return l;
+
+        return set_ensure_consume(&m->linger_users, &string_hash_ops_free, TAKE_PTR(n));
+}
+
+static int linger_users_remove(Manager *m, const char *escaped) {
+        _cleanup_free_ char *n = NULL;
+        ssize_t l;
+
+        assert(m);
+        assert(escaped);
+
+        l = cunescape(escaped, 0, &n);
+        if (l < 0)
+                return l;
+
+        free(set_remove(m->linger_users, n));
+        return 0;
+}
+
+static int linger_users_load(Manager *m) {
+        _cleanup_closedir_ DIR *d = NULL;
+        int r;
+
+        assert(m);
+
+        m->linger_users = set_free(m->linger_users);
+
+        d = opendir(LINGER_DIR);
+        if (!d) {
+                if (errno == ENOENT)
+                        return 0;
+
+                return log_error_errno(errno, "Failed to open " LINGER_DIR "/: %m");
+        }
+
+        FOREACH_DIRENT(de, d, return -errno) {
+                if (!dirent_is_file(de))
+                        continue;
+
+                r = linger_users_add(m, de->d_name);
+                if (r == -ENOMEM)
+                        return log_oom();
+                if (r < 0)
+                        log_warning_errno(r, "Failed to unescape username '%s', ignoring: %m", de->d_name);
+        }
+
+        return 0;
+}
+
+static void linger_watch_stop(Manager *m) {
+        assert(m);
+
+        m->linger_event_source = sd_event_source_disable_unref(m->linger_event_source);
+        m->linger_users = set_free(m->linger_users);
+}
+
+static int linger_watch_start(Manager *m);
+
+static int manager_dispatch_linger(sd_event_source *s, const struct inotify_event *event, void *userdata) {
+        Manager *m = ASSERT_PTR(userdata);
+        int r;
+
+        assert(event);
+
+        if (event->mask & IN_Q_OVERFLOW) {
+                log_debug("Lost track of " LINGER_DIR "/, rereading it.");
+
+                r = linger_users_load(m);
+                if (r < 0)
+                        linger_watch_stop(m);
+                return 0;
+        }
+
+        if (event->mask & (IN_DELETE_SELF|IN_MOVE_SELF|IN_IGNORED)) {
+                log_debug(LINGER_DIR "/ went away, waiting for it to reappear.");
+
+                linger_watch_stop(m);
+                (void) linger_watch_start(m);
+                return 0;
+        }
+
+        if (event->len == 0 || (event->mask & IN_ISDIR))
+                return 0;
+
+        if (event->mask & (IN_CREATE|IN_MOVED_TO))
+                r = linger_users_add(m, event->name);
+        else if (event->mask & (IN_DELETE|IN_MOVED_FROM))
+                r = linger_users_remove(m, event->name);
+        else
+                return 0;
+        if (r < 0)
+                log_warning_errno(r, "Failed to process linger file '%s', ignoring: %m", event->name);
+
+        return 0;
+}
+
+static int manager_dispatch_linger_parent(sd_event_source *s, const struct inotify_event *event, void *userdata) {
+        Manager *m = ASSERT_PTR(userdata);
+
+        assert(event);
+
+        if (event->mask & (IN_DELETE_SELF|IN_MOVE_SELF|IN_IGNORED)) {
+                log_debug(LINGER_PARENT_DIR "/ went away, checking linger files directly from now on.");
+
+                linger_watch_stop(m);
+                return 0;
+        }
+
+        /* After an overflow we don't know whether the directory appeared, hence just look */
+        if (!(event->mask & IN_Q_OVERFLOW) &&
+            (event->len == 0 || !(event->mask & IN_ISDIR) || !streq(event->name, "linger")))
+                return 0;
+
+        log_debug("Checking for " LINGER_DIR "/ to appear.");
+
+        linger_watch_stop(m);
+        (void) linger_watch_start(m);
+        return 0;
+}
+
+static int linger_watch_dir(Manager *m) {
+        int r;
+
+        assert(m);
+        assert(!m->linger_event_source);
+
+        /* Set up the watch first, and read the directory afterwards, so that nothing is missed */
+        r = sd_event_add_inotify(
+                        m->event,
+                        &m->linger_event_source,
+                        LINGER_DIR,
+                        IN_CREATE|IN_DELETE|IN_MOVED_FROM|IN_MOVED_TO|IN_DELETE_SELF|IN_MOVE_SELF|IN_ONLYDIR,
+                        manager_dispatch_linger, m);
+        if (r == -ENOENT)
+                return r;
+        if (r < 0)
+                log_warning_errno(r, "Failed to watch " LINGER_DIR "/, checking linger files directly: %m");
+        else
+                (void) sd_event_source_set_description(m->linger_event_source, "logind-linger");
+
+        /* The set is read even without a watch, as manager_enumerate_linger_users() goes through it */
+        r = linger_users_load(m);
+        if (r < 0) {
+                /* Never answer lookups from a partially read set */
+                linger_watch_stop(m);
+                return r;
+        }
+
+        return 0;
+}
+
+static int linger_watch_start(Manager *m) {
+        int r;
+
+        assert(m);
+        assert(!m->linger_event_source);
+
+        r = linger_watch_dir(m);
+        if (r != -ENOENT)
+                return r;
+
+        /* Nobody ever lingered. Rather than creating the directory on each start, wait for
+         * SetUserLinger() to do so. Until then the empty set is accurate. */
+        m->linger_users = set_free(m->linger_users);
+
+        r = sd_event_add_inotify(
+                        m->event,
+                        &m->linger_event_source,
+                        LINGER_PARENT_DIR,
+                        IN_CREATE|IN_MOVED_TO|IN_DELETE_SELF|IN_MOVE_SELF|IN_ONLYDIR,
+                        manager_dispatch_linger_parent, m);
+        if (r < 0) {
+                /* Checking for linger files that don't exist is cheap, hence this is not worth a warning */
+                log_debug_errno(r, "Failed to watch " LINGER_PARENT_DIR "/, checking linger files directly: %m");
+                return 0;
+        }
+
+        (void) sd_event_source_set_description(m->linger_event_source, "logind-linger-parent");
+
+        /* The directory might have been created before the watch was in place */
+        if (access(LINGER_DIR, F_OK) < 0)
+                return 0;
+
+        linger_watch_stop(m);
+
+        r = linger_watch_dir(m);
+        return r == -ENOENT ? 0 : r;
+}
+
+int manager_linger_watch(Manager *m) {
+        assert(m);
+
+        return linger_watch_start(m);
+}
+
+void manager_linger_update(Manager *m, const char *user_name, bool enable) {
+        int r;
+
+        assert(m);
+        assert(user_name);
+
+        /* Called after SetUserLinger() changed a linger file, so that the change is seen right away rather
+         * than only once the inotify event has been dispatched. */
+
+        if (!m->linger_event_source)
+                return;
+
+        if (!enable) {
+                free(set_remove(m->linger_users, user_name));
+                return;
+        }
+
+        r = set_put_strdup(&m->linger_users, user_name);
+        if (r < 0) {
+                /* Better be slow than wrong */
+                log_warning_errno(r, "Failed to remember lingering user %s, checking linger files directly from now on: %m", user_name);
+                m->linger_event_source = sd_event_source_disable_unref(m->linger_event_source);
+                m->linger_users = set_free(m->linger_users);
+        }
+}
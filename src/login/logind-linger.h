@@ -0,0 +1,21 @@
+/* SPDX-License-Identifier: LGPL-2.1-or-later */
+#pragma once
+
+#include "logind.h"
+#include "set.h"
+
+/* Keeps the set of users with a linger file in /var/lib/elogind/linger/ in memory, see logind-linger.c */
+
+int manager_linger_watch(Manager *m);
+void manager_linger_update(Manager *m, const char *user_name, bool enable);
+
+/* Returns -ENODATA if the directory could not be watched, and the linger file has to be checked directly */
+static inline int manager_linger_lookup(Manager *m, const char *user_name) {
+        assert(m);
+        assert(user_name);
+
+        if (!m->linger_event_source)
+                return -ENODATA;
+
+        return set_contains(m->linger_users, user_name);
+}
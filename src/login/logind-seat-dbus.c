@@ -143,9 +143,17 @@ int bus_seat_method_terminate(sd_bus_message *message, void *userdata, sd_bus_er
         if (r == 0)
                 return 1; /* Will call us back */
 
+#if 0 /// elogind kills the processes of all sessions in one batch, see manager_kill_sessions()
         r = seat_stop_sessions(s, /* force = */ true);
         if (r < 0)
                 return r;
+#else // 0
+        manager_begin_session_kill_batch(s->manager);
+        r = seat_stop_sessions(s, /* force = */ true);
+        RET_GATHER(r, manager_end_session_kill_batch(s->manager, SIGTERM));
+        if (r < 0)
+                return r;
+#endif // 0
 
         return sd_bus_reply_method_return(message, NULL);
 }
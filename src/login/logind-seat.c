@@ -25,6 +25,7 @@
 #include "terminal-util.h"
 #include "tmpfile-util.h"
 /// Additional includes needed by elogind
+#include "logind-db.h"
 #include "musl_missing.h"
 
 int seat_new(Manager *m, const char *id, Seat **ret) {
@@ -63,8 +64,19 @@ Seat* seat_free(Seat *s) {
                 return NULL;
 
         log_debug_elogind("Freeing Seat %s ...", s->id);
+#if 1 /// elogind: keep the login state database in sync
+        manager_login_db_mark_dirty(s->manager);
+#endif // 1
         if (s->in_gc_queue)
                 LIST_REMOVE(gc_queue, s->manager->seat_gc_queue, s);
+#if 1 /// elogind: objects are garbage collected incrementally, see manager_gc()
+        if (s->in_gc_queue)
+                s->manager->n_gc_queued--;
+#endif // 1
+#if 1 /// elogind: state files are written lazily, see manager_flush_save_queue()
+        if (s->in_save_queue)
+                LIST_REMOVE(save_queue, s->manager->seat_save_queue, s);
+#endif // 1
 
         while (s->sessions)
                 session_free(s->sessions);
@@ -83,7 +95,11 @@ Seat* seat_free(Seat *s) {
         return mfree(s);
 }
 
+#if 0 /// elogind: state files are written lazily, seat_save() only queues the seat
 int seat_save(Seat *s) {
+#else // 0
+int seat_save_now(Seat *s) {
+#endif // 0
         _cleanup_(unlink_and_freep) char *temp_path = NULL;
         _cleanup_fclose_ FILE *f = NULL;
         int r;
@@ -157,6 +173,34 @@ fail:
         return log_error_errno(r, "Failed to save seat data %s: %m", s->state_file);
 }
 
+#if 1 /// elogind: state files are written lazily, see manager_flush_save_queue()
+int seat_save(Seat *s) {
+        assert(s);
+
+        manager_login_db_mark_dirty(s->manager);
+
+        if (!s->started)
+                return 0;
+
+        seat_add_to_save_queue(s);
+        return 0;
+}
+
+void seat_add_to_save_queue(Seat *s) {
+        assert(s);
+
+        s->manager->n_save_requests++;
+
+        if (s->in_save_queue)
+                return;
+
+        LIST_PREPEND(save_queue, s->manager->seat_save_queue, s);
+        s->in_save_queue = true;
+
+        manager_enqueue_save_queue(s->manager);
+}
+#endif // 1
+
 int seat_load(Seat *s) {
         assert(s);
 
@@ -465,6 +509,9 @@ int seat_stop(Seat *s, bool force) {
         r = seat_stop_sessions(s, force);
 
         (void) unlink(s->state_file);
+#if 1 /// elogind: keep the login state database in sync
+        manager_login_db_mark_dirty(s->manager);
+#endif // 1
         seat_add_to_gc_queue(s);
 
         if (s->started)
@@ -665,6 +712,9 @@ void seat_add_to_gc_queue(Seat *s) {
 
         LIST_PREPEND(gc_queue, s->manager->seat_gc_queue, s);
         s->in_gc_queue = true;
+#if 1 /// elogind: objects are garbage collected incrementally, see manager_gc()
+        s->manager->n_gc_queued++;
+#endif // 1
 }
 
 static bool seat_name_valid_char(char c) {
@@ -22,8 +22,14 @@ struct Seat {
 
         bool in_gc_queue:1;
         bool started:1;
+#if 1 /// elogind: state files are written lazily, see manager_flush_save_queue()
+        bool in_save_queue:1;
+#endif // 1
 
         LIST_FIELDS(Seat, gc_queue);
+#if 1 /// elogind: state files are written lazily, see manager_flush_save_queue()
+        LIST_FIELDS(Seat, save_queue);
+#endif // 1
 };
 
 int seat_new(Manager *m, const char *id, Seat **ret);
@@ -32,6 +38,10 @@ Seat* seat_free(Seat *s);
 DEFINE_TRIVIAL_CLEANUP_FUNC(Seat*, seat_free);
 
 int seat_save(Seat *s);
+#if 1 /// elogind: state files are written lazily, see manager_flush_save_queue()
+int seat_save_now(Seat *s);
+void seat_add_to_save_queue(Seat *s);
+#endif // 1
 int seat_load(Seat *s);
 
 int seat_apply_acls(Seat *s, Session *old_active);
@@ -102,10 +102,19 @@ static int property_get_idle_hint(
                 sd_bus_error *error) {
 
         Session *s = ASSERT_PTR(userdata);
+#if 1 /// elogind: see session_defer_idle_hint()
+        int r;
+#endif // 1
 
         assert(bus);
         assert(reply);
 
+#if 1 /// elogind: don't stat() the TTY while other calls are waiting, see session_defer_idle_hint()
+        r = session_defer_idle_hint(s, reply);
+        if (r != 0)
+                return r < 0 ? r : 0;
+#endif // 1
+
         return sd_bus_message_append(reply, "b", session_get_idle_hint(s, NULL) > 0);
 }
 
@@ -160,6 +169,12 @@ static int property_get_idle_since_hint(
         assert(bus);
         assert(reply);
 
+#if 1 /// elogind: don't stat() the TTY while other calls are waiting, see session_defer_idle_hint()
+        r = session_defer_idle_hint(s, reply);
+        if (r != 0)
+                return r < 0 ? r : 0;
+#endif // 1
+
         r = session_get_idle_hint(s, &t);
         if (r < 0)
                 return r;
@@ -740,6 +755,11 @@ static int session_object_find(sd_bus *bus, const char *path, const char *interf
 
         message = sd_bus_get_current_message(bus);
 
+#if 1 /// elogind: the sd-bus property cache resolves paths without a caller, then the aliases resolve to nothing
+        if (!message && (SESSION_IS_SELF(e) || SESSION_IS_AUTO(e)))
+                return 0;
+#endif // 1
+
         r = manager_get_session_from_creds(m, message, e, error, &session);
         if (r == -ENXIO) {
                 sd_bus_error_free(error);
@@ -764,6 +784,23 @@ char* session_bus_path(Session *s) {
         return strjoin("/org/freedesktop/login1/session/", t);
 }
 
+#if 1 /// elogind: drop what sd-bus cached of the session's properties
+void session_invalidate_property_cache(Session *s) {
+        _cleanup_free_ char *p = NULL;
+
+        assert(s);
+
+        if (!s->manager->bus)
+                return;
+
+        p = session_bus_path(s);
+        if (!p)
+                return;
+
+        (void) sd_bus_invalidate_property_cache(s->manager->bus, p, NULL);
+}
+#endif // 1
+
 static int session_node_enumerator(sd_bus *bus, const char *path, void *userdata, char ***nodes, sd_bus_error *error) {
         _cleanup_strv_free_ char **l = NULL;
         sd_bus_message *message;
@@ -952,6 +989,9 @@ int session_send_create_reply(Session *s, sd_bus_error *error) {
 
 #if 1 /// Additionally elogind saves the user state file
         user_save(s->user);
+
+        /* State files are written lazily, but the client must find them once it got the reply */
+        manager_flush_save_queue(s->manager);
 #endif // 1
         p = session_bus_path(s);
         if (!p)
@@ -998,6 +1038,9 @@ int session_send_upgrade_reply(Session *s, sd_bus_error *error) {
                 return sd_bus_reply_method_error(c, error);
 
         session_save(s);
+#if 1 /// elogind: state files are written lazily, but the client must find them once it got the reply
+        manager_flush_save_queue(s->manager);
+#endif // 1
 
         return sd_bus_reply_method_return(c, NULL);
 }
@@ -1005,13 +1048,25 @@ int session_send_upgrade_reply(Session *s, sd_bus_error *error) {
 static const sd_bus_vtable session_vtable[] = {
         SD_BUS_VTABLE_START(0),
 
+#if 0 /// elogind serves the properties that only change with a PropertiesChanged signal from the sd-bus property cache
         SD_BUS_PROPERTY("Id", "s", NULL, offsetof(Session, id), SD_BUS_VTABLE_PROPERTY_CONST),
         SD_BUS_PROPERTY("User", "(uo)", property_get_user, 0, SD_BUS_VTABLE_PROPERTY_CONST),
         SD_BUS_PROPERTY("Name", "s", property_get_name, 0, SD_BUS_VTABLE_PROPERTY_CONST),
+#else // 0
+        SD_BUS_PROPERTY("Id", "s", NULL, offsetof(Session, id), SD_BUS_VTABLE_PROPERTY_CONST|SD_BUS_VTABLE_PROPERTY_CACHED),
+        SD_BUS_PROPERTY("User", "(uo)", property_get_user, 0, SD_BUS_VTABLE_PROPERTY_CONST|SD_BUS_VTABLE_PROPERTY_CACHED),
+        SD_BUS_PROPERTY("Name", "s", property_get_name, 0, SD_BUS_VTABLE_PROPERTY_CONST|SD_BUS_VTABLE_PROPERTY_CACHED),
+#endif // 0
         BUS_PROPERTY_DUAL_TIMESTAMP("Timestamp", offsetof(Session, timestamp), SD_BUS_VTABLE_PROPERTY_CONST),
+#if 0 /// elogind serves the properties that only change with a PropertiesChanged signal from the sd-bus property cache
         SD_BUS_PROPERTY("VTNr", "u", NULL, offsetof(Session, vtnr), SD_BUS_VTABLE_PROPERTY_CONST),
         SD_BUS_PROPERTY("Seat", "(so)", property_get_seat, 0, SD_BUS_VTABLE_PROPERTY_CONST),
+#else // 0
+        SD_BUS_PROPERTY("VTNr", "u", NULL, offsetof(Session, vtnr), SD_BUS_VTABLE_PROPERTY_CONST|SD_BUS_VTABLE_PROPERTY_CACHED),
+        SD_BUS_PROPERTY("Seat", "(so)", property_get_seat, 0, SD_BUS_VTABLE_PROPERTY_CONST|SD_BUS_VTABLE_PROPERTY_CACHED),
+#endif // 0
         SD_BUS_PROPERTY("TTY", "s", NULL, offsetof(Session, tty), SD_BUS_VTABLE_PROPERTY_EMITS_CHANGE),
+#if 0 /// elogind serves the properties that only change with a PropertiesChanged signal from the sd-bus property cache
         SD_BUS_PROPERTY("Display", "s", NULL, offsetof(Session, display), SD_BUS_VTABLE_PROPERTY_EMITS_CHANGE),
         SD_BUS_PROPERTY("Remote", "b", bus_property_get_bool, offsetof(Session, remote), SD_BUS_VTABLE_PROPERTY_CONST),
         SD_BUS_PROPERTY("RemoteHost", "s", NULL, offsetof(Session, remote_host), SD_BUS_VTABLE_PROPERTY_CONST),
@@ -1023,14 +1078,37 @@ static const sd_bus_vtable session_vtable[] = {
         SD_BUS_PROPERTY("Audit", "u", NULL, offsetof(Session, audit_id), SD_BUS_VTABLE_PROPERTY_CONST),
         SD_BUS_PROPERTY("Type", "s", property_get_type, offsetof(Session, type), SD_BUS_VTABLE_PROPERTY_EMITS_CHANGE),
         SD_BUS_PROPERTY("Class", "s", property_get_class, offsetof(Session, class), SD_BUS_VTABLE_PROPERTY_EMITS_CHANGE),
+#else // 0
+        SD_BUS_PROPERTY("Display", "s", NULL, offsetof(Session, display), SD_BUS_VTABLE_PROPERTY_EMITS_CHANGE|SD_BUS_VTABLE_PROPERTY_CACHED),
+        SD_BUS_PROPERTY("Remote", "b", bus_property_get_bool, offsetof(Session, remote), SD_BUS_VTABLE_PROPERTY_CONST|SD_BUS_VTABLE_PROPERTY_CACHED),
+        SD_BUS_PROPERTY("RemoteHost", "s", NULL, offsetof(Session, remote_host), SD_BUS_VTABLE_PROPERTY_CONST|SD_BUS_VTABLE_PROPERTY_CACHED),
+        SD_BUS_PROPERTY("RemoteUser", "s", NULL, offsetof(Session, remote_user), SD_BUS_VTABLE_PROPERTY_CONST|SD_BUS_VTABLE_PROPERTY_CACHED),
+        SD_BUS_PROPERTY("Service", "s", NULL, offsetof(Session, service), SD_BUS_VTABLE_PROPERTY_CONST|SD_BUS_VTABLE_PROPERTY_CACHED),
+        SD_BUS_PROPERTY("Desktop", "s", NULL, offsetof(Session, desktop), SD_BUS_VTABLE_PROPERTY_CONST|SD_BUS_VTABLE_PROPERTY_CACHED),
+        SD_BUS_PROPERTY("Scope", "s", NULL, offsetof(Session, scope), SD_BUS_VTABLE_PROPERTY_CONST|SD_BUS_VTABLE_PROPERTY_CACHED),
+        SD_BUS_PROPERTY("Leader", "u", bus_property_get_pid, offsetof(Session, leader.pid), SD_BUS_VTABLE_PROPERTY_CONST|SD_BUS_VTABLE_PROPERTY_CACHED),
+        SD_BUS_PROPERTY("Audit", "u", NULL, offsetof(Session, audit_id), SD_BUS_VTABLE_PROPERTY_CONST|SD_BUS_VTABLE_PROPERTY_CACHED),
+        SD_BUS_PROPERTY("Type", "s", property_get_type, offsetof(Session, type), SD_BUS_VTABLE_PROPERTY_EMITS_CHANGE|SD_BUS_VTABLE_PROPERTY_CACHED),
+        SD_BUS_PROPERTY("Class", "s", property_get_class, offsetof(Session, class), SD_BUS_VTABLE_PROPERTY_EMITS_CHANGE|SD_BUS_VTABLE_PROPERTY_CACHED),
+#endif // 0
         SD_BUS_PROPERTY("Active", "b", property_get_active, 0, SD_BUS_VTABLE_PROPERTY_EMITS_CHANGE),
         SD_BUS_PROPERTY("State", "s", property_get_state, 0, SD_BUS_VTABLE_PROPERTY_EMITS_CHANGE),
+#if 0 /// elogind: reads may be deferred until the TTY atime was refreshed, see session_defer_idle_hint()
         SD_BUS_PROPERTY("IdleHint", "b", property_get_idle_hint, 0, SD_BUS_VTABLE_PROPERTY_EMITS_CHANGE),
         SD_BUS_PROPERTY("IdleSinceHint", "t", property_get_idle_since_hint, 0, SD_BUS_VTABLE_PROPERTY_EMITS_CHANGE),
         SD_BUS_PROPERTY("IdleSinceHintMonotonic", "t", property_get_idle_since_hint, 0, SD_BUS_VTABLE_PROPERTY_EMITS_CHANGE),
+#else // 0
+        SD_BUS_PROPERTY("IdleHint", "b", property_get_idle_hint, 0, SD_BUS_VTABLE_PROPERTY_EMITS_CHANGE|SD_BUS_VTABLE_PROPERTY_ASYNC),
+        SD_BUS_PROPERTY("IdleSinceHint", "t", property_get_idle_since_hint, 0, SD_BUS_VTABLE_PROPERTY_EMITS_CHANGE|SD_BUS_VTABLE_PROPERTY_ASYNC),
+        SD_BUS_PROPERTY("IdleSinceHintMonotonic", "t", property_get_idle_since_hint, 0, SD_BUS_VTABLE_PROPERTY_EMITS_CHANGE|SD_BUS_VTABLE_PROPERTY_ASYNC),
+#endif // 0
         SD_BUS_PROPERTY("CanIdle", "b", property_get_can_idle, 0, SD_BUS_VTABLE_PROPERTY_CONST),
         SD_BUS_PROPERTY("CanLock", "b", property_get_can_lock, 0, SD_BUS_VTABLE_PROPERTY_CONST),
+#if 0 /// elogind serves the properties that only change with a PropertiesChanged signal from the sd-bus property cache
         SD_BUS_PROPERTY("LockedHint", "b", property_get_locked_hint, 0, SD_BUS_VTABLE_PROPERTY_EMITS_CHANGE),
+#else // 0
+        SD_BUS_PROPERTY("LockedHint", "b", property_get_locked_hint, 0, SD_BUS_VTABLE_PROPERTY_EMITS_CHANGE|SD_BUS_VTABLE_PROPERTY_CACHED),
+#endif // 0
 
         SD_BUS_METHOD("Terminate",
                       NULL,
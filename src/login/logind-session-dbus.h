@@ -9,6 +9,9 @@
 extern const BusObjectImplementation session_object;
 
 char* session_bus_path(Session *s);
+#if 1 /// elogind: see the sd-bus property cache
+void session_invalidate_property_cache(Session *s);
+#endif // 1
 
 int session_send_signal(Session *s, bool new_session);
 int session_send_changed(Session *s, const char *properties, ...) _sentinel_;
@@ -44,6 +44,8 @@
 #include "cgroup.h"
 #include "cgroup-setup.h"
 #include "extract-word.h"
+#include "logind-db.h"
+#include "logind-stop-idle.h"
 #include "musl_missing.h"
 
 #define RELEASE_USEC (20*USEC_PER_SEC)
@@ -55,6 +57,9 @@
 
 static void session_remove_fifo(Session *s);
 static void session_restore_vt(Session *s);
+#if 1 /// elogind: see session_defer_idle_hint()
+static void session_resume_idle_hint_reads(Session *s);
+#endif // 1
 
 #if 1 /// elogind allow to take (limited) control of the users VT, and needs two helper functions for that
 static int session_chown_tty(Session *s) {
@@ -219,6 +224,58 @@ static int session_enable_controllers(const char *path) {
         return 0;
 }
 
+#if 1 /// elogind: sessions are indexed by the IDs of their cgroups, see manager_get_session_by_pidref()
+static void session_index_cgroup_id(Session *s, const char *path, uint64_t *id) {
+        _cleanup_free_ char *fs = NULL;
+        int r;
+
+        assert(s);
+        assert(id);
+
+        if (!path || *id != 0)
+                return;
+
+        r = cg_get_path(SYSTEMD_CGROUP_CONTROLLER, path, NULL, &fs);
+        if (r >= 0)
+                r = cg_path_get_cgroupid(fs, id);
+        if (r < 0) {
+                log_debug_errno(r, "Failed to determine ID of cgroup %s, not indexing it: %m", path);
+                return;
+        }
+
+        r = hashmap_ensure_put(&s->manager->sessions_by_cgroup_id, &uint64_hash_ops, id, s);
+        if (r < 0) {
+                log_debug_errno(r, "Failed to index cgroup %s of session %s, ignoring: %m", path, s->id);
+                *id = 0;
+        }
+}
+
+void session_index_cgroup(Session *s) {
+        assert(s);
+
+        /* Only cgroup v2 has cgroup IDs */
+        if (cg_unified_controller(SYSTEMD_CGROUP_CONTROLLER) <= 0)
+                return;
+
+        /* The leader ends up in the leaf cgroup. Processes in cgroups below the delegated/ subtree are
+         * still found the slow way, through /proc/$PID/cgroup. */
+        session_index_cgroup_id(s, s->cgroup_path ?: s->id, &s->cgroup_id);
+        if (!streq_ptr(s->cgroup_leaf_path, s->cgroup_path ?: s->id))
+                session_index_cgroup_id(s, s->cgroup_leaf_path, &s->cgroup_leaf_id);
+}
+
+void session_unindex_cgroup(Session *s) {
+        assert(s);
+
+        if (s->cgroup_id != 0)
+                (void) hashmap_remove_value(s->manager->sessions_by_cgroup_id, &s->cgroup_id, s);
+        if (s->cgroup_leaf_id != 0)
+                (void) hashmap_remove_value(s->manager->sessions_by_cgroup_id, &s->cgroup_leaf_id, s);
+
+        s->cgroup_id = s->cgroup_leaf_id = 0;
+}
+#endif // 1
+
 static int session_setup_cgroup_paths(Session *s) {
         int r;
 
@@ -415,13 +472,28 @@ Session* session_free(Session *s) {
         if (!s)
                 return NULL;
 
+#if 1 /// elogind: keep the login state database in sync
+        manager_login_db_mark_dirty(s->manager);
+#endif // 1
+#if 0 /// elogind uses one timer wheel for all sessions, see logind-stop-idle.c
         sd_event_source_unref(s->stop_on_idle_event_source);
+#else // 0
+        manager_stop_idle_remove(s->manager, s);
+#endif // 0
 
         if (s->in_gc_queue) {
                 assert(s->manager);
                 LIST_REMOVE(gc_queue, s->manager->session_gc_queue, s);
+#if 1 /// elogind: objects are garbage collected incrementally, see manager_gc()
+                s->manager->n_gc_queued--;
+#endif // 1
         }
 
+#if 1 /// elogind: state files are written lazily, see manager_flush_save_queue()
+        if (s->in_save_queue)
+                LIST_REMOVE(save_queue, s->manager->session_save_queue, s);
+#endif // 1
+
         sd_event_source_unref(s->timer_event_source);
 
         session_drop_controller(s);
@@ -465,11 +537,23 @@ Session* session_free(Session *s) {
 #endif // 0
 
         session_reset_leader(s, /* keep_fdstore = */ true);
+#if 1 /// elogind: see the sd-bus property cache
+        session_invalidate_property_cache(s);
+#endif // 1
 
         sd_bus_message_unref(s->create_message);
         sd_bus_message_unref(s->upgrade_message);
 
         free(s->tty);
+#if 1 /// elogind: TTY atimes are cached, see session_get_idle_hint()
+        free(s->idle_tty);
+#endif // 1
+#if 1 /// elogind: see session_defer_idle_hint()
+        sd_event_source_disable_unref(s->idle_hint_event_source);
+        /* Let the deferred reads go on, they'll find the object gone */
+        session_resume_idle_hint_reads(s);
+        free(s->idle_hint_reads);
+#endif // 1
         free(s->display);
         free(s->remote_host);
         free(s->remote_user);
@@ -483,6 +567,7 @@ Session* session_free(Session *s) {
 
 #if 1 /// elogind does not rely on external cgroup controllers to clean up after ourselves
         session_release_cgroup(s);
+        session_unindex_cgroup(s);
 #endif // 1
 
         /* Note that we remove neither the state file nor the fifo path here, since we want both to survive
@@ -551,7 +636,11 @@ static void session_save_devices(Session *s, FILE *f) {
         }
 }
 
+#if 0 /// elogind: state files are written lazily, session_save() only queues the session
 int session_save(Session *s) {
+#else // 0
+int session_save_now(Session *s) {
+#endif // 0
         _cleanup_(unlink_and_freep) char *temp_path = NULL;
         _cleanup_fclose_ FILE *f = NULL;
         int r;
@@ -712,6 +801,37 @@ fail:
         return log_error_errno(r, "Failed to save session data %s: %m", s->state_file);
 }
 
+#if 1 /// elogind: state files are written lazily, see manager_flush_save_queue()
+int session_save(Session *s) {
+        assert(s);
+
+        if (!s->user)
+                return -ESTALE;
+
+        manager_login_db_mark_dirty(s->manager);
+
+        if (!s->started)
+                return 0;
+
+        session_add_to_save_queue(s);
+        return 0;
+}
+
+void session_add_to_save_queue(Session *s) {
+        assert(s);
+
+        s->manager->n_save_requests++;
+
+        if (s->in_save_queue)
+                return;
+
+        LIST_PREPEND(save_queue, s->manager->session_save_queue, s);
+        s->in_save_queue = true;
+
+        manager_enqueue_save_queue(s->manager);
+}
+#endif // 1
+
 static int session_load_devices(Session *s, const char *devices) {
         int r = 0;
 
@@ -1123,10 +1243,13 @@ static int session_start_cgroup(Session *s) {
         if (r < 0)
                 log_warning_errno(r, "Failed to watch cgroup %s: %m", s->cgroup_path ?: s->id);
 
+        session_index_cgroup(s);
+
         return 0;
 }
 #endif // 0
 
+#if 0 /// elogind uses one timer wheel for all sessions, see logind-stop-idle.c
 static int session_dispatch_stop_on_idle(sd_event_source *source, uint64_t t, void *userdata) {
         Session *s = userdata;
         dual_timestamp ts;
@@ -1178,6 +1301,47 @@ static int session_setup_stop_on_idle_timer(Session *s) {
 
         return 0;
 }
+#else // 0
+int session_stop_on_idle(Session *s) {
+        dual_timestamp ts;
+        int idle;
+
+        assert(s);
+
+        if (s->stopping)
+                return 0;
+
+        /* TTY atimes are cached, make sure to act on the current one */
+        session_invalidate_idle_hint(s);
+
+        idle = session_get_idle_hint(s, &ts);
+        if (idle) {
+                log_info("Session \"%s\" of user \"%s\" is idle, stopping.", s->id, s->user->user_record->user_name);
+
+                return session_stop(s, /* force */ true);
+        }
+
+        return manager_stop_idle_add(
+                        s->manager, s,
+                        usec_add(dual_timestamp_is_set(&ts) ? ts.monotonic : now(CLOCK_MONOTONIC),
+                                 s->manager->stop_idle_session_usec));
+}
+
+static int session_setup_stop_on_idle_timer(Session *s) {
+        int r;
+
+        assert(s);
+
+        if (s->manager->stop_idle_session_usec == USEC_INFINITY || !SESSION_CLASS_CAN_STOP_ON_IDLE(s->class))
+                return 0;
+
+        r = manager_stop_idle_add(s->manager, s, usec_add(now(CLOCK_MONOTONIC), s->manager->stop_idle_session_usec));
+        if (r < 0)
+                return log_error_errno(r, "Failed to add stop on idle session timer: %m");
+
+        return 0;
+}
+#endif // 0
 
 int session_start(Session *s, sd_bus_message *properties, sd_bus_error *error) {
         int r;
@@ -1280,7 +1444,11 @@ static int session_stop_scope(Session *s, bool force) {
                 // elogind must not kill lingering user processes alive
                 r = 0;
                 if (force || (user_check_linger_file(s->user) < 1)) {
-                        // Kill the cgroup!
+                        // Kill the cgroup! Unless this is part of a batch, see manager_kill_sessions()
+                        if (s->manager->session_kill_batch &&
+                            set_put(s->manager->session_kill_batch, s) >= 0)
+                                return 0;
+
                         r = session_kill(s, KILL_ALL, SIGTERM, &error);
                         if (r < 0)
                                 return r;
@@ -1365,6 +1533,7 @@ int session_finalize(Session *s) {
 
 #if 1 /// cleanup elogind session watch on its cgroup
         session_release_cgroup(s);
+        session_unindex_cgroup(s);
         if (s->cgroup_path)
                 (void) cg_trim(SYSTEMD_CGROUP_CONTROLLER, s->cgroup_path, /* delete_root= */ true);
         else if (s->id)
@@ -1393,6 +1562,9 @@ int session_finalize(Session *s) {
                 session_device_free(sd);
 
         (void) unlink(s->state_file);
+#if 1 /// elogind: keep the login state database in sync
+        manager_login_db_mark_dirty(s->manager);
+#endif // 1
         session_add_to_gc_queue(s);
         user_add_to_gc_queue(s->user);
 
@@ -1409,6 +1581,9 @@ int session_finalize(Session *s) {
         }
 
         session_reset_leader(s, /* keep_fdstore = */ false);
+#if 1 /// elogind: the leader is gone, which is not announced via PropertiesChanged
+        session_invalidate_property_cache(s);
+#endif // 1
 
         (void) user_save(s->user);
         (void) user_send_changed(s->user, "Display", NULL);
@@ -1485,6 +1660,7 @@ static int get_tty_atime(const char *tty, usec_t *atime) {
         return 0;
 }
 
+#if 0 /// UNNEEDED by elogind, see session_get_tty_atime()
 static int get_process_ctty_atime(pid_t pid, usec_t *atime) {
         _cleanup_free_ char *p = NULL;
         int r;
@@ -1498,6 +1674,199 @@ static int get_process_ctty_atime(pid_t pid, usec_t *atime) {
 
         return get_tty_atime(p, atime);
 }
+#endif // 0
+
+#if 1 /// elogind: TTY atimes are cached, see session_get_idle_hint()
+/* Upper bound for how long a cached TTY atime is trusted even if no idle deadline is near, so that
+ * IdleSinceHint stays reasonably current. */
+#define IDLE_TTY_CACHE_MAX_USEC (5 * USEC_PER_SEC)
+
+/* Returns how long a TTY may see no input before its session counts as idle, USEC_INFINITY if never */
+static usec_t session_idle_timeout(Session *s) {
+        assert(s);
+
+        if (s->manager->idle_action_usec > 0 && s->manager->stop_idle_session_usec != USEC_INFINITY)
+                return MIN(s->manager->idle_action_usec, s->manager->stop_idle_session_usec);
+        if (s->manager->idle_action_usec > 0)
+                return s->manager->idle_action_usec;
+
+        return s->manager->stop_idle_session_usec;
+}
+
+void session_invalidate_idle_hint(Session *s) {
+        assert(s);
+
+        s->idle_tty_refresh_usec = 0;
+}
+
+static bool session_idle_hint_needs_refresh(Session *s) {
+        assert(s);
+
+        /* Mirrors session_get_idle_hint(): only TTY sessions look at the TTY, and only if the cached atime
+         * (or the cached failure to find one) went stale. */
+        if (!SESSION_CLASS_CAN_IDLE(s->class) || s->type != SESSION_TTY)
+                return false;
+
+        return now(CLOCK_MONOTONIC) >= s->idle_tty_refresh_usec;
+}
+
+static void session_resume_idle_hint_reads(Session *s) {
+        int r;
+
+        assert(s);
+
+        FOREACH_ARRAY(m, s->idle_hint_reads, s->n_idle_hint_reads) {
+                r = sd_bus_property_resume(*m);
+                if (r < 0)
+                        log_debug_errno(r, "Failed to resume deferred idle hint read of session %s, ignoring: %m", s->id);
+
+                sd_bus_message_unref(*m);
+        }
+
+        s->n_idle_hint_reads = 0;
+}
+
+static int session_resolve_idle_tty(Session *s, char **ret_tty, usec_t *ret_atime) {
+        _cleanup_free_ char *p = NULL;
+        int r;
+
+        assert(s);
+        assert(ret_tty);
+        assert(ret_atime);
+
+        /* For sessions with an explicitly configured tty, let's check its atime */
+        if (s->tty) {
+                r = get_tty_atime(s->tty, ret_atime);
+                if (r >= 0)
+                        return strdup_to(ret_tty, s->tty);
+        }
+
+        /* For sessions with a leader but no explicitly configured tty, let's check the controlling tty of
+         * the leader */
+        if (!pidref_is_set(&s->leader))
+                return -ENXIO;
+
+        r = get_ctty(s->leader.pid, NULL, &p);
+        if (r < 0)
+                return r;
+
+        r = get_tty_atime(p, ret_atime);
+        if (r < 0)
+                return r;
+
+        *ret_tty = TAKE_PTR(p);
+        return 0;
+}
+
+static int session_get_tty_atime(Session *s, usec_t *ret) {
+        usec_t n, atime, timeout, deadline;
+        int r;
+
+        assert(s);
+        assert(ret);
+
+        /* Queries are answered from the cache until either the cache times out or the point in time is
+         * reached where the session would become idle if the TTY saw no further input. The atime only ever
+         * moves forward, hence until then "not idle" stays the correct answer, and afterwards we look again.
+         * The TTY itself (and for sessions without a configured TTY the leader's ctty, which requires going
+         * through /proc) is resolved once and only looked up again if it vanishes. */
+
+        n = now(CLOCK_MONOTONIC);
+        if (n < s->idle_tty_refresh_usec) {
+                if (!s->idle_tty)
+                        return -ENXIO;
+
+                *ret = s->idle_tty_atime;
+                return 0;
+        }
+
+        r = s->idle_tty ? get_tty_atime(s->idle_tty, &atime) : -ENOENT;
+        if (r < 0) {
+                s->idle_tty = mfree(s->idle_tty);
+
+                r = session_resolve_idle_tty(s, &s->idle_tty, &atime);
+                if (r < 0) {
+                        /* Remember the failure too, e.g. for a closing session whose pts is gone. Otherwise
+                         * each deferred read would find the cache stale again and be deferred once more. */
+                        s->idle_tty_refresh_usec = n + IDLE_TTY_CACHE_MAX_USEC;
+                        return r;
+                }
+        }
+
+        deadline = n + IDLE_TTY_CACHE_MAX_USEC;
+
+        timeout = session_idle_timeout(s);
+        if (timeout != USEC_INFINITY) {
+                usec_t idle_at = usec_add(atime, timeout), rt = now(CLOCK_REALTIME);
+
+                if (idle_at > rt)
+                        deadline = MIN(deadline, n + (idle_at - rt));
+        }
+
+        s->idle_tty_atime = atime;
+        s->idle_tty_refresh_usec = deadline;
+
+        *ret = atime;
+        return 0;
+}
+
+static int session_dispatch_idle_hint(sd_event_source *es, void *userdata) {
+        Session *s = ASSERT_PTR(userdata);
+        usec_t atime;
+
+        /* Runs once everything of higher priority (in particular further bus traffic) got its turn. The
+         * resumed reads will then find the atime cached. Should it go stale again before they are
+         * dispatched, they are simply deferred one more time, which the next refresh settles, since it
+         * always yields a deadline in the future, also if no atime could be read. */
+        (void) session_get_tty_atime(s, &atime);
+        session_resume_idle_hint_reads(s);
+
+        return 0;
+}
+
+int session_defer_idle_hint(Session *s, sd_bus_message *reply) {
+        _cleanup_(sd_bus_message_unrefp) sd_bus_message *call = NULL;
+        int r;
+
+        assert(s);
+        assert(reply);
+
+        /* Returns > 0 if the property read has been deferred until the TTY atime was refreshed, 0 if the
+         * caller shall provide the value right away, either because the cached atime is still good, or
+         * because the read cannot be deferred (e.g. when building a PropertiesChanged signal). */
+
+        if (!session_idle_hint_needs_refresh(s))
+                return 0;
+
+        /* Set up everything first, so that the read is never deferred without being resumed later */
+        if (!GREEDY_REALLOC(s->idle_hint_reads, s->n_idle_hint_reads + 1))
+                return -ENOMEM;
+
+        if (s->idle_hint_event_source)
+                r = sd_event_source_set_enabled(s->idle_hint_event_source, SD_EVENT_ONESHOT);
+        else {
+                /* Defer event sources start out in SD_EVENT_ONESHOT mode */
+                r = sd_event_add_defer(s->manager->event, &s->idle_hint_event_source, session_dispatch_idle_hint, s);
+                if (r >= 0) {
+                        (void) sd_event_source_set_priority(s->idle_hint_event_source, SD_EVENT_PRIORITY_IDLE);
+                        (void) sd_event_source_set_description(s->idle_hint_event_source, "session-idle-hint");
+                }
+        }
+        if (r < 0) {
+                log_debug_errno(r, "Failed to schedule idle hint refresh of session %s, reading it right away: %m", s->id);
+                return 0;
+        }
+
+        r = sd_bus_property_defer(reply, &call);
+        if (r == -EOPNOTSUPP)
+                return 0;
+        if (r < 0)
+                return r;
+
+        s->idle_hint_reads[s->n_idle_hint_reads++] = TAKE_PTR(call);
+        return 1;
+}
+#endif // 1
 
 int session_get_idle_hint(Session *s, dual_timestamp *t) {
         usec_t atime = 0, dtime = 0;
@@ -1517,6 +1886,7 @@ int session_get_idle_hint(Session *s, dual_timestamp *t) {
         }
 
         if (s->type == SESSION_TTY) {
+#if 0 /// elogind caches the TTY atime instead of stat()ing the TTY on every query
                 /* For sessions with an explicitly configured tty, let's check its atime */
                 if (s->tty) {
                         r = get_tty_atime(s->tty, &atime);
@@ -1531,6 +1901,11 @@ int session_get_idle_hint(Session *s, dual_timestamp *t) {
                         if (r >= 0)
                                 goto found_atime;
                 }
+#else // 0
+                r = session_get_tty_atime(s, &atime);
+                if (r >= 0)
+                        goto found_atime;
+#endif // 0
         }
 
         if (t)
@@ -1542,6 +1917,7 @@ found_atime:
         if (t)
                 dual_timestamp_from_realtime(t, atime);
 
+#if 0 /// elogind shares this with session_get_tty_atime(), see session_idle_timeout()
         if (s->manager->idle_action_usec > 0 && s->manager->stop_idle_session_usec != USEC_INFINITY)
                 dtime = MIN(s->manager->idle_action_usec, s->manager->stop_idle_session_usec);
         else if (s->manager->idle_action_usec > 0)
@@ -1550,6 +1926,11 @@ found_atime:
                 dtime = s->manager->stop_idle_session_usec;
         else
                 return false;
+#else // 0
+        dtime = session_idle_timeout(s);
+        if (dtime == USEC_INFINITY)
+                return false;
+#endif // 0
 
         return usec_add(atime, dtime) <= now(CLOCK_REALTIME);
 }
@@ -1654,6 +2035,11 @@ int session_set_tty(Session *s, const char *tty) {
         if (r <= 0)  /* 0 means the strings were equal */
                 return r;
 
+#if 1 /// elogind: TTY atimes are cached, see session_get_idle_hint()
+        s->idle_tty = mfree(s->idle_tty);
+        session_invalidate_idle_hint(s);
+#endif // 1
+
         (void) session_save(s);
         (void) session_send_changed(s, "TTY", NULL);
 
@@ -1708,6 +2094,10 @@ int session_create_fifo(Session *s) {
                 if (r < 0)
                         return r;
 
+#if 1 /// elogind: name the source for the event loop statistics, see org.freedesktop.login1.Debug
+                (void) sd_event_source_set_description(s->fifo_event_source, "session-fifo");
+#endif // 1
+
                 log_debug_elogind("Raising event priority for session %s fifo", s->id);
                 /* Let's make sure we noticed dead sessions before we process new bus requests (which might
                  * create new sessions). */
@@ -1825,6 +2215,9 @@ void session_add_to_gc_queue(Session *s) {
 
         LIST_PREPEND(gc_queue, s->manager->session_gc_queue, s);
         s->in_gc_queue = true;
+#if 1 /// elogind: objects are garbage collected incrementally, see manager_gc()
+        s->manager->n_gc_queued++;
+#endif // 1
 }
 
 SessionState session_get_state(Session *s) {
@@ -142,6 +142,9 @@ struct Session {
 
         bool in_gc_queue;
         bool started;
+#if 1 /// elogind: state files are written lazily, see manager_flush_save_queue()
+        bool in_save_queue;
+#endif // 1
         bool stopping;
 
         bool was_active;
@@ -150,6 +153,16 @@ struct Session {
 
         bool idle_hint;
         dual_timestamp idle_hint_timestamp;
+#if 1 /// elogind: TTY atimes are cached, see session_get_idle_hint()
+        char *idle_tty;                 /* The TTY whose atime was last read, either s->tty or the leader's ctty */
+        usec_t idle_tty_atime;          /* CLOCK_REALTIME */
+        usec_t idle_tty_refresh_usec;   /* CLOCK_MONOTONIC, idle_tty_atime is stale after this */
+#endif // 1
+#if 1 /// elogind: property reads that need the TTY atime refreshed are deferred, see session_defer_idle_hint()
+        sd_event_source *idle_hint_event_source;
+        sd_bus_message **idle_hint_reads;
+        size_t n_idle_hint_reads;
+#endif // 1
 
         sd_bus_message *create_message;   /* The D-Bus message used to create the session, which we haven't responded to yet */
         sd_bus_message *upgrade_message;  /* The D-Bus message used to upgrade the session class user-incomplete → user, which we haven't responded to yet */
@@ -165,17 +178,33 @@ struct Session {
         char *cgroup_path;
         char *cgroup_leaf_path;
 #endif // 1
+#if 1 /// elogind: sessions are indexed by the IDs of their cgroups, see manager_get_session_by_pidref()
+        uint64_t cgroup_id;
+        uint64_t cgroup_leaf_id;
+#endif // 1
 
         char *controller;
         Hashmap *devices;
         sd_bus_track *track;
 
+#if 0 /// elogind uses one timer wheel for all sessions, see logind-stop-idle.c
         sd_event_source *stop_on_idle_event_source;
+#else // 0
+        usec_t stop_idle_deadline;      /* CLOCK_MONOTONIC */
+        unsigned stop_idle_slot;
+        bool in_stop_idle_wheel;
+#endif // 0
 
         LIST_FIELDS(Session, sessions_by_user);
         LIST_FIELDS(Session, sessions_by_seat);
 
         LIST_FIELDS(Session, gc_queue);
+#if 1 /// elogind uses one timer wheel for all sessions, see logind-stop-idle.c
+        LIST_FIELDS(Session, stop_idle_wheel);
+#endif // 1
+#if 1 /// elogind: state files are written lazily, see manager_flush_save_queue()
+        LIST_FIELDS(Session, save_queue);
+#endif // 1
 };
 
 int session_new(Manager *m, const char *id, Session **ret);
@@ -190,6 +219,11 @@ void session_add_to_gc_queue(Session *s);
 int session_activate(Session *s);
 bool session_is_active(Session *s);
 int session_get_idle_hint(Session *s, dual_timestamp *t);
+#if 1 /// elogind: TTY atimes are cached, see session_get_idle_hint()
+void session_invalidate_idle_hint(Session *s);
+int session_defer_idle_hint(Session *s, sd_bus_message *reply);
+int session_stop_on_idle(Session *s);
+#endif // 1
 int session_set_idle_hint(Session *s, bool b);
 int session_get_locked_hint(Session *s);
 int session_set_locked_hint(Session *s, bool b);
@@ -203,6 +237,14 @@ int session_stop(Session *s, bool force);
 int session_finalize(Session *s);
 int session_release(Session *s);
 int session_save(Session *s);
+#if 1 /// elogind: sessions are indexed by the IDs of their cgroups, see manager_get_session_by_pidref()
+void session_index_cgroup(Session *s);
+void session_unindex_cgroup(Session *s);
+#endif // 1
+#if 1 /// elogind: state files are written lazily, see manager_flush_save_queue()
+int session_save_now(Session *s);
+void session_add_to_save_queue(Session *s);
+#endif // 1
 int session_load(Session *s);
 int session_kill(Session *s, KillWhom whom, int signo, sd_bus_error *error);
 
@@ -0,0 +1,195 @@
+/* SPDX-License-Identifier: LGPL-2.1-or-later */
+
+#include "logind-session.h"
+#include "logind-stop-idle.h"
+
+/* All sessions subject to StopIdleSessionSec= are kept in a hashed timer wheel of STOP_IDLE_WHEEL_SLOTS
+ * slots, and only a single timer event source is armed, for the earliest slot that is not empty. A
+ * deadline is never further than StopIdleSessionSec= in the future, hence the slot length is chosen so that
+ * one revolution of the wheel covers that span, and a slot normally only holds deadlines of the current
+ * revolution. When a slot has passed, all its sessions are processed in one batch, i.e. deadlines are
+ * effectively rounded up to the slot length. */
+
+/* Don't bother waking up more often than that, even for very short StopIdleSessionSec= */
+#define STOP_IDLE_WHEEL_TICK_MIN_USEC USEC_PER_SEC
+
+static int manager_dispatch_stop_idle(sd_event_source *source, uint64_t usec, void *userdata);
+
+static void stop_idle_wheel_init(Manager *m) {
+        assert(m);
+        assert(m->n_stop_idle_sessions == 0);
+
+        m->stop_idle_wheel_tick_usec = MAX(DIV_ROUND_UP(m->stop_idle_session_usec, STOP_IDLE_WHEEL_SLOTS),
+                                           STOP_IDLE_WHEEL_TICK_MIN_USEC);
+        m->stop_idle_wheel_cursor = now(CLOCK_MONOTONIC) / m->stop_idle_wheel_tick_usec;
+        m->stop_idle_wheel_armed = UINT64_MAX;
+}
+
+static int stop_idle_wheel_arm(Manager *m, uint64_t tick) {
+        usec_t usec;
+        int r;
+
+        assert(m);
+        assert(m->stop_idle_wheel_tick_usec > 0);
+
+        /* A slot is done when it has passed entirely, hence wake up at the beginning of the next one */
+        usec = (tick + 1) * m->stop_idle_wheel_tick_usec;
+
+        if (m->stop_idle_event_source) {
+                r = sd_event_source_set_time(m->stop_idle_event_source, usec);
+                if (r < 0)
+                        return r;
+
+                r = sd_event_source_set_enabled(m->stop_idle_event_source, SD_EVENT_ONESHOT);
+                if (r < 0)
+                        return r;
+        } else {
+                r = sd_event_add_time(
+                                m->event,
+                                &m->stop_idle_event_source,
+                                CLOCK_MONOTONIC,
+                                usec,
+                                m->stop_idle_wheel_tick_usec,
+                                manager_dispatch_stop_idle, m);
+                if (r < 0)
+                        return r;
+
+                (void) sd_event_source_set_description(m->stop_idle_event_source, "logind-stop-idle");
+        }
+
+        m->stop_idle_wheel_armed = tick;
+        return 0;
+}
+
+static int stop_idle_wheel_rearm(Manager *m) {
+        assert(m);
+
+        m->stop_idle_wheel_armed = UINT64_MAX;
+
+        if (m->n_stop_idle_sessions == 0)
+                return sd_event_source_set_enabled(m->stop_idle_event_source, SD_EVENT_OFF);
+
+        for (uint64_t t = m->stop_idle_wheel_cursor; t < m->stop_idle_wheel_cursor + STOP_IDLE_WHEEL_SLOTS; t++)
+                if (m->stop_idle_wheel[t % STOP_IDLE_WHEEL_SLOTS])
+                        return stop_idle_wheel_arm(m, t);
+
+        assert_not_reached();
+}
+
+int manager_stop_idle_add(Manager *m, Session *s, usec_t deadline) {
+        uint64_t tick;
+
+        assert(m);
+        assert(s);
+
+        manager_stop_idle_remove(m, s);
+
+        if (m->stop_idle_session_usec == USEC_INFINITY || deadline == USEC_INFINITY)
+                return 0;
+
+        if (m->n_stop_idle_sessions == 0 && m->stop_idle_wheel_tick_usec == 0)
+                stop_idle_wheel_init(m);
+
+        /* Deadlines in slots that have already been processed go into the next slot due */
+        tick = MAX(deadline / m->stop_idle_wheel_tick_usec, m->stop_idle_wheel_cursor);
+
+        s->stop_idle_deadline = deadline;
+        s->stop_idle_slot = tick % STOP_IDLE_WHEEL_SLOTS;
+        s->in_stop_idle_wheel = true;
+        LIST_PREPEND(stop_idle_wheel, m->stop_idle_wheel[s->stop_idle_slot], s);
+        m->n_stop_idle_sessions++;
+
+        /* Only touch the timer if this deadline is due earlier than the one it is armed for. Removals
+         * never re-arm, the timer then simply finds nothing to do. */
+        if (tick >= m->stop_idle_wheel_armed)
+                return 0;
+
+        return stop_idle_wheel_arm(m, tick);
+}
+
+void manager_stop_idle_remove(Manager *m, Session *s) {
+        assert(m);
+        assert(s);
+
+        if (!s->in_stop_idle_wheel)
+                return;
+
+        LIST_REMOVE(stop_idle_wheel, m->stop_idle_wheel[s->stop_idle_slot], s);
+        s->in_stop_idle_wheel = false;
+
+        assert(m->n_stop_idle_sessions > 0);
+        m->n_stop_idle_sessions--;
+}
+
+void manager_stop_idle_reset(Manager *m) {
+        LIST_HEAD(Session, sessions) = NULL;
+        Session *s;
+        int r;
+
+        assert(m);
+
+        /* StopIdleSessionSec= changed, hence the slot length might have to be changed as well. Reinsert all
+         * sessions with their current deadlines, which is what the per-session timers used to do. */
+
+        for (size_t i = 0; i < STOP_IDLE_WHEEL_SLOTS; i++)
+                while ((s = m->stop_idle_wheel[i])) {
+                        manager_stop_idle_remove(m, s);
+                        LIST_PREPEND(stop_idle_wheel, sessions, s);
+                }
+
+        m->stop_idle_event_source = sd_event_source_disable_unref(m->stop_idle_event_source);
+        m->stop_idle_wheel_tick_usec = 0;
+        m->stop_idle_wheel_armed = UINT64_MAX;
+
+        while ((s = sessions)) {
+                LIST_REMOVE(stop_idle_wheel, sessions, s);
+
+                r = manager_stop_idle_add(m, s, s->stop_idle_deadline);
+                if (r < 0)
+                        log_warning_errno(r, "Failed to reschedule stop on idle for session %s, ignoring: %m", s->id);
+        }
+}
+
+static int manager_dispatch_stop_idle(sd_event_source *source, uint64_t usec, void *userdata) {
+        LIST_HEAD(Session, expired) = NULL;
+        Manager *m = ASSERT_PTR(userdata);
+        uint64_t now_tick, end;
+        usec_t n;
+        Session *s;
+        size_t n_expired = 0;
+        int r;
+
+        n = now(CLOCK_MONOTONIC);
+        now_tick = n / m->stop_idle_wheel_tick_usec;
+
+        /* Collect everything due from all slots that have passed since we last looked, but never more than
+         * one revolution. Deadlines of a later revolution stay where they are. */
+        end = MIN(now_tick, m->stop_idle_wheel_cursor + STOP_IDLE_WHEEL_SLOTS);
+        for (uint64_t t = m->stop_idle_wheel_cursor; t < end; t++)
+                LIST_FOREACH(stop_idle_wheel, i, m->stop_idle_wheel[t % STOP_IDLE_WHEEL_SLOTS]) {
+                        if (i->stop_idle_deadline > n)
+                                continue;
+
+                        manager_stop_idle_remove(m, i);
+                        LIST_PREPEND(stop_idle_wheel, expired, i);
+                        n_expired++;
+                }
+
+        m->stop_idle_wheel_cursor = MAX(m->stop_idle_wheel_cursor, now_tick);
+
+        if (n_expired > 0)
+                log_debug("Checking %zu session(s) for stop on idle.", n_expired);
+
+        /* Sessions that turn out not to be idle yet are put back into the wheel by session_stop_on_idle(),
+         * with a deadline computed from their current TTY atime. */
+        while ((s = expired)) {
+                LIST_REMOVE(stop_idle_wheel, expired, s);
+                (void) session_stop_on_idle(s);
+        }
+
+        r = stop_idle_wheel_rearm(m);
+        if (r < 0)
+                return log_error_errno(r, "Failed to arm stop on idle timer: %m");
+
+        return 0;
+}
@@ -0,0 +1,10 @@
+/* SPDX-License-Identifier: LGPL-2.1-or-later */
+#pragma once
+
+#include "logind.h"
+
+/* Keeps track of the StopIdleSessionSec= deadlines of all sessions, see logind-stop-idle.c */
+
+int manager_stop_idle_add(Manager *m, Session *s, usec_t deadline);
+void manager_stop_idle_remove(Manager *m, Session *s);
+void manager_stop_idle_reset(Manager *m);
@@ -16,6 +16,8 @@
 #include "signal-util.h"
 #include "strv.h"
 #include "user-util.h"
+/// Additional includes needed by elogind
+#include "errno-util.h"
 
 static int property_get_uid(
                 sd_bus *bus,
@@ -205,9 +207,17 @@ int bus_user_method_terminate(sd_bus_message *message, void *userdata, sd_bus_er
         if (r == 0)
                 return 1; /* Will call us back */
 
+#if 0 /// elogind kills the processes of all sessions in one batch, see manager_kill_sessions()
         r = user_stop(u, /* force = */ true);
         if (r < 0)
                 return r;
+#else // 0
+        manager_begin_session_kill_batch(u->manager);
+        r = user_stop(u, /* force = */ true);
+        RET_GATHER(r, manager_end_session_kill_batch(u->manager, SIGTERM));
+        if (r < 0)
+                return r;
+#endif // 0
 
         return sd_bus_reply_method_return(message, NULL);
 }
@@ -37,6 +37,8 @@
 #include "unit-name.h"
 #include "user-util.h"
 /// Additional includes needed by elogind
+#include "logind-db.h"
+#include "logind-linger.h"
 #include "user-runtime-dir.h"
 
 
@@ -118,8 +120,19 @@ User *user_free(User *u) {
                 return NULL;
 
         log_debug_elogind("Freeing User %s ...", u->user_record->user_name);
+#if 1 /// elogind: keep the login state database in sync
+        manager_login_db_mark_dirty(u->manager);
+#endif // 1
         if (u->in_gc_queue)
                 LIST_REMOVE(gc_queue, u->manager->user_gc_queue, u);
+#if 1 /// elogind: objects are garbage collected incrementally, see manager_gc()
+        if (u->in_gc_queue)
+                u->manager->n_gc_queued--;
+#endif // 1
+#if 1 /// elogind: state files are written lazily, see manager_flush_save_queue()
+        if (u->in_save_queue)
+                LIST_REMOVE(save_queue, u->manager->user_save_queue, u);
+#endif // 1
 
         while (u->sessions)
                 session_free(u->sessions);
@@ -321,7 +334,11 @@ fail:
         return log_error_errno(r, "Failed to save user data %s: %m", u->state_file);
 }
 
+#if 0 /// elogind: state files are written lazily, user_save() only queues the user
 int user_save(User *u) {
+#else // 0
+int user_save_now(User *u) {
+#endif // 0
         assert(u);
 
         if (!u->started)
@@ -330,6 +347,34 @@ int user_save(User *u) {
         return user_save_internal(u);
 }
 
+#if 1 /// elogind: state files are written lazily, see manager_flush_save_queue()
+int user_save(User *u) {
+        assert(u);
+
+        manager_login_db_mark_dirty(u->manager);
+
+        if (!u->started)
+                return 0;
+
+        user_add_to_save_queue(u);
+        return 0;
+}
+
+void user_add_to_save_queue(User *u) {
+        assert(u);
+
+        u->manager->n_save_requests++;
+
+        if (u->in_save_queue)
+                return;
+
+        LIST_PREPEND(save_queue, u->manager->user_save_queue, u);
+        u->in_save_queue = true;
+
+        manager_enqueue_save_queue(u->manager);
+}
+#endif // 1
+
 int user_load(User *u) {
         _cleanup_free_ char *realtime = NULL, *monotonic = NULL, *stopping = NULL, *last_session_timestamp = NULL, *gc_mode = NULL;
         int r;
@@ -534,6 +579,118 @@ static int user_update_slice(User *u) {
         return 0;
 }
 
+#if 1 /// elogind: IPC objects of users are removed in a worker thread, see user_clean_ipc()
+typedef struct UserIPCCleanup {
+        Manager *manager;
+        uid_t uid;
+} UserIPCCleanup;
+
+static int user_clean_ipc_work(void *userdata) {
+        UserIPCCleanup *c = ASSERT_PTR(userdata);
+
+        /* Runs in a worker thread, hence must not touch anything but the UID */
+        return clean_ipc_by_uid(c->uid);
+}
+
+static int user_clean_ipc_done(sd_event_source *s, int result, void *userdata) {
+        UserIPCCleanup *c = ASSERT_PTR(userdata);
+
+        /* clean_ipc_by_uid() logged about failures already */
+        if (result > 0)
+                log_debug("Removed IPC objects of UID " UID_FMT ".", c->uid);
+
+        assert_se(hashmap_remove_value(c->manager->ipc_cleanups, UID_TO_PTR(c->uid), s));
+        sd_event_source_unref(s);
+        return 0;
+}
+
+static int user_clean_ipc(User *u) {
+        _cleanup_(sd_event_source_unrefp) sd_event_source *s = NULL;
+        _cleanup_free_ UserIPCCleanup *c = NULL;
+        uid_t uid;
+        int r;
+
+        assert(u);
+
+        /* Walking all IPC objects of the system may take a while, hence do it in a worker thread, rather than
+         * blocking the event loop. */
+
+        uid = u->user_record->uid;
+        if (hashmap_contains(u->manager->ipc_cleanups, UID_TO_PTR(uid)))
+                return 0;
+
+        c = new(UserIPCCleanup, 1);
+        if (!c)
+                return log_oom();
+
+        *c = (UserIPCCleanup) {
+                .manager = u->manager,
+                .uid = uid,
+        };
+
+        r = sd_event_add_work(u->manager->event, &s, user_clean_ipc_work, user_clean_ipc_done, c);
+        if (r < 0)
+                goto fallback;
+
+        (void) sd_event_source_set_destroy_callback(s, free);
+        TAKE_PTR(c);
+
+        (void) sd_event_source_set_description(s, "user-clean-ipc");
+
+        r = hashmap_ensure_put(&u->manager->ipc_cleanups, NULL, UID_TO_PTR(uid), s);
+        if (r < 0)
+                goto fallback;
+
+        TAKE_PTR(s);
+        return 0;
+
+fallback:
+        /* Dropping the event source waits for the removal in case it started already, doing it again is
+         * harmless */
+        s = sd_event_source_unref(s);
+
+        log_debug_errno(r, "Failed to remove IPC objects of UID " UID_FMT " in a worker thread, removing them right away: %m", uid);
+        return clean_ipc_by_uid(uid);
+}
+
+static void user_cancel_clean_ipc(User *u) {
+        sd_event_source *s;
+
+        assert(u);
+
+        /* The user logged in again, before the IPC objects of the previous login were removed. That's not
+         * different from logging in again before the user was finalized, in which case they are kept, too.
+         * If the removal is running already, this waits for it to finish, so that it never removes objects
+         * of the new login. */
+
+        s = hashmap_remove(u->manager->ipc_cleanups, UID_TO_PTR(u->user_record->uid));
+        if (!s)
+                return;
+
+        log_debug("User %s logged in again, not removing IPC objects of the previous login.", u->user_record->user_name);
+        sd_event_source_unref(s);
+}
+
+void user_flush_ipc_cleanups(Manager *m) {
+        sd_event_source *s;
+        void *k;
+
+        assert(m);
+
+        /* Called on exit, removals that did not start yet are done right away */
+
+        while ((s = hashmap_steal_first_key_and_value(m->ipc_cleanups, &k))) {
+                bool done = sd_event_source_get_pending(s) > 0;
+
+                sd_event_source_unref(s);
+                if (!done)
+                        (void) clean_ipc_by_uid(PTR_TO_UID(k));
+        }
+
+        m->ipc_cleanups = hashmap_free(m->ipc_cleanups);
+}
+#endif // 1
+
 int user_start(User *u) {
         int r;
 
@@ -558,6 +715,10 @@ int user_start(User *u) {
                 if (!u->started)
                         log_debug("Tracking new user %s.", u->user_record->user_name);
 
+#if 1 /// elogind: IPC objects of users are removed in a worker thread, see user_clean_ipc()
+                user_cancel_clean_ipc(u);
+#endif // 1
+
                 /* Save the user data so far, because pam_elogind will read the XDG_RUNTIME_DIR out of it
                  * while starting up elogind --user. We need to do user_save_internal() because we have not
                  * "officially" started yet. */
@@ -681,9 +842,16 @@ int user_finalize(User *u) {
          * a cronjob running as the same user just finished. Hence: exclude system users generally from IPC clean-up,
          * and do it only for normal users. */
         if (u->manager->remove_ipc && !uid_is_system(u->user_record->uid))
+#if 0 /// elogind removes them in a worker thread
                 RET_GATHER(r, clean_ipc_by_uid(u->user_record->uid));
+#else // 0
+                RET_GATHER(r, user_clean_ipc(u));
+#endif // 0
 
         (void) unlink(u->state_file);
+#if 1 /// elogind: keep the login state database in sync
+        manager_login_db_mark_dirty(u->manager);
+#endif // 1
         user_add_to_gc_queue(u);
 
         if (u->started) {
@@ -739,6 +907,12 @@ int user_check_linger_file(const User *u) {
         assert(u);
         assert(u->user_record);
 
+#if 1 /// elogind: linger files are tracked through inotify, see logind-linger.c
+        int r = manager_linger_lookup(u->manager, u->user_record->user_name);
+        if (r != -ENODATA)
+                return r;
+#endif // 1
+
         cc = cescape(u->user_record->user_name);
         if (!cc)
                 return -ENOMEM;
@@ -888,6 +1062,9 @@ void user_add_to_gc_queue(User *u) {
 
         LIST_PREPEND(gc_queue, u->manager->user_gc_queue, u);
         u->in_gc_queue = true;
+#if 1 /// elogind: objects are garbage collected incrementally, see manager_gc()
+        u->manager->n_gc_queued++;
+#endif // 1
 }
 
 UserState user_get_state(User *u) {
@@ -940,18 +1117,19 @@ int user_kill(User *u, int signo) {
 
         return manager_kill_unit(u->manager, u->slice, KILL_ALL, signo, NULL);
 #else // 0
-        _cleanup_(sd_bus_error_free) sd_bus_error error = SD_BUS_ERROR_NULL;
-        int res = 0;
+        _cleanup_set_free_ Set *sessions = NULL;
+        int r;
 
         assert(u);
 
+        /* Kill the processes of all sessions at once, see manager_kill_sessions() */
         LIST_FOREACH(sessions_by_user, session, u->sessions) {
-                int r = session_kill(session, KILL_ALL, signo, &error);
-                if (res == 0 && r < 0)
-                        res = r;
+                r = set_ensure_put(&sessions, NULL, session);
+                if (r < 0)
+                        return r;
         }
 
-        return res;
+        return manager_kill_sessions(u->manager, sessions, signo);
 #endif // 0
 }
 
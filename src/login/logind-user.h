@@ -60,6 +60,9 @@ struct User {
 
         UserGCMode gc_mode;
         bool in_gc_queue:1;
+#if 1 /// elogind: state files are written lazily, see manager_flush_save_queue()
+        bool in_save_queue:1;
+#endif // 1
 
         bool started:1;       /* Whenever the user being started, has been started or is being stopped again
                                  (tracked through user-runtime-dir@.service) */
@@ -67,6 +70,9 @@ struct User {
 
         LIST_HEAD(Session, sessions);
         LIST_FIELDS(User, gc_queue);
+#if 1 /// elogind: state files are written lazily, see manager_flush_save_queue()
+        LIST_FIELDS(User, save_queue);
+#endif // 1
 };
 
 int user_new(Manager *m, UserRecord *ur, User **ret);
@@ -86,8 +92,16 @@ int user_finalize(User *u);
 UserState user_get_state(User *u);
 int user_get_idle_hint(User *u, dual_timestamp *t);
 int user_save(User *u);
+#if 1 /// elogind: state files are written lazily, see manager_flush_save_queue()
+int user_save_now(User *u);
+void user_add_to_save_queue(User *u);
+#endif // 1
 int user_load(User *u);
 int user_kill(User *u, int signo);
+#if 1 /// elogind: IPC objects of users are removed in a worker thread, see user_clean_ipc()
+void user_flush_ipc_cleanups(Manager *m);
+#endif // 1
+
 int user_check_linger_file(const User *u);
 void user_elect_display(User *u);
 void user_update_last_session_timer(User *u);
@@ -41,6 +41,9 @@
 #include "udev-util.h"
 /// Additional includes needed by elogind
 #include "elogind.h"
+#include "logind-db.h"
+#include "logind-linger.h"
+#include "logind-stop-idle.h"
 #include "musl_missing.h"
 #include "user-util.h"
 
@@ -100,6 +103,12 @@ static int manager_new(Manager **ret) {
         if (r < 0)
                 return r;
 
+#if 1 /// elogind: re-arming the per-session and per-user timers shall be cheap, see sd_event_set_timer_wheel()
+        r = sd_event_set_timer_wheel(m->event, true);
+        if (r < 0)
+                log_debug_errno(r, "Failed to enable timer wheel, ignoring: %m");
+#endif // 1
+
 #if 0 /// elogind uses its own signal handler, installed at elogind_manager_startup()
         r = sd_event_set_signal_exit(m->event, true);
         if (r < 0)
@@ -131,6 +140,12 @@ static int manager_new(Manager **ret) {
 
         (void) sd_event_set_watchdog(m->event, true);
 
+#if 1 /// elogind: collect statistics of the event loop, see org.freedesktop.login1.Debug
+        r = sd_event_set_collect_stats(m->event, true);
+        if (r < 0)
+                log_warning_errno(r, "Failed to enable event loop statistics, ignoring: %m");
+#endif // 1
+
 
 #if 1 /// elogind needs some more data
         r = elogind_manager_new(m);
@@ -149,6 +164,18 @@ static Manager* manager_free(Manager *m) {
         if (!m)
                 return NULL;
 
+#if 1 /// elogind: write out state files still queued, so that they survive a daemon restart
+        manager_flush_save_queue(m);
+        log_debug("%" PRIu64 " of %" PRIu64 " state file save requests have been coalesced.",
+                  m->n_save_requests - m->n_save_writes, m->n_save_requests);
+#endif // 1
+#if 1 /// elogind: objects are garbage collected incrementally, see manager_gc()
+        log_debug("Garbage collected %" PRIu64 " objects in %s (longest run %s), queues were up to %zu objects long, "
+                  "the per-iteration budget was exhausted %" PRIu64 " times.",
+                  m->n_gc_processed, FORMAT_TIMESPAN(m->gc_usec, 0), FORMAT_TIMESPAN(m->gc_usec_max, 0),
+                  m->n_gc_queued_max, m->n_gc_deferred);
+#endif // 1
+
         log_debug_elogind("%s", "Freeing hashmaps ...");
         hashmap_free(m->devices);
         hashmap_free(m->seats);
@@ -157,11 +184,19 @@ static Manager* manager_free(Manager *m) {
         /* All records should have been removed by session_free */
         assert(hashmap_isempty(m->sessions_by_leader));
         hashmap_free(m->sessions_by_leader);
+#if 1 /// elogind: sessions are indexed by the IDs of their cgroups, see manager_get_session_by_pidref()
+        /* All records should have been removed by session_free */
+        assert(hashmap_isempty(m->sessions_by_cgroup_id));
+        hashmap_free(m->sessions_by_cgroup_id);
+#endif // 1
 
         hashmap_free(m->users);
         hashmap_free(m->inhibitors);
         hashmap_free(m->buttons);
         hashmap_free(m->brightness_writers);
+#if 1 /// elogind: IPC objects of users are removed in a worker thread, see user_clean_ipc()
+        user_flush_ipc_cleanups(m);
+#endif // 1
 
         hashmap_free(m->user_units);
 #if 0 /// elogind does not support systemd session units.
@@ -174,6 +209,16 @@ static Manager* manager_free(Manager *m) {
         sd_event_source_unref(m->scheduled_shutdown_timeout_source);
         sd_event_source_unref(m->nologin_timeout_source);
         sd_event_source_unref(m->wall_message_timeout_source);
+#if 1 /// elogind: state files are written lazily, see manager_flush_save_queue()
+        sd_event_source_unref(m->save_queue_event_source);
+#endif // 1
+#if 1 /// elogind: StopIdleSessionSec= is enforced through a timer wheel, see logind-stop-idle.c
+        sd_event_source_unref(m->stop_idle_event_source);
+#endif // 1
+#if 1 /// elogind: linger files are tracked through inotify, see logind-linger.c
+        sd_event_source_unref(m->linger_event_source);
+        set_free(m->linger_users);
+#endif // 1
 
         sd_event_source_unref(m->console_active_event_source);
         sd_event_source_unref(m->lid_switch_ignore_event_source);
@@ -328,6 +373,7 @@ static int manager_enumerate_seats(Manager *m) {
 }
 
 static int manager_enumerate_linger_users(Manager *m) {
+#if 0 /// elogind reads the linger directory once, and watches it afterwards, see logind-linger.c
         _cleanup_closedir_ DIR *d = NULL;
         int r = 0;
 
@@ -360,6 +406,24 @@ static int manager_enumerate_linger_users(Manager *m) {
         }
 
         return r;
+#else // 0
+        const char *n;
+        int r, k;
+
+        assert(m);
+
+        r = manager_linger_watch(m);
+        if (r < 0)
+                return r;
+
+        SET_FOREACH(n, m->linger_users) {
+                k = manager_add_user_by_name(m, n, NULL);
+                if (k < 0)
+                        RET_GATHER(r, log_warning_errno(k, "Couldn't add lingering user %s, ignoring: %m", n));
+        }
+
+        return r;
+#endif // 0
 }
 
 static int manager_enumerate_users(Manager *m) {
@@ -749,6 +813,12 @@ static int manager_connect_bus(Manager *m) {
         if (r < 0)
                 return log_error_errno(r, "Failed to connect to system bus: %m");
 
+#if 1 /// elogind: collect statistics of the bus connection, see org.freedesktop.login1.Debug
+        r = sd_bus_set_collect_stats(m->bus, true);
+        if (r < 0)
+                log_warning_errno(r, "Failed to enable bus statistics, ignoring: %m");
+#endif // 1
+
         r = bus_add_implementation(m->bus, &manager_object, m);
         if (r < 0)
                 return r;
@@ -801,6 +871,12 @@ static int manager_connect_bus(Manager *m) {
         if (r < 0)
                 return log_error_errno(r, "Failed to attach bus to event loop: %m");
 
+#if 1 /// elogind: write all signals and replies of one event loop iteration with as few syscalls as possible
+        r = sd_bus_set_coalesce_writes(m->bus, true);
+        if (r < 0)
+                log_warning_errno(r, "Failed to enable write coalescing on the bus, ignoring: %m");
+#endif // 1
+
 #if 0 /// elogind has to setup its release agent
         return 0;
 #else // 0
@@ -900,6 +976,10 @@ static int manager_connect_console(Manager *m) {
         if (r < 0)
                 return log_error_errno(r, "Failed to watch foreground console: %m");
 
+#if 1 /// elogind: name the source for the event loop statistics, see org.freedesktop.login1.Debug
+        (void) sd_event_source_set_description(m->console_active_event_source, "logind-console");
+#endif // 1
+
         /*
          * SIGRTMIN + 0 is used as global VT-release signal, SIGRTMIN + 1 is used
          * as VT-acquire signal. We ignore any acquire-events (yes, we still
@@ -1026,14 +1106,62 @@ static int manager_connect_udev(Manager *m) {
         return 0;
 }
 
+#if 0 /// elogind limits the number of objects looked at per event loop iteration
 static void manager_gc(Manager *m, bool drop_not_started) {
+#else // 0
+/* How many objects manager_gc() looks at per event loop iteration at most. Deciding whether an object may be
+ * collected can mean looking at cgroupfs and the linger file, and freeing it means writing out state, hence
+ * a mass logout is spread over several iterations, so that bus calls and other events get served
+ * in between. */
+#define MANAGER_GC_BUDGET 64U
+
+static void manager_gc_account(Manager *m, size_t n, usec_t begin) {
+        usec_t d;
+
+        assert(m);
+
+        if (n == 0)
+                return;
+
+        d = usec_sub_unsigned(now(CLOCK_MONOTONIC), begin);
+
+        m->n_gc_processed += n;
+        m->gc_usec += d;
+        m->gc_usec_max = MAX(m->gc_usec_max, d);
+
+        if (m->n_gc_queued > 0) {
+                m->n_gc_deferred++;
+                log_debug("Garbage collected %zu objects in %s, %zu left for the next iteration.",
+                          n, FORMAT_TIMESPAN(d, 0), m->n_gc_queued);
+        }
+}
+
+/* Returns true if there are objects left in the gc queues because the budget was exhausted */
+static bool manager_gc(Manager *m, bool drop_not_started, size_t budget) {
+        usec_t begin;
+        size_t n = 0;
+#endif // 0
         Seat *seat;
         Session *session;
         User *user;
 
         assert(m);
 
+#if 1 /// elogind: objects are garbage collected incrementally
+        if (m->n_gc_queued == 0)
+                return false;
+
+        begin = now(CLOCK_MONOTONIC);
+        m->n_gc_queued_max = MAX(m->n_gc_queued_max, m->n_gc_queued);
+#endif // 1
+
+#if 0 /// elogind limits the number of objects looked at per event loop iteration
         while ((seat = LIST_POP(gc_queue, m->seat_gc_queue))) {
+#else // 0
+        while (n < budget && (seat = LIST_POP(gc_queue, m->seat_gc_queue))) {
+                m->n_gc_queued--;
+                n++;
+#endif // 0
                 seat->in_gc_queue = false;
 
                 if (seat_may_gc(seat, drop_not_started)) {
@@ -1043,7 +1171,13 @@ static void manager_gc(Manager *m, bool drop_not_started) {
                 }
         }
 
+#if 0 /// elogind limits the number of objects looked at per event loop iteration
         while ((session = LIST_POP(gc_queue, m->session_gc_queue))) {
+#else // 0
+        while (n < budget && (session = LIST_POP(gc_queue, m->session_gc_queue))) {
+                m->n_gc_queued--;
+                n++;
+#endif // 0
                 session->in_gc_queue = false;
 
                 /* First, if we are not closing yet, initiate stopping. */
@@ -1060,7 +1194,13 @@ static void manager_gc(Manager *m, bool drop_not_started) {
                 }
         }
 
+#if 0 /// elogind limits the number of objects looked at per event loop iteration
         while ((user = LIST_POP(gc_queue, m->user_gc_queue))) {
+#else // 0
+        while (n < budget && (user = LIST_POP(gc_queue, m->user_gc_queue))) {
+                m->n_gc_queued--;
+                n++;
+#endif // 0
                 user->in_gc_queue = false;
 
                 /* First step: queue stop jobs */
@@ -1074,6 +1214,11 @@ static void manager_gc(Manager *m, bool drop_not_started) {
                         user_free(user);
                 }
         }
+#if 1 /// elogind: objects are garbage collected incrementally
+        manager_gc_account(m, n, begin);
+
+        return m->n_gc_queued > 0;
+#endif // 1
 }
 
 static int manager_dispatch_idle_action(sd_event_source *s, uint64_t t, void *userdata) {
@@ -1162,6 +1307,10 @@ static int manager_dispatch_reload_signal(sd_event_source *s, const struct signa
         else
                 log_info("Config file reloaded.");
 
+#if 1 /// elogind: StopIdleSessionSec= is enforced through a timer wheel, see logind-stop-idle.c
+        manager_stop_idle_reset(m);
+#endif // 1
+
         (void) sd_notify(/* unset= */ false, NOTIFY_READY);
         return 0;
 }
@@ -1241,7 +1390,11 @@ static int manager_startup(Manager *m) {
         manager_load_scheduled_shutdown(m);
 
         /* Remove stale objects before we start them */
+#if 0 /// elogind: objects are garbage collected incrementally, but here we want all of them gone
         manager_gc(m, false);
+#else // 0
+        (void) manager_gc(m, false, SIZE_MAX);
+#endif // 0
 
 #if 0 /// elogind does not support autospawning of vts
         /* Reserve the special reserved VT */
@@ -1296,7 +1449,11 @@ static int manager_run(Manager *m) {
                 if (r == SD_EVENT_FINISHED)
                         return 0;
 
+#if 0 /// elogind collects garbage incrementally, and must not sleep while some is left
                 manager_gc(m, true);
+#else // 0
+                bool gc_pending = manager_gc(m, true, MANAGER_GC_BUDGET);
+#endif // 0
 
                 r = manager_dispatch_delayed(m, false);
                 if (r < 0)
@@ -1304,7 +1461,15 @@ static int manager_run(Manager *m) {
                 if (r > 0)
                         continue;
 
+#if 1 /// elogind: publish all changes of this iteration to the login state database at once
+                (void) manager_flush_login_db(m);
+#endif // 1
+
+#if 0 /// elogind collects garbage incrementally, and must not sleep while some is left
                 r = sd_event_run(m->event, UINT64_MAX);
+#else // 0
+                r = sd_event_run(m->event, gc_pending ? 0 : UINT64_MAX);
+#endif // 0
                 if (r < 0)
                         return r;
         }
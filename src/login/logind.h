@@ -44,6 +44,10 @@ typedef enum ManagerTestRunFlags {
 } ManagerTestRunFlags;
 #endif // 1
 
+#if 1 /// elogind: StopIdleSessionSec= is enforced through a timer wheel, see logind-stop-idle.c
+#define STOP_IDLE_WHEEL_SLOTS 256U
+#endif // 1
+
 struct Manager {
         sd_event *event;
         sd_bus *bus;
@@ -52,6 +56,9 @@ struct Manager {
         Hashmap *seats;
         Hashmap *sessions;
         Hashmap *sessions_by_leader;
+#if 1 /// elogind: sessions are indexed by the IDs of their cgroups, see manager_get_session_by_pidref()
+        Hashmap *sessions_by_cgroup_id;
+#endif // 1
         Hashmap *users;  /* indexed by UID */
         Hashmap *inhibitors;
         Hashmap *buttons;
@@ -60,6 +67,37 @@ struct Manager {
         LIST_HEAD(Seat, seat_gc_queue);
         LIST_HEAD(Session, session_gc_queue);
         LIST_HEAD(User, user_gc_queue);
+#if 1 /// elogind: objects are garbage collected incrementally, see manager_gc()
+        size_t n_gc_queued;             /* Objects in all three gc queues right now */
+        size_t n_gc_queued_max;         /* The longest the gc queues have ever been */
+        uint64_t n_gc_processed;        /* Objects taken off the gc queues in total */
+        uint64_t n_gc_deferred;         /* Event loop iterations that ran out of budget */
+        usec_t gc_usec;                 /* Time spent in manager_gc() in total */
+        usec_t gc_usec_max;             /* Longest single run of manager_gc() */
+#endif // 1
+
+#if 1 /// elogind: state files are written lazily, see manager_flush_save_queue()
+        LIST_HEAD(Seat, seat_save_queue);
+        LIST_HEAD(Session, session_save_queue);
+        LIST_HEAD(User, user_save_queue);
+        LIST_HEAD(Inhibitor, inhibitor_save_queue);
+        sd_event_source *save_queue_event_source;
+
+        /* How often a state file was asked to be saved, and how often one was actually written */
+        uint64_t n_save_requests;
+        uint64_t n_save_writes;
+#endif // 1
+
+#if 1 /// elogind: linger files are tracked through inotify, see logind-linger.c
+        Set *linger_users;      /* unescaped names of users with a linger file */
+        sd_event_source *linger_event_source;
+#endif // 1
+
+#if 1 /// elogind: sessions can be killed in batches, see manager_kill_sessions()
+        /* If set, session_stop() doesn't kill the processes of the session right away, but adds the session
+         * here, and manager_end_session_kill_batch() kills them all in one go. */
+        Set *session_kill_batch;
+#endif // 1
 
         sd_device_monitor *device_seat_monitor, *device_monitor, *device_vcsa_monitor, *device_button_monitor;
 
@@ -112,6 +150,11 @@ struct Manager {
 
         /* To wake up sleeping consumers using the right operation, the manager must know what is going on. */
         const HandleActionData *sleep_fork_action;
+
+        /* The memory mapped login state database, see logind-db.c */
+        uint8_t *login_db;
+        size_t login_db_size;
+        bool login_db_dirty;
 #endif // 1
 
         Seat *seat0;
@@ -162,6 +205,14 @@ struct Manager {
         bool was_idle;
 
         usec_t stop_idle_session_usec;
+#if 1 /// elogind: StopIdleSessionSec= is enforced through a timer wheel, see logind-stop-idle.c
+        LIST_HEAD(Session, stop_idle_wheel[STOP_IDLE_WHEEL_SLOTS]);
+        size_t n_stop_idle_sessions;
+        sd_event_source *stop_idle_event_source;
+        usec_t stop_idle_wheel_tick_usec;   /* length of one slot */
+        uint64_t stop_idle_wheel_cursor;    /* first tick not processed yet */
+        uint64_t stop_idle_wheel_armed;     /* tick the timer is armed for, UINT64_MAX if none */
+#endif // 1
 
         HandleActionSleepMask handle_action_sleep_mask;
 
@@ -186,6 +237,9 @@ struct Manager {
         bool reboot_key_ignore_inhibited;
 
         bool remove_ipc;
+#if 1 /// elogind: IPC objects of users are removed in a worker thread, see user_clean_ipc()
+        Hashmap *ipc_cleanups; /* The work event sources removing them, indexed by UID */
+#endif // 1
 
         Hashmap *polkit_registry;
 
@@ -239,6 +293,9 @@ int manager_get_idle_hint(Manager *m, dual_timestamp *t);
 
 int manager_get_user_by_pid(Manager *m, pid_t pid, User **user);
 int manager_get_session_by_pidref(Manager *m, const PidRef *pid, Session **ret);
+#if 1 /// elogind: sessions are indexed by the IDs of their cgroups
+Session* manager_get_session_by_cgroupid(Manager *m, const PidRef *pid);
+#endif // 1
 
 bool manager_is_lid_closed(Manager *m);
 bool manager_is_docked_or_external_displays(Manager *m);
@@ -262,6 +319,17 @@ bool logind_wall_tty_filter(const char *tty, bool is_local, void *userdata);
 
 int manager_read_efi_boot_loader_entries(Manager *m);
 
+#if 1 /// elogind: state files are written lazily, see manager_flush_save_queue()
+void manager_enqueue_save_queue(Manager *m);
+void manager_flush_save_queue(Manager *m);
+#endif // 1
+
+#if 1 /// elogind: sessions can be killed in batches, see manager_kill_sessions()
+int manager_kill_sessions(Manager *m, Set *sessions, int signo);
+void manager_begin_session_kill_batch(Manager *m);
+int manager_end_session_kill_batch(Manager *m, int signo);
+#endif // 1
+
 #if 1 /// elogind needs a few priority enums from the systemd manager.h
 enum {
         /* most important … */
@@ -0,0 +1,303 @@
+/* SPDX-License-Identifier: LGPL-2.1-or-later */
+
+#include <fcntl.h>
+#include <stdlib.h>
+#include <sys/mman.h>
+#include <unistd.h>
+
+#include "alloc-util.h"
+#include "fd-util.h"
+#include "io-util.h"
+#include "login-db.h"
+#include "logind-db.h"
+#include "path-util.h"
+#include "rm-rf.h"
+#include "static-destruct.h"
+#include "strv.h"
+#include "tests.h"
+#include "tmpfile-util.h"
+#include "user-util.h"
+
+typedef struct TestSession {
+        const char *id;
+        const char *seat;
+        uint32_t flags;
+} TestSession;
+
+typedef struct TestUser {
+        uid_t uid;
+        const char *state;
+        const TestSession *sessions;
+        size_t n_sessions;
+} TestUser;
+
+typedef struct TestSeat {
+        const char *id;
+        const char *active_session;
+        uid_t active_uid;
+} TestSeat;
+
+static const TestSession sessions_1000[] = {
+        { "c1", "seat0", LOGIN_DB_SESSION_ACTIVE|LOGIN_DB_SESSION_ONLINE },
+        { "c2", NULL,    LOGIN_DB_SESSION_ONLINE                         },
+        { "c3", "seat0", 0 /* closing */                                 },
+};
+
+static const TestSession sessions_1001[] = {
+        { "c4", "seat1", LOGIN_DB_SESSION_ONLINE },
+};
+
+static const TestSeat seats[] = {
+        { "seat0", "c1", 1000        },
+        { "seat1", NULL, UID_INVALID },
+};
+
+static char *arg_dir = NULL;
+static uint8_t *arg_file = NULL;
+static size_t arg_file_size = 0;
+
+STATIC_DESTRUCTOR_REGISTER(arg_dir, rm_rf_physical_and_freep);
+
+/* Builds the image like logind-db.c does from the Manager, but from the static data above. Users must be
+ * passed sorted by uid. */
+static void build_image(
+                const TestUser *users,
+                size_t n_users,
+                const TestSeat *s,
+                size_t n_seats,
+                LoginDbImage *ret) {
+
+        _cleanup_(login_db_image_done) LoginDbImage image = {};
+        _cleanup_free_ LoginDbSession *dsessions = NULL;
+        _cleanup_free_ LoginDbUser *dusers = NULL;
+        _cleanup_free_ LoginDbSeat *dseats = NULL;
+        size_t n_sessions = 0;
+        LoginDbHeader h;
+
+        for (size_t i = 0; i < n_users; i++)
+                n_sessions += users[i].n_sessions;
+
+        assert_se(dusers = new0(LoginDbUser, n_users));
+        assert_se(dsessions = new0(LoginDbSession, n_sessions));
+        assert_se(dseats = new0(LoginDbSeat, n_seats));
+
+        h = (LoginDbHeader) {
+                .version = LOGIN_DB_VERSION,
+                .n_sessions = n_sessions,
+                .n_users = n_users,
+                .n_seats = n_seats,
+        };
+        memcpy(h.signature, LOGIN_DB_SIGNATURE, sizeof(h.signature));
+
+        assert_se(login_db_image_reserve(&image, sizeof(LoginDbHeader), NULL) >= 0);
+        assert_se(login_db_image_reserve(&image, n_sessions * sizeof(LoginDbSession), &h.sessions_offset) >= 0);
+        assert_se(login_db_image_reserve(&image, n_users * sizeof(LoginDbUser), &h.users_offset) >= 0);
+
+        n_sessions = 0;
+        for (size_t i = 0; i < n_users; i++) {
+                dusers[i] = (LoginDbUser) {
+                        .uid = users[i].uid,
+                        .first_session = n_sessions,
+                        .n_sessions = users[i].n_sessions,
+                };
+                assert_se(login_db_image_add_string(&image, users[i].state, &dusers[i].state) >= 0);
+
+                for (size_t j = 0; j < users[i].n_sessions; j++) {
+                        LoginDbSession *ds = dsessions + n_sessions++;
+
+                        *ds = (LoginDbSession) {
+                                .uid = users[i].uid,
+                                .flags = users[i].sessions[j].flags,
+                        };
+                        assert_se(login_db_image_add_string(&image, users[i].sessions[j].id, &ds->id) >= 0);
+                        assert_se(login_db_image_add_string(&image, users[i].sessions[j].seat, &ds->seat) >= 0);
+                }
+        }
+
+        for (size_t i = 0; i < n_seats; i++) {
+                dseats[i] = (LoginDbSeat) {
+                        .active_uid = s[i].active_uid,
+                };
+                assert_se(login_db_image_add_string(&image, s[i].id, &dseats[i].id) >= 0);
+                assert_se(login_db_image_add_string(&image, s[i].active_session, &dseats[i].active_session) >= 0);
+        }
+
+        assert_se(login_db_image_reserve(&image, n_seats * sizeof(LoginDbSeat), &h.seats_offset) >= 0);
+        h.size = image.size;
+
+        memcpy(image.data, &h, sizeof(h));
+        memcpy_safe(image.data + h.sessions_offset, dsessions, n_sessions * sizeof(LoginDbSession));
+        memcpy_safe(image.data + h.users_offset, dusers, n_users * sizeof(LoginDbUser));
+        memcpy_safe(image.data + h.seats_offset, dseats, n_seats * sizeof(LoginDbSeat));
+
+        *ret = TAKE_STRUCT(image);
+}
+
+static void write_image(const char *user_1000_state) {
+        _cleanup_(login_db_image_done) LoginDbImage image = {};
+        const TestUser users[] = {
+                { 1000, user_1000_state, sessions_1000, ELEMENTSOF(sessions_1000) },
+                { 1001, "online",        sessions_1001, ELEMENTSOF(sessions_1001) },
+        };
+
+        build_image(users, ELEMENTSOF(users), seats, ELEMENTSOF(seats), &image);
+        assert_se(login_db_write(&arg_file, &arg_file_size, &image) >= 0);
+}
+
+static void write_raw(const void *data, size_t size) {
+        _cleanup_close_ int fd = -EBADF;
+
+        /* Always a new file, like elogind would write it */
+        (void) unlink(login_db_path());
+        assert_se((fd = open(login_db_path(), O_WRONLY|O_CREAT|O_EXCL|O_CLOEXEC, 0644)) >= 0);
+        assert_se(loop_write(fd, data, size) >= 0);
+}
+
+static void check_state(uid_t uid, const char *expected) {
+        _cleanup_free_ char *state = NULL;
+
+        assert_se(login_db_uid_get_state(uid, &state) >= 0);
+        assert_se(streq(state, expected));
+}
+
+static void check_array(uid_t uid, int require_active, bool seats_only, char **expected) {
+        _cleanup_strv_free_ char **l = NULL;
+
+        assert_se(login_db_uid_get_array(uid, require_active, seats_only, &l) == (int) strv_length(expected));
+        assert_se(strv_equal(l, expected));
+}
+
+TEST(corrupt) {
+        _cleanup_(login_db_image_done) LoginDbImage image = {};
+        LoginDbHeader h;
+        char *state;
+
+        /* Everything that can't be used makes the callers fall back to the state files */
+        assert_se(login_db_uid_get_state(1000, &state) == -ENOMEDIUM);
+
+        /* Truncated header */
+        build_image(NULL, 0, NULL, 0, &image);
+        write_raw(image.data, sizeof(LoginDbHeader) - 1);
+        assert_se(login_db_uid_get_state(1000, &state) == -ENOMEDIUM);
+
+        /* Bad signature and version */
+        memcpy(&h, image.data, sizeof(h));
+        h.signature[0] = 'X';
+        write_raw(&h, sizeof(h));
+        assert_se(login_db_uid_get_state(1000, &state) == -ENOMEDIUM);
+
+        memcpy(&h, image.data, sizeof(h));
+        h.version = LOGIN_DB_VERSION + 1;
+        write_raw(&h, sizeof(h));
+        assert_se(login_db_uid_get_state(1000, &state) == -ENOMEDIUM);
+
+        /* Tables pointing outside of the file */
+        memcpy(&h, image.data, sizeof(h));
+        h.users_offset = 1024;
+        h.n_users = 1;
+        write_raw(&h, sizeof(h));
+        assert_se(login_db_uid_get_state(1000, &state) == -ENOMEDIUM);
+        assert_se(login_db_seat_get_active("seat0", &state, NULL) == -ENXIO);
+}
+
+TEST(read_back) {
+        _cleanup_free_ char *session = NULL;
+        uid_t uid;
+
+        /* The file left behind by the previous test is marked obsolete when replaced, which makes the
+         * reader map the new one. */
+        write_image("active");
+
+        check_state(1000, "active");
+        check_state(1001, "online");
+        assert_se(login_db_uid_get_state(1002, &session) == -ENXIO);
+
+        check_array(1000, -1, false, STRV_MAKE("c1", "c2", "c3"));
+        check_array(1000, 0, false, STRV_MAKE("c1", "c2"));
+        check_array(1000, 1, false, STRV_MAKE("c1"));
+        check_array(1000, -1, true, STRV_MAKE("seat0"));
+        check_array(1000, 0, true, STRV_MAKE("seat0"));
+        check_array(1001, 1, true, NULL);
+        check_array(1001, 0, true, STRV_MAKE("seat1"));
+        assert_se(login_db_uid_get_array(1002, -1, false, NULL) == -ENXIO);
+
+        assert_se(login_db_seat_get_active("seat0", &session, &uid) >= 0);
+        assert_se(streq(session, "c1"));
+        assert_se(uid == 1000);
+        session = mfree(session);
+
+        assert_se(login_db_seat_get_active("seat1", &session, NULL) == -ENODATA);
+        assert_se(login_db_seat_get_active("seat1", NULL, &uid) == -ENODATA);
+        assert_se(login_db_seat_get_active("seat2", &session, &uid) == -ENXIO);
+}
+
+TEST(update_in_place) {
+        uint8_t *file;
+
+        write_image("active");
+        file = arg_file;
+
+        write_image("lingering");
+        assert_se(arg_file == file);
+        assert_se(((const LoginDbHeader*) arg_file)->generation % 2 == 0);
+
+        check_state(1000, "lingering");
+}
+
+TEST(replace) {
+        _cleanup_(login_db_image_done) LoginDbImage image = {};
+        _cleanup_free_ TestUser *users = NULL;
+        _cleanup_close_ int fd = -EBADF;
+        const LoginDbHeader *old;
+        size_t n_users;
+        char *state;
+
+        /* Keep the current file mapped, to check that it is marked obsolete once replaced */
+        assert_se((fd = open(login_db_path(), O_RDONLY|O_CLOEXEC)) >= 0);
+        assert_se((old = mmap(NULL, sizeof(LoginDbHeader), PROT_READ, MAP_SHARED, fd, 0)) != MAP_FAILED);
+        assert_se(!FLAGS_SET(old->flags, LOGIN_DB_OBSOLETE));
+
+        /* Enough users to not fit into the current file */
+        n_users = arg_file_size / sizeof(LoginDbUser) + 1;
+        assert_se(users = new(TestUser, n_users));
+        for (size_t i = 0; i < n_users; i++)
+                users[i] = (TestUser) {
+                        .uid = 2000 + i,
+                        .state = "closing",
+                };
+
+        build_image(users, n_users, NULL, 0, &image);
+        assert_se(image.size > arg_file_size);
+        assert_se(login_db_write(&arg_file, &arg_file_size, &image) >= 0);
+        assert_se(arg_file_size >= image.size);
+
+        assert_se(FLAGS_SET(old->flags, LOGIN_DB_OBSOLETE));
+        assert_se(munmap((void*) old, sizeof(LoginDbHeader)) >= 0);
+
+        check_state(2000, "closing");
+        check_state(2000 + n_users - 1, "closing");
+        assert_se(login_db_uid_get_state(1000, &state) == -ENXIO);
+        assert_se(login_db_seat_get_active("seat0", NULL, NULL) == -ENXIO);
+}
+
+TEST(close) {
+        char *state;
+
+        login_db_close(&arg_file, &arg_file_size);
+        assert_se(!arg_file);
+        assert_se(access(login_db_path(), F_OK) < 0 && errno == ENOENT);
+
+        assert_se(login_db_uid_get_state(2000, &state) == -ENOMEDIUM);
+}
+
+static int intro(void) {
+        _cleanup_free_ char *p = NULL;
+
+        assert_se(mkdtemp_malloc("/tmp/test-login-db-XXXXXX", &arg_dir) >= 0);
+        assert_se(p = path_join(arg_dir, "login.db"));
+        assert_se(setenv("SYSTEMD_LOGIN_DB_PATH", p, /* overwrite= */ true) >= 0);
+
+        return EXIT_SUCCESS;
+}
+
+DEFINE_TEST_MAIN_WITH_INTRO(LOG_INFO, intro);
@@ -45,6 +45,12 @@ __extension__ enum {
         SD_BUS_VTABLE_PROPERTY_EXPLICIT            = 1ULL << 7,
         SD_BUS_VTABLE_SENSITIVE                    = 1ULL << 8, /* covers both directions: method call + reply */
         SD_BUS_VTABLE_ABSOLUTE_OFFSET              = 1ULL << 9,
+#if 1 /** elogind: serve GetAll() from the serialized value, until a change is emitted */
+        SD_BUS_VTABLE_PROPERTY_CACHED              = 1ULL << 10,
+#endif /** 1 */
+#if 1 /** elogind: the getter may complete Get()/GetAll() later, see sd_bus_property_defer() */
+        SD_BUS_VTABLE_PROPERTY_ASYNC               = 1ULL << 11,
+#endif /** 1 */
         _SD_BUS_VTABLE_CAPABILITY_MASK             = 0xFFFFULL << 40
 };
 
@@ -25,6 +25,9 @@
 
 #include "sd-event.h"
 #include "sd-id128.h"
+#if 1 /** elogind: statistics are returned as JSON object */
+#include "sd-json.h"
+#endif /** 1 */
 
 #include "_sd-common.h"
 
@@ -164,6 +167,9 @@ int sd_bus_get_description(sd_bus *bus, const char **description);
 int sd_bus_negotiate_creds(sd_bus *bus, int b, uint64_t creds_mask);
 int sd_bus_negotiate_timestamp(sd_bus *bus, int b);
 int sd_bus_negotiate_fds(sd_bus *bus, int b);
+#if 1 /** elogind: pass large message bodies as sealed memfd to peers that agree to that */
+int sd_bus_negotiate_memfd(sd_bus *bus, int b);
+#endif /** 1 */
 int sd_bus_can_send(sd_bus *bus, char type);
 int sd_bus_get_creds_mask(sd_bus *bus, uint64_t *creds_mask);
 int sd_bus_set_allow_interactive_authorization(sd_bus *bus, int b);
@@ -172,6 +178,10 @@ int sd_bus_set_exit_on_disconnect(sd_bus *bus, int b);
 int sd_bus_get_exit_on_disconnect(sd_bus *bus);
 int sd_bus_set_close_on_exit(sd_bus *bus, int b);
 int sd_bus_get_close_on_exit(sd_bus *bus);
+#if 1 /** elogind: hold back messages sent from an event loop and write them out together */
+int sd_bus_set_coalesce_writes(sd_bus *bus, int b);
+int sd_bus_get_coalesce_writes(sd_bus *bus);
+#endif /** 1 */
 int sd_bus_set_watch_bind(sd_bus *bus, int b);
 int sd_bus_get_watch_bind(sd_bus *bus);
 int sd_bus_set_connected_signal(sd_bus *bus, int b);
@@ -225,6 +235,13 @@ sd_event* sd_bus_get_event(sd_bus *bus);
 int sd_bus_get_n_queued_read(sd_bus *bus, uint64_t *ret);
 int sd_bus_get_n_queued_write(sd_bus *bus, uint64_t *ret);
 
+#if 1 /** elogind: per-connection statistics */
+int sd_bus_set_collect_stats(sd_bus *bus, int b);
+int sd_bus_get_collect_stats(sd_bus *bus);
+int sd_bus_get_stats(sd_bus *bus, sd_json_variant **ret);
+int sd_bus_reset_stats(sd_bus *bus);
+#endif /** 1 */
+
 int sd_bus_set_method_call_timeout(sd_bus *bus, uint64_t usec);
 int sd_bus_get_method_call_timeout(sd_bus *bus, uint64_t *ret);
 
@@ -395,6 +412,13 @@ int sd_bus_emit_interfaces_added_strv(sd_bus *bus, const char *path, char **inte
 int sd_bus_emit_interfaces_added(sd_bus *bus, const char *path, const char *interface, ...) _sd_sentinel_;
 int sd_bus_emit_interfaces_removed_strv(sd_bus *bus, const char *path, char **interfaces);
 int sd_bus_emit_interfaces_removed(sd_bus *bus, const char *path, const char *interface, ...) _sd_sentinel_;
+#if 1 /** elogind: drop what was cached for properties flagged SD_BUS_VTABLE_PROPERTY_CACHED */
+int sd_bus_invalidate_property_cache(sd_bus *bus, const char *path, const char *interface);
+#endif /** 1 */
+#if 1 /** elogind: getters of SD_BUS_VTABLE_PROPERTY_ASYNC properties may provide their value later */
+int sd_bus_property_defer(sd_bus_message *reply, sd_bus_message **ret_call);
+int sd_bus_property_resume(sd_bus_message *call);
+#endif /** 1 */
 
 int sd_bus_query_sender_creds(sd_bus_message *m, uint64_t mask, sd_bus_creds **creds);
 int sd_bus_query_sender_privilege(sd_bus_message *m, int capability);
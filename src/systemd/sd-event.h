@@ -26,6 +26,10 @@
 #include <sys/wait.h>
 #include <time.h>
 
+#if 1 /** elogind: statistics are returned as JSON object */
+#include "sd-json.h"
+#endif /** 1 */
+
 #include "_sd-common.h"
 
 /*
@@ -80,6 +84,10 @@ typedef int (*sd_event_child_handler_t)(sd_event_source *s, const siginfo_t *si,
 typedef void* sd_event_child_handler_t;
 #endif
 typedef int (*sd_event_inotify_handler_t)(sd_event_source *s, const struct inotify_event *event, void *userdata);
+#if 1 /** elogind: run functions in a pool of worker threads */
+typedef int (*sd_event_work_func_t)(void *userdata);
+typedef int (*sd_event_work_handler_t)(sd_event_source *s, int result, void *userdata);
+#endif /** 1 */
 typedef _sd_destroy_t sd_event_destroy_t;
 
 int sd_event_default(sd_event **e);
@@ -100,6 +108,9 @@ int sd_event_add_defer(sd_event *e, sd_event_source **s, sd_event_handler_t call
 int sd_event_add_post(sd_event *e, sd_event_source **s, sd_event_handler_t callback, void *userdata);
 int sd_event_add_exit(sd_event *e, sd_event_source **s, sd_event_handler_t callback, void *userdata);
 int sd_event_add_memory_pressure(sd_event *e, sd_event_source **s, sd_event_handler_t callback, void *userdata);
+#if 1 /** elogind: run functions in a pool of worker threads */
+int sd_event_add_work(sd_event *e, sd_event_source **s, sd_event_work_func_t work, sd_event_work_handler_t callback, void *userdata);
+#endif /** 1 */
 
 int sd_event_prepare(sd_event *e);
 int sd_event_wait(sd_event *e, uint64_t usec);
@@ -116,6 +127,24 @@ int sd_event_get_tid(sd_event *e, pid_t *ret);
 int sd_event_get_exit_code(sd_event *e, int *ret);
 int sd_event_set_watchdog(sd_event *e, int b);
 int sd_event_get_watchdog(sd_event *e);
+#if 1 /** elogind: batch reads following up on wakeups through io_uring */
+int sd_event_set_io_uring(sd_event *e, int b);
+int sd_event_get_io_uring(sd_event *e);
+#endif /** 1 */
+#if 1 /** elogind: per-source dispatch statistics */
+int sd_event_set_collect_stats(sd_event *e, int b);
+int sd_event_get_collect_stats(sd_event *e);
+int sd_event_get_stats(sd_event *e, sd_json_variant **ret);
+int sd_event_reset_stats(sd_event *e);
+#endif /** 1 */
+#if 1 /** elogind: queue time sources with sufficient accuracy in a timer wheel */
+int sd_event_set_timer_wheel(sd_event *e, int b);
+int sd_event_get_timer_wheel(sd_event *e);
+#endif /** 1 */
+#if 1 /** elogind: run functions in a pool of worker threads */
+int sd_event_set_work_threads_max(sd_event *e, unsigned n);
+int sd_event_get_work_threads_max(sd_event *e, unsigned *ret);
+#endif /** 1 */
 int sd_event_get_iteration(sd_event *e, uint64_t *ret);
 int sd_event_set_signal_exit(sd_event *e, int b);
 
@@ -199,6 +199,37 @@ int sd_session_get_tty(const char *session, char **display);
 /* Determine the VT number of this session. */
 int sd_session_get_vt(const char *session, unsigned *vtnr);
 
+#if 1 /** elogind: snapshot of all data of a session, read with a single parse */
+/* Session snapshot object. Reads the whole session record once and answers all subsequent queries from
+ * memory. The returned strings are owned by the snapshot and remain valid until it is freed. */
+typedef struct sd_session_snapshot sd_session_snapshot;
+
+/* Create a snapshot of the session. If session is NULL the session of the calling process is used. */
+int sd_session_snapshot_new(const char *session, sd_session_snapshot **ret);
+sd_session_snapshot* sd_session_snapshot_ref(sd_session_snapshot *s);
+sd_session_snapshot* sd_session_snapshot_unref(sd_session_snapshot *s);
+
+/* These mirror the sd_session_is_*() and sd_session_get_*() calls above and return the same errors. */
+int sd_session_snapshot_get_id(sd_session_snapshot *s, const char **ret);
+int sd_session_snapshot_is_active(sd_session_snapshot *s);
+int sd_session_snapshot_is_remote(sd_session_snapshot *s);
+int sd_session_snapshot_get_state(sd_session_snapshot *s, const char **ret);
+int sd_session_snapshot_get_uid(sd_session_snapshot *s, uid_t *ret);
+int sd_session_snapshot_get_username(sd_session_snapshot *s, const char **ret);
+int sd_session_snapshot_get_seat(sd_session_snapshot *s, const char **ret);
+int sd_session_snapshot_get_start_time(sd_session_snapshot *s, uint64_t *ret);
+int sd_session_snapshot_get_tty(sd_session_snapshot *s, const char **ret);
+int sd_session_snapshot_get_vt(sd_session_snapshot *s, unsigned *ret);
+int sd_session_snapshot_get_service(sd_session_snapshot *s, const char **ret);
+int sd_session_snapshot_get_type(sd_session_snapshot *s, const char **ret);
+int sd_session_snapshot_get_class(sd_session_snapshot *s, const char **ret);
+int sd_session_snapshot_get_desktop(sd_session_snapshot *s, const char **ret);
+int sd_session_snapshot_get_display(sd_session_snapshot *s, const char **ret);
+int sd_session_snapshot_get_remote_user(sd_session_snapshot *s, const char **ret);
+int sd_session_snapshot_get_remote_host(sd_session_snapshot *s, const char **ret);
+int sd_session_snapshot_get_leader(sd_session_snapshot *s, pid_t *ret);
+#endif /** 1 */
+
 /* Return active session and user of seat */
 int sd_seat_get_active(const char *seat, char **session, uid_t *uid);
 
@@ -233,6 +264,13 @@ int sd_get_seats(char ***seats);
  * sessions. If sessions is NULL, this only returns the number of sessions. */
 int sd_get_sessions(char ***sessions);
 
+#if 1 /** elogind: enumerate sessions together with their data */
+/* Get snapshots of all sessions, store them in a NULL-terminated array in *ret. Returns the number of
+ * sessions. Release each entry with sd_session_snapshot_unref() and the array itself with free(). If ret
+ * is NULL, this only returns the number of sessions. */
+int sd_get_sessions_snapshot(sd_session_snapshot ***ret);
+#endif /** 1 */
+
 /* Get all logged in users, store in *users. Returns the number of
  * users. If users is NULL, this only returns the number of users. */
 int sd_get_uids(uid_t **users);
@@ -264,6 +302,9 @@ int sd_login_monitor_get_events(sd_login_monitor *m);
 int sd_login_monitor_get_timeout(sd_login_monitor *m, uint64_t *timeout_usec);
 
 _SD_DEFINE_POINTER_CLEANUP_FUNC(sd_login_monitor, sd_login_monitor_unref);
+#if 1 /** elogind: snapshot of all data of a session */
+_SD_DEFINE_POINTER_CLEANUP_FUNC(sd_session_snapshot, sd_session_snapshot_unref);
+#endif /** 1 */
 
 _SD_END_DECLARATIONS;
 
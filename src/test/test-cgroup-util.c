@@ -7,6 +7,7 @@
 #include "fd-util.h"
 #include "format-util.h"
 #include "parse-util.h"
+#include "pidref.h"
 #include "proc-cmdline.h"
 #include "process-util.h"
 #include "special.h"
@@ -531,4 +532,71 @@ TEST(bfq_weight_conversion) {
 }
 #endif // 0
 
+#if 1 /// elogind: compare the two ways logind maps a process to its session
+TEST(pid_get_cgroupid_benchmark) {
+        _cleanup_(pidref_done) PidRef pidref = PIDREF_NULL;
+        _cleanup_hashmap_free_ Hashmap *h = NULL;
+        _cleanup_free_ char *path = NULL, *fs = NULL;
+        uint64_t id, expected;
+        usec_t t, q;
+        int r;
+
+        unsigned long long iterations = slow_tests_enabled() ? 100000 : 1000;
+
+        r = cg_unified_controller(SYSTEMD_CGROUP_CONTROLLER);
+        if (r <= 0)
+                return (void) log_tests_skipped("cgroup v2 is not available");
+
+        ASSERT_OK(pidref_set_self(&pidref));
+        if (pidref.fd < 0)
+                return (void) log_tests_skipped("pidfds are not available");
+
+        r = pidfd_get_cgroupid(pidref.fd, &id);
+        if (r == -EOPNOTSUPP)
+                return (void) log_tests_skipped("kernel does not support PIDFD_GET_INFO");
+        ASSERT_OK(r);
+
+        /* The pidfd and the path to the cgroup must agree */
+        ASSERT_OK(cg_pid_get_path(SYSTEMD_CGROUP_CONTROLLER, 0, &path));
+        ASSERT_OK(cg_get_path(SYSTEMD_CGROUP_CONTROLLER, path, NULL, &fs));
+        ASSERT_OK(cg_path_get_cgroupid(fs, &expected));
+        ASSERT_EQ(id, expected);
+
+        ASSERT_OK(hashmap_ensure_put(&h, &uint64_hash_ops, &expected, INT_TO_PTR(1)));
+
+        log_info("/* %s (%llu iterations) */", __func__, iterations);
+
+        t = now(CLOCK_MONOTONIC);
+        for (unsigned long long i = 0; i < iterations; i++) {
+                _cleanup_free_ char *session = NULL;
+
+                (void) cg_pid_get_session(0, &session);
+        }
+        q = now(CLOCK_MONOTONIC) - t;
+
+        log_info("        /proc/$PID/cgroup: %lf μs each", (double) q / iterations);
+
+        t = now(CLOCK_MONOTONIC);
+        for (unsigned long long i = 0; i < iterations; i++) {
+                ASSERT_OK(pidfd_get_cgroupid(pidref.fd, &id));
+                ASSERT_NOT_NULL(hashmap_get(h, &id));
+        }
+        q = now(CLOCK_MONOTONIC) - t;
+
+        log_info("cgroup ID of pidfd + lookup: %lf μs each", (double) q / iterations);
+
+        t = now(CLOCK_MONOTONIC);
+        for (unsigned long long i = 0; i < iterations; i++) {
+                _cleanup_(pidref_done) PidRef p = PIDREF_NULL;
+
+                ASSERT_OK(pidref_set_pid(&p, pidref.pid));
+                ASSERT_OK(pidfd_get_cgroupid(p.fd, &id));
+                ASSERT_NOT_NULL(hashmap_get(h, &id));
+        }
+        q = now(CLOCK_MONOTONIC) - t;
+
+        log_info("  pidfd_open() + ID + lookup: %lf μs each", (double) q / iterations);
+}
+#endif // 1
+
 DEFINE_TEST_MAIN(LOG_DEBUG);
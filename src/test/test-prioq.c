@@ -8,6 +8,9 @@
 #include "siphash24.h"
 #include "sort-util.h"
 #include "tests.h"
+/// Additional includes needed by elogind
+#include "random-util.h"
+#include "time-util.h"
 
 #define SET_SIZE 1024*4
 
@@ -120,4 +123,160 @@ TEST(struct) {
         assert_se(set_isempty(s));
 }
 
+#if 1 /// elogind: inline keys and the 4-ary heap, see prioq_new_with_key()
+#define N_KEYED 5000U
+#define N_BENCHMARK 100000U
+
+static uint64_t test_key(const void *a) {
+        const struct test *x = a;
+
+        /* Deliberately coarse, so that ties have to be resolved by the compare function */
+        return x->value >> 8;
+}
+
+static void test_verify_order(Prioq *q, struct test *tests, size_t n, bool *queued) {
+        _cleanup_free_ unsigned *sorted = NULL;
+        size_t n_sorted = 0;
+        struct test *t;
+
+        /* Pops everything, and checks that this yields the queued values in order */
+
+        assert_se(sorted = new(unsigned, n));
+        for (size_t i = 0; i < n; i++)
+                if (queued[i])
+                        sorted[n_sorted++] = tests[i].value;
+
+        typesafe_qsort(sorted, n_sorted, unsigned_compare);
+
+        for (size_t i = 0; i < n_sorted; i++) {
+                assert_se(t = prioq_pop(q));
+                assert_se(t->value == sorted[i]);
+                queued[t - tests] = false;
+        }
+
+        assert_se(prioq_isempty(q));
+}
+
+TEST(keyed) {
+        _cleanup_free_ struct test *tests = NULL;
+        _cleanup_free_ bool *queued = NULL;
+
+        assert_se(tests = new0(struct test, N_KEYED));
+        assert_se(queued = new0(bool, N_KEYED));
+
+        for (unsigned k = 0; k < 2; k++) {
+                _cleanup_(prioq_freep) Prioq *q = NULL;
+
+                if (k == 0)
+                        assert_se(q = prioq_new((compare_func_t) test_compare));
+                else
+                        assert_se(q = prioq_new_with_key((compare_func_t) test_compare, test_key));
+
+                for (unsigned i = 0; i < N_KEYED * 20; i++) {
+                        size_t j = random_u64_range(N_KEYED);
+                        struct test *t = tests + j;
+
+                        switch (random_u64_range(4)) {
+
+                        case 0:
+                                if (queued[j])
+                                        break;
+
+                                t->value = random_u64_range(1U << 20);
+                                assert_se(prioq_put(q, t, &t->idx) >= 0);
+                                queued[j] = true;
+                                break;
+
+                        case 1:
+                                assert_se(prioq_remove(q, t, &t->idx) == queued[j]);
+                                queued[j] = false;
+                                break;
+
+                        case 2:
+                                /* Changes the value, and with it the key */
+                                t->value = random_u64_range(1U << 20);
+                                prioq_reshuffle(q, t, &t->idx);
+                                break;
+
+                        case 3: {
+                                struct test *p;
+
+                                t = prioq_pop(q);
+                                if (!t)
+                                        break;
+
+                                assert_se(queued[t - tests]);
+                                queued[t - tests] = false;
+
+                                p = prioq_peek(q);
+                                assert_se(!p || p->value >= t->value);
+                                break;
+                        }
+                        }
+                }
+
+                test_verify_order(q, tests, N_KEYED, queued);
+        }
+}
+
+static void benchmark_one(bool keyed, struct test **tests, const unsigned *values) {
+        _cleanup_(prioq_freep) Prioq *q = NULL;
+        nsec_t begin, put, reshuffle, pop;
+        struct test *t;
+
+        if (keyed)
+                assert_se(q = prioq_new_with_key((compare_func_t) test_compare, test_key));
+        else
+                assert_se(q = prioq_new((compare_func_t) test_compare));
+
+        begin = now_nsec(CLOCK_MONOTONIC);
+        for (size_t i = 0; i < N_BENCHMARK; i++) {
+                tests[i]->value = values[i];
+                assert_se(prioq_put(q, tests[i], &tests[i]->idx) >= 0);
+        }
+        put = now_nsec(CLOCK_MONOTONIC) - begin;
+
+        /* Like rearming timers, each object gets a new value */
+        begin = now_nsec(CLOCK_MONOTONIC);
+        for (size_t i = 0; i < N_BENCHMARK; i++) {
+                t = tests[(i * 7919) % N_BENCHMARK];
+                t->value = values[N_BENCHMARK - 1 - i];
+                prioq_reshuffle(q, t, &t->idx);
+        }
+        reshuffle = now_nsec(CLOCK_MONOTONIC) - begin;
+
+        begin = now_nsec(CLOCK_MONOTONIC);
+        for (unsigned previous = 0; (t = prioq_pop(q)); previous = t->value)
+                assert_se(t->value >= previous);
+        pop = now_nsec(CLOCK_MONOTONIC) - begin;
+
+        log_info("%-10s %8u items %6" PRIu64 " ns/put %6" PRIu64 " ns/reshuffle %6" PRIu64 " ns/pop",
+                 keyed ? "keyed" : "unkeyed", N_BENCHMARK,
+                 put / N_BENCHMARK, reshuffle / N_BENCHMARK, pop / N_BENCHMARK);
+}
+
+TEST(benchmark) {
+        _cleanup_free_ struct test **tests = NULL;
+        _cleanup_free_ unsigned *values = NULL;
+
+        if (!slow_tests_enabled())
+                return (void) log_tests_skipped("slow tests are disabled");
+
+        /* The objects are allocated individually, like event sources, hence are spread over the heap */
+        assert_se(tests = new0(struct test*, N_BENCHMARK));
+        assert_se(values = new(unsigned, N_BENCHMARK));
+
+        for (size_t i = 0; i < N_BENCHMARK; i++) {
+                assert_se(tests[i] = new0(struct test, 1));
+                values[i] = random_u64_range(UINT_MAX);
+        }
+
+        benchmark_one(false, tests, values);
+        benchmark_one(true, tests, values);
+
+        for (size_t i = 0; i < N_BENCHMARK; i++)
+                free(tests[i]);
+}
+#endif // 1
+
 DEFINE_TEST_MAIN(LOG_INFO);